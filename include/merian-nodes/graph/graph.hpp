@@ -3,12 +3,15 @@
 #include "errors.hpp"
 #include "graph_run.hpp"
 #include "merian/utils/chrono.hpp"
+#include "merian/utils/concurrent/task_graph.hpp"
+#include "merian/utils/defer.hpp"
 #include "node.hpp"
 #include "resource.hpp"
 
 #include "merian-nodes/graph/node_registry.hpp"
 #include "merian/vk/context.hpp"
 #include "merian/vk/extension/extension_vk_debug_utils.hpp"
+#include "merian/vk/extension/extension_vk_push_descriptor.hpp"
 #include "merian/vk/memory/resource_allocator.hpp"
 #include "merian/vk/sync/ring_fences.hpp"
 #include "merian/vk/utils/math.hpp"
@@ -19,6 +22,7 @@
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
 #include <fmt/chrono.h>
 namespace merian_nodes {
@@ -122,11 +126,10 @@ struct NodeData {
     // get_descriptor_info() does not return std::nullopt.
     DescriptorSetLayoutHandle descriptor_set_layout;
 
-    DescriptorPoolHandle descriptor_pool;
-
     // A descriptor set for each combination of resources that can occur, due to delayed accesses.
     // Also keep at least RING_SIZE to allow updating descriptor sets while iterations are in
-    // flight. Access with iteration % data.descriptor_sets.size() (on prepare descriptor sets)
+    // flight (not necessary for push descriptor sets since those are recorded into the command
+    // buffer). Access with iteration % data.descriptor_sets.size() (on prepare descriptor sets)
     struct PerDescriptorSetInfo {
         DescriptorSetHandle descriptor_set;
         std::unique_ptr<DescriptorSetUpdate> update;
@@ -151,7 +154,6 @@ struct NodeData {
 
         resource_maps.clear();
         descriptor_sets.clear();
-        descriptor_pool.reset();
         descriptor_set_layout.reset();
 
         statistics = {};
@@ -192,6 +194,9 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
         // Staging set, to release staging buffers and images when the copy
         // to device local memory has finished.
         merian::StagingMemoryManager::SetID staging_set_id{};
+        // Bindless heap indices that were freed during the iteration and can be recycled when
+        // the iteration has finished.
+        merian::BindlessHeap::SetID bindless_set_id{};
         // The graph run, holds semaphores and such.
         GraphRun graph_run{ITERATIONS_IN_FLIGHT};
         // Query pools for the profiler
@@ -207,7 +212,8 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
   public:
     Graph(const ContextHandle& context, const ResourceAllocatorHandle& resource_allocator)
         : context(context), resource_allocator(resource_allocator), queue(context->get_queue_GCT()),
-          registry(context, resource_allocator), ring_fences(context) {
+          registry(context, resource_allocator), ring_fences(context),
+          iteration_semaphore(std::make_shared<TimelineSemaphore>(context, 0)) {
         for (uint32_t i = 0; i < ITERATIONS_IN_FLIGHT; i++) {
             InFlightData& in_flight_data = ring_fences.get(i).user_data;
             in_flight_data.command_pool = std::make_shared<CommandPool>(queue);
@@ -215,6 +221,7 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
                 std::make_shared<merian::QueryPool<vk::QueryType::eTimestamp>>(context, 512, true);
         }
         debug_utils = context->get_extension<ExtensionVkDebugUtils>();
+        push_descriptor = context->get_extension<ExtensionVkPushDescriptor>();
         run_profiler = std::make_shared<merian::Profiler>(context);
         time_connect_reference = time_reference = std::chrono::high_resolution_clock::now();
         duration_elapsed = 0ns;
@@ -222,6 +229,11 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
 
     ~Graph() {
         wait();
+        if (const BindlessHeapHandle& bindless_heap = resource_allocator->get_bindless_heap()) {
+            for (uint32_t i = 0; i < ITERATIONS_IN_FLIGHT; i++) {
+                bindless_heap->release_set(ring_fences.get(i).user_data.bindless_set_id);
+            }
+        }
     }
 
     // --- add / remove nodes and connections ---
@@ -495,6 +507,15 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
 
         // now we can release the resources from staging space and reset the command pool
         resource_allocator->getStaging()->releaseResourceSet(in_flight_data.staging_set_id);
+        if (const BindlessHeapHandle& bindless_heap = resource_allocator->get_bindless_heap()) {
+            bindless_heap->release_set(in_flight_data.bindless_set_id);
+            if (bindless_heap->has_pending_updates()) {
+                // descriptors can only be rewritten if no iteration in flight uses them (e.g.
+                // after Texture::set_sampler()).
+                wait();
+                bindless_heap->apply_pending_updates();
+            }
+        }
         const std::shared_ptr<CommandPool>& cmd_pool = in_flight_data.command_pool;
         GraphRun& run = in_flight_data.graph_run;
         cmd_pool->reset();
@@ -506,6 +527,9 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
 
         // CONNECT and PREPROCESS
         do {
+            // CPU tasks of a previous attempt might still access the old connections
+            run.wait_all_cpu_tasks();
+
             // While connection nodes can signalize that they need to reconnect
             while (needs_reconnect) {
                 connect();
@@ -533,22 +557,24 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
             time_delta = duration_elapsed - last_elapsed_ns;
 
             run.reset(run_iteration, run_iteration % ITERATIONS_IN_FLIGHT, profiler, cmd_pool,
-                      resource_allocator, time_delta, duration_elapsed,
-                      duration_elapsed_since_connect, total_iteration);
+                      resource_allocator, context->thread_pool, iteration_semaphore, time_delta,
+                      duration_elapsed, duration_elapsed_since_connect, total_iteration);
 
             // While preprocessing nodes can signalize that they need to reconnect as well
             {
                 MERIAN_PROFILE_SCOPE(profiler, "Preprocess nodes");
-                for (auto& node : flat_topology) {
-                    NodeData& data = node_data.at(node);
-                    MERIAN_PROFILE_SCOPE(profiler, fmt::format("{} ({})", data.identifier,
-                                                               registry.node_name(node)));
-                    const uint32_t set_idx = data.set_index(run_iteration);
-                    Node::NodeStatusFlags flags =
-                        node->pre_process(run, data.resource_maps[set_idx]);
-                    needs_reconnect |= flags & Node::NodeStatusFlagBits::NEEDS_RECONNECT;
-                    if ((flags & Node::NodeStatusFlagBits::RESET_IN_FLIGHT_DATA) != 0u) {
-                        in_flight_data.in_flight_data[node].reset();
+                if (parallel_pre_process) {
+                    pre_process_nodes_parallel(run, in_flight_data);
+                } else {
+                    for (auto& node : flat_topology) {
+                        NodeData& data = node_data.at(node);
+                        MERIAN_PROFILE_SCOPE(profiler, fmt::format("{} ({})", data.identifier,
+                                                                   registry.node_name(node)));
+                        const Node::NodeStatusFlags flags = pre_process_node(run, node, data);
+                        needs_reconnect |= flags & Node::NodeStatusFlagBits::NEEDS_RECONNECT;
+                        if ((flags & Node::NodeStatusFlagBits::RESET_IN_FLIGHT_DATA) != 0u) {
+                            in_flight_data.in_flight_data[node].reset();
+                        }
                     }
                 }
             }
@@ -563,6 +589,12 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
             MERIAN_PROFILE_SCOPE_GPU(profiler, cmd, "Run nodes");
             for (auto& node : flat_topology) {
                 NodeData& data = node_data.at(node);
+                if (run.has_cpu_tasks(node.get())) {
+                    MERIAN_PROFILE_SCOPE(profiler,
+                                         fmt::format("wait for CPU tasks ({})", data.identifier));
+                    run.wait_cpu_tasks(node.get());
+                }
+
                 if (debug_utils)
                     debug_utils->cmd_begin_label(cmd, registry.node_name(node));
 
@@ -575,12 +607,20 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
 
         // FINISH RUN: submit
 
+        if (run.has_cpu_tasks(nullptr)) {
+            MERIAN_PROFILE_SCOPE(profiler, "wait for CPU tasks");
+            run.wait_all_cpu_tasks();
+        }
         {
             MERIAN_PROFILE_SCOPE_GPU(profiler, cmd, "on_pre_submit");
             on_pre_submit(run, cmd);
         }
         cmd_pool->end_all();
         in_flight_data.staging_set_id = resource_allocator->getStaging()->finalizeResourceSet();
+        if (const BindlessHeapHandle& bindless_heap = resource_allocator->get_bindless_heap()) {
+            in_flight_data.bindless_set_id = bindless_heap->finalize_release_set();
+        }
+        run.add_signal_semaphore(iteration_semaphore, total_iteration + 1);
         {
             MERIAN_PROFILE_SCOPE(profiler, "submit");
             queue->submit(cmd_pool, ring_fences.reset(), run.get_signal_semaphores(),
@@ -699,6 +739,47 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
                                   to_milliseconds(in_flight_data.cpu_sleep_time));
             }
 
+            props.st_separate();
+            if (push_descriptor) {
+                needs_reconnect |= props.config_bool(
+                    "push descriptors", use_push_descriptors,
+                    fmt::format("Push the descriptors of nodes into the command buffer instead of "
+                                "allocating and updating descriptor sets. Only used for nodes with "
+                                "at most {} descriptors.",
+                                push_descriptor->max_push_descriptors()));
+            } else {
+                props.output_text("push descriptors: requires ExtensionVkPushDescriptor");
+            }
+            props.config_bool(
+                "parallel pre_process", parallel_pre_process,
+                "Preprocess independent nodes concurrently on the thread pool. Nodes must not "
+                "access shared state in pre_process without synchronization.");
+            if (parallel_pre_process && !pre_process_graph.empty()) {
+                std::string critical_path;
+                for (const TaskGraph::TaskID task : pre_process_graph.get_critical_path()) {
+                    critical_path +=
+                        fmt::format("\n  {}: {:04f}ms", pre_process_graph.get_name(task),
+                                    to_milliseconds(pre_process_graph.get_duration(task)));
+                }
+                props.output_text(
+                    "pre_process: {:04f}ms (work: {:04f}ms, critical path: {:04f}ms){}",
+                    to_milliseconds(pre_process_graph.get_run_duration()),
+                    to_milliseconds(pre_process_graph.get_work_duration()),
+                    to_milliseconds(pre_process_graph.get_critical_path_duration()), critical_path);
+            }
+            if (props.st_begin_child("descriptor_allocator", "Descriptor Allocator")) {
+                resource_allocator->get_descriptor_allocator()->properties(props);
+                props.st_end_child();
+            }
+            if (props.st_begin_child("layout_cache", "Layout Cache")) {
+                context->layout_cache->properties(props);
+                props.st_end_child();
+            }
+            if (props.st_begin_child("thread_pool", "Thread Pool")) {
+                context->thread_pool.properties(props);
+                props.st_end_child();
+            }
+
             props.st_end_child();
         }
 
@@ -820,6 +901,11 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
                         props.config_float("gpu max ms", gpu_max, 0, 1000);
                         Profiler::get_gpu_report_as_config(props, last_run_report);
                     }
+
+                    if (!last_run_report.task_report.empty()) {
+                        props.st_separate("Tasks");
+                        Profiler::get_task_report_as_config(props, last_run_report);
+                    }
                     props.st_end_child();
                 }
                 if (last_build_report && props.st_begin_child("build", "Last Graph Build")) {
@@ -1156,6 +1242,11 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
 
         if (report) {
             last_run_report = std::move(*report);
+            if (context->thread_pool.get_tracing_enabled()) {
+                // all tasks since the last report, matches the report intervall.
+                last_run_report.task_report =
+                    Profiler::make_task_report(context->thread_pool.collect_trace());
+            }
 
             const float cpu_sum = std::transform_reduce(
                 last_run_report.cpu_report.begin(), last_run_report.cpu_report.end(), 0,
@@ -1175,6 +1266,63 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
         return run_profiler;
     }
 
+    // Calls pre_process of the node and attributes CPU tasks the node starts to it.
+    Node::NodeStatusFlags pre_process_node(GraphRun& run, const NodeHandle& node, NodeData& data) {
+        const uint32_t set_idx = data.set_index(run_iteration);
+        // restore the previous owner, pre_process may run nested (e.g. in a helping wait)
+        const Node* previous_owner = std::exchange(GraphRun::cpu_task_owner, node.get());
+        defer {
+            GraphRun::cpu_task_owner = previous_owner;
+        };
+        return node->pre_process(run, data.resource_maps[set_idx]);
+    }
+
+    // Runs pre_process of all nodes on the thread pool. A node is preprocessed after the nodes it
+    // has (non-delayed) inputs from, independent nodes are preprocessed concurrently.
+    //
+    // The profiler is not thread-safe and is therefore not available in pre_process. Instead, the
+    // critical path is recorded and shown in the graph properties.
+    void pre_process_nodes_parallel(GraphRun& run, InFlightData& in_flight_data) {
+        pre_process_graph.clear();
+        std::vector<Node::NodeStatusFlags> flags(flat_topology.size(), 0);
+        std::unordered_map<NodeHandle, TaskGraph::TaskID> task_for_node;
+
+        for (uint32_t i = 0; i < flat_topology.size(); i++) {
+            const NodeHandle& node = flat_topology[i];
+            NodeData& data = node_data.at(node);
+            task_for_node[node] = pre_process_graph.add_task(
+                fmt::format("{} ({})", data.identifier, registry.node_name(node)),
+                [this, &run, &flags, &node, &data, i] {
+                    flags[i] = pre_process_node(run, node, data);
+                });
+        }
+        for (const NodeHandle& node : flat_topology) {
+            for (const auto& [input, per_input_info] : node_data.at(node).input_connections) {
+                if (per_input_info.node && input->delay == 0) {
+                    pre_process_graph.add_dependency(task_for_node.at(per_input_info.node),
+                                                     task_for_node.at(node));
+                }
+            }
+        }
+
+        const ProfilerHandle profiler = run.profiler;
+        run.profiler = nullptr;
+        try {
+            pre_process_graph.run(context->thread_pool);
+        } catch (...) {
+            run.profiler = profiler;
+            throw;
+        }
+        run.profiler = profiler;
+
+        for (uint32_t i = 0; i < flat_topology.size(); i++) {
+            needs_reconnect |= flags[i] & Node::NodeStatusFlagBits::NEEDS_RECONNECT;
+            if ((flags[i] & Node::NodeStatusFlagBits::RESET_IN_FLIGHT_DATA) != 0u) {
+                in_flight_data.in_flight_data[flat_topology[i]].reset();
+            }
+        }
+    }
+
     // Calls connector callbacks, checks resource states and records as well as applies descriptor
     // set updates.
     void run_node(GraphRun& run,
@@ -1811,7 +1959,18 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
                     binding_counter++;
                 }
             }
-            dst_data.descriptor_set_layout = layout_builder.build_layout(context);
+
+            // Push descriptors are recorded into the command buffer, no sets must be allocated and
+            // updated. The descriptors are pushed when the node binds the set.
+            const bool push_descriptors =
+                use_push_descriptors && push_descriptor &&
+                layout_builder.descriptor_count() <= push_descriptor->max_push_descriptors();
+            if (push_descriptors) {
+                dst_data.descriptor_set_layout = layout_builder.build_layout(
+                    context, vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR);
+            } else {
+                dst_data.descriptor_set_layout = layout_builder.build_layout(context);
+            }
             SPDLOG_DEBUG("descriptor set layout for node {} ({}):\n{}", dst_data.identifier,
                          registry.node_name(dst_node), dst_data.descriptor_set_layout);
 
@@ -1833,24 +1992,27 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
                 num_resources.push_back(per_output_info.resources.size());
             }
 
-            uint32_t num_sets = std::max(lcm(num_resources), ITERATIONS_IN_FLIGHT);
-            // make sure it is at least RING_SIZE to allow updates while iterations are in-flight
-            // solve k * num_sets >= RING_SIZE
-            const uint32_t k = (ITERATIONS_IN_FLIGHT + num_sets - 1) / num_sets;
-            num_sets *= k;
-
-            SPDLOG_DEBUG("needing {} descriptor sets for node {} ({})", num_sets,
-                         dst_data.identifier, registry.node_name(dst_node));
+            uint32_t num_sets = std::max(lcm(num_resources), 1u);
+            if (!push_descriptors) {
+                // make sure it is at least RING_SIZE to allow updates while iterations are
+                // in-flight solve k * num_sets >= RING_SIZE
+                num_sets = std::max(num_sets, ITERATIONS_IN_FLIGHT);
+                const uint32_t k = (ITERATIONS_IN_FLIGHT + num_sets - 1) / num_sets;
+                num_sets *= k;
+            }
 
-            // --- ALLOCATE POOL ---
-            dst_data.descriptor_pool =
-                std::make_shared<DescriptorPool>(dst_data.descriptor_set_layout, num_sets);
+            SPDLOG_DEBUG("needing {} {}descriptor sets for node {} ({})", num_sets,
+                         push_descriptors ? "push " : "", dst_data.identifier,
+                         registry.node_name(dst_node));
 
             // --- ALLOCATE SETS and PRECOMUTE RESOURCES for each iteration ---
             for (uint32_t set_idx = 0; set_idx < num_sets; set_idx++) {
-                // allocate
+                // allocate (sets from the previous connect are reused or their pools are reset)
                 const DescriptorSetHandle desc_set =
-                    std::make_shared<DescriptorSet>(dst_data.descriptor_pool);
+                    push_descriptors
+                        ? std::make_shared<DescriptorSet>(dst_data.descriptor_set_layout)
+                        : resource_allocator->get_descriptor_allocator()->allocate(
+                              dst_data.descriptor_set_layout);
                 dst_data.descriptor_sets.emplace_back();
                 dst_data.descriptor_sets.back().descriptor_set = desc_set;
                 dst_data.descriptor_sets.back().update =
@@ -1949,6 +2111,7 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
     const ResourceAllocatorHandle resource_allocator;
     const QueueHandle queue;
     std::shared_ptr<ExtensionVkDebugUtils> debug_utils = nullptr;
+    std::shared_ptr<ExtensionVkPushDescriptor> push_descriptor = nullptr;
 
     NodeRegistry registry;
 
@@ -1961,6 +2124,8 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
 
     // Per-iteration data management
     merian::RingFences<ITERATIONS_IN_FLIGHT, InFlightData> ring_fences;
+    // signaled with total_iteration + 1 when an iteration finished on the GPU.
+    const TimelineSemaphoreHandle iteration_semaphore;
 
     // State
     bool needs_reconnect = false;
@@ -1986,6 +2151,10 @@ class Graph : public std::enable_shared_from_this<Graph<ITERATIONS_IN_FLIGHT>> {
     std::chrono::nanoseconds cpu_time = 0ns;
 
     bool low_latency_mode = false;
+    bool use_push_descriptors = false;
+    bool parallel_pre_process = false;
+    // only used if parallel_pre_process is enabled, holds the timings of the last run.
+    TaskGraph pre_process_graph;
     std::chrono::duration<double> gpu_wait_time = 0ns;
     std::chrono::duration<double> external_wait_time = 0ns;
     int32_t limit_fps = 0;
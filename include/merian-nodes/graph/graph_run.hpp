@@ -1,18 +1,25 @@
 #pragma once
 
 #include "merian/utils/chrono.hpp"
+#include "merian/utils/concurrent/thread_pool.hpp"
 #include "merian/vk/memory/resource_allocator.hpp"
 #include "merian/vk/sync/semaphore_binary.hpp"
 #include "merian/vk/sync/semaphore_timeline.hpp"
 #include "merian/vk/utils/profiler.hpp"
 
+#include <cassert>
 #include <cstdint>
+#include <future>
+#include <mutex>
+#include <unordered_map>
 
 namespace merian_nodes {
 
 using namespace merian;
 using namespace std::literals::chrono_literals;
 
+class Node;
+
 // Manages data of a single graph run.
 class GraphRun {
     template <uint32_t> friend class Graph;
@@ -22,12 +29,14 @@ class GraphRun {
 
     void add_wait_semaphore(const BinarySemaphoreHandle& wait_semaphore,
                             const vk::PipelineStageFlags& wait_stage_flags) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
         wait_semaphores.push_back(*wait_semaphore);
         wait_stages.push_back(wait_stage_flags);
         wait_values.push_back(0);
     }
 
     void add_signal_semaphore(const BinarySemaphoreHandle& signal_semaphore) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
         signal_semaphores.push_back(*signal_semaphore);
         signal_values.push_back(0);
     }
@@ -35,6 +44,7 @@ class GraphRun {
     void add_wait_semaphore(const TimelineSemaphoreHandle& wait_semaphore,
                             const vk::PipelineStageFlags& wait_stage_flags,
                             const uint64_t value) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
         wait_semaphores.push_back(*wait_semaphore);
         wait_stages.push_back(wait_stage_flags);
         wait_values.push_back(value);
@@ -42,19 +52,41 @@ class GraphRun {
 
     void add_signal_semaphore(const TimelineSemaphoreHandle& signal_semaphore,
                               const uint64_t value) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
         signal_semaphores.push_back(*signal_semaphore);
         signal_values.push_back(value);
     }
 
     void add_submit_callback(
         const std::function<void(const QueueHandle& queue, GraphRun& run)>& callback) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
         submit_callbacks.push_back(callback);
     }
 
     void request_reconnect() noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
         needs_reconnect = true;
     }
 
+    // Runs the task on the thread pool, concurrently to the rest of the graph run.
+    //
+    // If called from Node::pre_process(), the graph waits for the task to finish before calling
+    // process() of the same node. This allows to move CPU work (loading files, preparing geometry,
+    // ...) off the critical path while the other nodes are preprocessed and recorded. Tasks that
+    // are started elsewhere are waited for before the graph is submitted.
+    //
+    // Exceptions thrown by the task are rethrown on the graph thread.
+    void run_cpu_task(const std::function<void()>& task) {
+        std::future<void> future = thread_pool->submit(task, "graph cpu task");
+        std::lock_guard<std::mutex> lock(mutex);
+        cpu_tasks[cpu_task_owner].emplace_back(std::move(future));
+    }
+
+    // The thread pool that executes CPU tasks (the shared pool of the context).
+    ThreadPool& get_thread_pool() noexcept {
+        return *thread_pool;
+    }
+
     // Number of iterations since connect.
     // Use get_total_iteration() for iterations since graph initialization.
     //
@@ -82,6 +114,13 @@ class GraphRun {
         return iterations_in_flight;
     }
 
+    // A timeline semaphore of the graph that is signaled with get_total_iteration() + 1 when the
+    // GPU work of the iteration finished. Allows to check without blocking if the work that was
+    // recorded in an iteration completed: get_counter_value() > total_iteration.
+    const TimelineSemaphoreHandle& get_iteration_semaphore() const noexcept {
+        return iteration_semaphore;
+    }
+
     const CommandPoolHandle& get_cmd_pool() noexcept {
         return cmd_pool;
     }
@@ -167,15 +206,62 @@ class GraphRun {
     // Hint the graph that waiting was necessary for external events. This information can be used
     // to shift CPU processing back to reduce waiting and reduce latency.
     void hint_external_wait_time(auto chrono_duration) {
+        std::lock_guard<std::mutex> lock(mutex);
         external_wait_time = std::max(external_wait_time, chrono_duration);
     }
 
+  private:
+    // Returns true if CPU tasks that were started by the node (or outside of pre_process if
+    // nullptr) are pending.
+    bool has_cpu_tasks(const Node* node) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return cpu_tasks.contains(node);
+    }
+
+    // Waits for the CPU tasks that were started by the node (or outside of pre_process if
+    // nullptr) and helps out with other tasks in the meantime.
+    void wait_cpu_tasks(const Node* node) {
+        std::vector<std::future<void>> futures;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto it = cpu_tasks.find(node);
+            if (it == cpu_tasks.end()) {
+                return;
+            }
+            futures = std::move(it->second);
+            cpu_tasks.erase(it);
+        }
+
+        for (auto& future : futures) {
+            while (future.wait_for(0s) != std::future_status::ready &&
+                   thread_pool->run_pending_task()) {}
+            future.get();
+        }
+    }
+
+    // Waits for all pending CPU tasks.
+    void wait_all_cpu_tasks() {
+        while (true) {
+            const Node* node;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (cpu_tasks.empty()) {
+                    return;
+                }
+                node = cpu_tasks.begin()->first;
+            }
+            wait_cpu_tasks(node);
+        }
+    }
+
   private:
     void reset(const uint64_t iteration,
                const uint32_t in_flight_index,
                const ProfilerHandle& profiler,
                const CommandPoolHandle& cmd_pool,
                const ResourceAllocatorHandle& allocator,
+               ThreadPool& thread_pool,
+               const TimelineSemaphoreHandle& iteration_semaphore,
                const std::chrono::nanoseconds time_delta,
                const std::chrono::nanoseconds elapsed,
                const std::chrono::nanoseconds elapsed_run,
@@ -184,6 +270,8 @@ class GraphRun {
         this->in_flight_index = in_flight_index;
         this->cmd_pool = cmd_pool;
         this->allocator = allocator;
+        this->thread_pool = &thread_pool;
+        this->iteration_semaphore = iteration_semaphore;
         this->time_delta = time_delta;
         this->elapsed = elapsed;
         this->elapsed_since_connect = elapsed_run;
@@ -195,6 +283,7 @@ class GraphRun {
         signal_values.clear();
         submit_callbacks.clear();
         external_wait_time = 0ns;
+        assert(cpu_tasks.empty());
 
         this->profiler = profiler;
         this->needs_reconnect = false;
@@ -215,6 +304,15 @@ class GraphRun {
     ProfilerHandle profiler = nullptr;
     CommandPoolHandle cmd_pool = nullptr;
     ResourceAllocatorHandle allocator = nullptr;
+    ThreadPool* thread_pool = nullptr;
+    TimelineSemaphoreHandle iteration_semaphore = nullptr;
+
+    // protects the members that nodes can modify, pre_process might run concurrently.
+    std::mutex mutex;
+    // pending CPU tasks by the node that started them.
+    std::unordered_map<const Node*, std::vector<std::future<void>>> cpu_tasks;
+    // set by the graph while calling pre_process of a node.
+    static inline thread_local const Node* cpu_task_owner = nullptr;
 
     bool needs_reconnect = false;
     uint64_t iteration;
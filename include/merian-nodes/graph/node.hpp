@@ -68,6 +68,8 @@ class Node : public std::enable_shared_from_this<Node> {
     // It contains all input and output connectors for which get_descriptor_info() method does not
     // return std::nullopt. The order is guaranteed to be all inputs in the order of
     // describe_inputs() then outputs in the order of describe_outputs().
+    // If the graph uses push descriptors for this node, the layout is created with the push
+    // descriptor flag (see descriptor_set_layout->is_push_descriptor_layout()).
     // 
     // Here also delayed inputs can be accessed from io_layout.
     [[nodiscard]]
@@ -101,6 +103,10 @@ class Node : public std::enable_shared_from_this<Node> {
     //
     // You can provide data that that is required for the current run by setting the io map
     // in_flight_data. The pointer is persisted and supplied again after (graph ring size - 1) runs.
+    //
+    // The descriptor set must be bound using Pipeline::bind_descriptor_set(), which pushes the
+    // descriptors into cmd in case of a push descriptor set
+    // (descriptor_set->is_push_descriptor_set()).
     virtual void process([[maybe_unused]] GraphRun& run,
                          [[maybe_unused]] const vk::CommandBuffer& cmd,
                          [[maybe_unused]] const DescriptorSetHandle& descriptor_set,
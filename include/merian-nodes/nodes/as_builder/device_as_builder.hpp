@@ -5,10 +5,18 @@
 #include "merian-nodes/connectors/vk_tlas_out.hpp"
 #include "merian-nodes/graph/errors.hpp"
 #include "merian-nodes/graph/node.hpp"
+#include "merian/io/gltf.hpp"
+#include "merian/utils/string.hpp"
 #include "merian/utils/vector.hpp"
 #include "merian/vk/raytrace/as_builder.hpp"
+#include "merian/vk/raytrace/as_compressor.hpp"
+#include "merian/vk/utils/query_pool.hpp"
 #include "merian/vk/utils/math.hpp"
 
+#include <algorithm>
+#include <array>
+#include <string_view>
+
 namespace merian_nodes {
 
 /**
@@ -26,6 +34,9 @@ class DeviceASBuilder : public Node {
      *  - build_flags include allowUpdate
      *
      * Calling both request_update() and request_rebuild() results in a rebuild.
+     *
+     * BLASes with eAllowCompaction in build_flags are compacted a few iterations after the build
+     * (see DeviceASBuilder). A compacted BLAS is rebuilt into a new acceleration structure.
      */
     class BlasBuildInfo {
         friend DeviceASBuilder;
@@ -43,23 +54,31 @@ class DeviceASBuilder : public Node {
         /**
          * @brief      Adds geometry with rgb32f vertices and uint32 index.
          *
+         * The vertices start at vtx_offset bytes into vtx_buffer, the position is at the start of
+         * every vertex (e.g. interleaved vertices with vertex_stride sizeof(Mesh::Vertex)). The
+         * indices start at idx_offset bytes into idx_buffer and are relative to the first vertex.
+         *
          * You must ensure that the buffers are not destructed until the build has
          * finished.
          */
-        GeometryHandle add_geometry_f32_u32(const uint32_t vertex_count,
-                                            const uint32_t primitive_count,
-                                            const BufferHandle& vtx_buffer,
-                                            const BufferHandle& idx_buffer) {
+        GeometryHandle
+        add_geometry_f32_u32(const uint32_t vertex_count,
+                             const uint32_t primitive_count,
+                             const BufferHandle& vtx_buffer,
+                             const BufferHandle& idx_buffer,
+                             const vk::DeviceSize vtx_offset = 0,
+                             const vk::DeviceSize idx_offset = 0,
+                             const vk::DeviceSize vertex_stride = 3 * sizeof(float)) {
             // cannot update or reuse
             blas.reset();
 
             const vk::AccelerationStructureGeometryTrianglesDataKHR triangles{
                 vk::Format::eR32G32B32Sfloat,
-                vtx_buffer->get_device_address(),
-                3 * sizeof(float),
+                vtx_buffer->get_device_address() + vtx_offset,
+                vertex_stride,
                 vertex_count - 1, // why max and not count?!
                 vk::IndexType::eUint32,
-                idx_buffer->get_device_address(),
+                idx_buffer->get_device_address() + idx_offset,
                 {},
             };
             const vk::AccelerationStructureGeometryKHR geometry{
@@ -80,7 +99,9 @@ class DeviceASBuilder : public Node {
                                      const uint32_t primitive_count,
                                      const BufferHandle& vtx_buffer,
                                      const BufferHandle& idx_buffer,
-                                     const bool prefer_update = false) {
+                                     const bool prefer_update = false,
+                                     const vk::DeviceSize vtx_offset = 0,
+                                     const vk::DeviceSize idx_offset = 0) {
             assert(handle < geometries.size());
             assert(handle < range_infos.size());
             assert(handle < vtx_buffers.size());
@@ -88,7 +109,6 @@ class DeviceASBuilder : public Node {
             assert(geometries[handle].geometryType == vk::GeometryTypeKHR::eTriangles);
             assert(geometries[handle].geometry.triangles.vertexFormat ==
                    vk::Format::eR32G32B32Sfloat);
-            assert(geometries[handle].geometry.triangles.vertexStride == 3 * sizeof(float));
             assert(geometries[handle].geometry.triangles.indexType == vk::IndexType::eUint32);
             assert(range_infos[handle].firstVertex == 0);
             assert(range_infos[handle].primitiveOffset == 0);
@@ -116,8 +136,10 @@ class DeviceASBuilder : public Node {
                 }
             }
 
-            geometries[handle].geometry.triangles.vertexData = vtx_buffer->get_device_address();
-            geometries[handle].geometry.triangles.indexData = idx_buffer->get_device_address();
+            geometries[handle].geometry.triangles.vertexData =
+                vtx_buffer->get_device_address() + vtx_offset;
+            geometries[handle].geometry.triangles.indexData =
+                idx_buffer->get_device_address() + idx_offset;
 
             vtx_buffers[handle] = vtx_buffer;
             idx_buffers[handle] = idx_buffer;
@@ -137,6 +159,21 @@ class DeviceASBuilder : public Node {
             update = true;
         }
 
+        // The acceleration structure of the last build (nullptr before the first build).
+        const AccelerationStructureHandle& get_blas() const {
+            return blas;
+        }
+
+        // The BLAS was replaced by its compacted copy.
+        bool is_compacted() const {
+            return compacted;
+        }
+
+        // Incremented with every build, rebuild and update.
+        uint64_t get_build_count() const {
+            return build_count;
+        }
+
       private:
         const vk::BuildAccelerationStructureFlagsKHR build_flags;
         bool release_scratch_buffer_after;
@@ -152,6 +189,11 @@ class DeviceASBuilder : public Node {
         AccelerationStructureHandle blas;
         bool update = false;
         bool rebuild = false;
+
+        // incremented with every build, rebuild and update to detect outdated compaction queries
+        uint64_t build_count = 0;
+        // the blas is a compacted copy, it cannot be rebuilt in place.
+        bool compacted = false;
     };
 
     /**
@@ -160,7 +202,11 @@ class DeviceASBuilder : public Node {
      * The TLAS is automatically rebuild if any of the BLASs is changed or a instance is added.
      * In the former case the previous tlas is overwritten in the latter a new tlas is constructed.
      *
-     * TLASs are always rebuild and never updated (since that is not recommended anyways).
+     * If only transforms changed (set_transform()) and the build_flags include eAllowUpdate the
+     * TLAS is updated instead. Since updates degrade the trace performance, the TLAS is rebuilt
+     * after a number of consecutive updates (see the "max TLAS updates" property).
+     *
+     * Only the instances that changed are uploaded to the device.
      */
     class TlasBuildInfo {
         friend DeviceASBuilder;
@@ -190,14 +236,61 @@ class DeviceASBuilder : public Node {
             // clang-format on
             instances.emplace_back(instance);
             blases.emplace_back(blas_info);
+            mark_dirty(instances.size() - 1);
 
             return *this;
         }
 
+        // Changes the transform of an instance, the TLAS is updated or rebuilt in the next run.
+        void set_transform(const uint32_t instance_index, const vk::TransformMatrixKHR& transform) {
+            assert(instance_index < instances.size());
+            instances[instance_index].transform = transform;
+            mark_dirty(instance_index);
+            update = true;
+        }
+
+        const vk::TransformMatrixKHR& get_transform(const uint32_t instance_index) const {
+            assert(instance_index < instances.size());
+            return instances[instance_index].transform;
+        }
+
+        uint32_t get_instance_count() const {
+            return instances.size();
+        }
+
+        // The instance as it is uploaded, accelerationStructureReference is set by the builder.
+        const vk::AccelerationStructureInstanceKHR&
+        get_instance(const uint32_t instance_index) const {
+            assert(instance_index < instances.size());
+            return instances[instance_index];
+        }
+
+        // The TLAS of the last build (nullptr before the first build).
+        const AccelerationStructureHandle& get_tlas() const {
+            return tlas;
+        }
+
         void request_rebuild() {
             rebuild = true;
         }
 
+        // The instances [first, last) that are uploaded in the next run, unsorted and possibly
+        // overlapping (see coalesce_dirty_ranges()).
+        const std::vector<std::pair<uint32_t, uint32_t>>& get_dirty_ranges() const {
+            return dirty_ranges;
+        }
+
+      private:
+        void mark_dirty(const uint32_t instance_index) {
+            if (!dirty_ranges.empty() && dirty_ranges.back().first <= instance_index &&
+                instance_index <= dirty_ranges.back().second) {
+                dirty_ranges.back().second =
+                    std::max(dirty_ranges.back().second, instance_index + 1);
+                return;
+            }
+            dirty_ranges.emplace_back(instance_index, instance_index + 1);
+        }
+
       private:
         const vk::BuildAccelerationStructureFlagsKHR build_flags;
 
@@ -207,20 +300,127 @@ class DeviceASBuilder : public Node {
         // After the build stored here for rebuilds / updates
         AccelerationStructureHandle tlas;
         BufferHandle instances_buffer;
+        // [first, last) of instances that must be uploaded, unsorted and possibly overlapping.
+        std::vector<std::pair<uint32_t, uint32_t>> dirty_ranges;
+        uint32_t updates_since_build = 0;
 
         bool rebuild = false;
+        // only transforms changed
+        bool update = false;
     };
 
   private:
+    // The compacted size of a BLAS that is written in the build iteration and read when the in
+    // flight data is reused.
+    struct CompactionQuery {
+        std::shared_ptr<BlasBuildInfo> blas_info;
+        AccelerationStructureHandle blas;
+        uint64_t build_count;
+    };
+
+  public:
+    // Keeps the resources of one iteration alive, must not be reused before the GPU finished the
+    // commands that record_builds() recorded with it.
     struct InFlightData {
         std::vector<AccelerationStructureHandle> blases;
         std::vector<BufferHandle> build_buffers;
+
+        QueryPoolHandle<vk::QueryType::eAccelerationStructureCompactedSizeKHR>
+            compaction_query_pool;
+        std::vector<CompactionQuery> compaction_queries;
     };
 
-  public:
     DeviceASBuilder(const ContextHandle& context, const ResourceAllocatorHandle& allocator)
         : Node(), context(context), allocator(allocator), as_builder(context, allocator) {}
 
+    // Describes one BLAS per mesh of the scene (same index) with one geometry per primitive. The
+    // descriptions keep the buffers of the scene alive. Meshes without primitives get nullptr.
+    static std::vector<std::shared_ptr<BlasBuildInfo>>
+    get_blas_build_infos(const GLTFScene& scene,
+                         const vk::BuildAccelerationStructureFlagsKHR build_flags =
+                             vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace) {
+        std::vector<std::shared_ptr<BlasBuildInfo>> blas_infos;
+        for (const GLTFScene::MeshInfo& mesh : scene.get_meshes()) {
+            if (mesh.primitive_count == 0) {
+                blas_infos.emplace_back();
+                continue;
+            }
+            const std::shared_ptr<BlasBuildInfo>& blas_info =
+                blas_infos.emplace_back(std::make_shared<BlasBuildInfo>(build_flags));
+            for (const GLTFScene::Primitive& primitive : scene.get_primitives(mesh)) {
+                blas_info->add_geometry_f32_u32(
+                    primitive.vertex_count, primitive.index_count / 3, primitive.vertex_buffer,
+                    primitive.index_buffer, primitive.vertex_offset, primitive.index_offset,
+                    sizeof(GLTFScene::Vertex));
+            }
+        }
+        return blas_infos;
+    }
+
+    // How record_builds() brings a TLAS up to date.
+    enum class TlasBuildMode {
+        // nothing changed
+        NONE,
+        // there is no TLAS yet or instances were added
+        BUILD,
+        // full build into a new TLAS
+        REBUILD,
+        // in-place update, only transforms changed
+        UPDATE,
+    };
+
+    // Decides how record_builds() brings the TLAS up to date. blas_addresses are the current
+    // addresses of the BLASes of the instances (same index), a changed address forces a rebuild.
+    //
+    // Transform changes update the TLAS if it was built with eAllowUpdate and was updated less than
+    // max_tlas_updates times in a row, otherwise they rebuild it.
+    static TlasBuildMode get_tlas_build_mode(const TlasBuildInfo& tlas_build_info,
+                                             const std::vector<vk::DeviceAddress>& blas_addresses,
+                                             const uint32_t max_tlas_updates) {
+        assert(blas_addresses.size() == tlas_build_info.instances.size());
+
+        if (!tlas_build_info.tlas) {
+            return TlasBuildMode::BUILD;
+        }
+        if (tlas_build_info.rebuild) {
+            return TlasBuildMode::REBUILD;
+        }
+        for (uint32_t i = 0; i < blas_addresses.size(); i++) {
+            if (tlas_build_info.instances[i].accelerationStructureReference != blas_addresses[i]) {
+                return TlasBuildMode::REBUILD;
+            }
+        }
+        if (!tlas_build_info.update) {
+            return TlasBuildMode::NONE;
+        }
+        if (!(tlas_build_info.build_flags &
+              vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate) ||
+            tlas_build_info.updates_since_build >= max_tlas_updates) {
+            // update not possible or too many updates in a row
+            return TlasBuildMode::REBUILD;
+        }
+        return TlasBuildMode::UPDATE;
+    }
+
+    // dirty ranges with at most this many clean instances in between are uploaded together
+    static constexpr uint32_t UPLOAD_MERGE_DISTANCE = 16;
+
+    // Sorts the ranges and merges overlapping and close ranges, since every upload has overhead.
+    // The ranges are [first, last) instance indices.
+    static std::vector<std::pair<uint32_t, uint32_t>>
+    coalesce_dirty_ranges(std::vector<std::pair<uint32_t, uint32_t>> ranges) {
+        std::sort(ranges.begin(), ranges.end());
+        std::vector<std::pair<uint32_t, uint32_t>> coalesced;
+        for (const auto& [first, last] : ranges) {
+            if (!coalesced.empty() && first <= coalesced.back().second + UPLOAD_MERGE_DISTANCE) {
+                coalesced.back().second = std::max(coalesced.back().second, last);
+            } else {
+                coalesced.emplace_back(first, last);
+            }
+        }
+        return coalesced;
+    }
+
     std::vector<InputConnectorHandle> describe_inputs() {
         return {
             con_in_instance_info,
@@ -245,26 +445,62 @@ class DeviceASBuilder : public Node {
                  const vk::CommandBuffer& cmd,
                  [[maybe_unused]] const DescriptorSetHandle& descriptor_set,
                  const NodeIO& io) {
-        InFlightData& in_flight_data = io.frame_data<InFlightData>();
+        io[con_out_tlas] =
+            record_builds(cmd, *io[con_in_instance_info], io.frame_data<InFlightData>(),
+                          io[con_out_tlas].input_pipeline_stages, run.get_profiler());
+    }
+
+    // Records the BLAS and TLAS builds (and compaction) of one iteration and returns the TLAS.
+    // This is what process() does, usable without a graph: Use a ring of InFlightData and pass the
+    // same one again only after the commands of its last use finished. tlas_read_stages are the
+    // stages that read the TLAS of the previous iteration.
+    const AccelerationStructureHandle& record_builds(const vk::CommandBuffer& cmd,
+                                                     TlasBuildInfo& tlas_build_info,
+                                                     InFlightData& in_flight_data,
+                                                     const vk::PipelineStageFlags2 tlas_read_stages,
+                                                     const ProfilerHandle& profiler = nullptr) {
         in_flight_data.build_buffers.clear();
-        TlasBuildInfo& tlas_build_info = *io[con_in_instance_info];
         in_flight_data.blases.clear();
 
         std::vector<vk::BufferMemoryBarrier2> pre_build_barriers;
         bool any_release_scratch_buffer_after = false;
 
-        // 1. Iterate over instances to queue the BLAS builds and update the BLAS addresses in the
-        // instances
+        // 0. The iteration that used this in flight data before has finished, i.e. the compacted
+        // sizes it queried are available. Record the compacting copies and swap the BLASes.
+        // The new addresses of compacted BLASes rebuild the TLAS.
+        if (!in_flight_data.compaction_queries.empty()) {
+            record_compaction(cmd, in_flight_data);
+            in_flight_data.compaction_queries.clear();
+        }
+        std::vector<std::shared_ptr<BlasBuildInfo>> compaction_candidates;
+
+        // 1. Iterate over instances to queue the BLAS builds and collect the BLAS addresses
+        std::vector<vk::DeviceAddress> blas_addresses;
+        blas_addresses.reserve(tlas_build_info.instances.size());
         for (uint32_t instance_index = 0; instance_index < tlas_build_info.instances.size();
              instance_index++) {
             BlasBuildInfo& blas_info = *tlas_build_info.blases[instance_index];
-            vk::AccelerationStructureInstanceKHR& instance =
-                tlas_build_info.instances[instance_index];
+
+            if (blas_info.rebuild && blas_info.compacted) {
+                // the compacted blas is too small for a rebuild
+                blas_info.blas.reset();
+            }
+
+            const bool full_build = !blas_info.blas || blas_info.rebuild;
+            if (full_build || blas_info.update) {
+                blas_info.build_count++;
+            }
+            if (full_build && compaction_enabled &&
+                (blas_info.build_flags &
+                 vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction)) {
+                compaction_candidates.emplace_back(tlas_build_info.blases[instance_index]);
+            }
 
             if (!blas_info.blas) {
                 // build
                 blas_info.blas = as_builder.queue_build(blas_info.geometries, blas_info.range_infos,
                                                         blas_info.build_flags);
+                blas_info.compacted = false;
                 tlas_build_info.rebuild = true;
                 any_release_scratch_buffer_after |= blas_info.release_scratch_buffer_after;
                 merian::insert_all(in_flight_data.build_buffers, blas_info.vtx_buffers);
@@ -293,68 +529,264 @@ class DeviceASBuilder : public Node {
 
             blas_info.update = false;
             blas_info.rebuild = false;
-            instance.accelerationStructureReference =
-                blas_info.blas->get_acceleration_structure_device_address();
+            blas_addresses.push_back(blas_info.blas->get_acceleration_structure_device_address());
+        }
+
+        // 1.1. Decide how to build the TLAS, then write the addresses into the instances
+        const TlasBuildMode tlas_build_mode =
+            get_tlas_build_mode(tlas_build_info, blas_addresses, max_tlas_updates);
+        for (uint32_t instance_index = 0; instance_index < tlas_build_info.instances.size();
+             instance_index++) {
+            vk::AccelerationStructureInstanceKHR& instance =
+                tlas_build_info.instances[instance_index];
+            if (instance.accelerationStructureReference != blas_addresses[instance_index]) {
+                instance.accelerationStructureReference = blas_addresses[instance_index];
+                tlas_build_info.mark_dirty(instance_index);
+            }
         }
 
         // 2. Create Instance buffer
-        if (!allocator->ensureBufferSize(
-                tlas_build_info.instances_buffer,
-                std::max(
-                    size_of(tlas_build_info.instances),
-                    16 * sizeof(
-                             vk::AccelerationStructureInstanceKHR)), // prevent resizes at low count
-                                                                     // and support empty TLASes
-                Buffer::INSTANCES_BUFFER_USAGE, "DeviceASBuilder Instances",
-                merian::MemoryMappingType::NONE, 16, 1.25)) {
-            // old buffer reused -> insert barrier for last iteration
-            cmd.pipelineBarrier(
-                vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
-                vk::PipelineStageFlagBits::eTransfer, {}, {},
-                tlas_build_info.instances_buffer->buffer_barrier(
-                    vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eTransferWrite),
-                {});
-        }
-        // 2.1. Upload instances to GPU and copy to buffer
-        allocator->getStaging()->cmdToBuffer(cmd, *tlas_build_info.instances_buffer, 0,
-                                             size_of(tlas_build_info.instances),
-                                             tlas_build_info.instances.data());
-
-        // Validation Layers complain if dst does not include transfer write and compute shader dst
-        // stage?! Seems like a bug to me or wrong specs...
-        pre_build_barriers.push_back(tlas_build_info.instances_buffer->buffer_barrier2(
-            vk::PipelineStageFlagBits2::eTransfer,
-            vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR |
-                vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
-            vk::AccessFlagBits2::eTransferWrite,
-            vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eTransferWrite));
+        // (minimum size prevents resizes at low count and supports empty TLASes)
+        const bool new_instances_buffer = allocator->ensureBufferSize(
+            tlas_build_info.instances_buffer,
+            std::max(size_of(tlas_build_info.instances),
+                     16 * sizeof(vk::AccelerationStructureInstanceKHR)),
+            Buffer::INSTANCES_BUFFER_USAGE, "DeviceASBuilder Instances",
+            merian::MemoryMappingType::NONE, 16, 1.25);
+        if (new_instances_buffer) {
+            // contents are lost
+            tlas_build_info.dirty_ranges.assign(
+                1, {0, static_cast<uint32_t>(tlas_build_info.instances.size())});
+        }
+        const std::vector<std::pair<uint32_t, uint32_t>> upload_ranges =
+            coalesce_dirty_ranges(tlas_build_info.dirty_ranges);
+        tlas_build_info.dirty_ranges.clear();
+
+        // 2.1. Upload changed instances to GPU and copy to buffer
+        last_instance_upload_bytes = 0;
+        last_instance_upload_ranges = upload_ranges.size();
+        if (!upload_ranges.empty()) {
+            if (!new_instances_buffer) {
+                // old buffer reused -> insert barrier for last iteration
+                cmd.pipelineBarrier(
+                    vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                    vk::PipelineStageFlagBits::eTransfer, {}, {},
+                    tlas_build_info.instances_buffer->buffer_barrier(
+                        vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eTransferWrite),
+                    {});
+            }
+
+            for (const auto& [first, last] : upload_ranges) {
+                const vk::DeviceSize offset = first * sizeof(vk::AccelerationStructureInstanceKHR);
+                const vk::DeviceSize size =
+                    (last - first) * sizeof(vk::AccelerationStructureInstanceKHR);
+                allocator->getStaging()->cmdToBuffer(cmd, *tlas_build_info.instances_buffer,
+                                                     offset, size,
+                                                     tlas_build_info.instances.data() + first);
+                last_instance_upload_bytes += size;
+            }
+
+            // Validation Layers complain if dst does not include transfer write and compute shader
+            // dst stage?! Seems like a bug to me or wrong specs...
+            pre_build_barriers.push_back(tlas_build_info.instances_buffer->buffer_barrier2(
+                vk::PipelineStageFlagBits2::eTransfer,
+                vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR |
+                    vk::PipelineStageFlagBits2::eTransfer |
+                    vk::PipelineStageFlagBits2::eComputeShader,
+                vk::AccessFlagBits2::eTransferWrite,
+                vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eTransferWrite));
+        }
 
         // 3. Queue TLAS build
-        if (!tlas_build_info.tlas) {
+        switch (tlas_build_mode) {
+        case TlasBuildMode::BUILD:
             tlas_build_info.tlas = as_builder.queue_build(tlas_build_info.instances.size(),
                                                           tlas_build_info.instances_buffer,
                                                           tlas_build_info.build_flags);
-        } else if (tlas_build_info.rebuild) {
+            tlas_build_info.updates_since_build = 0;
+            break;
+        case TlasBuildMode::REBUILD:
             pre_build_barriers.push_back(
-                tlas_build_info.tlas->tlas_build_barrier2(io[con_out_tlas].input_pipeline_stages));
+                tlas_build_info.tlas->tlas_build_barrier2(tlas_read_stages));
             tlas_build_info.tlas = as_builder.queue_build(tlas_build_info.instances.size(),
                                                           tlas_build_info.instances_buffer,
                                                           tlas_build_info.build_flags);
+            tlas_build_info.updates_since_build = 0;
+            break;
+        case TlasBuildMode::UPDATE:
+            // in place
+            pre_build_barriers.push_back(
+                tlas_build_info.tlas->tlas_build_barrier2(tlas_read_stages));
+            as_builder.queue_update(tlas_build_info.instances.size(),
+                                    tlas_build_info.instances_buffer, tlas_build_info.tlas,
+                                    tlas_build_info.build_flags);
+            tlas_build_info.updates_since_build++;
+            break;
+        case TlasBuildMode::NONE:
+            break;
         }
         tlas_build_info.rebuild = false;
+        tlas_build_info.update = false;
+        last_tlas_build_mode = tlas_build_mode;
+        last_tlas_updates_since_build = tlas_build_info.updates_since_build;
         cmd.pipelineBarrier2(vk::DependencyInfo{{}, {}, pre_build_barriers});
 
         // 4. Run builds (reusing the same scratch buffer)
-        as_builder.get_cmds(cmd, scratch_buffer, run.get_profiler());
+        as_builder.get_cmds(cmd, scratch_buffer, profiler);
+
+        // 4.1. Query the compacted sizes, they are read when this in flight data is reused.
+        if (!compaction_candidates.empty()) {
+            record_compaction_queries(cmd, in_flight_data, compaction_candidates);
+        }
 
         // 5. Prevent object destruction
         in_flight_data.build_buffers.emplace_back(scratch_buffer);
         in_flight_data.build_buffers.emplace_back(tlas_build_info.instances_buffer);
-        io[con_out_tlas] = tlas_build_info.tlas;
 
         if (any_release_scratch_buffer_after) {
             scratch_buffer.reset();
         }
+
+        return tlas_build_info.tlas;
+    }
+
+    TlasBuildMode get_last_tlas_build_mode() const {
+        return last_tlas_build_mode;
+    }
+
+    // Transform changes rebuild the TLAS after this many updates in a row (0 always rebuilds).
+    void set_max_tlas_updates(const uint32_t max_tlas_updates) {
+        this->max_tlas_updates = max_tlas_updates;
+    }
+
+    // Number of instance ranges that the last record_builds() uploaded.
+    uint32_t get_last_instance_upload_ranges() const {
+        return last_instance_upload_ranges;
+    }
+
+    // Bytes of instances that the last record_builds() uploaded.
+    vk::DeviceSize get_last_instance_upload_bytes() const {
+        return last_instance_upload_bytes;
+    }
+
+    // Number of BLASes that were replaced by their compacted copy so far.
+    uint64_t get_compacted_blas_count() const {
+        return compacted_blas_count;
+    }
+
+    NodeStatusFlags properties(Properties& config) override {
+        uint32_t scratch_budget_mib = as_builder.get_scratch_budget() / (1024 * 1024);
+        if (config.config_uint("scratch budget", scratch_budget_mib, 1, 4096,
+                               "Scratch memory in MiB per batch of BLAS builds. Builds of a "
+                               "batch run concurrently, a larger budget needs more memory.")) {
+            as_builder.set_scratch_budget(vk::DeviceSize(scratch_budget_mib) * 1024 * 1024);
+        }
+        config.output_text("last BLAS builds: {} in {} batches",
+                           as_builder.get_last_blas_build_count(),
+                           as_builder.get_last_blas_batch_count());
+        config.output_text("scratch buffer: {}",
+                           format_size(scratch_buffer ? scratch_buffer->get_size() : 0));
+
+        config.st_separate("TLAS");
+        config.config_uint("max TLAS updates", max_tlas_updates, 0, 1024,
+                           "If only transforms changed, TLASes with eAllowUpdate are updated "
+                           "instead of rebuilt. Updates degrade the trace performance, the TLAS is "
+                           "rebuilt after this many updates in a row (0 always rebuilds).");
+        config.output_text("last TLAS build: {} ({} updates since build)",
+                           TLAS_BUILD_MODE_NAMES[static_cast<uint32_t>(last_tlas_build_mode)],
+                           last_tlas_updates_since_build);
+        config.output_text("last instance upload: {} in {} ranges",
+                           format_size(last_instance_upload_bytes), last_instance_upload_ranges);
+
+        config.st_separate("Compaction");
+        config.config_bool("compaction", compaction_enabled,
+                           "Compacts BLASes with eAllowCompaction after the build. The compacted "
+                           "sizes are read back asynchronously, the copy is recorded when the "
+                           "iteration that built the BLAS has finished.");
+        config.output_text("compacted BLASes: {}\nmemory saved: {}", compacted_blas_count,
+                           format_size(compaction_saved_bytes));
+
+        return {};
+    }
+
+  private:
+    // Replaces BLASes by their compacted copy if that is smaller.
+    void record_compaction(const vk::CommandBuffer& cmd, InFlightData& in_flight_data) {
+        const std::vector<uint64_t> compacted_sizes =
+            in_flight_data.compaction_query_pool->get_query_pool_results_64(
+                0, in_flight_data.compaction_queries.size());
+
+        bool any_compacted = false;
+        for (uint32_t i = 0; i < in_flight_data.compaction_queries.size(); i++) {
+            const CompactionQuery& query = in_flight_data.compaction_queries[i];
+            BlasBuildInfo& blas_info = *query.blas_info;
+            if (blas_info.blas != query.blas || blas_info.build_count != query.build_count) {
+                // rebuilt or updated in the meantime
+                continue;
+            }
+            vk::AccelerationStructureBuildSizesInfoKHR size_info = query.blas->get_size_info();
+            if (compacted_sizes[i] == 0 ||
+                compacted_sizes[i] >= size_info.accelerationStructureSize) {
+                continue;
+            }
+
+            if (!any_compacted) {
+                cmd.pipelineBarrier2(
+                    vk::DependencyInfo{{}, ASCompressor::build_compress_barrier, {}, {}});
+                any_compacted = true;
+            }
+
+            compaction_saved_bytes += size_info.accelerationStructureSize - compacted_sizes[i];
+            compacted_blas_count++;
+            size_info.accelerationStructureSize = compacted_sizes[i];
+            const AccelerationStructureHandle compacted = allocator->createAccelerationStructure(
+                vk::AccelerationStructureTypeKHR::eBottomLevel, size_info,
+                "DeviceASBuilder compacted BLAS");
+            cmd.copyAccelerationStructureKHR(vk::CopyAccelerationStructureInfoKHR{
+                *query.blas, *compacted, vk::CopyAccelerationStructureModeKHR::eCompact});
+
+            // the original is released when this iteration has finished
+            in_flight_data.blases.push_back(query.blas);
+            blas_info.blas = compacted;
+            blas_info.compacted = true;
+        }
+
+        if (any_compacted) {
+            // Make sure the TLAS is not built (or the BLAS updated) before the copy finished.
+            const vk::MemoryBarrier2 copy_build_barrier{
+                vk::PipelineStageFlagBits2::eAccelerationStructureCopyKHR,
+                vk::AccessFlagBits2::eAccelerationStructureWriteKHR,
+                vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+                vk::AccessFlagBits2::eAccelerationStructureReadKHR |
+                    vk::AccessFlagBits2::eAccelerationStructureWriteKHR};
+            cmd.pipelineBarrier2(vk::DependencyInfo{{}, copy_build_barrier, {}, {}});
+        }
+
+    }
+
+    void record_compaction_queries(const vk::CommandBuffer& cmd,
+                                   InFlightData& in_flight_data,
+                                   const std::vector<std::shared_ptr<BlasBuildInfo>>& candidates) {
+        const uint32_t query_count = candidates.size();
+        // the previous iteration that used the in flight data has finished, the pool is unused.
+        if (!in_flight_data.compaction_query_pool ||
+            in_flight_data.compaction_query_pool->get_query_count() < query_count) {
+            in_flight_data.compaction_query_pool = std::make_shared<
+                QueryPool<vk::QueryType::eAccelerationStructureCompactedSizeKHR>>(
+                context, std::max(query_count, 64u));
+        }
+        in_flight_data.compaction_query_pool->reset(cmd, 0, query_count);
+
+        std::vector<vk::AccelerationStructureKHR> acceleration_structures;
+        for (const std::shared_ptr<BlasBuildInfo>& blas_info : candidates) {
+            acceleration_structures.emplace_back(*blas_info->blas);
+            in_flight_data.compaction_queries.push_back(
+                {blas_info, blas_info->blas, blas_info->build_count});
+        }
+        // the builds are followed by a barrier (see ASBuilder::get_cmds_blas)
+        cmd.writeAccelerationStructuresPropertiesKHR(
+            acceleration_structures, vk::QueryType::eAccelerationStructureCompactedSizeKHR,
+            in_flight_data.compaction_query_pool->get_query_pool(), 0);
     }
 
   private:
@@ -373,6 +805,18 @@ class DeviceASBuilder : public Node {
     // clang-format on
 
     BufferHandle scratch_buffer;
+
+    uint32_t max_tlas_updates = 16;
+    static constexpr std::array<std::string_view, 4> TLAS_BUILD_MODE_NAMES = {"none", "build",
+                                                                              "rebuild", "update"};
+    TlasBuildMode last_tlas_build_mode = TlasBuildMode::NONE;
+    uint32_t last_tlas_updates_since_build = 0;
+    vk::DeviceSize last_instance_upload_bytes = 0;
+    uint32_t last_instance_upload_ranges = 0;
+
+    bool compaction_enabled = true;
+    uint64_t compacted_blas_count = 0;
+    vk::DeviceSize compaction_saved_bytes = 0;
 };
 
 } // namespace merian_nodes
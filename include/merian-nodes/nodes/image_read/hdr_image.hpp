@@ -2,6 +2,7 @@
 
 #include "merian-nodes/connectors/managed_vk_image_out.hpp"
 #include "merian-nodes/graph/node.hpp"
+#include "merian-nodes/nodes/image_read/image_decode.hpp"
 
 #include <filesystem>
 
@@ -15,9 +16,12 @@ class HDRImageRead : public Node {
     //
     // Set keep_on_host to keep a copy in host memory, otherwise the image is reloaded from disk
     // everytime the graph reconnects.
-    HDRImageRead(const ContextHandle& context);
-
-    ~HDRImageRead();
+    //
+    // The image is decoded on the thread pool, starting when the graph connects. Until it is
+    // available the output is cleared to zero. If an allocator is supplied the decoded pixels are
+    // staged in a host-visible buffer on the worker, otherwise the upload copies them through the
+    // staging manager of the graph.
+    HDRImageRead(const ContextHandle& context, const ResourceAllocatorHandle& allocator = nullptr);
 
     std::vector<OutputConnectorHandle> describe_outputs(const NodeIOLayout& io_layout) override;
 
@@ -30,13 +34,21 @@ class HDRImageRead : public Node {
 
   private:
     const ContextHandle context;
+    const ResourceAllocatorHandle allocator;
     bool keep_on_host = false;
 
     ManagedVkImageOutHandle con_out;
 
-    // can be nullptr when image is unloaded.
-    float* image{nullptr};
+    ImageDecode decode;
+    // can be nullptr when image is unloaded or not decoded yet.
+    DecodedImageHandle image;
+    std::string load_error;
+    // block the graph until the image is decoded instead of outputting the placeholder.
+    bool wait_for_load = false;
     bool needs_run = true;
+    bool placeholder_cleared = false;
+    // the staging buffer can only be released when the upload finished executing.
+    uint64_t upload_iteration = 0;
 
     int width, height, channels;
     std::filesystem::path filename;
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "merian/utils/concurrent/thread_pool.hpp"
+#include "merian/vk/memory/resource_allocator.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <stop_token>
+
+namespace merian_nodes {
+
+using namespace merian;
+
+// Pixels of an image that was decoded with stb_image, always 4 components per pixel.
+struct DecodedImage {
+    std::filesystem::path path;
+    int width;
+    int height;
+    // components in the file
+    int channels;
+    // size of the pixel data in bytes
+    vk::DeviceSize size;
+    // time spent on the worker (reading, decoding and staging)
+    std::chrono::nanoseconds decode_duration;
+
+    // Set if an allocator was supplied: the pixels were copied into this host-visible buffer on
+    // the worker and the upload is a single buffer to image copy. Otherwise the pixels are kept in
+    // host memory and uploaded using the staging manager.
+    BufferHandle staging_buffer;
+    // the pixels returned by stb_image, released once they were copied to the staging buffer.
+    std::shared_ptr<void> pixels;
+
+    // Records the copy into the first layer of image, which must be in eTransferDstOptimal
+    // layout. The staging buffer (if any) must be kept alive until the copy finished executing.
+    void cmd_upload(const vk::CommandBuffer& cmd,
+                    const vk::Image& image,
+                    const ResourceAllocatorHandle& allocator) const;
+};
+
+using DecodedImageHandle = std::shared_ptr<DecodedImage>;
+
+// Decodes image files on the thread pool such that loading large images does not stall the graph.
+class ImageDecode {
+  public:
+    struct Info {
+        int width;
+        int height;
+        int channels;
+    };
+
+    // Reads only the header. Throws graph_errors::node_error if the file does not exist or the
+    // format is not supported.
+    static Info read_info(const std::filesystem::path& path);
+
+  public:
+    ImageDecode() {}
+
+    // Cancels and waits for a pending decode.
+    ~ImageDecode();
+
+    // Starts decoding the file as background task, previous loads are cancelled. If hdr is true
+    // the pixels are decoded as float, else as 8 bit unsigned integer.
+    //
+    // If staging_buffer is large enough it is used instead of allocating a new one (requires an
+    // allocator). The caller must ensure that the buffer is not in use anymore.
+    void start(ThreadPool& thread_pool,
+               const std::filesystem::path& path,
+               const bool hdr,
+               const ResourceAllocatorHandle& allocator = nullptr,
+               const BufferHandle& staging_buffer = nullptr);
+
+    // Cancels a pending decode. Decoding cannot be interrupted once it started, but the result is
+    // discarded.
+    void cancel();
+
+    // True if a decode was started and its result was not retrieved yet.
+    bool pending() const {
+        return future.valid();
+    }
+
+    // True if the result can be retrieved without blocking.
+    bool ready() const;
+
+    // Returns the result and resets the pending state. If wait is false and the decode is not
+    // finished nullptr is returned, otherwise the calling thread helps out on the pool until the
+    // result is available. Throws graph_errors::node_error if decoding failed.
+    DecodedImageHandle get(const bool wait = false);
+
+    // The path of the pending or last started decode.
+    const std::filesystem::path& get_path() const {
+        return path;
+    }
+
+  private:
+    ThreadPool* thread_pool = nullptr;
+    std::filesystem::path path;
+    std::stop_source stop_source;
+    std::future<DecodedImageHandle> future;
+};
+
+} // namespace merian_nodes
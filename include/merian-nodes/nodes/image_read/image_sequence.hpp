@@ -0,0 +1,131 @@
+#pragma once
+
+#include "merian-nodes/connectors/managed_vk_image_out.hpp"
+#include "merian-nodes/graph/node.hpp"
+#include "merian-nodes/nodes/image_read/image_decode.hpp"
+
+#include <deque>
+#include <filesystem>
+
+namespace merian_nodes {
+
+// Streams a sequence of image files, for example frames that were captured with ImageWrite.
+//
+// The filename is a format string with the variable `frame` (e.g. "capture/frame_{frame:06}.hdr").
+// Upcoming frames are decoded ahead on the thread pool into a ring of staging buffers, such that
+// the upload is only a buffer to image copy.
+//
+// In "iteration" mode every iteration outputs the next frame, if it is not decoded yet the graph
+// waits (as fast as possible). In "fixed rate" mode the frame is selected using the graph time, if
+// it is not decoded yet the previous frame is kept. Both count as stall.
+class ImageSequenceRead : public Node {
+    // A frame that is decoded ahead.
+    struct Slot {
+        // the position in the sequence (increases monotonically when looping).
+        uint64_t index;
+        ImageDecode decode;
+        // set if a buffer of the ring was handed to the decode
+        BufferHandle staging_buffer;
+    };
+
+    // A staging buffer of the ring that can be reused from the iteration on.
+    struct FreeBuffer {
+        BufferHandle buffer;
+        uint64_t available_iteration;
+    };
+
+  public:
+    ImageSequenceRead(const ContextHandle& context,
+                      const ResourceAllocatorHandle& allocator = nullptr,
+                      const std::string& filename_format = "frame_{frame:06}.png");
+
+    std::vector<OutputConnectorHandle> describe_outputs(const NodeIOLayout& io_layout) override;
+
+    void process(GraphRun& run,
+                 const vk::CommandBuffer& cmd,
+                 const DescriptorSetHandle& descriptor_set,
+                 const NodeIO& io) override;
+
+    NodeStatusFlags properties(Properties& config) override;
+
+    // Starts the sequence over at the first frame.
+    void restart();
+
+  private:
+    // Returns the file of the frame relative to the first frame.
+    std::filesystem::path get_frame_path(const uint64_t frame) const;
+
+    // Returns the file of the frame at the position in the sequence.
+    std::filesystem::path get_path(const uint64_t index) const;
+
+    // Number of consecutive frames that exist on disk.
+    uint32_t count_frames() const;
+
+    // Drops slots before index and starts decoding the frames up to index + read_ahead.
+    void fill_ring(const uint64_t index, const uint64_t iteration);
+
+    // Cancels the decode and returns the staging buffer to the ring if possible.
+    void release_slot(Slot& slot);
+
+    void clear_ring();
+
+    // Selects and uploads the frame of this iteration. Returns true if a frame was uploaded.
+    bool advance(GraphRun& run, const vk::CommandBuffer& cmd, const NodeIO& io);
+
+  private:
+    const ContextHandle context;
+    const ResourceAllocatorHandle allocator;
+
+    std::string filename_format;
+    int first_frame = 0;
+    // 0 detects the number of frames on disk
+    int frame_count = 0;
+    int format = 0;
+    int mode = 0;
+    float frame_rate = 30;
+    bool loop = true;
+    bool pause = false;
+    uint32_t read_ahead = 4;
+
+    ManagedVkImageOutHandle con_out;
+    uint32_t sequence_length = 0;
+    int width = 0, height = 0;
+
+    std::deque<std::unique_ptr<Slot>> ring;
+    std::vector<FreeBuffer> free_buffers;
+
+    // the position of the frame in the output, -1 if none.
+    int64_t displayed = -1;
+    // false after connect until the output was written.
+    bool output_initialized = false;
+    // keeps the staging buffer of the last upload alive.
+    DecodedImageHandle current;
+    uint64_t current_upload_iteration = 0;
+
+    // fixed rate mode: time and position when the clock was (re)started.
+    bool reset_clock = true;
+    double clock_start_time = 0;
+    uint64_t clock_start_index = 0;
+
+    // --- Statistics ---
+
+    uint64_t uploaded_frames = 0;
+    uint64_t uploaded_bytes = 0;
+    uint64_t failed_frames = 0;
+    // frames that were passed over in fixed rate mode
+    uint64_t skipped_frames = 0;
+    // iterations in which the due frame was not decoded yet
+    uint64_t stalls = 0;
+    std::chrono::nanoseconds stall_duration{0};
+    std::chrono::nanoseconds decode_duration{0};
+    std::string last_error;
+
+    // for rates in properties()
+    std::chrono::steady_clock::time_point last_statistics_time;
+    uint64_t last_uploaded_frames = 0;
+    uint64_t last_uploaded_bytes = 0;
+    float frames_per_second = 0;
+    float bytes_per_second = 0;
+};
+
+} // namespace merian_nodes
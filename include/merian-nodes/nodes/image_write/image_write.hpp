@@ -2,16 +2,87 @@
 
 #include "merian-nodes/connectors/managed_vk_image_in.hpp"
 #include "merian-nodes/graph/node.hpp"
+#include "merian/io/image_encoder.hpp"
+#include "merian/io/raw_frames.hpp"
+#include "merian/io/video_stream_writer.hpp"
+#include "merian/utils/concurrent/spsc_queue.hpp"
 #include "merian/utils/stopwatch.hpp"
 #include "merian/vk/memory/resource_allocator.hpp"
+#include "merian/vk/pipeline/pipeline.hpp"
+#include "merian/vk/shader/shader_module.hpp"
+#include "merian/vk/sync/semaphore_timeline.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <stop_token>
 
 namespace merian_nodes {
 
 // Writes to images files.
+//
+// Captures are copied into a fixed ring of host-visible readback buffers (blitting through an
+// intermediate image only if the input must be scaled or converted). Completion is tracked with the
+// iteration semaphore of the graph: once the copy finished, the capture is handed to a background
+// task on the thread pool of the context that encodes and writes the file. Neither the recording
+// thread nor the workers wait for the GPU. If no buffer is free the back-pressure policy decides
+// whether to wait, drop the capture or grow the ring.
+//
+// Encoding uses ImageEncoder, which splits the image into stripes that are compressed in parallel.
+// The raw formats and EXR are written directly from the mapped readback buffer, conversions to
+// half float are done by the GPU blit.
+//
+// The video formats convert the capture to YUV 4:2:0 with a compute shader and append it to a
+// stream (file, named pipe or the stdin of a command). The stream stays open while recording,
+// frames are written in capture order by a single task at a time.
 class ImageWrite : public Node {
-    class FrameData {
-      public:
-        std::optional<ImageHandle> intermediate_image;
+    static constexpr uint32_t yuv_local_size_x = 256;
+    // the graph thread blocks if more frames wait for the write task.
+    static constexpr uint32_t VIDEO_QUEUE_SIZE = 256;
+
+    struct YUVPushConstant {
+        uint32_t width;
+        uint32_t height;
+        uint32_t chroma_width;
+        uint32_t chroma_height;
+    };
+
+    enum SlotState : uint32_t {
+        FREE,
+        // the copy was recorded, waiting for the GPU
+        RECORDED,
+        // handed to the encoder
+        ENCODING,
+    };
+
+    // A readback buffer of the ring together with the capture it holds.
+    struct ReadbackSlot {
+        std::atomic<uint32_t> state{FREE};
+
+        BufferHandle buffer;
+        // only created if the capture needs a blit
+        ImageHandle intermediate_image;
+        // video formats: the intermediate image as storage image and the set for the YUV pass
+        TextureHandle yuv_texture;
+        DescriptorSetHandle yuv_set;
+
+        // --- capture ---
+
+        vk::Extent3D extent;
+        // the format of the buffer (and intermediate image)
+        vk::Format readback_format = vk::Format::eUndefined;
+        // the file format
+        int format = -1;
+        // copied at capture time, the encoder must not read the node's settings.
+        ImageEncoder::Options encoder_options;
+        std::filesystem::path path;
+        // video formats: the stream the frame is appended to
+        VideoStreamWriterHandle video_stream;
+        int64_t record_iteration;
+        double record_time;
+        // the value of the iteration semaphore that signals that the copy finished
+        uint64_t ready_value;
+        std::stop_token stop_token;
     };
 
   public:
@@ -25,6 +96,7 @@ class ImageWrite : public Node {
                const std::string& base_filename =
                    "image_{record_iteration:06}_{image_index:06}_{run_iteration:06}");
 
+    // Waits for pending writes.
     virtual ~ImageWrite();
 
     virtual std::vector<InputConnectorHandle> describe_inputs() override;
@@ -43,6 +115,39 @@ class ImageWrite : public Node {
 
     void record();
 
+    // Cancels writes that did not start yet, the corresponding captures are lost.
+    void cancel_pending_writes();
+
+  private:
+    // Returns a free slot that can hold the capture or nullptr according to the back-pressure
+    // policy.
+    // If yuv the buffer receives the YUV 4:2:0 frame that is computed from the intermediate image.
+    ReadbackSlot* acquire_slot(const vk::Extent3D& extent,
+                               const vk::Format readback_format,
+                               const bool needs_blit,
+                               const bool yuv);
+
+    // Hands the captures whose copy finished to the encoder.
+    void dispatch_completed_captures();
+
+    void encode(ReadbackSlot& slot);
+
+    // Writes the queued video frames in order, runs as one task at a time.
+    void write_video_frames();
+
+    // Number of slots that are not free.
+    uint32_t get_pending_captures() const;
+
+    // Returns the writer for the multi-frame file at path, the previous file is finalized once no
+    // encoder uses it anymore.
+    RawFramesWriterHandle get_frames_writer(const std::filesystem::path& path);
+
+    // Finalizes the current multi-frame file, the next capture opens it again and appends.
+    void close_frames_writer();
+
+    // The stream is closed once the queued frames are written. The next capture opens a new one.
+    void close_video_stream();
+
   private:
     template <typename T>
     void
@@ -62,10 +167,37 @@ class ImageWrite : public Node {
 
     ManagedVkImageInHandle con_src = ManagedVkImageIn::transfer_src("src");
 
-    uint32_t max_concurrent_tasks = std::thread::hardware_concurrency();
-    uint32_t concurrent_tasks = 0;
-    std::mutex mutex_concurrent;
-    std::condition_variable cv_concurrent;
+    // fixed size unless the back-pressure policy is "grow". Slots are only added or removed by
+    // the graph thread, the encoder only changes the state of the slot it works on.
+    std::vector<std::unique_ptr<ReadbackSlot>> ring;
+    uint32_t ring_size = 8;
+    int back_pressure = 0;
+    TimelineSemaphoreHandle iteration_semaphore;
+    // notified when a slot becomes free
+    std::mutex mutex_slots;
+    std::condition_variable cv_slots;
+    std::stop_source pending_writes;
+    // the open multi-frame file, accessed by the encoders
+    std::mutex mutex_frames_writer;
+    RawFramesWriterHandle frames_writer;
+    // only accessed by the graph thread, captures hold a reference until they are written.
+    VideoStreamWriterHandle video_stream;
+    // video frames whose copy finished in capture order. Produced by the graph thread, consumed by
+    // the write task. video_writing is set while a write task is scheduled or running.
+    SPSCQueue<ReadbackSlot*> video_queue{VIDEO_QUEUE_SIZE};
+    std::atomic<bool> video_writing{false};
+
+    ShaderModuleHandle yuv_shader;
+    DescriptorSetLayoutHandle yuv_set_layout;
+    PipelineHandle yuv_pipeline;
+
+    uint64_t captured = 0;
+    uint64_t dropped = 0;
+    uint64_t stalls = 0;
+    std::chrono::nanoseconds stall_duration{0};
+    std::atomic<uint64_t> encoded{0};
+    std::atomic<uint64_t> encoded_pixels{0};
+    std::atomic<uint64_t> encode_nanos{0};
 
     std::function<void()> callback;
 
@@ -81,6 +213,12 @@ class ImageWrite : public Node {
     bool undersampling = false;
 
     int format = 0;
+    int compression = (int)ImageEncoder::Compression::DEFAULT;
+    int jpg_quality = 100;
+    int raw_precision = 0;
+    // pipe the video stream to this command instead of writing the file
+    std::string video_command;
+    uint32_t encoder_threads = std::thread::hardware_concurrency();
 
     bool record_enable = false;
     int enable_run = -1;
@@ -95,6 +233,7 @@ class ImageWrite : public Node {
     bool rebuild_on_record = false;
     bool callback_after_capture = false;
     bool callback_on_record = false;
+    bool cancel_on_reconnect = false;
 
     int it_power = 1;
     int it_offset = 0;
@@ -94,7 +94,6 @@ class SVGF : public Node {
     int svgf_iterations = 0;
 
     DescriptorSetLayoutHandle ping_pong_layout;
-    DescriptorPoolHandle filter_pool;
     struct EAWRes {
         TextureHandle ping_pong;
         // Set reads from this resources and writes to i ^ 1
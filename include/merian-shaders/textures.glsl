@@ -7,4 +7,44 @@
 #define MERIAN_TEXTUREEFFECT_WAVES(st, time) (-vec2(.1, 0) * cos((st).x * 5 + (time) * 2) * pow(max(sin((st).x * 5 + (time) * 2), 0), 5) \
                          -vec2(.07, 0) * cos(-(st).x * 5 + -(st).y * 3 + (time) * 3) * pow(max(sin(-(st).x * 5 + -(st).y * 3 + (time) * 3), 0), 5))
 
+// BINDLESS HEAP (merian::BindlessHeap)
+//
+// Define MERIAN_BINDLESS_SET as the set index the heap is bound at before including this file.
+// Textures and buffers are then addressed by their index (get_bindless_index() on the host).
+// Textures are expected to be in SHADER_READ_ONLY_OPTIMAL layout.
+#ifdef MERIAN_BINDLESS_SET
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+#define MERIAN_BINDLESS_INVALID_INDEX 0xFFFFFFFFu
+
+layout(set = MERIAN_BINDLESS_SET, binding = 0) uniform sampler2D merian_bindless_textures_2d[];
+layout(set = MERIAN_BINDLESS_SET, binding = 0) uniform sampler3D merian_bindless_textures_3d[];
+layout(set = MERIAN_BINDLESS_SET, binding = 0) uniform samplerCube merian_bindless_textures_cube[];
+
+#define merian_bindless_texture(index) merian_bindless_textures_2d[nonuniformEXT(index)]
+#define merian_bindless_texture_3d(index) merian_bindless_textures_3d[nonuniformEXT(index)]
+#define merian_bindless_texture_cube(index) merian_bindless_textures_cube[nonuniformEXT(index)]
+
+// Declares the heap's storage buffers as array "name" of blocks with a runtime sized array "data".
+// Use MERIAN_BINDLESS_BUFFER(name, index).data[i] to access the buffers.
+#define MERIAN_BINDLESS_BUFFERS(name, type) \
+    layout(set = MERIAN_BINDLESS_SET, binding = 1) buffer name##_block { type data[]; } name[]
+
+#define MERIAN_BINDLESS_BUFFER(name, index) name[nonuniformEXT(index)]
+
+// Returns the "missing texture" color for MERIAN_BINDLESS_INVALID_INDEX.
+vec4 merian_bindless_sample_lod(const uint index, const vec2 uv, const float lod) {
+    if (index == MERIAN_BINDLESS_INVALID_INDEX) {
+        return vec4(1, 0, 1, 1);
+    }
+    return textureLod(merian_bindless_texture(index), uv, lod);
+}
+
+ivec2 merian_bindless_texture_size(const uint index, const int lod) {
+    return textureSize(merian_bindless_texture(index), lod);
+}
+
+#endif // MERIAN_BINDLESS_SET
+
 #endif // _MERIAN_SHADERS_TEXTURES_H_
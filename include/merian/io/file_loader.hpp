@@ -1,45 +1,72 @@
 #pragma once
 
+#include "merian/io/mapped_file.hpp"
 #include "merian/utils/string.hpp"
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <spdlog/spdlog.h>
 #include <string>
+#include <unordered_map>
 
 namespace merian {
 
+// Finds files in search paths and loads them.
+//
+// Results of find_file are cached (including files that were not found). The cache is invalidated
+// when the search paths change, entries for files that were not found expire after a short time.
+// Call invalidate_cache() after changing the working directory or if files were moved or deleted.
 class FileLoader {
+  public:
+    struct CacheStatistics {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // file system queries (stat) issued to resolve paths
+        uint64_t stat_calls = 0;
+    };
+
+  private:
+    struct CacheEntry {
+        std::optional<std::filesystem::path> result;
+        uint64_t generation;
+        std::chrono::steady_clock::time_point created;
+    };
 
   public:
     static bool exists(const std::filesystem::path& path,
                        std::filesystem::file_status file_status = std::filesystem::file_status{});
 
+    // Reads the file into a vector. Trailing bytes that do not fill a T are zero-padded.
     template <typename T> static std::vector<T> load_file(const std::filesystem::path& path) {
         if (!exists(path)) {
             throw std::runtime_error{
                 fmt::format("failed to load {} (does not exist)", path.string())};
         }
 
-        // Open the stream to 'lock' the file.
-        std::ifstream f(path, std::ios::in | std::ios::binary);
         const std::size_t size = std::filesystem::file_size(path);
-
         if (size % sizeof(T)) {
             SPDLOG_WARN("loading {} B of data into a vector quantized to {} B", size, sizeof(T));
         }
 
-        std::vector<T> result((size + sizeof(T) - 1) / sizeof(T), {});
-        f.read((char*)result.data(), (std::streamsize)size);
-
-        SPDLOG_DEBUG("load {} of data from {}", format_size(size), path.string());
-
+        std::vector<T> result((size + sizeof(T) - 1) / sizeof(T));
+        read_file(path, result.data(), size);
         return result;
     }
 
+    // Reads the file into a string. The file is read directly into the result without mapping it,
+    // use map_file() to access a file without copy.
     static std::string load_file(const std::filesystem::path& path);
 
+    // Maps the file into memory without copying (see MappedFile).
+    static MappedFileHandle
+    map_file(const std::filesystem::path& path,
+             const MappedFile::AccessPattern access_pattern = MappedFile::AccessPattern::SEQUENTIAL,
+             const bool prefetch = false);
+
     static std::optional<std::filesystem::path>
     search_cwd_parents(const std::filesystem::path& path);
 
@@ -47,6 +74,12 @@ class FileLoader {
     FileLoader(const std::set<std::filesystem::path>& search_paths = {"./"})
         : search_paths(search_paths) {}
 
+    // Copies the configuration, the cache is not copied.
+    FileLoader(const FileLoader& other);
+
+    // Copies the configuration, the cache is not copied.
+    FileLoader& operator=(const FileLoader& other);
+
     // Searches the file in cwd and search paths and returns the full path to the file
     std::optional<std::filesystem::path> find_file(const std::filesystem::path& path) const;
 
@@ -69,9 +102,37 @@ class FileLoader {
     // Search in parents of cwd
     void set_cwd_search_parents(const bool search_parents);
 
+    // Drops all cached results of find_file.
+    void invalidate_cache();
+
+    void set_cache_enabled(const bool enable);
+
+    CacheStatistics get_cache_statistics() const;
+
+  private:
+    // Reads size bytes of the file into data, throws std::runtime_error on failure.
+    static void read_file(const std::filesystem::path& path, void* data, const std::size_t size);
+
+    // find_file without cache
+    std::optional<std::filesystem::path> resolve(const std::filesystem::path& path,
+                                                 uint64_t& stat_calls) const;
+
+    std::optional<std::filesystem::path>
+    cached(const std::string& key,
+           const std::function<std::optional<std::filesystem::path>(uint64_t& stat_calls)>&
+               resolve_uncached) const;
+
   private:
     std::set<std::filesystem::path> search_paths;
     bool enable_search_cwd_parents = true;
+
+    mutable std::mutex cache_mutex;
+    // the keys are paths, or for relative lookups both paths separated by '\0'.
+    mutable std::unordered_map<std::string, CacheEntry> cache;
+    mutable CacheStatistics cache_statistics;
+    // entries of other generations are stale.
+    uint64_t generation = 0;
+    bool cache_enabled = true;
 };
 using FileLoaderHandle = std::shared_ptr<FileLoader>;
 
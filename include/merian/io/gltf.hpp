@@ -0,0 +1,189 @@
+#pragma once
+
+#include "merian/io/mesh.hpp"
+#include "merian/utils/chrono.hpp"
+#include "merian/utils/concurrent/utils.hpp"
+#include "merian/vk/command/queue.hpp"
+#include "merian/vk/memory/resource_allocator.hpp"
+
+#include "glm/glm.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace merian {
+
+class GLTFScene;
+using GLTFSceneHandle = std::shared_ptr<GLTFScene>;
+
+// A glTF 2.0 scene (.gltf or .glb) with its geometry on the device.
+//
+// The geometry of all primitives is converted to interleaved vertices (Mesh::Vertex) and 32 bit
+// indices and packed into a few large vertex and index buffers, each primitive references a range
+// of these. The buffers can be used as vertex / index buffers, storage buffers and as input for
+// acceleration structure builds. Images are decoded to RGBA8 and kept on the host.
+//
+// Requires merian to be built with tinygltf, otherwise load() throws.
+class GLTFScene {
+  public:
+    using Vertex = Mesh::Vertex;
+
+    // A triangle list.
+    struct Primitive {
+        BufferHandle vertex_buffer;
+        // in bytes, the vertices are at vertex_buffer + vertex_offset with stride sizeof(Vertex)
+        vk::DeviceSize vertex_offset;
+        uint32_t vertex_count;
+
+        BufferHandle index_buffer;
+        // in bytes, indices are relative to the first vertex of the primitive
+        vk::DeviceSize index_offset;
+        uint32_t index_count;
+
+        // -1 if the primitive has no material
+        int32_t material;
+    };
+
+    // The primitives of a mesh are consecutive.
+    struct MeshInfo {
+        std::string name;
+        uint32_t first_primitive;
+        uint32_t primitive_count;
+    };
+
+    // A node of the default scene that references a mesh.
+    struct Instance {
+        uint32_t mesh;
+        // object to world, all parent transforms applied
+        glm::mat4 transform;
+    };
+
+    // Image indices are -1 if the texture is not set.
+    struct Material {
+        std::string name;
+        glm::vec4 base_color_factor;
+        float metallic_factor;
+        float roughness_factor;
+        glm::vec3 emissive_factor;
+        int32_t base_color_image;
+        int32_t metallic_roughness_image;
+        int32_t normal_image;
+        int32_t emissive_image;
+        bool double_sided;
+    };
+
+    // RGBA8, base color and emissive images are sRGB encoded.
+    struct Image {
+        std::string name;
+        uint32_t width;
+        uint32_t height;
+        // nullptr if the image could not be decoded
+        std::shared_ptr<const void> pixels;
+    };
+
+    struct Statistics {
+        // reading JSON and buffers
+        std::chrono::nanoseconds parse_duration{0};
+        // converting and transferring the geometry
+        std::chrono::nanoseconds upload_duration{0};
+        // load() until all images are decoded
+        std::chrono::nanoseconds decode_duration{0};
+        std::chrono::nanoseconds total_duration{0};
+
+        std::size_t uploaded_bytes = 0;
+        uint32_t upload_batches = 0;
+        // Estimated from the glTF buffers, encoded and decoded images and the staging memory in
+        // flight. Allocations of the JSON parser are not accounted.
+        std::size_t peak_host_memory = 0;
+
+        // bytes per second
+        double get_upload_bandwidth() const {
+            return upload_duration.count() > 0 ? uploaded_bytes / to_seconds(upload_duration) : 0.;
+        }
+    };
+
+    // Geometry is uploaded in batches of about this size (vertices and indices together). A
+    // primitive that is larger gets a batch of its own.
+    static constexpr vk::DeviceSize DEFAULT_BATCH_SIZE = vk::DeviceSize(64) * 1024 * 1024;
+
+    static constexpr vk::BufferUsageFlags VERTEX_BUFFER_USAGE =
+        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eShaderDeviceAddress |
+        vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+
+    static constexpr vk::BufferUsageFlags INDEX_BUFFER_USAGE =
+        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eShaderDeviceAddress |
+        vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+
+  public:
+    // Loads the file and uploads the geometry with a staging memory manager of its own (on the
+    // memory allocator of the allocator), such that it can run on any thread while the allocator
+    // and its staging memory manager are used elsewhere.
+    //
+    // Images are decoded on the thread pool while the geometry is converted (also on the thread
+    // pool) and transferred. Two batches are kept in flight, such that converting a batch overlaps
+    // with the transfer of the previous one. Returns after all transfers finished and all images
+    // are decoded. Only triangle primitives are loaded, others are skipped with a warning.
+    //
+    // Throws std::runtime_error if the file cannot be read or is not valid.
+    static GLTFSceneHandle load(const std::filesystem::path& path,
+                                const ResourceAllocatorHandle& allocator,
+                                const QueueHandle& queue,
+                                ThreadPool& thread_pool = get_default_thread_pool(),
+                                const vk::DeviceSize batch_size = DEFAULT_BATCH_SIZE);
+
+  public:
+    std::span<const Primitive> get_primitives() const {
+        return primitives;
+    }
+
+    std::span<const MeshInfo> get_meshes() const {
+        return meshes;
+    }
+
+    std::span<const Primitive> get_primitives(const MeshInfo& mesh) const {
+        return get_primitives().subspan(mesh.first_primitive, mesh.primitive_count);
+    }
+
+    std::span<const Instance> get_instances() const {
+        return instances;
+    }
+
+    std::span<const Material> get_materials() const {
+        return materials;
+    }
+
+    std::span<const Image> get_images() const {
+        return images;
+    }
+
+    // The large buffers that the primitives reference.
+    std::span<const BufferHandle> get_buffers() const {
+        return buffers;
+    }
+
+    const Statistics& get_statistics() const {
+        return statistics;
+    }
+
+  private:
+    GLTFScene() = default;
+
+  private:
+    std::vector<Primitive> primitives;
+    std::vector<MeshInfo> meshes;
+    std::vector<Instance> instances;
+    std::vector<Material> materials;
+    std::vector<Image> images;
+    std::vector<BufferHandle> buffers;
+
+    Statistics statistics;
+};
+
+} // namespace merian
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "merian/utils/concurrent/thread_pool.hpp"
+
+#include <cstdint>
+#include <ostream>
+#include <thread>
+
+namespace merian {
+
+// Encodes images to PNG, JPEG, Radiance HDR and OpenEXR.
+//
+// For PNG, JPEG and HDR the image is split into horizontal stripes that are encoded independently
+// on the thread pool and stitched into one file:
+//
+// - PNG: the rows of every stripe are filtered and deflated separately. The compressor is primed
+//   with the previous 32 KiB, such that matches may cross stripe boundaries. Stripes end with an
+//   empty stored block (like zlib's sync flush) to be byte aligned and are written as separate IDAT
+//   chunks, the Adler-32 checksums are combined at the end.
+// - JPEG: baseline with restart intervals, every row of MCUs is a restart interval and a stripe
+//   covers whole rows.
+// - HDR: run-length encoded scanlines, which are independent anyway.
+//
+// OpenEXR is written uncompressed with half float scanlines, it is limited by the stream and
+// written line by line without copying the image.
+//
+// The pixels are RGBA with tightly packed rows, 8 bit unsigned for PNG and JPEG, 32 bit float for
+// HDR and 16 bit float for EXR. JPEG and HDR ignore alpha. Stream failures throw
+// std::runtime_error.
+class ImageEncoder {
+  public:
+    // Effort of the PNG compressor. All levels use LZ77 with fixed Huffman codes, except BEST
+    // which builds dynamic Huffman codes for every block.
+    enum class Compression {
+        // stored blocks, only filtering
+        NONE,
+        // one match candidate, fixed Paeth filter
+        FASTEST,
+        FAST,
+        DEFAULT,
+        // deep match search with lazy matching and dynamic Huffman codes
+        BEST,
+    };
+
+    struct Options {
+        // PNG only
+        Compression compression = Compression::DEFAULT;
+        // JPEG only, in [1, 100]. Chroma is subsampled (4:2:0) below 90.
+        int quality = 95;
+        // rows per stripe, 0 chooses depending on the height and number of tasks. Rounded up to
+        // the MCU height for JPEG.
+        uint32_t stripe_height = 0;
+        // maximum number of stripes that are encoded concurrently. The calling thread participates.
+        uint32_t tasks = std::thread::hardware_concurrency();
+        // priority of the helper tasks
+        ThreadPool::Priority priority = ThreadPool::Priority::NORMAL;
+    };
+
+  public:
+    ImageEncoder(ThreadPool& thread_pool, const Options& options);
+
+    void write_png(std::ostream& out,
+                   const uint8_t* pixels,
+                   const uint32_t width,
+                   const uint32_t height) const;
+
+    void write_jpg(std::ostream& out,
+                   const uint8_t* pixels,
+                   const uint32_t width,
+                   const uint32_t height) const;
+
+    void write_hdr(std::ostream& out,
+                   const float* pixels,
+                   const uint32_t width,
+                   const uint32_t height) const;
+
+    // pixels are IEEE 754 half floats.
+    void write_exr(std::ostream& out,
+                   const uint16_t* pixels,
+                   const uint32_t width,
+                   const uint32_t height) const;
+
+    const Options& get_options() const {
+        return options;
+    }
+
+  private:
+    uint32_t get_stripe_height(const uint32_t height, const uint32_t alignment) const;
+
+  private:
+    ThreadPool& thread_pool;
+    const Options options;
+};
+
+} // namespace merian
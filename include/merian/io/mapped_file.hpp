@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string_view>
+
+namespace merian {
+
+// A read-only view of a whole file.
+//
+// The file is memory mapped if the platform supports it, pages are then read on first access and
+// no copy is made. If mapping is not supported or fails the file is read into a buffer instead.
+// The data stays valid as long as the object exists, share it using MappedFileHandle.
+class MappedFile {
+  public:
+    // Passed to the kernel (madvise) to tune read-ahead. Ignored for the fallback path.
+    enum class AccessPattern {
+        NORMAL,
+        // aggressive read-ahead, pages can be freed soon after they were accessed.
+        SEQUENTIAL,
+        // no read-ahead
+        RANDOM,
+    };
+
+  public:
+    // Throws std::runtime_error if the file does not exist or cannot be read.
+    //
+    // If prefetch is true the kernel is asked to start reading the whole file asynchronously.
+    MappedFile(const std::filesystem::path& path,
+               const AccessPattern access_pattern = AccessPattern::SEQUENTIAL,
+               const bool prefetch = false);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::span<const std::byte> get_data() const noexcept {
+        return {data, size};
+    }
+
+    std::string_view get_string_view() const noexcept {
+        return {reinterpret_cast<const char*>(data), size};
+    }
+
+    // The data interpreted as array of T. Trailing bytes that do not fill a T are omitted.
+    template <typename T> std::span<const T> get_span() const noexcept {
+        return {reinterpret_cast<const T*>(data), size / sizeof(T)};
+    }
+
+    std::size_t get_size() const noexcept {
+        return size;
+    }
+
+    bool empty() const noexcept {
+        return size == 0;
+    }
+
+    // Returns false if the fallback path was used.
+    bool is_mapped() const noexcept {
+        return mapped;
+    }
+
+    const std::filesystem::path& get_path() const noexcept {
+        return path;
+    }
+
+  private:
+    const std::filesystem::path path;
+
+    const std::byte* data = nullptr;
+    std::size_t size = 0;
+    bool mapped = false;
+
+    // only used for the fallback path
+    std::unique_ptr<std::byte[]> buffer;
+};
+
+using MappedFileHandle = std::shared_ptr<MappedFile>;
+
+} // namespace merian
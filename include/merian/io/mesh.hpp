@@ -0,0 +1,191 @@
+#pragma once
+
+#include "merian/io/mapped_file.hpp"
+#include "merian/utils/concurrent/utils.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace merian {
+
+class Mesh;
+using MeshHandle = std::shared_ptr<Mesh>;
+
+// A triangle mesh with interleaved vertices and 32 bit indices, laid out for direct upload and
+// acceleration structure builds (position at offset 0, stride sizeof(Mesh::Vertex)).
+//
+// Meshes are either parsed from OBJ files or loaded from a binary cache. A cache is memory mapped
+// and used in place, no copy is made. Layout of the cache (little endian):
+//
+//   CacheHeader
+//   vertices, indices, parts, materials (offset and size into the strings), strings
+//
+// Every section starts at a multiple of CACHE_ALIGNMENT. The header stores the size, modification
+// time and a hash of the source, see load_obj().
+class Mesh {
+  public:
+    struct Vertex {
+        glm::vec3 position;
+        // (0, 0, 0) if the source does not provide a normal
+        glm::vec3 normal;
+        glm::vec2 uv;
+    };
+    static_assert(sizeof(Vertex) == 32);
+
+    // A range of triangles with the same object/group name and material.
+    struct Part {
+        uint32_t first_index;
+        uint32_t index_count;
+        // -1 if no material was set
+        int32_t material;
+        // into the strings
+        uint32_t name_offset;
+        uint32_t name_size;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(Part) == 24);
+
+    static constexpr char CACHE_MAGIC[8] = {'M', 'R', 'N', 'M', 'E', 'S', 'H', '\0'};
+    static constexpr uint32_t CACHE_VERSION = 1;
+    static constexpr uint64_t CACHE_ALIGNMENT = 64;
+
+    // Identifies the version of a source file.
+    struct SourceStamp {
+        uint64_t size;
+        // nanoseconds of std::filesystem::file_time_type
+        int64_t mtime;
+        uint64_t hash;
+    };
+
+    struct CacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertex_stride;
+        SourceStamp source;
+        uint64_t vertex_offset;
+        uint64_t vertex_count;
+        uint64_t index_offset;
+        uint64_t index_count;
+        uint64_t part_offset;
+        uint64_t part_count;
+        uint64_t material_offset;
+        uint64_t material_count;
+        uint64_t strings_offset;
+        uint64_t strings_size;
+        uint8_t reserved[8];
+    };
+    static_assert(sizeof(CacheHeader) == 128);
+
+  public:
+    // Parses an OBJ file in parallel: the file is split into chunks of lines that are parsed,
+    // triangulated (fans) and deduplicated independently. Vertices are only shared within a chunk,
+    // vertices at chunk boundaries may be duplicated. Material libraries are not read, materials
+    // are identified by the names used with usemtl. Line continuations are not supported.
+    //
+    // Throws std::runtime_error if the file cannot be read or is not valid.
+    static MeshHandle parse_obj(const std::filesystem::path& path,
+                                ThreadPool& thread_pool = get_default_thread_pool(),
+                                const uint32_t tasks = std::thread::hardware_concurrency());
+
+    // Loads an OBJ file using the cache at cache_path (default: path + ".meshcache").
+    //
+    // The cache is used if the size and modification time of the source match. If only the
+    // modification time differs the source is hashed, a matching hash still uses the cache (e.g.
+    // after a checkout or copy) and the new modification time is stored in the cache, such that
+    // the next load does not hash again. Otherwise the OBJ is parsed and the cache rewritten;
+    // failing to write the cache is only logged.
+    static MeshHandle
+    load_obj(const std::filesystem::path& path,
+             const std::optional<std::filesystem::path>& cache_path = std::nullopt,
+             ThreadPool& thread_pool = get_default_thread_pool());
+
+    // Maps a cache, the stamp of the source it was written for is returned by get_source().
+    // Throws std::runtime_error if the file is not a valid cache.
+    static MeshHandle read_cache(const std::filesystem::path& cache_path);
+
+    // Writes the cache to a temporary file first and renames it.
+    // Throws std::runtime_error if writing fails.
+    void write_cache(const std::filesystem::path& cache_path, const SourceStamp& source) const;
+
+    // Replaces the source stamp in the header of an existing cache, in place.
+    // Throws std::runtime_error if writing fails.
+    static void update_cache_stamp(const std::filesystem::path& cache_path,
+                                   const SourceStamp& source);
+
+    // Size and modification time of the file. The hash is only computed if with_hash is true.
+    static SourceStamp get_source_stamp(const std::filesystem::path& path,
+                                        const bool with_hash,
+                                        ThreadPool& thread_pool = get_default_thread_pool());
+
+  public:
+    std::span<const Vertex> get_vertices() const {
+        return vertices;
+    }
+
+    std::span<const uint32_t> get_indices() const {
+        return indices;
+    }
+
+    std::span<const Part> get_parts() const {
+        return parts;
+    }
+
+    std::string_view get_part_name(const Part& part) const {
+        return {strings.data() + part.name_offset, part.name_size};
+    }
+
+    uint32_t get_material_count() const {
+        return materials.size();
+    }
+
+    // The name used with usemtl.
+    std::string_view get_material_name(const uint32_t material) const {
+        return {strings.data() + materials[material].offset, materials[material].size};
+    }
+
+    // Whether the data is mapped from a cache.
+    bool is_cached() const {
+        return (bool)cache;
+    }
+
+    // Only set for meshes that were read from a cache.
+    const SourceStamp& get_source() const {
+        return source;
+    }
+
+  private:
+    struct Material {
+        uint32_t offset;
+        uint32_t size;
+    };
+    static_assert(sizeof(Material) == 8);
+
+    Mesh() = default;
+
+  private:
+    // either points into the cache or into the storage below
+    std::span<const Vertex> vertices;
+    std::span<const uint32_t> indices;
+    std::span<const Part> parts;
+    std::span<const Material> materials;
+    std::span<const char> strings;
+
+    std::unique_ptr<const MappedFile> cache;
+    SourceStamp source{};
+
+    std::vector<Vertex> vertex_storage;
+    std::vector<uint32_t> index_storage;
+    std::vector<Part> part_storage;
+    std::vector<Material> material_storage;
+    std::vector<char> string_storage;
+};
+
+} // namespace merian
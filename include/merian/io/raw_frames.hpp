@@ -0,0 +1,162 @@
+#pragma once
+
+#include "merian/io/mapped_file.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace merian {
+
+// A file of uncompressed frames that can be memory mapped and used in place.
+//
+// Layout (little endian, all offsets in bytes from the start of the file):
+//
+//   FileHeader, padded to ALIGNMENT
+//   for every frame: FrameHeader, padded to ALIGNMENT, then the payload padded to ALIGNMENT
+//   (optional) index: a FrameHeader per frame, followed by the end of the file
+//
+// The payload of a frame is width * height * channels tightly packed components, rows top to
+// bottom. Payloads start at page boundaries such that a frame can also be mapped on its own.
+//
+// The index is written when a RawFramesWriter is finalized, its position is stored in the file
+// header. Files that were not finalized (e.g. because the application crashed) are still readable,
+// the frames are then found by walking the frame headers.
+namespace raw_frames {
+
+// the headers are written as they are in memory.
+static_assert(std::endian::native == std::endian::little);
+
+static constexpr uint64_t ALIGNMENT = 4096;
+static constexpr char FILE_MAGIC[8] = {'M', 'R', 'N', 'F', 'R', 'A', 'M', 'E'};
+static constexpr char FRAME_MAGIC[4] = {'F', 'R', 'M', '0'};
+static constexpr uint32_t VERSION = 1;
+
+enum class ComponentType : uint32_t {
+    FLOAT32 = 0,
+    FLOAT16 = 1,
+    UINT8 = 2,
+};
+
+uint32_t get_component_size(const ComponentType type);
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t frame_count;
+    // 0 if the file was not finalized
+    uint64_t index_offset;
+    uint8_t reserved[40];
+};
+static_assert(sizeof(FileHeader) == 64);
+
+struct FrameHeader {
+    char magic[4];
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    ComponentType component_type;
+    uint32_t reserved0;
+    // set by the application, e.g. the iteration it was captured in.
+    uint64_t frame_number;
+    // seconds, set by the application
+    double time;
+    uint64_t payload_offset;
+    uint64_t payload_size;
+    uint8_t reserved1[8];
+};
+static_assert(sizeof(FrameHeader) == 64);
+
+} // namespace raw_frames
+
+// Appends frames to a raw frames file (see raw_frames above).
+//
+// Existing files are continued: their index is dropped and rewritten when finalized. Appends are
+// serialized, the writer can be shared between threads.
+class RawFramesWriter {
+  public:
+    // Throws std::runtime_error if the file cannot be opened or is not a raw frames file.
+    RawFramesWriter(const std::filesystem::path& path, const bool append = true);
+
+    // Finalizes the file.
+    ~RawFramesWriter();
+
+    RawFramesWriter(const RawFramesWriter&) = delete;
+
+    RawFramesWriter& operator=(const RawFramesWriter&) = delete;
+
+    // Writes the payload directly from data, no copy is made. Returns the index of the frame.
+    // Throws std::runtime_error if writing fails.
+    uint32_t append(const uint32_t width,
+                    const uint32_t height,
+                    const uint32_t channels,
+                    const raw_frames::ComponentType component_type,
+                    const void* data,
+                    const uint64_t frame_number = 0,
+                    const double time = 0);
+
+    // Writes the index and updates the file header. Frames can still be appended afterwards, the
+    // index is then rewritten on the next call.
+    void finalize();
+
+    uint32_t get_frame_count();
+
+    const std::filesystem::path& get_path() const {
+        return path;
+    }
+
+  private:
+    const std::filesystem::path path;
+
+    std::mutex mutex;
+    std::fstream file;
+    std::vector<raw_frames::FrameHeader> frames;
+    // where the next frame starts
+    uint64_t end;
+    bool finalized = false;
+};
+
+using RawFramesWriterHandle = std::shared_ptr<RawFramesWriter>;
+
+// Maps a raw frames file (see raw_frames above) for reading.
+class RawFramesReader {
+  public:
+    // Throws std::runtime_error if the file cannot be read or is not a raw frames file.
+    RawFramesReader(const std::filesystem::path& path);
+
+    uint32_t get_frame_count() const {
+        return frames.size();
+    }
+
+    const raw_frames::FrameHeader& get_frame(const uint32_t index) const {
+        return frames[index];
+    }
+
+    // The payload in the mapping, valid as long as the reader exists.
+    std::span<const std::byte> get_payload(const uint32_t index) const;
+
+    // Returns the index of the frame with the smallest frame number that is not smaller than
+    // frame_number, or get_frame_count() if there is none. Frames are sorted by frame number.
+    uint32_t find_frame(const uint64_t frame_number) const;
+
+    // Whether the index was used, false if the frames were found by walking the file.
+    bool is_finalized() const {
+        return finalized;
+    }
+
+    const std::filesystem::path& get_path() const {
+        return file.get_path();
+    }
+
+  private:
+    const MappedFile file;
+    std::vector<raw_frames::FrameHeader> frames;
+    bool finalized = false;
+};
+
+} // namespace merian
@@ -6,6 +6,9 @@ namespace merian {
 
 // Convenience method that reads a .obj file using tinyobjloader and throws if the file cound not be
 // found or the input file is not valid.
+//
+// Parses single-threaded on every call, for large meshes prefer Mesh::load_obj (merian/io/mesh.hpp)
+// which parses in parallel and keeps a binary cache.
 tinyobj::ObjReader read_obj(std::string filename,
                                    std::optional<FileLoader> loader = std::nullopt);
 
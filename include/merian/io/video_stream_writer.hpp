@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace merian {
+
+// Writes 8 bit YUV 4:2:0 frames (planar, Y then Cb then Cr, chroma planes have half the size
+// rounded up) as a continuous stream, either as YUV4MPEG2 (Y4M) or without any headers.
+//
+// The target is a file, a named pipe or the stdin of a command (e.g.
+// "ffmpeg -y -i - -c:v libx264 out.mp4"). The target is opened on the first frame, such that
+// opening a named pipe that has no reader does not block the constructor. If the command exits
+// early, writing raises SIGPIPE on POSIX systems, ignore the signal to get an error instead.
+class VideoStreamWriter {
+  public:
+    enum class Container {
+        // YUV4MPEG2 with a FRAME header before every frame
+        Y4M,
+        // only the planes, the reader must know size and frame rate
+        RAW,
+    };
+
+    enum class Target {
+        // a file or named pipe
+        PATH,
+        // a shell command, the stream is written to its stdin
+        COMMAND,
+    };
+
+  public:
+    VideoStreamWriter(const std::string& target,
+                      const Target target_type,
+                      const Container container,
+                      const uint32_t width,
+                      const uint32_t height,
+                      const double framerate);
+
+    // Closes the file or waits for the command to exit.
+    ~VideoStreamWriter();
+
+    VideoStreamWriter(const VideoStreamWriter&) = delete;
+
+    VideoStreamWriter& operator=(const VideoStreamWriter&) = delete;
+
+    // Writes a frame of get_frame_size() bytes. Not thread-safe.
+    // Throws std::runtime_error if the target cannot be opened or writing fails.
+    void write_frame(const void* yuv);
+
+    uint32_t get_width() const {
+        return width;
+    }
+
+    uint32_t get_height() const {
+        return height;
+    }
+
+    std::size_t get_frame_size() const {
+        return get_frame_size(width, height);
+    }
+
+    uint64_t get_frame_count() const {
+        return frame_count.load(std::memory_order_relaxed);
+    }
+
+    // Size of a 4:2:0 frame in bytes.
+    static std::size_t get_frame_size(const uint32_t width, const uint32_t height);
+
+  private:
+    const std::string target;
+    const Target target_type;
+    const Container container;
+    const uint32_t width;
+    const uint32_t height;
+    const double framerate;
+
+    FILE* file = nullptr;
+    std::atomic<uint64_t> frame_count{0};
+};
+
+using VideoStreamWriterHandle = std::shared_ptr<VideoStreamWriter>;
+
+} // namespace merian
@@ -53,7 +53,10 @@ class AudioDevice : public std::enable_shared_from_this<AudioDevice> {
     // Queue more audio to devices which were opened without callback.
     // Audio is buffered internally and forwarded to the device automatically.
     // If there is not enough audio, it is filled with silence.
-    virtual void queue_audio(const void* data, uint32_t len) = 0;
+    //
+    // Returns the number of bytes that were queued, which is less than len if the internal buffer
+    // is full. The remaining bytes can be queued again later.
+    virtual uint32_t queue_audio(const void* data, uint32_t len) = 0;
 
     virtual void close_device() = 0;
 
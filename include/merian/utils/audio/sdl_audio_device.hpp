@@ -1,14 +1,30 @@
 #pragma once
 
 #include "merian/utils/audio/audio_device.hpp"
+#include "merian/utils/concurrent/spsc_queue.hpp"
 
+#include <array>
 #include <cstdint>
 #include <functional>
 #include <optional>
 
 namespace merian {
 
+// Devices that are opened without callback (push mode) buffer queued audio in a lock-free ring
+// that is drained by the audio callback. Unlike SDL_QueueAudio, which locks the device against the
+// audio thread, the audio thread never waits for the producer and does not allocate. This is about
+// the real-time behavior of the audio thread, not throughput: the mutex based ConcurrentQueue can
+// be faster for one producer and one consumer (see tests/bench_queues.cpp).
 class SDLAudioDevice : public AudioDevice {
+    struct AudioChunk {
+        std::array<uint8_t, 4096> data;
+        uint32_t size;
+    };
+
+    // 64 chunks of 4 KiB, about 1.3 s of stereo float audio at 48 kHz. Each queue_audio() call
+    // starts a new chunk, queue at least 4 KiB at once to use the full capacity.
+    static constexpr uint32_t QUEUE_CHUNKS = 64;
+
   public:
     SDLAudioDevice();
 
@@ -23,7 +39,9 @@ class SDLAudioDevice : public AudioDevice {
 
     std::optional<AudioSpec> get_audio_spec() override;
 
-    void queue_audio(const void* data, uint32_t len) override;
+    // Must be called from one thread at a time. Never blocks, returns the number of bytes that fit
+    // into the queue (a multiple of the chunk size if not all bytes fit).
+    uint32_t queue_audio(const void* data, uint32_t len) override;
 
     void lock_device() override;
 
@@ -33,11 +51,27 @@ class SDLAudioDevice : public AudioDevice {
 
     void unpause_audio() override;
 
+  private:
+    // Called on the audio thread in push mode.
+    void pull_queued_audio(uint8_t* stream, int len);
+
   private:
     unsigned int audio_device_id;
     std::optional<AudioSpec> audio_spec;
+    uint8_t silence = 0;
 
     std::function<void(uint8_t* stream, int len)> callback;
+
+    // --- push mode ---
+
+    bool push_mode = false;
+    // produced by queue_audio(), consumed by the audio callback
+    SPSCQueue<AudioChunk> queued_audio{QUEUE_CHUNKS};
+    // the chunk the callback reads from, only accessed on the audio thread.
+    AudioChunk current_chunk{{}, 0};
+    uint32_t current_offset = 0;
+    uint64_t rejected_bytes = 0;
+    bool warned_full = false;
 };
 
 } // namespace merian
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+namespace merian {
+
+// Used to pad and align data that is accessed concurrently to prevent false sharing.
+//
+// std::hardware_destructive_interference_size is not used since its value may differ between
+// compilers and compiler flags, which leads to ABI issues.
+static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+} // namespace merian
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "merian/utils/concurrent/cache_line.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace merian {
+
+// Lets threads block until a condition becomes true, without a mutex (futex-style using
+// std::atomic::wait). Notifying is cheap if no thread is waiting.
+//
+// Waiters must follow the pattern:
+//
+//   const EventCount::Key key = event.prepare_wait();
+//   if (condition()) {
+//       event.cancel_wait();
+//   } else {
+//       event.wait(key);
+//   }
+//
+// Notifiers make the condition true first, then call notify_one() or notify_all().
+class EventCount {
+  public:
+    using Key = uint32_t;
+
+    // Suggested number of retries (with spin_pause()) before blocking.
+    static constexpr uint32_t SPIN_COUNT = 128;
+
+    // Hints the CPU that this is a spin-wait loop.
+    static void spin_pause() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    Key prepare_wait() {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        const Key key = epoch.load(std::memory_order_seq_cst);
+        // the check of the condition must not be reordered before the registration.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return key;
+    }
+
+    void cancel_wait() {
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Blocks until notified. Might return spuriously.
+    void wait(const Key key) {
+        epoch.wait(key, std::memory_order_seq_cst);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void notify_one() {
+        // the condition must be visible before checking for waiters.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            epoch.notify_one();
+        }
+    }
+
+    void notify_all() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            epoch.notify_all();
+        }
+    }
+
+    // Approximate.
+    bool has_waiters() const {
+        return waiters.load(std::memory_order_relaxed) > 0;
+    }
+
+  private:
+    alignas(CACHE_LINE_SIZE) std::atomic<Key> epoch{0};
+    std::atomic<uint32_t> waiters{0};
+};
+
+} // namespace merian
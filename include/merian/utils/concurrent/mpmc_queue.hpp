@@ -0,0 +1,178 @@
+#pragma once
+
+#include "merian/utils/concurrent/cache_line.hpp"
+#include "merian/utils/concurrent/event_count.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace merian {
+
+// A bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's bounded MPMC queue).
+//
+// Every slot carries a sequence number that tells producers and consumers whether the slot is free
+// for the current lap. Producers and consumers only contend on their respective index. The
+// capacity is rounded up to a power of two.
+//
+// try_push / try_pop never block. push / pop block (futex-style) while the queue is full / empty.
+template <typename T> class MPMCQueue {
+    struct alignas(CACHE_LINE_SIZE) Cell {
+        std::atomic<std::size_t> sequence;
+        alignas(T) std::byte storage[sizeof(T)];
+
+        T* value() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+  public:
+    MPMCQueue(const std::size_t capacity)
+        : capacity(std::bit_ceil(std::max(capacity, std::size_t(2)))), mask(this->capacity - 1),
+          cells(std::make_unique<Cell[]>(this->capacity)) {
+        for (std::size_t i = 0; i < this->capacity; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MPMCQueue() {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            while (try_pop()) {}
+        }
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    // Returns false if the queue is full, value is not moved from in this case.
+    template <typename U> bool try_push(U&& value) {
+        std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const std::intptr_t diff = (std::intptr_t)sequence - (std::intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (cell->storage) T(std::forward<U>(value));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        not_empty.notify_one();
+        return true;
+    }
+
+    // Returns std::nullopt if the queue is empty.
+    std::optional<T> try_pop() {
+        std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const std::intptr_t diff = (std::intptr_t)sequence - (std::intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return std::nullopt;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::optional<T> result(std::move(*cell->value()));
+        cell->value()->~T();
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        not_full.notify_one();
+        return result;
+    }
+
+    // Blocks while the queue is full.
+    template <typename U> void push(U&& value) {
+        for (uint32_t i = 0; i < EventCount::SPIN_COUNT; i++) {
+            if (try_push(std::forward<U>(value))) {
+                return;
+            }
+            EventCount::spin_pause();
+        }
+        while (!try_push(std::forward<U>(value))) {
+            const EventCount::Key key = not_full.prepare_wait();
+            if (!full()) {
+                not_full.cancel_wait();
+            } else {
+                not_full.wait(key);
+            }
+        }
+    }
+
+    // Blocks while the queue is empty.
+    T pop() {
+        for (uint32_t i = 0; i < EventCount::SPIN_COUNT; i++) {
+            if (std::optional<T> value = try_pop()) {
+                return std::move(*value);
+            }
+            EventCount::spin_pause();
+        }
+        while (true) {
+            if (std::optional<T> value = try_pop()) {
+                return std::move(*value);
+            }
+            const EventCount::Key key = not_empty.prepare_wait();
+            if (!empty()) {
+                not_empty.cancel_wait();
+            } else {
+                not_empty.wait(key);
+            }
+        }
+    }
+
+    // Approximate.
+    std::size_t size() const {
+        const std::size_t dequeue = dequeue_pos.load(std::memory_order_acquire);
+        const std::size_t enqueue = enqueue_pos.load(std::memory_order_acquire);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+
+    // Approximate.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Approximate.
+    bool full() const {
+        return size() >= capacity;
+    }
+
+    std::size_t get_capacity() const {
+        return capacity;
+    }
+
+  private:
+    const std::size_t capacity;
+    const std::size_t mask;
+    const std::unique_ptr<Cell[]> cells;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> enqueue_pos{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> dequeue_pos{0};
+
+    EventCount not_empty;
+    EventCount not_full;
+};
+
+} // namespace merian
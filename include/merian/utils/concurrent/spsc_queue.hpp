@@ -0,0 +1,162 @@
+#pragma once
+
+#include "merian/utils/concurrent/cache_line.hpp"
+#include "merian/utils/concurrent/event_count.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace merian {
+
+// A bounded lock-free single-producer single-consumer ring buffer.
+//
+// Producer and consumer keep a cached copy of the other side's index, so the shared indices are
+// only read when the cached one suggests that the queue is full / empty. The capacity is rounded up
+// to a power of two.
+//
+// Only one thread may push and only one thread may pop at the same time. try_push / try_pop never
+// block and are suitable for real-time threads (e.g. audio callbacks), they only enter the kernel
+// to wake the other side if it is blocked in push / pop. push / pop block (futex-style) while the
+// queue is full / empty.
+template <typename T> class SPSCQueue {
+    struct Slot {
+        alignas(T) std::byte storage[sizeof(T)];
+
+        T* value() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+  public:
+    SPSCQueue(const std::size_t capacity)
+        : capacity(std::bit_ceil(std::max(capacity, std::size_t(2)))), mask(this->capacity - 1),
+          slots(std::make_unique<Slot[]>(this->capacity)) {}
+
+    ~SPSCQueue() {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            while (try_pop()) {}
+        }
+    }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    // Producer only. Returns false if the queue is full, value is not moved from in this case.
+    template <typename U> bool try_push(U&& value) {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head >= capacity) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head >= capacity) {
+                return false;
+            }
+        }
+
+        new (slots[t & mask].storage) T(std::forward<U>(value));
+        tail.store(t + 1, std::memory_order_release);
+        not_empty.notify_one();
+        return true;
+    }
+
+    // Consumer only. Returns std::nullopt if the queue is empty.
+    std::optional<T> try_pop() {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail) {
+                return std::nullopt;
+            }
+        }
+
+        T* value = slots[h & mask].value();
+        std::optional<T> result(std::move(*value));
+        value->~T();
+        head.store(h + 1, std::memory_order_release);
+        not_full.notify_one();
+        return result;
+    }
+
+    // Producer only. Blocks while the queue is full.
+    template <typename U> void push(U&& value) {
+        for (uint32_t i = 0; i < EventCount::SPIN_COUNT; i++) {
+            if (try_push(std::forward<U>(value))) {
+                return;
+            }
+            EventCount::spin_pause();
+        }
+        while (!try_push(std::forward<U>(value))) {
+            const EventCount::Key key = not_full.prepare_wait();
+            if (!full()) {
+                not_full.cancel_wait();
+            } else {
+                not_full.wait(key);
+            }
+        }
+    }
+
+    // Consumer only. Blocks while the queue is empty.
+    T pop() {
+        for (uint32_t i = 0; i < EventCount::SPIN_COUNT; i++) {
+            if (std::optional<T> value = try_pop()) {
+                return std::move(*value);
+            }
+            EventCount::spin_pause();
+        }
+        while (true) {
+            if (std::optional<T> value = try_pop()) {
+                return std::move(*value);
+            }
+            const EventCount::Key key = not_empty.prepare_wait();
+            if (!empty()) {
+                not_empty.cancel_wait();
+            } else {
+                not_empty.wait(key);
+            }
+        }
+    }
+
+    // Approximate.
+    std::size_t size() const {
+        const std::size_t h = head.load(std::memory_order_acquire);
+        const std::size_t t = tail.load(std::memory_order_acquire);
+        return t - h;
+    }
+
+    // Approximate.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Approximate.
+    bool full() const {
+        return size() >= capacity;
+    }
+
+    std::size_t get_capacity() const {
+        return capacity;
+    }
+
+  private:
+    const std::size_t capacity;
+    const std::size_t mask;
+    const std::unique_ptr<Slot[]> slots;
+
+    // consumer
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> head{0};
+    std::size_t cached_tail = 0;
+
+    // producer
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> tail{0};
+    std::size_t cached_head = 0;
+
+    EventCount not_empty;
+    EventCount not_full;
+};
+
+} // namespace merian
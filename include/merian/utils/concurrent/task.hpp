@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace merian {
+
+// A move-only type-erased `void()` callable with small-buffer storage.
+//
+// Callables up to INLINE_SIZE bytes are stored inline and do not allocate. Unlike std::function
+// move-only callables (like std::packaged_task) are supported.
+class Task {
+  public:
+    static constexpr std::size_t INLINE_SIZE = 48;
+
+  private:
+    struct VTable {
+        void (*invoke)(void* storage);
+        // move constructs dst from src and destroys src.
+        void (*relocate)(void* dst, void* src);
+        void (*destroy)(void* storage);
+    };
+
+    template <typename F>
+    static constexpr bool is_inline = sizeof(F) <= INLINE_SIZE &&
+                                      alignof(F) <= alignof(std::max_align_t) &&
+                                      std::is_nothrow_move_constructible_v<F>;
+
+    template <typename F> static constexpr VTable inline_vtable = {
+        [](void* storage) { (*std::launder(static_cast<F*>(storage)))(); },
+        [](void* dst, void* src) {
+            F* f = std::launder(static_cast<F*>(src));
+            new (dst) F(std::move(*f));
+            f->~F();
+        },
+        [](void* storage) { std::launder(static_cast<F*>(storage))->~F(); },
+    };
+
+    template <typename F> static constexpr VTable heap_vtable = {
+        [](void* storage) { (**static_cast<F**>(storage))(); },
+        [](void* dst, void* src) { *static_cast<F**>(dst) = *static_cast<F**>(src); },
+        [](void* storage) { delete *static_cast<F**>(storage); },
+    };
+
+  public:
+    Task() {}
+
+    template <typename F,
+              typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task> &&
+                                          std::is_invocable_v<std::decay_t<F>&>>>
+    Task(F&& function) {
+        using Fn = std::decay_t<F>;
+        if constexpr (is_inline<Fn>) {
+            new (storage) Fn(std::forward<F>(function));
+            vtable = &inline_vtable<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(storage) = new Fn(std::forward<F>(function));
+            vtable = &heap_vtable<Fn>;
+        }
+    }
+
+    Task(const Task&) = delete;
+
+    Task(Task&& other) noexcept : vtable(other.vtable) {
+        if (vtable) {
+            vtable->relocate(storage, other.storage);
+            other.vtable = nullptr;
+        }
+    }
+
+    Task& operator=(const Task&) = delete;
+
+    Task& operator=(Task&& other) noexcept {
+        if (this == &other)
+            return *this;
+        reset();
+        if (other.vtable) {
+            other.vtable->relocate(storage, other.storage);
+            vtable = other.vtable;
+            other.vtable = nullptr;
+        }
+        return *this;
+    }
+
+    ~Task() {
+        reset();
+    }
+
+    void operator()() {
+        assert(vtable);
+        vtable->invoke(storage);
+    }
+
+    operator bool() const {
+        return vtable != nullptr;
+    }
+
+    void reset() {
+        if (vtable) {
+            vtable->destroy(storage);
+            vtable = nullptr;
+        }
+    }
+
+  private:
+    alignas(std::max_align_t) std::byte storage[INLINE_SIZE];
+    const VTable* vtable = nullptr;
+};
+
+} // namespace merian
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "merian/utils/concurrent/thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace merian {
+
+// A graph of CPU tasks with dependencies that is executed on a ThreadPool.
+//
+// Every task has a join counter that is initialized with its number of predecessors. When a task
+// finishes it decrements the counters of its successors. Successors that become ready are run
+// directly on the same thread (continuation) or submitted to the pool if more than one becomes
+// ready. The calling thread of run() participates. If tracing is enabled on the pool, every task
+// records a trace event with its name (nested in the "TaskGraph" event of the pool task that ran
+// it).
+//
+// The graph can be run multiple times. After each run the start and end times of all tasks are
+// available as well as the critical path (the chain of dependent tasks with the largest sum of
+// durations), which is the lower bound for the duration of a run regardless of the thread count.
+class TaskGraph {
+  public:
+    using TaskID = uint32_t;
+    using clock = std::chrono::high_resolution_clock;
+
+  private:
+    struct TaskInfo {
+        std::string name;
+        std::function<void()> function;
+        std::vector<TaskID> successors;
+        uint32_t predecessor_count = 0;
+
+        // instrumentation of the last run
+        clock::time_point start;
+        clock::time_point end;
+    };
+
+    // Per-run state, shared with the pool tasks.
+    struct RunState;
+
+  public:
+    TaskGraph() {}
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    // Adds a task and returns its ID.
+    TaskID add_task(const std::string& name, const std::function<void()>& function);
+
+    // "after" is run after "before" finished.
+    void add_dependency(const TaskID before, const TaskID after);
+
+    // Removes all tasks.
+    void clear();
+
+    std::size_t size() const {
+        return tasks.size();
+    }
+
+    bool empty() const {
+        return tasks.empty();
+    }
+
+    // Runs all tasks and blocks until all tasks are finished. If tasks throw the first exception
+    // is rethrown after all other tasks finished.
+    //
+    // The graph must be acyclic.
+    void run(ThreadPool& thread_pool);
+
+    // ---------------------------------------------------------------------------
+    // Instrumentation of the last run
+
+    const std::string& get_name(const TaskID task) const {
+        return tasks[task].name;
+    }
+
+    std::chrono::nanoseconds get_duration(const TaskID task) const {
+        return tasks[task].end - tasks[task].start;
+    }
+
+    // The tasks on the critical path of the last run, in execution order.
+    const std::vector<TaskID>& get_critical_path() const {
+        return critical_path;
+    }
+
+    // The sum of durations of the tasks on the critical path in the last run.
+    std::chrono::nanoseconds get_critical_path_duration() const {
+        return critical_path_duration;
+    }
+
+    // The sum of the durations of all tasks in the last run.
+    std::chrono::nanoseconds get_work_duration() const {
+        return work_duration;
+    }
+
+    // The wall time of the last run.
+    std::chrono::nanoseconds get_run_duration() const {
+        return run_duration;
+    }
+
+  private:
+    void execute(RunState& state, TaskID task);
+
+    void compute_critical_path();
+
+  private:
+    std::vector<TaskInfo> tasks;
+
+    std::vector<TaskID> critical_path;
+    std::chrono::nanoseconds critical_path_duration{0};
+    std::chrono::nanoseconds work_duration{0};
+    std::chrono::nanoseconds run_duration{0};
+};
+
+} // namespace merian
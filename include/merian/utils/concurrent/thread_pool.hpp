@@ -1,72 +1,346 @@
 #pragma once
 
-#include "merian/utils/concurrent/concurrent_queue.hpp"
+#include "merian/utils/concurrent/event_count.hpp"
+#include "merian/utils/concurrent/mpmc_queue.hpp"
+#include "merian/utils/concurrent/spsc_queue.hpp"
+#include "merian/utils/concurrent/task.hpp"
+#include "merian/utils/concurrent/work_stealing_deque.hpp"
+#include "merian/utils/properties.hpp"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <future>
-#include <optional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
 #include <thread>
 #include <vector>
 
 namespace merian {
 
+// A work-stealing thread pool.
+//
+// Every worker owns a Chase-Lev deque. Tasks that are submitted from a worker thread are pushed to
+// the worker's deque and executed LIFO by the worker, idle workers steal the oldest tasks from
+// other workers. Tasks that are submitted from other threads go into a global injection queue
+// (a lock-free ring with a locked overflow list) which is processed in FIFO order.
+//
+// Tasks have a priority. High priority tasks are taken before any other work, background tasks
+// only if no other work is available. Background tasks are never run by reserved workers (see
+// set_reserved_workers()) and by non-worker threads in run_pending_task(), such that long
+// running background jobs cannot delay latency-critical work. Tasks can be cancelled with a
+// std::stop_token or a deadline, they are skipped if they did not start before.
+//
+// Idle workers spin for a short time before parking. On destruction all pending tasks are run.
+//
+// The pool can optionally record statistics (submit to start latency, execution time, per-worker
+// utilization) and a trace event per task. Both are disabled by default and cost one relaxed load
+// per task in this case.
 class ThreadPool {
   public:
-    // concurrency sets the number of threads. queue_size controls the size of the task queue.
-    // While the task queue is full, submit blocks.
+    using clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t NO_WORKER = UINT32_MAX;
+
+    enum class Priority : uint32_t {
+        // latency-critical work, e.g. readback callbacks
+        HIGH,
+        NORMAL,
+        // long running jobs, e.g. encoding images, compiling shaders or loading assets
+        BACKGROUND,
+    };
+
+    static constexpr uint32_t PRIORITY_COUNT = 3;
+
+    // including the terminating null character
+    static constexpr uint32_t TRACE_NAME_SIZE = 32;
+
+    struct TaskOptions {
+        // shows up in traces, copied (truncated) at submission.
+        const char* name = nullptr;
+        Priority priority = Priority::NORMAL;
+        // the task is skipped if a stop was requested before it started. Long running tasks
+        // should additionally check the token themselves.
+        std::stop_token stop_token = {};
+        // the task is skipped if it did not start before the deadline.
+        clock::time_point deadline = clock::time_point::max();
+    };
+
+    // Recorded for every task while tracing is enabled.
+    struct TraceEvent {
+        // the (truncated) task name, "unnamed" if no name was supplied.
+        char name[TRACE_NAME_SIZE];
+        clock::time_point enqueued;
+        clock::time_point start;
+        clock::time_point end;
+        // NO_WORKER if the task was run by a non-worker thread in run_pending_task().
+        uint32_t worker;
+    };
+
+    // Cumulative since the pool was created. Latency and execution times are only accumulated
+    // while statistics are enabled.
+    struct Statistics {
+        uint64_t submitted = 0;
+        uint64_t executed = 0;
+        uint64_t stolen = 0;
+        // tasks that were skipped because they were cancelled or missed their deadline
+        uint64_t skipped = 0;
+        uint64_t dropped_trace_events = 0;
+        // tasks waiting for execution (approximate)
+        uint32_t queue_depth = 0;
+        // tasks waiting in the injection queue of each priority (approximate)
+        std::array<uint32_t, PRIORITY_COUNT> injected_depth{};
+
+        // sum over all timed tasks
+        std::chrono::nanoseconds latency{0};
+        std::chrono::nanoseconds max_latency{0};
+        // number of tasks that contribute to latency and busy
+        uint64_t timed = 0;
+        // time spent executing tasks per worker. The last entry accounts for non-worker threads.
+        std::vector<std::chrono::nanoseconds> busy;
+    };
+
+  private:
+    // A task together with its bookkeeping, this is what the queues store.
+    struct QueuedTask {
+        Task task;
+        std::stop_token stop_token;
+        clock::time_point deadline;
+        // only set if the pool was instrumented at submission.
+        clock::time_point enqueued;
+        // only set if tracing was enabled at submission, the name of the task can be freed as
+        // soon as it completed (it is not accessed after the task returned).
+        bool traced = false;
+        char name[TRACE_NAME_SIZE];
+    };
+
+    static constexpr uint32_t INJECTION_QUEUE_SIZE = 1024;
+
+    // The injection queue for one priority.
+    struct InjectionLane {
+        InjectionLane() : queue(INJECTION_QUEUE_SIZE) {}
+
+        MPMCQueue<QueuedTask*> queue;
+        // used when the queue is full. While the overflow list is not empty new tasks are
+        // appended here as well to keep the FIFO order.
+        std::mutex overflow_mutex;
+        std::deque<QueuedTask*> overflow;
+        // allows idle workers to check the overflow list without locking.
+        std::atomic<uint32_t> overflow_size{0};
+
+        void push(QueuedTask* task);
+
+        QueuedTask* pop();
+
+        bool empty() const;
+
+        uint32_t size() const;
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::atomic<uint64_t> skipped{0};
+        std::atomic<uint64_t> timed{0};
+        std::atomic<uint64_t> busy_ns{0};
+        std::atomic<uint64_t> latency_ns{0};
+        std::atomic<uint64_t> max_latency_ns{0};
+    };
+
+    static constexpr uint32_t TRACE_BUFFER_SIZE = 4096;
+
+    struct alignas(CACHE_LINE_SIZE) Worker {
+        Worker() : trace(TRACE_BUFFER_SIZE) {}
+
+        WorkStealingDeque<QueuedTask*> deque;
+        std::thread thread;
+        // written only by the worker itself
+        Counters counters;
+        // produced by the worker, consumed in collect_trace().
+        SPSCQueue<TraceEvent> trace;
+    };
+
+  public:
+    // concurrency sets the number of threads.
     ThreadPool(const uint32_t concurrency = std::thread::hardware_concurrency());
 
     ~ThreadPool();
 
     ThreadPool(ThreadPool& other) = delete;
 
-    ThreadPool(ThreadPool&& other) {
-        tasks = std::move(other.tasks);
-
-        for (uint32_t i = threads.size(); i < other.threads.size(); i++) {
-            threads.emplace_back([&] {
-                while (true) {
-                    const std::optional<std::function<void()>> task = tasks.pop();
-                    if (task) {
-                        task.value()();
-                    } else {
-                        return;
-                    }
-                }
-            });
-        }
-    }
+    ThreadPool(ThreadPool&& other) = delete;
 
     ThreadPool& operator=(const ThreadPool& src) = delete;
 
-    ThreadPool& operator=(ThreadPool&& src) {
-        if (this == &src)
-            return *this;
-        this->~ThreadPool();
-        new (this) ThreadPool(std::move(src));
-        return *this;
-    }
+    ThreadPool& operator=(ThreadPool&& src) = delete;
 
     uint32_t size();
 
-    template <typename T> std::future<T> submit(const std::function<T()>& function) {
-        std::shared_ptr<std::packaged_task<T()>> task =
-            std::make_shared<std::packaged_task<T()>>(function);
-        std::future<T> future = task->get_future();
-        tasks.push([task] { (*task)(); });
+    // The name shows up in traces, it is copied at submission.
+    template <typename T>
+    std::future<T> submit(const std::function<T()>& function, const char* name = nullptr) {
+        return submit<T>(function, TaskOptions{name});
+    }
+
+    // The name shows up in traces, it is copied at submission.
+    template <typename T>
+    std::future<T> submit(std::function<T()>&& function, const char* name = nullptr) {
+        return submit<T>(std::move(function), TaskOptions{name});
+    }
+
+    // If the task is skipped (cancelled or deadline missed) the future holds a
+    // std::future_error with broken_promise.
+    template <typename T>
+    std::future<T> submit(const std::function<T()>& function, const TaskOptions& options) {
+        std::packaged_task<T()> task(function);
+        std::future<T> future = task.get_future();
+        enqueue(Task(std::move(task)), options);
         return future;
     }
 
-    template <typename T> std::future<T> submit(const std::function<T()>&& function) {
-        std::shared_ptr<std::packaged_task<T()>> task =
-            std::make_shared<std::packaged_task<T()>>(function);
-        std::future<T> future = task->get_future();
-        tasks.push([task] { (*task)(); });
+    // If the task is skipped (cancelled or deadline missed) the future holds a
+    // std::future_error with broken_promise.
+    template <typename T>
+    std::future<T> submit(std::function<T()>&& function, const TaskOptions& options) {
+        std::packaged_task<T()> task(std::move(function));
+        std::future<T> future = task.get_future();
+        enqueue(Task(std::move(task)), options);
         return future;
     }
 
+    // Runs the function on the pool without creating a future. Exceptions must not escape the
+    // function.
+    template <typename F> void submit_detached(F&& function, const char* name = nullptr) {
+        enqueue(Task(std::forward<F>(function)), TaskOptions{name});
+    }
+
+    // Runs the function on the pool without creating a future. Exceptions must not escape the
+    // function. If the task is skipped the function is destroyed without being called.
+    template <typename F> void submit_detached(F&& function, const TaskOptions& options) {
+        enqueue(Task(std::forward<F>(function)), options);
+    }
+
+    // Runs one pending task on the calling thread, if there is one. Returns true if a task was run.
+    //
+    // Threads that wait for tasks of this pool should call this in their wait loop, this prevents
+    // deadlocks when waiting from inside a task.
+    bool run_pending_task();
+
+    // Returns true if the calling thread is a worker of this pool.
+    bool is_worker_thread() const;
+
+    // The first `count` workers do not run background tasks and stay available for normal and
+    // high priority work. Clamped such that at least one worker runs background tasks.
+    void set_reserved_workers(const uint32_t count);
+
+    uint32_t get_reserved_workers() const;
+
+    // ---------------------------------------------------------------------------
+    // Instrumentation
+
+    // Records a trace event on the calling thread for work that runs inside a task but should show
+    // up separately (e.g. continuations of a TaskGraph). The name is copied. Does nothing if
+    // tracing is disabled.
+    void add_trace_event(const char* name,
+                         const clock::time_point start,
+                         const clock::time_point end);
+
+    // Accumulate latency and execution times (two clock reads per task).
+    void set_statistics_enabled(const bool enable);
+
+    bool get_statistics_enabled() const;
+
+    // Record a trace event per task, implies statistics. Events are buffered per thread in
+    // fixed-size rings and dropped when a ring is full, call collect_trace() regularly.
+    void set_tracing_enabled(const bool enable);
+
+    bool get_tracing_enabled() const;
+
+    // Tasks waiting for execution (approximate).
+    uint32_t get_queue_depth();
+
+    Statistics get_statistics();
+
+    // Drains the per-thread trace buffers, appends the events to the trace history and returns
+    // them.
+    std::vector<TraceEvent> collect_trace();
+
+    // Collects and returns the last (up to max_trace_history) events.
+    std::vector<TraceEvent> get_trace_history();
+
+    void clear_trace_history();
+
+    // Collects and writes the trace history as Chrome trace event JSON (chrome://tracing,
+    // ui.perfetto.dev).
+    void write_chrome_trace(const std::string& filename);
+
+    // Live pool health and instrumentation settings.
+    void properties(Properties& props);
+
   private:
-    std::vector<std::thread> threads;
-    ConcurrentQueue<std::optional<std::function<void()>>> tasks;
+    void enqueue(Task&& task, const TaskOptions& options);
+
+    void worker_main(const uint32_t worker_index);
+
+    // Tries to find a task in the high priority queue, the worker's deque, the normal priority
+    // queue, the other workers' deques and the background queue (in this order). Set worker_index
+    // to NO_WORKER for non-worker threads.
+    QueuedTask* find_task(const uint32_t worker_index, uint32_t& rng_state);
+
+    bool may_run_background(const uint32_t worker_index) const;
+
+    // Returns true if there are tasks that the worker may run.
+    bool has_pending_tasks(const uint32_t worker_index);
+
+    // Runs (or skips) and deletes the task and records statistics and trace events if enabled.
+    void execute(QueuedTask* task, const uint32_t worker_index);
+
+    // Pushes to the trace buffer of the worker or the buffer for non-worker threads.
+    void push_trace_event(const TraceEvent& event, const uint32_t worker_index);
+
+    Counters& get_counters(const uint32_t worker_index) {
+        return worker_index == NO_WORKER ? external_counters : workers[worker_index]->counters;
+    }
+
+  private:
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // indexed by Priority
+    std::array<InjectionLane, PRIORITY_COUNT> lanes;
+    std::atomic<uint32_t> reserved_workers{0};
+
+    // parked workers wait here.
+    EventCount idle_workers;
+    std::atomic<bool> stop{false};
+
+    // --- Instrumentation ---
+
+    std::atomic<bool> statistics_enabled{false};
+    std::atomic<bool> tracing_enabled{false};
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> dropped_trace_events{0};
+    // tasks that non-worker threads run in run_pending_task()
+    Counters external_counters;
+    MPMCQueue<TraceEvent> external_trace;
+
+    std::mutex trace_mutex;
+    std::deque<TraceEvent> trace_history;
+    uint32_t max_trace_history = 1 << 16;
+    // time origin for exported traces
+    const clock::time_point created;
+
+    // for rates in properties()
+    Statistics last_statistics;
+    clock::time_point last_statistics_time;
+    std::vector<float> utilization;
+    float mean_latency_ms = 0;
+    float mean_execution_ms = 0;
+    float tasks_per_second = 0;
+    std::string trace_filename = "thread_pool_trace.json";
 };
 
 } // namespace merian
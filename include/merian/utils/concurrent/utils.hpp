@@ -2,49 +2,203 @@
 
 #include "merian/utils/concurrent/thread_pool.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <exception>
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace merian {
 
-// Run a function `count` times split into 'tasks' tasks.
-// The function gets the index [0,count) and the task index
-// [0,concurrency).
-inline void parallel_for(const uint32_t count,
-                         const std::function<void(uint32_t index, uint32_t thread_index)> function,
-                         ThreadPool& thread_pool,
-                         const uint32_t tasks = std::thread::hardware_concurrency()) {
+// Runs body(begin, end, thread_index) for chunks of [0, count) on the thread pool.
+//
+// The calling thread participates as thread_index 0 and up to `tasks - 1` helpers are submitted
+// to the pool, thread_index is in [0, tasks). Chunks are assigned dynamically with guided sizes
+// (large chunks first, then smaller ones down to min_chunk), which balances uneven workloads.
+//
+// The calling thread claims chunks like the helpers and only waits for chunks that helpers are
+// processing, it never runs unrelated tasks of the pool. Helpers that start after all chunks were
+// claimed return immediately, which makes calling this from a task of the same pool safe.
+//
+// The first exception thrown by body is rethrown on the calling thread, remaining chunks are
+// skipped in this case. The helpers are submitted with the given priority, with
+// Priority::BACKGROUND the calling thread might process all chunks if the pool is busy.
+template <typename F>
+void parallel_chunks(const uint32_t count,
+                     F&& body,
+                     ThreadPool& thread_pool,
+                     const uint32_t tasks = std::thread::hardware_concurrency(),
+                     const uint32_t min_chunk = 1,
+                     const ThreadPool::Priority priority = ThreadPool::Priority::NORMAL) {
     if (count == 0)
         return;
 
-    std::vector<std::future<void>> futures;
-    uint32_t real_concurrency = std::min(count, tasks);
-    uint32_t count_per_thread = (count + real_concurrency - 1) / real_concurrency;
+    const uint32_t participants = std::max(1u, std::min({count, tasks, thread_pool.size() + 1}));
+    if (participants == 1) {
+        body(0u, count, 0u);
+        return;
+    }
+
+    // Shared with the helpers, which may start after this function returned.
+    struct State {
+        // the chunk counter, >= count once all chunks are claimed
+        std::atomic<uint32_t> next{0};
+        // helpers that may still claim chunks or process one. A helper only accesses `work` (and
+        // with that the stack of the caller) while it is counted here.
+        std::atomic<uint32_t> active_helpers{0};
+        std::mutex mutex;
+        std::condition_variable cv_done;
+        std::exception_ptr exception;
+    };
+    const std::shared_ptr<State> state = std::make_shared<State>();
+
+    const uint32_t chunk_divisor = 2 * participants;
+    const auto work = [&](const uint32_t thread_index) {
+        uint32_t begin = state->next.load();
+        while (begin < count) {
+            const uint32_t chunk = std::max(min_chunk, (count - begin) / chunk_divisor);
+            const uint32_t end = count - begin > chunk ? begin + chunk : count;
+            if (!state->next.compare_exchange_weak(begin, end)) {
+                continue;
+            }
+
+            try {
+                body(begin, end, thread_index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->exception)
+                    state->exception = std::current_exception();
+                state->next.store(count);
+            }
+            begin = state->next.load();
+        }
+    };
 
-    for (uint32_t thread_index = 0; thread_index < real_concurrency; thread_index++) {
-        futures.emplace_back(
-            thread_pool.submit<void>([thread_index, count_per_thread, count, &function]() {
-                for (uint32_t index = thread_index * count_per_thread;
-                     index < std::min((thread_index + 1) * count_per_thread, count); index++) {
-                    function(index, thread_index);
+    for (uint32_t thread_index = 1; thread_index < participants; thread_index++) {
+        thread_pool.submit_detached(
+            [state, &work, count, thread_index] {
+                // Register before checking the counter (both sequentially consistent): either the
+                // caller sees this helper as active and waits, or the helper sees all chunks
+                // claimed and does not touch `work`.
+                state->active_helpers.fetch_add(1);
+                if (state->next.load() < count) {
+                    work(thread_index);
                 }
-            }));
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->active_helpers.fetch_sub(1) == 1) {
+                    state->cv_done.notify_one();
+                }
+            },
+            {"parallel_chunks", priority});
     }
 
-    for (auto& future : futures) {
-        future.get();
+    work(0);
+
+    // All chunks are claimed, wait only for the chunks that helpers are still processing.
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv_done.wait(lock, [&] { return state->active_helpers.load() == 0; });
+    lock.unlock();
+
+    if (state->exception) {
+        std::rethrow_exception(state->exception);
     }
 }
 
-// Run a function `count` times split into 'tasks' tasks.
+// Run a function `count` times split into at most 'tasks' tasks.
 // The function gets the index [0,count) and the task index
-// [0,concurrency).
-inline void parallel_for(const uint32_t count,
-                         const std::function<void(uint32_t index, uint32_t thread_index)> function,
-                         const uint32_t tasks = std::thread::hardware_concurrency()) {
-    ThreadPool thread_pool(std::thread::hardware_concurrency());
-    parallel_for(count, function, thread_pool, tasks);
+// [0,tasks). The calling thread participates as task 0.
+template <typename F>
+void parallel_for(const uint32_t count,
+                  F&& function,
+                  ThreadPool& thread_pool,
+                  const uint32_t tasks = std::thread::hardware_concurrency(),
+                  const ThreadPool::Priority priority = ThreadPool::Priority::NORMAL) {
+    parallel_chunks(
+        count,
+        [&function](const uint32_t begin, const uint32_t end, const uint32_t thread_index) {
+            for (uint32_t index = begin; index < end; index++) {
+                function(index, thread_index);
+            }
+        },
+        thread_pool, tasks, 1, priority);
+}
+
+// A process-wide pool for the overloads without pool argument. Prefer passing a pool explicitly
+// (e.g. Context::thread_pool) to not create additional threads.
+inline ThreadPool& get_default_thread_pool() {
+    static ThreadPool thread_pool;
+    return thread_pool;
+}
+
+// Run a function `count` times split into at most 'tasks' tasks.
+// The function gets the index [0,count) and the task index
+// [0,tasks).
+template <typename F>
+void parallel_for(const uint32_t count,
+                  F&& function,
+                  const uint32_t tasks = std::thread::hardware_concurrency()) {
+    parallel_for(count, std::forward<F>(function), get_default_thread_pool(), tasks);
+}
+
+// Computes reduce(... reduce(reduce(identity, map(0)), map(1)) ..., map(count - 1)) in parallel.
+//
+// reduce must be associative, the order of the reduction is unspecified.
+template <typename T, typename Map, typename Reduce>
+T parallel_reduce(const uint32_t count,
+                  const T& identity,
+                  Map&& map,
+                  Reduce&& reduce,
+                  ThreadPool& thread_pool,
+                  const uint32_t tasks = std::thread::hardware_concurrency()) {
+    std::vector<T> partial(std::max(1u, std::min({count, tasks, thread_pool.size() + 1})),
+                           identity);
+
+    parallel_chunks(
+        count,
+        [&](const uint32_t begin, const uint32_t end, const uint32_t thread_index) {
+            T accumulator = identity;
+            for (uint32_t index = begin; index < end; index++) {
+                accumulator = reduce(std::move(accumulator), map(index));
+            }
+            partial[thread_index] =
+                reduce(std::move(partial[thread_index]), std::move(accumulator));
+        },
+        thread_pool, tasks);
+
+    T result = identity;
+    for (T& value : partial) {
+        result = reduce(std::move(result), std::move(value));
+    }
+    return result;
+}
+
+// Parallel version of std::transform for random access iterators.
+template <typename InputIt, typename OutputIt, typename F>
+OutputIt parallel_transform(InputIt first,
+                            InputIt last,
+                            OutputIt out,
+                            F&& function,
+                            ThreadPool& thread_pool,
+                            const uint32_t tasks = std::thread::hardware_concurrency()) {
+    static_assert(std::random_access_iterator<InputIt> && std::random_access_iterator<OutputIt>);
+
+    const uint32_t count = std::distance(first, last);
+    parallel_chunks(
+        count,
+        [&](const uint32_t begin, const uint32_t end, const uint32_t /*thread_index*/) {
+            std::transform(first + begin, first + end, out + begin, std::ref(function));
+        },
+        thread_pool, tasks);
+
+    return out + count;
 }
 
 } // namespace merian
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "merian/utils/concurrent/cache_line.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace merian {
+
+// A Chase-Lev work-stealing deque, following "Correct and Efficient Work-Stealing for Weak Memory
+// Models" (Lê et al., 2013).
+//
+// Only the owning thread may call push() and pop() (LIFO), any thread may call steal() (FIFO). The
+// deque grows when full, retired buffers are kept until the deque is destroyed since thieves might
+// still read from them.
+//
+// T must be trivially copyable (typically a pointer).
+template <typename T> class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    struct Buffer {
+        Buffer(const int64_t capacity)
+            : capacity(capacity), mask(capacity - 1),
+              items(std::make_unique<std::atomic<T>[]>(capacity)) {
+            assert((capacity & mask) == 0 && "capacity must be a power of two");
+        }
+
+        T get(const int64_t index) const {
+            return items[index & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(const int64_t index, const T item) {
+            items[index & mask].store(item, std::memory_order_relaxed);
+        }
+
+        const int64_t capacity;
+        const int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+  public:
+    WorkStealingDeque(const int64_t initial_capacity = 256) {
+        buffers.emplace_back(std::make_unique<Buffer>(initial_capacity));
+        buffer.store(buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only.
+    void push(const T item) {
+        const int64_t b = bottom.load(std::memory_order_relaxed);
+        const int64_t t = top.load(std::memory_order_acquire);
+        Buffer* a = buffer.load(std::memory_order_relaxed);
+
+        if (b - t > a->capacity - 1) {
+            a = grow(a, b, t);
+        }
+
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only.
+    std::optional<T> pop() {
+        const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* a = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        std::optional<T> item = a->get(b);
+        if (t == b) {
+            // last item, race against thieves
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed)) {
+                item.reset();
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        return item;
+    }
+
+    // Any thread. Returns std::nullopt if the deque is empty or if the steal lost a race.
+    std::optional<T> steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return std::nullopt;
+        }
+
+        // consume ordering is promoted to acquire by all compilers anyway.
+        const Buffer* a = buffer.load(std::memory_order_acquire);
+        const T item = a->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+
+        return item;
+    }
+
+    // Approximate, any thread.
+    bool empty() const {
+        const int64_t t = top.load(std::memory_order_relaxed);
+        const int64_t b = bottom.load(std::memory_order_relaxed);
+        return b <= t;
+    }
+
+    // Approximate, any thread.
+    std::size_t size() const {
+        const int64_t t = top.load(std::memory_order_relaxed);
+        const int64_t b = bottom.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+  private:
+    Buffer* grow(const Buffer* old, const int64_t b, const int64_t t) {
+        std::unique_ptr<Buffer> grown = std::make_unique<Buffer>(old->capacity * 2);
+        for (int64_t i = t; i < b; i++) {
+            grown->put(i, old->get(i));
+        }
+        Buffer* a = grown.get();
+        buffers.emplace_back(std::move(grown));
+        buffer.store(a, std::memory_order_release);
+        return a;
+    }
+
+  private:
+    // on different cache lines to prevent false sharing between owner and thieves.
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> top{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> bottom{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<Buffer*> buffer;
+
+    // owner only, keeps retired buffers alive.
+    std::vector<std::unique_ptr<Buffer>> buffers;
+};
+
+} // namespace merian
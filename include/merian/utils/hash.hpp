@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 
@@ -25,6 +26,17 @@ template <typename... Types> std::size_t hash_val(const Types&... args) {
 }
 //--------------
 
+// 64 bit FNV-1a of the bytes. Pass the result of a previous call as seed to continue a hash.
+inline uint64_t hash_fnv1a(const void* data,
+                           const std::size_t size,
+                           uint64_t seed = 0xcbf29ce484222325ull) {
+    const std::byte* bytes = static_cast<const std::byte*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+        seed = (seed ^ (uint64_t)bytes[i]) * 0x100000001b3ull;
+    }
+    return seed;
+}
+
 template <typename T> std::size_t hash_aligned_8(const T& v) {
     const std::size_t size = sizeof(T) / sizeof(uint8_t);
     const uint8_t* v_bits = reinterpret_cast<const uint8_t*>(&v);
@@ -27,6 +27,8 @@ class ShaderModule;
 using ShaderModuleHandle = std::shared_ptr<ShaderModule>;
 class ShaderCompiler;
 using ShaderCompilerHandle = std::shared_ptr<ShaderCompiler>;
+class LayoutCache;
+using LayoutCacheHandle = std::shared_ptr<LayoutCache>;
 
 /* Initializes the Vulkan instance and device and holds core objects.
  *
@@ -236,6 +238,9 @@ class Context : public std::enable_shared_from_this<Context> {
     // A shader compiler with default include paths for convenience.
     ShaderCompilerHandle shader_compiler;
 
+    // Deduplicates descriptor set and pipeline layouts, used by the layout builders.
+    LayoutCacheHandle layout_cache;
+
   private:
     // in find_queues. Indexes are -1 if no suitable queue was found!
 
@@ -277,4 +282,5 @@ class Context : public std::enable_shared_from_this<Context> {
 
 #include "merian/vk/command/command_pool.hpp"
 #include "merian/vk/command/queue.hpp"
+#include "merian/vk/pipeline/layout_cache.hpp"
 #include "merian/vk/shader/shader_compiler.hpp"
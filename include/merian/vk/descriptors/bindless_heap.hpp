@@ -0,0 +1,205 @@
+#pragma once
+
+#include "merian/utils/properties.hpp"
+#include "merian/vk/context.hpp"
+#include "merian/vk/descriptors/descriptor_set.hpp"
+#include "merian/vk/memory/resource_allocations.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace merian {
+
+class BindlessHeap;
+using BindlessHeapHandle = std::shared_ptr<BindlessHeap>;
+
+/**
+ * @brief      A context-wide descriptor set that holds textures and storage buffers by index.
+ *
+ * The set uses descriptor indexing with update-after-bind and partially bound bindings:
+ *  - binding BINDING_TEXTURES: array of combined image samplers
+ *  - binding BINDING_BUFFERS: array of storage buffers
+ *
+ * The ResourceAllocator registers textures (of sampled images) and storage buffers on creation.
+ * They keep their index for their whole lifetime (Texture::get_bindless_index(),
+ * Buffer::get_bindless_index()), use the helpers in merian-shaders/textures.glsl to access them in
+ * shaders. Textures must be in vk::ImageLayout::eShaderReadOnlyOptimal when accessed through the
+ * heap.
+ *
+ * Texture::set_sampler() keeps the index. The descriptor of the slot cannot be rewritten while
+ * pending command buffers might use it, the new sampler is therefore recorded per slot and written
+ * with apply_pending_updates() when no work that uses the heap is pending. Until then the slot
+ * keeps the previous sampler (which is kept alive). The graph applies the updates before an
+ * iteration after waiting for the iterations in flight.
+ *
+ * The descriptor range of a buffer is clamped to maxStorageBufferRange, larger buffers are only
+ * accessible up to that size through the heap.
+ *
+ * Indices of destroyed resources are not reused immediately since in-flight command buffers might
+ * still reference them. Similar to the StagingMemoryManager, the indices that were freed since the
+ * last call to finalize_release_set() are recycled when release_set() is called with the returned
+ * SetID, i.e. after the GPU finished the work that was submitted in the meantime. The graph does
+ * that automatically for each iteration.
+ */
+class BindlessHeap : public std::enable_shared_from_this<BindlessHeap> {
+  public:
+    static constexpr uint32_t INVALID_INDEX = ~0u;
+    static constexpr uint32_t BINDING_TEXTURES = 0;
+    static constexpr uint32_t BINDING_BUFFERS = 1;
+
+    class SetID {
+        friend BindlessHeap;
+
+      private:
+        uint64_t id = 0;
+    };
+
+  public:
+    BindlessHeap(const BindlessHeap&) = delete;
+    BindlessHeap& operator=(const BindlessHeap&) = delete;
+
+    // The capacities are clamped to the update-after-bind limits of the device.
+    BindlessHeap(const ContextHandle& context,
+                 const uint32_t max_textures = 1 << 16,
+                 const uint32_t max_buffers = 1 << 16);
+
+    ~BindlessHeap();
+
+    // Returns true if the features required for the heap are supported.
+    static bool is_supported(const Context::FeaturesContainer& supported);
+
+    // Enables the features required for the heap.
+    static void enable_features(Context::FeaturesContainer& enable);
+
+    // ---------------------------------------------------------------------------
+
+    const DescriptorSetLayoutHandle& get_descriptor_set_layout() const {
+        return layout;
+    }
+
+    // Bind this set at the set index that you use for MERIAN_BINDLESS_SET in your shaders. The set
+    // can stay bound, new textures and buffers are written with update-after-bind.
+    const DescriptorSetHandle& get_descriptor_set() const {
+        return set;
+    }
+
+    // ---------------------------------------------------------------------------
+
+    // Assigns an index to the texture and writes its descriptor. Returns INVALID_INDEX (and logs a
+    // warning) if the heap is full. Normally called by the ResourceAllocator.
+    uint32_t register_texture(const TextureHandle& texture);
+
+    // Assigns an index to the buffer and writes its descriptor. Returns INVALID_INDEX (and logs a
+    // warning) if the heap is full. Normally called by the ResourceAllocator.
+    //
+    // The range of the descriptor is clamped to maxStorageBufferRange.
+    uint32_t register_buffer(const BufferHandle& buffer);
+
+    // Schedules a rewrite of the descriptor of a registered texture, e.g. if the sampler changed.
+    // The texture keeps its index, the descriptor is written with apply_pending_updates().
+    // previous_sampler is the sampler the texture had before (kept alive until the rewrite).
+    void update_texture(const Texture& texture, const SamplerHandle& previous_sampler);
+
+    // Returns true if descriptor rewrites are waiting for apply_pending_updates().
+    bool has_pending_updates() const {
+        return pending_update_count.load(std::memory_order_relaxed) > 0;
+    }
+
+    // Writes the scheduled descriptors. You need to ensure that the GPU does not access the heap
+    // while this is called, e.g. by waiting for all submits that used it.
+    void apply_pending_updates();
+
+    // ---------------------------------------------------------------------------
+
+    // Closes the batch of indices that were freed since the last call.
+    SetID finalize_release_set();
+
+    // Recycles the indices of this set. You need to ensure that the GPU does not access them
+    // anymore, e.g. by waiting for a fence of a submit that happened after finalize_release_set().
+    void release_set(const SetID set_id);
+
+    // ---------------------------------------------------------------------------
+
+    uint32_t get_max_textures() const {
+        return textures.capacity;
+    }
+
+    uint32_t get_max_buffers() const {
+        return buffers.capacity;
+    }
+
+    void properties(Properties& props);
+
+  private:
+    friend Texture;
+    friend Buffer;
+
+    // Called by Texture and Buffer on destruction.
+    void free_texture(const uint32_t index);
+    void free_buffer(const uint32_t index);
+
+    void write_texture(const vk::ImageView view, const Sampler& sampler, const uint32_t index);
+
+  private:
+    struct SlotAllocator {
+        uint32_t capacity = 0;
+        // all indices >= next_unused have never been used.
+        uint32_t next_unused = 0;
+        std::vector<uint32_t> free_indices;
+        uint32_t live = 0;
+        uint32_t pending = 0;
+
+        uint32_t allocate() {
+            uint32_t index;
+            if (!free_indices.empty()) {
+                index = free_indices.back();
+                free_indices.pop_back();
+            } else if (next_unused < capacity) {
+                index = next_unused++;
+            } else {
+                return INVALID_INDEX;
+            }
+            live++;
+            return index;
+        }
+    };
+
+    struct ReleaseSet {
+        std::vector<uint32_t> textures;
+        std::vector<uint32_t> buffers;
+        // samplers of descriptors that pending command buffers might still use
+        std::vector<SamplerHandle> samplers;
+    };
+
+    // A descriptor rewrite that waits for apply_pending_updates().
+    struct PendingTextureUpdate {
+        vk::ImageView view;
+        SamplerHandle sampler;
+        // the sampler that is still in the descriptor
+        SamplerHandle previous_sampler;
+    };
+
+    const ContextHandle context;
+
+    DescriptorSetLayoutHandle layout;
+    DescriptorPoolHandle pool;
+    DescriptorSetHandle set;
+
+    vk::DeviceSize max_storage_buffer_range;
+
+    std::mutex mutex;
+    SlotAllocator textures;
+    SlotAllocator buffers;
+
+    // by index
+    std::unordered_map<uint32_t, PendingTextureUpdate> pending_texture_updates;
+    std::atomic<uint32_t> pending_update_count{0};
+
+    ReleaseSet current_release_set;
+    std::unordered_map<uint64_t, ReleaseSet> release_sets;
+    uint64_t next_set_id = 1;
+};
+
+} // namespace merian
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "merian/utils/properties.hpp"
+#include "merian/vk/context.hpp"
+#include "merian/vk/descriptors/descriptor_set.hpp"
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace merian {
+
+class DescriptorAllocator;
+using DescriptorAllocatorHandle = std::shared_ptr<DescriptorAllocator>;
+
+/**
+ * @brief      Allocates descriptor sets from growable chains of pools.
+ *
+ * Layouts with the same "shape" (the descriptor counts per type) share a chain of pools. If all
+ * pools of a chain are full, a new pool with twice the capacity of the last pool is added (up to
+ * max_sets_per_pool).
+ *
+ * Destroyed sets are not freed but cached by layout and handed out again for the same layout. When
+ * all sets of a pool are destroyed, the whole pool is reset and can be used for any layout of the
+ * same shape.
+ *
+ * Sets of push descriptor layouts cannot be allocated.
+ */
+class DescriptorAllocator : public std::enable_shared_from_this<DescriptorAllocator> {
+  private:
+    struct Pool {
+        DescriptorPoolHandle pool;
+        uint32_t capacity;
+        // sets allocated from the pool since the last reset (in use and cached).
+        uint32_t allocated = 0;
+        // sets that are currently handed out.
+        uint32_t in_use = 0;
+        bool full = false;
+    };
+
+    struct Shape {
+        VkDescriptorPoolCreateFlags flags;
+        std::vector<std::pair<vk::DescriptorType, uint32_t>> sizes;
+
+        bool operator<(const Shape& other) const {
+            return std::tie(flags, sizes) < std::tie(other.flags, other.sizes);
+        }
+    };
+
+    struct CachedSet {
+        Pool* pool;
+        vk::DescriptorSet set;
+    };
+
+    struct LayoutCache {
+        // keep the layout alive, sets of destroyed layouts cannot be updated.
+        DescriptorSetLayoutHandle layout;
+        std::vector<CachedSet> sets;
+    };
+
+  public:
+    DescriptorAllocator(const DescriptorAllocator&) = delete;
+    DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+    DescriptorAllocator(const ContextHandle& context,
+                        const uint32_t initial_sets_per_pool = 8,
+                        const uint32_t max_sets_per_pool = 512);
+
+    ~DescriptorAllocator();
+
+    // Returns a set for the layout. The set is returned to the allocator when the last reference
+    // is dropped.
+    DescriptorSetHandle allocate(const DescriptorSetLayoutHandle& layout);
+
+    // Destroys all pools that have no sets in use.
+    void trim();
+
+    // ---------------------------------------------------------------------------
+
+    // The number of pools that are currently alive.
+    uint32_t get_pool_count() const;
+
+    // The number of sets that are currently handed out.
+    uint32_t get_set_count() const;
+
+    // The number of sets that are cached for reuse.
+    uint32_t get_cached_set_count() const;
+
+    void properties(Properties& props);
+
+  private:
+    // Called by the deleter of the handles returned by allocate().
+    void recycle(const DescriptorSetLayoutHandle& layout, Pool* pool, const vk::DescriptorSet set);
+
+    void reset_pool(Pool& pool);
+
+    static Shape shape_for_layout(const DescriptorSetLayoutHandle& layout);
+
+  private:
+    const ContextHandle context;
+    const uint32_t initial_sets_per_pool;
+    const uint32_t max_sets_per_pool;
+
+    mutable std::mutex mutex;
+    std::map<Shape, std::vector<std::unique_ptr<Pool>>> pools_for_shape;
+    std::unordered_map<const DescriptorSetLayout*, LayoutCache> cached_sets;
+
+    uint32_t pool_count = 0;
+    uint32_t set_count = 0;
+    uint32_t cached_set_count = 0;
+
+    // statistics
+    uint64_t pool_resets = 0;
+    uint64_t reused_sets = 0;
+    uint64_t allocated_sets = 0;
+};
+
+} // namespace merian
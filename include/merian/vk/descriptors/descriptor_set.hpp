@@ -45,7 +45,35 @@ class DescriptorSet : public std::enable_shared_from_this<DescriptorSet> {
         set = allocate_descriptor_set(*pool->get_context(), *pool, *pool->get_layout());
     }
 
+    // Wraps a set that was allocated from pool with the supplied layout. The set is not freed on
+    // destruction, this is used for sets that are managed by a DescriptorAllocator.
+    DescriptorSet(const std::shared_ptr<DescriptorPool>& pool,
+                  const DescriptorSetLayoutHandle& layout,
+                  const vk::DescriptorSet& set)
+        : pool(pool), layout(layout), set(set), owns_set(false) {
+        SPDLOG_DEBUG("create DescriptorSet ({}) for externally managed set", fmt::ptr(this));
+    }
+
+    // Creates a push descriptor set for a layout that was created with the
+    // vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR flag. No vk::DescriptorSet is
+    // allocated, instead DescriptorSetUpdate writes into the push data of this set and the
+    // descriptors are pushed into the command buffer in Pipeline::bind_descriptor_set.
+    DescriptorSet(const DescriptorSetLayoutHandle& layout)
+        : layout(layout), push_data(layout->get_template_data_size()) {
+        assert(layout->is_push_descriptor_layout());
+        SPDLOG_DEBUG("create push DescriptorSet ({})", fmt::ptr(this));
+    }
+
     ~DescriptorSet() {
+        if (!pool) {
+            // push descriptor set, nothing to free.
+            return;
+        }
+        if (!owns_set) {
+            SPDLOG_DEBUG("destroy DescriptorSet ({}), the set is managed externally",
+                         fmt::ptr(this));
+            return;
+        }
         if (pool->get_create_flags() & vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet) {
             // DescriptorSet can be given back to the DescriptorPool
             SPDLOG_DEBUG("freeing DescriptorSet ({})", fmt::ptr(this));
@@ -82,10 +110,27 @@ class DescriptorSet : public std::enable_shared_from_this<DescriptorSet> {
         return layout->get_bindings()[binding].descriptorType;
     }
 
+    bool is_push_descriptor_set() const {
+        return !pool;
+    }
+
+    // For push descriptor sets: The descriptor data in the layout of the layout's update template
+    // entries. Empty for regular sets.
+    std::byte* get_push_data() {
+        return push_data.data();
+    }
+
+    const std::byte* get_push_data() const {
+        return push_data.data();
+    }
+
   private:
     const std::shared_ptr<DescriptorPool> pool;
     const std::shared_ptr<DescriptorSetLayout> layout;
     vk::DescriptorSet set;
+    const bool owns_set = true;
+
+    std::vector<std::byte> push_data;
 };
 
 using DescriptorSetHandle = std::shared_ptr<DescriptorSet>;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "merian/vk/context.hpp"
+#include "merian/vk/sampler/sampler.hpp"
 #include <spdlog/spdlog.h>
 #include <vector>
 #include <vulkan/vulkan.hpp>
@@ -11,16 +12,61 @@ namespace merian {
 class DescriptorSetLayout : public std::enable_shared_from_this<DescriptorSetLayout> {
 
   public:
+    // binding_flags can be empty, else it must contain the flags for each binding (e.g. to enable
+    // update-after-bind and partially bound bindings for descriptor indexing).
+    //
+    // immutable_samplers are kept alive as long as the layout. Supply the samplers that are
+    // referenced by pImmutableSamplers of the bindings here.
     DescriptorSetLayout(const ContextHandle& context,
                         const std::vector<vk::DescriptorSetLayoutBinding>& bindings,
-                        const vk::DescriptorSetLayoutCreateFlags flags = {})
-        : context(context), bindings(bindings) {
+                        const vk::DescriptorSetLayoutCreateFlags flags = {},
+                        const std::vector<vk::DescriptorBindingFlags>& binding_flags = {},
+                        const std::vector<SamplerHandle>& immutable_samplers = {})
+        : context(context), bindings(bindings), flags(flags), binding_flags(binding_flags),
+          immutable_samplers(immutable_samplers) {
+        assert(binding_flags.empty() || binding_flags.size() == bindings.size());
         vk::DescriptorSetLayoutCreateInfo info{flags, bindings};
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info{binding_flags};
+        if (!binding_flags.empty()) {
+            info.setPNext(&binding_flags_info);
+        }
         SPDLOG_DEBUG("create DescriptorSetLayout ({})", fmt::ptr(this));
         layout = context->device.createDescriptorSetLayout(info);
+
+        // Pack all descriptors tightly into one byte buffer. This layout is used by
+        // DescriptorSetUpdate as shadow copy and can be directly applied using the update template.
+        template_entries.reserve(bindings.size());
+        binding_descriptor_offsets.reserve(bindings.size());
+        for (const auto& binding : bindings) {
+            const std::size_t stride = template_stride_for_type(binding.descriptorType);
+            template_entries.emplace_back(binding.binding, 0, binding.descriptorCount,
+                                          binding.descriptorType, template_data_size, stride);
+            binding_descriptor_offsets.emplace_back(descriptor_count);
+
+            const std::size_t size =
+                binding.descriptorType == vk::DescriptorType::eInlineUniformBlock
+                    ? binding.descriptorCount
+                    : stride * binding.descriptorCount;
+            // keep everything 8 byte aligned, all descriptor infos consist of 64 bit members.
+            template_data_size += (size + 7) & ~std::size_t(7);
+            descriptor_count += binding.descriptorCount;
+        }
+
+        // Created here and not on first use, such that sets of this layout can be updated from
+        // multiple threads.
+        if (!is_push_descriptor_layout() && !template_entries.empty()) {
+            SPDLOG_DEBUG("create DescriptorUpdateTemplate ({})", fmt::ptr(this));
+            vk::DescriptorUpdateTemplateCreateInfo info{
+                {}, template_entries, vk::DescriptorUpdateTemplateType::eDescriptorSet, layout};
+            update_template = context->device.createDescriptorUpdateTemplate(info);
+        }
     }
 
     ~DescriptorSetLayout() {
+        if (update_template) {
+            SPDLOG_DEBUG("destroy DescriptorUpdateTemplate ({})", fmt::ptr(this));
+            context->device.destroyDescriptorUpdateTemplate(update_template);
+        }
         SPDLOG_DEBUG("destroy DescriptorSetLayout ({})", fmt::ptr(this));
         context->device.destroyDescriptorSetLayout(layout);
     }
@@ -45,10 +91,95 @@ class DescriptorSetLayout : public std::enable_shared_from_this<DescriptorSetLay
         return bindings[binding].descriptorType;
     }
 
+    const vk::DescriptorSetLayoutCreateFlags& get_create_flags() const {
+        return flags;
+    }
+
+    // Empty if no binding flags were supplied.
+    const std::vector<vk::DescriptorBindingFlags>& get_binding_flags() const {
+        return binding_flags;
+    }
+
+    // Sets with this layout are not allocated from a pool but pushed into the command buffer.
+    bool is_push_descriptor_layout() const {
+        return static_cast<bool>(flags & vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR);
+    }
+
+    // Returns a descriptor update template that updates all bindings of a set with this layout
+    // from a packed buffer of size get_template_data_size(). Null if the layout has no bindings.
+    //
+    // Not available for push descriptor layouts, use PipelineLayout::get_push_descriptor_template
+    // instead.
+    //
+    // The entries of the template are returned by get_template_entries(), the data for
+    // (binding, array_element) is located at entry.offset + array_element * entry.stride.
+    const vk::DescriptorUpdateTemplate& get_update_template() const {
+        assert(!is_push_descriptor_layout());
+        return update_template;
+    }
+
+    const std::vector<vk::DescriptorUpdateTemplateEntry>& get_template_entries() const {
+        return template_entries;
+    }
+
+    // The size in bytes of the data that is consumed by the update template.
+    std::size_t get_template_data_size() const {
+        return template_data_size;
+    }
+
+    // The total number of descriptors (the sum of the descriptor counts of all bindings).
+    uint32_t get_descriptor_count() const {
+        return descriptor_count;
+    }
+
+    // The index of the first descriptor of this binding when enumerating all descriptors of the
+    // layout (all array elements of binding 0, then binding 1,...).
+    uint32_t get_descriptor_offset(uint32_t binding) const {
+        return binding_descriptor_offsets[binding];
+    }
+
+  public:
+    // The size of the data for one descriptor in an update template.
+    static std::size_t template_stride_for_type(const vk::DescriptorType type) {
+        switch (type) {
+        case vk::DescriptorType::eSampler:
+        case vk::DescriptorType::eCombinedImageSampler:
+        case vk::DescriptorType::eSampledImage:
+        case vk::DescriptorType::eStorageImage:
+        case vk::DescriptorType::eInputAttachment:
+            return sizeof(vk::DescriptorImageInfo);
+        case vk::DescriptorType::eUniformBuffer:
+        case vk::DescriptorType::eStorageBuffer:
+        case vk::DescriptorType::eUniformBufferDynamic:
+        case vk::DescriptorType::eStorageBufferDynamic:
+            return sizeof(vk::DescriptorBufferInfo);
+        case vk::DescriptorType::eUniformTexelBuffer:
+        case vk::DescriptorType::eStorageTexelBuffer:
+            return sizeof(vk::BufferView);
+        case vk::DescriptorType::eAccelerationStructureKHR:
+            return sizeof(vk::AccelerationStructureKHR);
+        case vk::DescriptorType::eInlineUniformBlock:
+            // descriptorCount is the size in bytes, stride is ignored.
+            return 1;
+        default:
+            throw std::runtime_error{
+                fmt::format("descriptor type {} not supported", vk::to_string(type))};
+        }
+    }
+
   private:
     const ContextHandle context;
     const std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    const vk::DescriptorSetLayoutCreateFlags flags;
+    const std::vector<vk::DescriptorBindingFlags> binding_flags;
+    const std::vector<SamplerHandle> immutable_samplers;
     vk::DescriptorSetLayout layout;
+
+    std::vector<vk::DescriptorUpdateTemplateEntry> template_entries;
+    std::vector<uint32_t> binding_descriptor_offsets;
+    std::size_t template_data_size = 0;
+    uint32_t descriptor_count = 0;
+    vk::DescriptorUpdateTemplate update_template;
 };
 using DescriptorSetLayoutHandle = std::shared_ptr<DescriptorSetLayout>;
 
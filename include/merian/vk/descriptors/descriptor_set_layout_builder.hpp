@@ -115,6 +115,27 @@ class DescriptorSetLayoutBuilder {
         return *this;
     }
 
+    // Binds one immutable sampler per descriptor. The layout keeps the samplers alive and can
+    // therefore be deduplicated by the layout cache (raw vk::Sampler pointers are not).
+    DescriptorSetLayoutBuilder&
+    add_binding_sampler(vk::ShaderStageFlags stage_flags,
+                        const std::vector<SamplerHandle>& immutable_samplers,
+                        std::optional<uint32_t> binding = std::nullopt) {
+        add_binding(stage_flags, vk::DescriptorType::eSampler, immutable_samplers, binding);
+        return *this;
+    }
+
+    // Binds one immutable sampler per descriptor. The layout keeps the samplers alive and can
+    // therefore be deduplicated by the layout cache (raw vk::Sampler pointers are not).
+    DescriptorSetLayoutBuilder&
+    add_binding_combined_sampler(vk::ShaderStageFlags stage_flags,
+                                 const std::vector<SamplerHandle>& immutable_samplers,
+                                 std::optional<uint32_t> binding = std::nullopt) {
+        add_binding(stage_flags, vk::DescriptorType::eCombinedImageSampler, immutable_samplers,
+                    binding);
+        return *this;
+    }
+
     DescriptorSetLayoutBuilder& add_binding_acceleration_structure(
         vk::ShaderStageFlags stage_flags = vk::ShaderStageFlagBits::eCompute,
         uint32_t descriptor_count = 1,
@@ -153,6 +174,18 @@ class DescriptorSetLayoutBuilder {
         return *this;
     }
 
+    // Adds a binding with one immutable sampler per descriptor.
+    DescriptorSetLayoutBuilder& add_binding(vk::ShaderStageFlags stage_flags,
+                                            vk::DescriptorType descriptor_type,
+                                            const std::vector<SamplerHandle>& immutable_samplers,
+                                            std::optional<uint32_t> binding = std::nullopt) {
+        const uint32_t binding_index = binding.value_or(next_free_binding());
+        add_binding(stage_flags, descriptor_type, static_cast<uint32_t>(immutable_samplers.size()),
+                    nullptr, binding_index);
+        this->immutable_samplers[binding_index] = immutable_samplers;
+        return *this;
+    }
+
     DescriptorSetLayoutBuilder& add_binding(const std::vector<vk::DescriptorSetLayoutBinding>& bindings) {
         for (const auto& binding : bindings) {
             add_binding(binding);
@@ -168,24 +201,52 @@ class DescriptorSetLayoutBuilder {
         }
 #endif
         bindings[binding.binding] = binding;
+        immutable_samplers.erase(binding.binding);
         return *this;
     }
 
     // --------------------------------------------------------------------------------------------------------------------
 
+    // Returns the sum of the descriptor counts of all bindings.
+    uint32_t descriptor_count() const {
+        uint32_t count = 0;
+        for (const auto& [_, binding] : bindings) {
+            count += binding.descriptorCount;
+        }
+        return count;
+    }
+
     // Requires that there is a binding from 0 to num_bindings-1.
     // Return a shared ptr since many descriptor sets may have a reference on this.
+    //
+    // Identical layouts are deduplicated using the layout cache of the context.
     DescriptorSetLayoutHandle build_layout(const ContextHandle& context,
                                            const vk::DescriptorSetLayoutCreateFlags flags = {}) {
 
         std::vector<vk::DescriptorSetLayoutBinding> sorted_bindings(bindings.size());
 
+        // vk::Sampler arrays for pImmutableSamplers, only needed during layout creation.
+        std::vector<std::vector<vk::Sampler>> sampler_arrays;
+        sampler_arrays.reserve(immutable_samplers.size());
+        std::vector<SamplerHandle> sampler_handles;
+
         for (uint32_t i = 0; i < bindings.size(); i++) {
             assert(bindings.contains(i));
             sorted_bindings[i] = bindings[i];
+
+            const auto it = immutable_samplers.find(i);
+            if (it != immutable_samplers.end()) {
+                std::vector<vk::Sampler>& samplers = sampler_arrays.emplace_back();
+                for (const SamplerHandle& sampler : it->second) {
+                    samplers.emplace_back(sampler->get_sampler());
+                    sampler_handles.emplace_back(sampler);
+                }
+                sorted_bindings[i].pImmutableSamplers = samplers.data();
+            }
         }
 
-        return make_shared<DescriptorSetLayout>(context, std::move(sorted_bindings), flags);
+        return context->layout_cache->acquire_descriptor_set_layout(context, sorted_bindings,
+                                                                    flags, {}, sampler_handles);
     }
 
     // --------------------------------------------------------------------------------------------------------------------
@@ -203,6 +264,8 @@ class DescriptorSetLayoutBuilder {
 
   private:
     std::map<uint32_t, vk::DescriptorSetLayoutBinding> bindings;
+    // binding -> one sampler per descriptor, for bindings added with SamplerHandles.
+    std::map<uint32_t, std::vector<SamplerHandle>> immutable_samplers;
 };
 
 } // namespace merian
@@ -3,6 +3,7 @@
 #include "merian/vk/descriptors/descriptor_set.hpp"
 #include "merian/vk/memory/resource_allocations.hpp"
 
+#include <cstring>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -16,14 +17,24 @@ namespace merian {
 // The binding type is automatically determined using the DescriptorSets and the binding index.
 // However, you can use the *_type methods if you want to overwrite the type.
 //
-// From the spec: The operations described by pDescriptorWrites are performed first, followed by the
-// operations described by pDescriptorCopies. Within each array, the operations are performed in the
-// order they appear in the array.
+// Writes are recorded into a packed shadow copy of the set that is laid out as expected by the
+// update template of the DescriptorSetLayout. Recording does not allocate (except for the first
+// time a texture is kept alive). The shadow copy persists across next() calls with the same set,
+// so once every descriptor was written, update() applies the whole set with a single
+// updateDescriptorSetWithTemplate instead of building vk::WriteDescriptorSet structures. If only
+// few descriptors changed (or not all descriptors were written yet) only the changed descriptors
+// are written using vk::WriteDescriptorSets that point into the shadow copy.
+//
+// If the same descriptor is written multiple times before update() the last write wins.
+//
+// For push descriptor sets update() only copies the changed descriptors into the set's push data,
+// which is then pushed when the set is bound to a pipeline.
 class DescriptorSetUpdate {
 
   public:
     DescriptorSetUpdate(const std::shared_ptr<DescriptorSet> set) : set(set) {
         assert(set);
+        reset_shadow();
     }
 
     // Bind `buffer` at the binding point `binding` of DescriptorSet `set`.
@@ -51,25 +62,21 @@ class DescriptorSetUpdate {
     }
 
     // Bind `buffer` at the binding point `binding` of DescriptorSet `set`.
-    // The type is automatically determined from the set using the binding index.
+    // The type must match the type of the binding in the layout.
     DescriptorSetUpdate&
     write_descriptor_buffer_type(const uint32_t binding,
                                  const vk::Buffer& buffer,
-                                 const vk::DescriptorType type = vk::DescriptorType::eStorageBuffer,
+                                 [[maybe_unused]] const vk::DescriptorType type =
+                                     vk::DescriptorType::eStorageBuffer,
                                  const vk::DeviceSize offset = 0,
                                  const vk::DeviceSize range = VK_WHOLE_SIZE,
                                  const uint32_t dst_array_element = 0,
                                  const uint32_t descriptor_count = 1) {
-        write_buffer_infos.emplace_back(
-            std::make_unique<vk::DescriptorBufferInfo>(buffer, offset, range));
-        vk::WriteDescriptorSet write{*set,
-                                     binding,
-                                     dst_array_element,
-                                     descriptor_count,
-                                     type,
-                                     {},
-                                     write_buffer_infos.back().get()};
-        writes.push_back(write);
+        assert(type == set->get_type_for_binding(binding));
+        const vk::DescriptorBufferInfo info{buffer, offset, range};
+        for (uint32_t i = 0; i < descriptor_count; i++) {
+            write_shadow(binding, dst_array_element + i, info);
+        }
         return *this;
     }
 
@@ -79,19 +86,11 @@ class DescriptorSetUpdate {
         const vk::AccelerationStructureKHR& acceleration_structure,
         const uint32_t dst_array_element = 0,
         const uint32_t descriptor_count = 1) {
-        write_acceleration_structures.emplace_back(
-            std::make_unique<vk::WriteDescriptorSetAccelerationStructureKHR>(
-                1, &acceleration_structure));
-        vk::WriteDescriptorSet write{*set,
-                                     binding,
-                                     dst_array_element,
-                                     descriptor_count,
-                                     vk::DescriptorType::eAccelerationStructureKHR,
-                                     {},
-                                     {},
-                                     {},
-                                     write_acceleration_structures.back().get()};
-        writes.push_back(write);
+        assert(set->get_type_for_binding(binding) ==
+               vk::DescriptorType::eAccelerationStructureKHR);
+        for (uint32_t i = 0; i < descriptor_count; i++) {
+            write_shadow(binding, dst_array_element + i, acceleration_structure);
+        }
         return *this;
     }
 
@@ -126,66 +125,190 @@ class DescriptorSetUpdate {
     }
 
     // Bind `sampler` at the binding point `binding` of DescriptorSet `set`.
+    // The type must match the type of the binding in the layout.
     DescriptorSetUpdate&
     write_descriptor_image_type(const uint32_t binding,
-                                const vk::DescriptorType type,
+                                [[maybe_unused]] const vk::DescriptorType type,
                                 const vk::ImageView& view,
                                 const vk::ImageLayout& image_layout = vk::ImageLayout::eGeneral,
                                 const vk::Sampler& sampler = {},
                                 const uint32_t dst_array_element = 0,
                                 const uint32_t descriptor_count = 1) {
-        write_image_infos.emplace_back(
-            std::make_unique<vk::DescriptorImageInfo>(sampler, view, image_layout));
-        vk::WriteDescriptorSet write{*set,
-                                     binding,
-                                     dst_array_element,
-                                     descriptor_count,
-                                     type,
-                                     write_image_infos.back().get()};
-        writes.push_back(write);
-
+        assert(type == set->get_type_for_binding(binding));
+        const vk::DescriptorImageInfo info{sampler, view, image_layout};
+        for (uint32_t i = 0; i < descriptor_count; i++) {
+            write_shadow(binding, dst_array_element + i, info);
+        }
         return *this;
     }
 
+    // The number of descriptors that are written on update().
     uint32_t count() const noexcept {
-        return writes.size();
+        return dirty.size();
     }
 
     bool empty() const noexcept {
-        return writes.empty();
+        return dirty.empty();
     }
 
     // Updates the vk::DescriptorSet immediately (!) to point to the configured resources.
     void update(ContextHandle context) {
-        assert(writes.size() == write_buffer_infos.size() + write_image_infos.size() +
-                                    write_acceleration_structures.size());
-        context->device.updateDescriptorSets(writes, {});
+        if (dirty.empty()) {
+            return;
+        }
+
+        const DescriptorSetLayoutHandle& layout = set->get_layout();
+        if (set->is_push_descriptor_set()) {
+            for (const auto& [binding, array_element] : dirty) {
+                const vk::DescriptorUpdateTemplateEntry& entry =
+                    layout->get_template_entries()[binding];
+                const std::size_t offset = entry.offset + (array_element * entry.stride);
+                std::memcpy(set->get_push_data() + offset, shadow.data() + offset, entry.stride);
+            }
+        } else if (written_count == layout->get_descriptor_count() &&
+                   dirty.size() * 4 >= layout->get_descriptor_count()) {
+            // Templates always write every descriptor, only use them if all descriptors are valid
+            // and a considerable amount of descriptors changed (e.g. not for a single texture in a
+            // large texture array).
+            context->device.updateDescriptorSetWithTemplate(
+                *set, layout->get_update_template(), static_cast<const void*>(shadow.data()));
+        } else {
+            // reserve, such that the pointers in writes stay valid.
+            write_acceleration_structures.clear();
+            write_acceleration_structures.reserve(dirty.size());
+            writes.clear();
+            for (const auto& [binding, array_element] : dirty) {
+                const vk::DescriptorUpdateTemplateEntry& entry =
+                    layout->get_template_entries()[binding];
+                const std::byte* data = shadow_data(entry, array_element);
+
+                vk::WriteDescriptorSet& write = writes.emplace_back(
+                    *set, binding, array_element, 1, entry.descriptorType);
+                switch (entry.descriptorType) {
+                case vk::DescriptorType::eUniformBuffer:
+                case vk::DescriptorType::eStorageBuffer:
+                case vk::DescriptorType::eUniformBufferDynamic:
+                case vk::DescriptorType::eStorageBufferDynamic:
+                    write.setPBufferInfo(reinterpret_cast<const vk::DescriptorBufferInfo*>(data));
+                    break;
+                case vk::DescriptorType::eUniformTexelBuffer:
+                case vk::DescriptorType::eStorageTexelBuffer:
+                    write.setPTexelBufferView(reinterpret_cast<const vk::BufferView*>(data));
+                    break;
+                case vk::DescriptorType::eAccelerationStructureKHR:
+                    write.setPNext(&write_acceleration_structures.emplace_back(
+                        1, reinterpret_cast<const vk::AccelerationStructureKHR*>(data)));
+                    break;
+                default:
+                    write.setPImageInfo(reinterpret_cast<const vk::DescriptorImageInfo*>(data));
+                }
+            }
+            context->device.updateDescriptorSets(writes, {});
+        }
+
+        for (const auto& [binding, array_element] : dirty) {
+            descriptor_state[layout->get_descriptor_offset(binding) + array_element] &=
+                ~(DIRTY | FIRST_WRITE);
+        }
+        dirty.clear();
+        applied.clear();
     }
 
     // Start a new update. If set == nullptr then the current set is reused.
+    //
+    // When reusing the set, the shadow copy is kept and only descriptors that are written after
+    // this call are applied in the next update(). Writes that were not applied are discarded, the
+    // shadow copy is rolled back to the values of the last update().
     void next(const std::shared_ptr<DescriptorSet> set = nullptr) {
-        if (set)
+        textures.clear();
+
+        if (set && set != this->set) {
             this->set = set;
+            reset_shadow();
+            return;
+        }
 
-        writes.clear();
-        write_buffer_infos.clear();
-        write_image_infos.clear();
-        write_acceleration_structures.clear();
-        textures.clear();
+        const DescriptorSetLayoutHandle& layout = this->set->get_layout();
+        const std::byte* applied_data = applied.data();
+        for (const auto& [binding, array_element] : dirty) {
+            const vk::DescriptorUpdateTemplateEntry& entry =
+                layout->get_template_entries()[binding];
+            std::memcpy(shadow_data(entry, array_element), applied_data, entry.stride);
+            applied_data += entry.stride;
+
+            uint8_t& state =
+                descriptor_state[layout->get_descriptor_offset(binding) + array_element];
+            if ((state & FIRST_WRITE) != 0) {
+                state &= ~WRITTEN;
+                written_count--;
+            }
+            state &= ~(DIRTY | FIRST_WRITE);
+        }
+        dirty.clear();
+        applied.clear();
+    }
+
+  private:
+    static constexpr uint8_t WRITTEN = 0b1;
+    static constexpr uint8_t DIRTY = 0b10;
+    // the dirty descriptor was not written before, next() clears WRITTEN.
+    static constexpr uint8_t FIRST_WRITE = 0b100;
+
+    void reset_shadow() {
+        const DescriptorSetLayoutHandle& layout = set->get_layout();
+        shadow.assign(layout->get_template_data_size(), std::byte{0});
+        descriptor_state.assign(layout->get_descriptor_count(), 0);
+        written_count = 0;
+        dirty.clear();
+        applied.clear();
+    }
+
+    std::byte* shadow_data(const vk::DescriptorUpdateTemplateEntry& entry,
+                           const uint32_t array_element) {
+        return shadow.data() + entry.offset + (array_element * entry.stride);
+    }
+
+    template <typename T>
+    void write_shadow(const uint32_t binding, const uint32_t array_element, const T& info) {
+        const DescriptorSetLayoutHandle& layout = set->get_layout();
+        const vk::DescriptorUpdateTemplateEntry& entry = layout->get_template_entries()[binding];
+        assert(array_element < entry.descriptorCount);
+        assert(entry.stride == sizeof(T));
+
+        std::byte* data = shadow_data(entry, array_element);
+        uint8_t& state = descriptor_state[layout->get_descriptor_offset(binding) + array_element];
+        if ((state & DIRTY) == 0) {
+            // keep the applied value to roll back in next()
+            applied.insert(applied.end(), data, data + sizeof(T));
+            dirty.emplace_back(binding, array_element);
+            state |= DIRTY;
+            if ((state & WRITTEN) == 0) {
+                written_count++;
+                state |= WRITTEN | FIRST_WRITE;
+            }
+        }
+
+        std::memcpy(data, &info, sizeof(T));
     }
 
   private:
     std::shared_ptr<DescriptorSet> set;
 
-    std::vector<vk::WriteDescriptorSet> writes;
     std::vector<TextureHandle> textures;
 
-    // vk::WriteDescriptorSet takes pointers. We must ensure that these stay valid until update() ->
-    // use unique ptrs
-    std::vector<std::unique_ptr<vk::DescriptorBufferInfo>> write_buffer_infos;
-    std::vector<std::unique_ptr<vk::DescriptorImageInfo>> write_image_infos;
-    std::vector<std::unique_ptr<vk::WriteDescriptorSetAccelerationStructureKHR>>
-        write_acceleration_structures;
+    // packed descriptor infos as expected by the layout's update template.
+    std::vector<std::byte> shadow;
+    // WRITTEN | DIRTY | FIRST_WRITE for each descriptor of the layout
+    std::vector<uint8_t> descriptor_state;
+    uint32_t written_count = 0;
+    // (binding, array element) of each descriptor that changed since the last update.
+    std::vector<std::pair<uint32_t, uint32_t>> dirty;
+    // the shadow data of the dirty descriptors as of the last update, in the order of dirty.
+    std::vector<std::byte> applied;
+
+    // Only used if not updating with the template. Kept to reuse the memory.
+    std::vector<vk::WriteDescriptorSet> writes;
+    std::vector<vk::WriteDescriptorSetAccelerationStructureKHR> write_acceleration_structures;
 };
 
 } // namespace merian
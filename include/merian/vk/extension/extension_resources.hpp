@@ -10,6 +10,8 @@ namespace merian {
  * @brief      Convenience extension that initializes an memory and resource allocator.
  *
  * The extension automatically enables commonly used features (like device address) if available.
+ * If the device supports the required descriptor indexing features, a BindlessHeap is created and
+ * attached to the resource allocator.
  */
 class ExtensionResources : public Extension {
   public:
@@ -26,10 +28,15 @@ class ExtensionResources : public Extension {
     void on_context_created(const ContextHandle& context) override;
     void on_destroy_context() override;
 
+    std::map<std::string, std::string> shader_macro_definitions() override;
+
     std::shared_ptr<MemoryAllocator> memory_allocator();
     std::shared_ptr<ResourceAllocator> resource_allocator();
     std::shared_ptr<SamplerPool> sampler_pool();
     std::shared_ptr<StagingMemoryManager> staging();
+    // nullptr if the features for bindless descriptors are not supported.
+    std::shared_ptr<BindlessHeap> bindless_heap();
+    std::shared_ptr<DescriptorAllocator> descriptor_allocator();
 
   private:
     std::weak_ptr<Context> weak_context;
@@ -37,11 +44,14 @@ class ExtensionResources : public Extension {
     // Both filled depending on device features and supported extensions.
     std::vector<const char*> required_extensions;
     VmaAllocatorCreateFlags flags{};
+    bool bindless_supported = false;
 
     std::weak_ptr<MemoryAllocator> _memory_allocator;
     std::weak_ptr<ResourceAllocator> _resource_allocator;
     std::weak_ptr<SamplerPool> _sampler_pool;
     std::weak_ptr<StagingMemoryManager> _staging;
+    std::weak_ptr<BindlessHeap> _bindless_heap;
+    std::weak_ptr<DescriptorAllocator> _descriptor_allocator;
 };
 
 } // namespace merian
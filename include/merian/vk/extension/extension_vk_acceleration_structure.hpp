@@ -2,6 +2,8 @@
 
 #include "merian/vk/extension/extension.hpp"
 
+#include <array>
+
 namespace merian {
 
 /**
@@ -27,7 +29,8 @@ class ExtensionVkAccelerationStructure : public Extension {
     void
     on_physical_device_selected(const Context::PhysicalDeviceContainer& pd_container) override {
         vk::PhysicalDeviceProperties2KHR props2;
-        props2.pNext = &acceleration_structure_properties;
+        id_properties.pNext = &acceleration_structure_properties;
+        props2.pNext = &id_properties;
         pd_container.physical_device.getProperties2(&props2);
     }
 
@@ -49,9 +52,23 @@ class ExtensionVkAccelerationStructure : public Extension {
         return acceleration_structure_properties.minAccelerationStructureScratchOffsetAlignment;
     }
 
+    // Whether acceleration structures can be built, copied and (de)serialized on the host. This
+    // feature is enabled if supported.
+    bool supports_host_commands() const {
+        return acceleration_structure_features.accelerationStructureHostCommands == VK_TRUE;
+    }
+
+    // Identifies the driver, serialized acceleration structures are only compatible with the same
+    // driver.
+    const std::array<uint8_t, VK_UUID_SIZE>& get_driver_uuid() const {
+        return id_properties.driverUUID;
+    }
+
   private:
     vk::PhysicalDeviceAccelerationStructureFeaturesKHR acceleration_structure_features;
 
+    vk::PhysicalDeviceIDProperties id_properties;
+
   public:
     vk::PhysicalDeviceAccelerationStructurePropertiesKHR acceleration_structure_properties;
 };
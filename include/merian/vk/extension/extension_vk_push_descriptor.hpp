@@ -13,6 +13,21 @@ class ExtensionVkPushDescriptor : public Extension {
     required_device_extension_names(vk::PhysicalDevice) const override {
         return {VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME};
     }
+
+    void
+    on_physical_device_selected(const Context::PhysicalDeviceContainer& pd_container) override {
+        vk::PhysicalDeviceProperties2KHR props2;
+        props2.pNext = &push_descriptor_properties;
+        pd_container.physical_device.getProperties2(&props2);
+    }
+
+    // The maximum number of descriptors that can be used in a push descriptor set layout.
+    const uint32_t& max_push_descriptors() const {
+        return push_descriptor_properties.maxPushDescriptors;
+    }
+
+  public:
+    vk::PhysicalDevicePushDescriptorPropertiesKHR push_descriptor_properties;
 };
 
 } // namespace merian
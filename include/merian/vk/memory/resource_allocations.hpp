@@ -18,8 +18,10 @@ class MemoryAllocation;
 using MemoryAllocationHandle = std::shared_ptr<MemoryAllocation>;
 class Buffer;
 using BufferHandle = std::shared_ptr<Buffer>;
+class BindlessHeap;
 
 class Buffer : public std::enable_shared_from_this<Buffer> {
+    friend BindlessHeap;
 
   public:
     constexpr static vk::BufferUsageFlags SCRATCH_BUFFER_USAGE =
@@ -81,6 +83,12 @@ class Buffer : public std::enable_shared_from_this<Buffer> {
 
     BufferHandle create_aliasing_buffer();
 
+    // The index of this buffer in the BindlessHeap of the ResourceAllocator or ~0u if the buffer
+    // is not registered.
+    uint32_t get_bindless_index() const noexcept {
+        return bindless_index;
+    }
+
     // Return a suitable vk::BufferMemoryBarrier.
     [[nodiscard]] vk::BufferMemoryBarrier
     buffer_barrier(const vk::AccessFlags src_access_flags,
@@ -106,6 +114,10 @@ class Buffer : public std::enable_shared_from_this<Buffer> {
     const vk::Buffer buffer;
     const MemoryAllocationHandle memory;
     const vk::BufferCreateInfo create_info;
+
+    // set by BindlessHeap::register_buffer
+    std::shared_ptr<BindlessHeap> bindless_heap;
+    uint32_t bindless_index = ~0u;
 };
 
 class Image;
@@ -282,6 +294,8 @@ class Image : public std::enable_shared_from_this<Image> {
  *  to keep the internal state valid.
  */
 class Texture : public std::enable_shared_from_this<Texture> {
+    friend BindlessHeap;
+
   public:
     Texture(const vk::ImageView& view, const ImageHandle& image, const SamplerHandle& sampler);
 
@@ -326,8 +340,16 @@ class Texture : public std::enable_shared_from_this<Texture> {
         return vk::DescriptorImageInfo{*get_sampler(), view, image->get_current_layout()};
     }
 
+    // If the texture is registered in the BindlessHeap, it keeps its index and the descriptor is
+    // rewritten when no pending work uses the heap (see BindlessHeap::update_texture()).
     void set_sampler(const SamplerHandle& sampler);
 
+    // The index of this texture in the BindlessHeap of the ResourceAllocator or ~0u if the texture
+    // is not registered. Note that the heap expects vk::ImageLayout::eShaderReadOnlyOptimal.
+    uint32_t get_bindless_index() const noexcept {
+        return bindless_index;
+    }
+
     // -----------------------------------------------------------
 
     void properties(Properties& props);
@@ -336,6 +358,10 @@ class Texture : public std::enable_shared_from_this<Texture> {
     const vk::ImageView view;
     const ImageHandle image;
     SamplerHandle sampler;
+
+    // set by BindlessHeap::register_texture
+    std::shared_ptr<BindlessHeap> bindless_heap;
+    uint32_t bindless_index = ~0u;
 };
 
 using TextureHandle = std::shared_ptr<Texture>;
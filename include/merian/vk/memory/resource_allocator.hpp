@@ -1,5 +1,7 @@
 #pragma once
 
+#include "merian/vk/descriptors/bindless_heap.hpp"
+#include "merian/vk/descriptors/descriptor_allocator.hpp"
 #include "merian/vk/extension/extension_vk_debug_utils.hpp"
 #include "merian/vk/memory/memory_allocator.hpp"
 #include "merian/vk/memory/resource_allocations.hpp"
@@ -19,6 +21,9 @@ namespace merian {
 //
 // Debug names are forwarded to the memory allocator. If NDEBUG is not defined the debug are
 // attempted to be set using the debug extension.
+//
+// If a BindlessHeap is supplied, textures of sampled images and storage buffers are registered in
+// the heap on creation. If no DescriptorAllocator is supplied, a new one is created.
 class ResourceAllocator : public std::enable_shared_from_this<ResourceAllocator> {
   public:
     ResourceAllocator(ResourceAllocator const&) = delete;
@@ -28,7 +33,9 @@ class ResourceAllocator : public std::enable_shared_from_this<ResourceAllocator>
     ResourceAllocator(const ContextHandle& context,
                       const std::shared_ptr<MemoryAllocator>& memAllocator,
                       const StagingMemoryManagerHandle staging,
-                      const SamplerPoolHandle& samplerPool);
+                      const SamplerPoolHandle& samplerPool,
+                      const BindlessHeapHandle& bindless_heap = nullptr,
+                      const DescriptorAllocatorHandle& descriptor_allocator = nullptr);
 
     // All staging buffers must be cleared before
     virtual ~ResourceAllocator() {
@@ -180,7 +187,8 @@ class ResourceAllocator : public std::enable_shared_from_this<ResourceAllocator>
     AccelerationStructureHandle
     createAccelerationStructure(const vk::AccelerationStructureTypeKHR type,
                                 const vk::AccelerationStructureBuildSizesInfoKHR& size_info,
-                                const std::string& debug_name = {});
+                                const std::string& debug_name = {},
+                                const MemoryMappingType mapping_type = MemoryMappingType::NONE);
 
     //--------------------------------------------------------------------------------------------------
 
@@ -192,6 +200,16 @@ class ResourceAllocator : public std::enable_shared_from_this<ResourceAllocator>
         return m_samplerPool;
     }
 
+    // Can be nullptr if the features for the heap are not supported.
+    const BindlessHeapHandle& get_bindless_heap() const {
+        return bindless_heap;
+    }
+
+    // Use this allocator for descriptor sets instead of creating pools for each set.
+    const DescriptorAllocatorHandle& get_descriptor_allocator() const {
+        return descriptor_allocator;
+    }
+
     //--------------------------------------------------------------------------------------------------
 
   protected:
@@ -199,6 +217,8 @@ class ResourceAllocator : public std::enable_shared_from_this<ResourceAllocator>
     const std::shared_ptr<MemoryAllocator> m_memAlloc;
     const StagingMemoryManagerHandle m_staging;
     const SamplerPoolHandle m_samplerPool;
+    const BindlessHeapHandle bindless_heap;
+    const DescriptorAllocatorHandle descriptor_allocator;
     const std::shared_ptr<ExtensionVkDebugUtils> debug_utils;
 
     TextureHandle dummy_texture;
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "merian/utils/properties.hpp"
+#include "merian/vk/context.hpp"
+
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace merian {
+
+// forward definitions, this header is included by context.hpp
+class DescriptorSetLayout;
+using DescriptorSetLayoutHandle = std::shared_ptr<DescriptorSetLayout>;
+class PipelineLayout;
+using PipelineLayoutHandle = std::shared_ptr<PipelineLayout>;
+class Sampler;
+using SamplerHandle = std::shared_ptr<Sampler>;
+
+/**
+ * @brief      Deduplicates DescriptorSetLayouts and PipelineLayouts by their structure.
+ *
+ * Similar to the SamplerPool only weak references are held, meaning a layout is destroyed when it
+ * is not used anymore and recreated on the next request. Identical layouts that are requested
+ * while another one is alive return the same object, which makes pipelines that are created with
+ * builders compatible and lets DescriptorAllocator reuse sets across reconnects.
+ *
+ * Immutable samplers are compared by their SamplerHandle, which the cache entry keeps alive, such
+ * that a new sampler that reuses the handle value of a destroyed one cannot match. Layouts with
+ * immutable samplers that are not supplied as SamplerHandle are not deduplicated.
+ *
+ * A shared instance is available as Context::layout_cache, the builders use it automatically.
+ */
+class LayoutCache : public std::enable_shared_from_this<LayoutCache> {
+  private:
+    struct DescriptorSetLayoutKey {
+        VkDescriptorSetLayoutCreateFlags flags;
+        // (binding, type, count, stage flags)
+        std::vector<std::tuple<uint32_t, vk::DescriptorType, uint32_t, VkShaderStageFlags>>
+            bindings;
+        std::vector<SamplerHandle> immutable_samplers;
+        std::vector<VkDescriptorBindingFlags> binding_flags;
+
+        bool operator==(const DescriptorSetLayoutKey&) const = default;
+    };
+
+    struct DescriptorSetLayoutKeyHash {
+        std::size_t operator()(const DescriptorSetLayoutKey& key) const;
+    };
+
+    struct PipelineLayoutKey {
+        VkPipelineLayoutCreateFlags flags;
+        // set layouts are compared by identity. They are deduplicated as well and kept alive by
+        // the pipeline layout.
+        std::vector<const DescriptorSetLayout*> set_layouts;
+        // (stage flags, offset, size)
+        std::vector<std::tuple<VkShaderStageFlags, uint32_t, uint32_t>> ranges;
+
+        bool operator==(const PipelineLayoutKey&) const = default;
+    };
+
+    struct PipelineLayoutKeyHash {
+        std::size_t operator()(const PipelineLayoutKey& key) const;
+    };
+
+  public:
+    LayoutCache(const LayoutCache&) = delete;
+    LayoutCache& operator=(const LayoutCache&) = delete;
+
+    LayoutCache();
+
+    ~LayoutCache();
+
+    // Returns an existing layout with the same structure or creates a new one.
+    //
+    // immutable_samplers must contain the samplers that are referenced by pImmutableSamplers of
+    // the bindings, otherwise a new layout is created that does not take part in deduplication.
+    DescriptorSetLayoutHandle acquire_descriptor_set_layout(
+        const ContextHandle& context,
+        const std::vector<vk::DescriptorSetLayoutBinding>& bindings,
+        const vk::DescriptorSetLayoutCreateFlags flags = {},
+        const std::vector<vk::DescriptorBindingFlags>& binding_flags = {},
+        const std::vector<SamplerHandle>& immutable_samplers = {});
+
+    // Returns an existing layout with the same structure or creates a new one.
+    PipelineLayoutHandle
+    acquire_pipeline_layout(const ContextHandle& context,
+                            const std::vector<DescriptorSetLayoutHandle>& descriptor_set_layouts,
+                            const std::vector<vk::PushConstantRange>& ranges = {},
+                            const vk::PipelineLayoutCreateFlags flags = {});
+
+    // ---------------------------------------------------------------------------
+
+    // The number of requests that returned an existing layout instead of creating a new one.
+    uint64_t get_deduplicated_count() const;
+
+    void properties(Properties& props);
+
+  private:
+    // removes expired entries from time to time.
+    void cleanup();
+
+  private:
+    mutable std::mutex mutex;
+
+    std::unordered_map<DescriptorSetLayoutKey,
+                       std::weak_ptr<DescriptorSetLayout>,
+                       DescriptorSetLayoutKeyHash>
+        descriptor_set_layouts;
+    std::unordered_map<PipelineLayoutKey, std::weak_ptr<PipelineLayout>, PipelineLayoutKeyHash>
+        pipeline_layouts;
+
+    uint64_t created_descriptor_set_layouts = 0;
+    uint64_t created_pipeline_layouts = 0;
+    uint64_t deduplicated_descriptor_set_layouts = 0;
+    uint64_t deduplicated_pipeline_layouts = 0;
+    uint32_t inserts_since_cleanup = 0;
+};
+
+using LayoutCacheHandle = std::shared_ptr<LayoutCache>;
+
+} // namespace merian
@@ -34,9 +34,17 @@ class Pipeline : public std::enable_shared_from_this<Pipeline> {
         cmd.bindPipeline(get_pipeline_bind_point(), pipeline);
     }
 
+    // Push descriptor sets (DescriptorSet::is_push_descriptor_set()) are pushed instead.
     void bind_descriptor_set(const vk::CommandBuffer& cmd,
                              const std::shared_ptr<DescriptorSet>& descriptor_set,
                              const uint32_t first_set = 0) {
+        if (descriptor_set->is_push_descriptor_set()) {
+            cmd.pushDescriptorSetWithTemplateKHR(
+                pipeline_layout->get_push_descriptor_template(first_set, get_pipeline_bind_point()),
+                *pipeline_layout, first_set,
+                static_cast<const void*>(descriptor_set->get_push_data()));
+            return;
+        }
         cmd.bindDescriptorSets(get_pipeline_bind_point(), *pipeline_layout, first_set, 1,
                                &**descriptor_set, 0, nullptr);
     }
@@ -4,6 +4,8 @@
 #include "merian/vk/descriptors/descriptor_set_layout.hpp"
 
 #include "vulkan/vulkan.hpp"
+#include <map>
+#include <mutex>
 #include <spdlog/spdlog.h>
 
 namespace merian {
@@ -30,6 +32,9 @@ class PipelineLayout : public std::enable_shared_from_this<PipelineLayout> {
     }
 
     ~PipelineLayout() {
+        for (const auto& [key, update_template] : push_descriptor_templates) {
+            context->device.destroyDescriptorUpdateTemplate(update_template);
+        }
         SPDLOG_DEBUG("destroy PipelineLayout ({})", fmt::ptr(this));
         context->device.destroyPipelineLayout(pipeline_layout);
     }
@@ -51,11 +56,50 @@ class PipelineLayout : public std::enable_shared_from_this<PipelineLayout> {
         return ranges[id];
     }
 
+    const std::shared_ptr<DescriptorSetLayout>& get_descriptor_set_layout(uint32_t set) const {
+        assert(set < shared_descriptor_set_layouts.size());
+        return shared_descriptor_set_layouts[set];
+    }
+
+    // Returns a update template to push the descriptors of a push descriptor set at `set`. The
+    // template consumes the push data of a DescriptorSet (see DescriptorSet::get_push_data()).
+    // Created on first use, thread-safe.
+    //
+    // Requires the VK_KHR_push_descriptor extension (see ExtensionVkPushDescriptor).
+    const vk::DescriptorUpdateTemplate&
+    get_push_descriptor_template(const uint32_t set, const vk::PipelineBindPoint bind_point) {
+        const auto key = std::make_pair(set, bind_point);
+        // references into the map stay valid on insert, the lock is only needed for the lookup.
+        std::lock_guard<std::mutex> lock(push_descriptor_templates_mutex);
+        const auto it = push_descriptor_templates.find(key);
+        if (it != push_descriptor_templates.end()) {
+            return it->second;
+        }
+
+        const std::shared_ptr<DescriptorSetLayout>& layout = get_descriptor_set_layout(set);
+        assert(layout->is_push_descriptor_layout());
+        SPDLOG_DEBUG("create push DescriptorUpdateTemplate for set {} ({})", set, fmt::ptr(this));
+        const vk::DescriptorUpdateTemplateCreateInfo info{
+            {},
+            layout->get_template_entries(),
+            vk::DescriptorUpdateTemplateType::ePushDescriptorsKHR,
+            layout->get_layout(),
+            bind_point,
+            pipeline_layout,
+            set};
+        return push_descriptor_templates[key] =
+                   context->device.createDescriptorUpdateTemplate(info);
+    }
+
   private:
     const ContextHandle context;
     const std::vector<vk::PushConstantRange> ranges;
     const std::vector<std::shared_ptr<DescriptorSetLayout>> shared_descriptor_set_layouts;
     vk::PipelineLayout pipeline_layout;
+
+    std::mutex push_descriptor_templates_mutex;
+    std::map<std::pair<uint32_t, vk::PipelineBindPoint>, vk::DescriptorUpdateTemplate>
+        push_descriptor_templates;
 };
 
 using PipelineLayoutHandle = std::shared_ptr<PipelineLayout>;
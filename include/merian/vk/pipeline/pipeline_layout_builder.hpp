@@ -59,10 +59,11 @@ class PipelineLayoutBuilder {
         return *this;
     }
 
+    // Identical layouts are deduplicated using the layout cache of the context.
     std::shared_ptr<PipelineLayout>
     build_pipeline_layout(const vk::PipelineLayoutCreateFlags flags = {}) {
-        return std::make_shared<PipelineLayout>(context, shared_descriptor_set_layouts, ranges,
-                                                flags);
+        return context->layout_cache->acquire_pipeline_layout(
+            context, shared_descriptor_set_layouts, ranges, flags);
     }
 
   private:
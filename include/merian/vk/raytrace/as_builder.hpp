@@ -16,9 +16,10 @@ namespace merian {
  * BLASs hold the geometry, while top-level accelerations structures instances bottom-level as using
  * transformation matrices.
  *
- * This builder holds a scratch buffer that is large enough for the largest AS.
- * The scratch buffer can be released by calling release(). This class must kept alive until the
- * build has finished.
+ * BLAS builds are recorded in batches, every build of a batch uses its own region of the scratch
+ * buffer such that the builds of a batch can run concurrently on the device. The scratch memory of
+ * a batch is limited by the scratch budget (see set_scratch_budget()), a build that alone exceeds
+ * the budget gets a batch of its own. The scratch buffer is grown to the largest batch.
  *
  * Best practices: (from
  * https://developer.nvidia.com/blog/best-practices-using-nvidia-rtx-ray-tracing/)
@@ -46,6 +47,8 @@ class ASBuilder {
         AccelerationStructureHandle blas;
         vk::AccelerationStructureBuildGeometryInfoKHR build_info;
         const vk::AccelerationStructureBuildRangeInfoKHR* range_info;
+        // build or update scratch size
+        vk::DeviceSize scratch_size;
     };
 
     struct PendingTLAS {
@@ -54,6 +57,9 @@ class ASBuilder {
         vk::AccelerationStructureGeometryKHR geometry;
     };
 
+  public:
+    static constexpr vk::DeviceSize DEFAULT_SCRATCH_BUDGET = vk::DeviceSize(128) * 1024 * 1024;
+
   public:
     ASBuilder(const ContextHandle context, const ResourceAllocatorHandle& allocator)
         : context(context), allocator(allocator) {
@@ -224,7 +230,7 @@ class ASBuilder {
     // it is large enough else it is replaced with a larger one. Make sure to keep the scratch
     // buffer alive while processing has not finished on the GPU.
     //
-    // This command inserts a barrier for the BLAS that are built.
+    // This command inserts a barrier for the BLAS that are built (one per batch).
     void get_cmds_blas(const vk::CommandBuffer& cmd,
                        BufferHandle& scratch_buffer,
                        const ProfilerHandle profiler = nullptr);
@@ -255,6 +261,26 @@ class ASBuilder {
         }
     }
 
+    // Limits the scratch memory of a batch of BLAS builds. Larger budgets allow more builds to run
+    // concurrently but require a larger scratch buffer.
+    void set_scratch_budget(const vk::DeviceSize scratch_budget) {
+        this->scratch_budget = scratch_budget;
+    }
+
+    vk::DeviceSize get_scratch_budget() const {
+        return scratch_budget;
+    }
+
+    // Number of BLAS builds / updates of the last get_cmds_blas().
+    uint32_t get_last_blas_build_count() const {
+        return last_blas_build_count;
+    }
+
+    // Number of batches of the last get_cmds_blas().
+    uint32_t get_last_blas_batch_count() const {
+        return last_blas_batch_count;
+    }
+
   private:
     // Ensures the scratch buffer has min size `min_size`.
     void ensure_scratch_buffer(const vk::DeviceSize min_size, BufferHandle& scratch_buffer) {
@@ -270,12 +296,16 @@ class ASBuilder {
     const ContextHandle context;
     const ResourceAllocatorHandle allocator;
     vk::DeviceSize scratch_buffer_min_alignment;
+    vk::DeviceSize scratch_budget = DEFAULT_SCRATCH_BUDGET;
 
     // The BLASs/TLASs that are build when calling get_cmds()
     std::vector<PendingBLAS> pending_blas_builds;
     std::vector<PendingTLAS> pending_tlas_builds;
-    // The minimum scratch buffer size that is required to build all pending BLASs.
+    // The minimum scratch buffer size that is required to build all pending TLASs.
     vk::DeviceSize pending_min_scratch_buffer = 0;
+
+    uint32_t last_blas_build_count = 0;
+    uint32_t last_blas_batch_count = 0;
 };
 
 } // namespace merian
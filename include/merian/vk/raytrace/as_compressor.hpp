@@ -14,7 +14,8 @@ namespace merian {
  * required (that is also the reason why it is not recommended to use compaction with dynamic
  * BLASs).
  *
- * Note: This is slow: The pool is submitted twice while building.
+ * Note: This is slow: The pool is submitted twice while building. The DeviceASBuilder node
+ * compacts without waiting by reading the sizes in a later iteration.
  */
 class ASCompressor {
   public:
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "merian/io/mesh.hpp"
+#include "merian/vk/context.hpp"
+#include "merian/vk/memory/resource_allocator.hpp"
+
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <future>
+#include <optional>
+#include <vector>
+
+namespace merian {
+
+/*
+ * Builds BLASs for static geometry on the host (accelerationStructureHostCommands), using the
+ * thread pool of the context. The builds run on worker threads in parallel to the device.
+ *
+ * Optionally, built BLASs are serialized into a cache directory, later runs deserialize them
+ * instead of building again. An entry is named after a hash of the geometry and build flags and
+ * is only used if it was written by the same driver (driver UUID) and the driver reports the data
+ * as compatible. Otherwise the BLAS is built and the entry rewritten. Layout of an entry:
+ *
+ *   CacheHeader
+ *   serialized acceleration structure (see vkCopyAccelerationStructureToMemoryKHR)
+ *
+ * Host builds require the acceleration structures to live in host visible memory, which may be
+ * slower to trace than device local memory. Many drivers do not support host commands, check
+ * is_supported() and fall back to ASBuilder.
+ */
+class HostASBuilder {
+  public:
+    // A triangle list on the host. Positions are three floats at the start of every vertex.
+    // index_count must be a multiple of 3 and vertex_count must not be 0.
+    struct Geometry {
+        const void* vertices;
+        uint32_t vertex_count;
+        vk::DeviceSize vertex_stride;
+        const uint32_t* indices;
+        uint32_t index_count;
+        vk::GeometryFlagsKHR flags = vk::GeometryFlagBitsKHR::eOpaque;
+    };
+
+    static constexpr char CACHE_MAGIC[8] = {'M', 'R', 'N', 'B', 'L', 'A', 'S', '\0'};
+    static constexpr uint32_t CACHE_VERSION = 1;
+
+    struct CacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved0;
+        uint8_t driver_uuid[VK_UUID_SIZE];
+        uint64_t geometry_hash;
+        // size of the serialized acceleration structure that follows the header
+        uint64_t data_size;
+        uint8_t reserved1[16];
+    };
+    // keeps the serialized data 16 byte aligned (required for deserialization)
+    static_assert(sizeof(CacheHeader) == 64);
+
+  public:
+    // Whether the device supports acceleration structure host commands.
+    static bool is_supported(const ContextHandle& context);
+
+    // Throws std::runtime_error if host commands are not supported.
+    //
+    // The cache directory is created if it does not exist. Builds that are still running must be
+    // finished before the builder is destroyed.
+    HostASBuilder(const ContextHandle& context,
+                  const ResourceAllocatorHandle& allocator,
+                  const std::optional<std::filesystem::path>& cache_dir = std::nullopt);
+
+    // Builds the BLAS (or loads it from the cache) on the thread pool of the context.
+    //
+    // The geometry must stay valid until the future is ready. The BLAS can be used in command
+    // buffers that are submitted after the future is ready. Errors are reported through the
+    // future, failing to write the cache is only logged.
+    //
+    // Every geometry must have at least one vertex and an index count that is a multiple of 3,
+    // otherwise the future holds a std::runtime_error.
+    std::future<AccelerationStructureHandle>
+    build(const std::vector<Geometry>& geometries,
+          const vk::BuildAccelerationStructureFlagsKHR build_flags =
+              vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+
+    // Builds one geometry from all triangles of the mesh, the mesh is kept alive until the build
+    // finished.
+    std::future<AccelerationStructureHandle>
+    build(const MeshHandle& mesh,
+          const vk::BuildAccelerationStructureFlagsKHR build_flags =
+              vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+
+    // Identifies the geometry in the cache (positions, indices and flags).
+    static uint64_t hash_geometry(const std::vector<Geometry>& geometries,
+                                  const vk::BuildAccelerationStructureFlagsKHR build_flags);
+
+  public:
+    // BLASs that were built on the host.
+    uint32_t get_build_count() const {
+        return build_count;
+    }
+
+    // BLASs that were deserialized from the cache.
+    uint32_t get_cache_hit_count() const {
+        return cache_hit_count;
+    }
+
+  private:
+    AccelerationStructureHandle build_or_load(const std::vector<Geometry>& geometries,
+                                              const vk::BuildAccelerationStructureFlagsKHR flags);
+
+    // Returns nullptr if the entry does not exist or is not valid. The scratch sizes are taken
+    // from size_info, the size of the acceleration structure from the entry.
+    AccelerationStructureHandle
+    load_cache(const std::filesystem::path& path,
+               const uint64_t geometry_hash,
+               vk::AccelerationStructureBuildSizesInfoKHR size_info) const;
+
+    void write_cache(const std::filesystem::path& path,
+                     const uint64_t geometry_hash,
+                     const AccelerationStructureHandle& blas) const;
+
+  private:
+    const ContextHandle context;
+    const ResourceAllocatorHandle allocator;
+    const std::optional<std::filesystem::path> cache_dir;
+    std::array<uint8_t, VK_UUID_SIZE> driver_uuid;
+
+    std::atomic_uint32_t build_count = 0;
+    std::atomic_uint32_t cache_hit_count = 0;
+};
+
+} // namespace merian
@@ -3,10 +3,17 @@
 #include "merian/vk/shader/shader_compiler.hpp"
 #include "merian/vk/shader/shader_module.hpp"
 
+#include <future>
+#include <stop_token>
+
 namespace merian {
 
 /**
  * @brief Reloads shader modules automatically if the modified date changes.
+ *
+ * Recompilations run as background tasks on the thread pool of the context, until they finish the
+ * previous shader is returned. A recompilation that did not start yet is cancelled if the file
+ * changes again or clear() is called.
  */
 class HotReloader {
   public:
@@ -14,14 +21,16 @@ class HotReloader {
         : context(context), compiler(compiler) {}
 
     // Compiles the shader at the specified path and returns a ShaderModule.
-    // If this method is called multiple times the shader is automatically recompiled if the file
-    // was changed, otherwise the same ShaderModule is returned.
+    // If this method is called multiple times the shader is automatically recompiled in the
+    // background if the file was changed. Until then (or if the file did not change) the same
+    // ShaderModule is returned.
     //
     // If the compilation fails, ShaderCompiler::compilation_failed might be thrown.
     ShaderModuleHandle
     get_shader(const std::filesystem::path& path,
                const std::optional<vk::ShaderStageFlagBits> shader_kind = std::nullopt);
 
+    // Forgets all shaders and cancels pending recompilations.
     void clear();
 
   private:
@@ -32,6 +41,10 @@ class HotReloader {
         ShaderModuleHandle shader;
         std::filesystem::file_time_type last_write_time;
         std::optional<ShaderCompiler::compilation_failed> error;
+
+        // recompilation that runs in the background
+        std::future<ShaderModuleHandle> pending;
+        std::stop_source pending_stop;
     };
     std::unordered_map<std::filesystem::path, per_path> shaders;
 };
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "merian/utils/concurrent/thread_pool.hpp"
 #include "merian/utils/properties.hpp"
 #include "merian/utils/stopwatch.hpp"
 #include "merian/vk/utils/query_pool.hpp"
@@ -88,6 +89,8 @@ class Profiler : public std::enable_shared_from_this<Profiler> {
     struct Report {
         std::vector<ReportEntry> cpu_report;
         std::vector<ReportEntry> gpu_report;
+        // thread pool tasks aggregated by name, see make_task_report().
+        std::vector<ReportEntry> task_report;
 
         double cpu_total_std_deviation() const {
             if (cpu_report.empty()) {
@@ -124,7 +127,7 @@ class Profiler : public std::enable_shared_from_this<Profiler> {
         }
 
         operator bool() const {
-            return !cpu_report.empty() || !gpu_report.empty();
+            return !cpu_report.empty() || !gpu_report.empty() || !task_report.empty();
         }
     };
 
@@ -180,9 +183,16 @@ class Profiler : public std::enable_shared_from_this<Profiler> {
     static void get_cpu_report_as_config(Properties& config, const Profiler::Report& report);
     static void get_gpu_report_as_config(Properties& config, const Profiler::Report& report);
 
+    static void get_task_report_as_config(Properties& config, const Profiler::Report& report);
+
     // outputs the report as config
     static void get_report_as_config(Properties& config, const Profiler::Report& report);
 
+    // Aggregates thread pool trace events (ThreadPool::collect_trace()) by task name into mean
+    // execution times with the mean time the tasks were queued as child. Sorted by total time.
+    static std::vector<ReportEntry>
+    make_task_report(const std::vector<ThreadPool::TraceEvent>& events);
+
   private:
     const ContextHandle context;
     const float timestamp_period;
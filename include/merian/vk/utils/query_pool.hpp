@@ -51,6 +51,10 @@ class QueryPool : public std::enable_shared_from_this<QueryPool<QUERY_TYPE>> {
         return query_count;
     }
 
+    const vk::QueryPool& get_query_pool() const {
+        return query_pool;
+    }
+
     template <typename RETURN_TYPE>
     std::vector<RETURN_TYPE> get_query_pool_results(const uint32_t first_query,
                                                     const uint32_t query_count,
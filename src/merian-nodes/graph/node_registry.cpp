@@ -10,6 +10,7 @@
 #include "merian-nodes/nodes/fxaa/fxaa.hpp"
 #include "merian-nodes/nodes/glfw_window/glfw_window.hpp"
 #include "merian-nodes/nodes/image_read/hdr_image.hpp"
+#include "merian-nodes/nodes/image_read/image_sequence.hpp"
 #include "merian-nodes/nodes/image_read/ldr_image.hpp"
 #include "merian-nodes/nodes/image_write/image_write.hpp"
 #include "merian-nodes/nodes/mean/mean.hpp"
@@ -51,12 +52,15 @@ NodeRegistry::NodeRegistry(const ContextHandle& context, const ResourceAllocator
                                  [=]() { return std::make_shared<FXAA>(context); }});
     register_node<GLFWWindow>(NodeInfo{"Window (GLFW)", "Outputs to a window created with GLFW.",
                                        [=]() { return std::make_shared<GLFWWindow>(context); }});
-    register_node<HDRImageRead>(NodeInfo{"HDR Image", "Loads an HDR image.", [=]() {
-                                             return std::make_shared<HDRImageRead>(context);
-                                         }});
-    register_node<LDRImageRead>(NodeInfo{"LDR Image", "Loads a LDR image.", [=]() {
-                                             return std::make_shared<LDRImageRead>(context);
-                                         }});
+    register_node<HDRImageRead>(
+        NodeInfo{"HDR Image", "Loads an HDR image.",
+                 [=]() { return std::make_shared<HDRImageRead>(context, allocator); }});
+    register_node<LDRImageRead>(
+        NodeInfo{"LDR Image", "Loads a LDR image.",
+                 [=]() { return std::make_shared<LDRImageRead>(context, allocator); }});
+    register_node<ImageSequenceRead>(
+        NodeInfo{"Image Sequence", "Streams a sequence of image files.",
+                 [=]() { return std::make_shared<ImageSequenceRead>(context, allocator); }});
     register_node<ImageWrite>(
         NodeInfo{"Image Write", "Stores a graph output as image file.",
                  [=]() { return std::make_shared<ImageWrite>(context, allocator); }});
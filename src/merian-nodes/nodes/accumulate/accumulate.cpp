@@ -56,11 +56,8 @@ Accumulate::on_connected([[maybe_unused]] const NodeIOLayout& io_layout,
         accumulate_desc_layout =
             DescriptorSetLayoutBuilder().add_binding_combined_sampler().build_layout(context);
 
-        percentile_desc_pool = std::make_shared<DescriptorPool>(percentile_desc_layout);
-        accumulate_desc_pool = std::make_shared<DescriptorPool>(accumulate_desc_layout);
-
-        percentile_set = std::make_shared<DescriptorSet>(percentile_desc_pool);
-        accumulate_set = std::make_shared<DescriptorSet>(accumulate_desc_pool);
+        percentile_set = allocator->get_descriptor_allocator()->allocate(percentile_desc_layout);
+        accumulate_set = allocator->get_descriptor_allocator()->allocate(accumulate_desc_layout);
     }
 
     percentile_group_count_x =
@@ -1,65 +1,85 @@
 #include "merian-nodes/nodes/image_read/hdr_image.hpp"
 
-#include "stb_image.h"
 #include "merian-nodes/graph/errors.hpp"
+#include "merian/utils/chrono.hpp"
 
 #include <filesystem>
 
 namespace merian_nodes {
 
-HDRImageRead::HDRImageRead(const ContextHandle& context) : Node(), context(context) {}
-
-HDRImageRead::~HDRImageRead() {
-    if (image) {
-        stbi_image_free(image);
-    }
-}
+HDRImageRead::HDRImageRead(const ContextHandle& context, const ResourceAllocatorHandle& allocator)
+    : Node(), context(context), allocator(allocator) {}
 
 std::vector<OutputConnectorHandle>
 HDRImageRead::describe_outputs([[maybe_unused]] const NodeIOLayout& io_layout) {
-    if (filename.empty()) {
-        throw graph_errors::node_error{"no file set"};
-    }
-    if (!std::filesystem::exists(filename)) {
-        throw graph_errors::node_error{fmt::format("file does not exist: {}", filename.string())};
-    }
-    if (!stbi_info(filename.string().c_str(), &width, &height, &channels)) {
-        throw graph_errors::node_error{"format not supported!"};
-    }
+    const ImageDecode::Info info = ImageDecode::read_info(filename);
+    width = info.width;
+    height = info.height;
+    channels = info.channels;
 
     con_out = ManagedVkImageOut::transfer_write("out", vk::Format::eR32G32B32A32Sfloat, width,
                                                 height, 1, true);
 
+    if (image && image->path != filename) {
+        image.reset();
+    }
+    // start decoding while the rest of the graph connects.
+    if (!image && (!decode.pending() || decode.get_path() != filename)) {
+        load_error.clear();
+        decode.start(context->thread_pool, filename, true, allocator);
+    }
+
     needs_run = true;
+    placeholder_cleared = false;
     return {con_out};
 }
 
-void HDRImageRead::process([[maybe_unused]] GraphRun& run,
+void HDRImageRead::process(GraphRun& run,
                            const vk::CommandBuffer& cmd,
                            [[maybe_unused]] const DescriptorSetHandle& descriptor_set,
                            const NodeIO& io) {
-    if (needs_run) {
-        if (!image) {
-            image = stbi_loadf(filename.string().c_str(), &width, &height, &channels, 4);
-            assert(image);
-            assert(width == (int)io[con_out]->get_extent().width &&
-                   height == (int)io[con_out]->get_extent().height);
-
-            SPDLOG_INFO("Loaded image from {} ({}x{}, {} channels)", filename.string(), width,
-                        height, channels);
+    if (!needs_run) {
+        if (image && !keep_on_host &&
+            run.get_iteration() >= upload_iteration + run.get_iterations_in_flight()) {
+            image.reset();
         }
+        return;
+    }
 
-        run.get_allocator()->getStaging()->cmdToImage(cmd, *io[con_out], {0, 0, 0},
-                                                      io[con_out]->get_extent(), first_layer(),
-                                                      width * height * 4 * sizeof(float), image);
+    if (!image) {
+        try {
+            image = decode.get(wait_for_load);
+            if (image) {
+                SPDLOG_INFO("Loaded image from {} ({}x{}, {} channels) in {:.1f} ms",
+                            filename.string(), width, height, channels,
+                            to_milliseconds(image->decode_duration));
+            }
+        } catch (const graph_errors::node_error& e) {
+            load_error = e.what();
+            SPDLOG_ERROR(load_error);
+            needs_run = false;
+        }
+    }
 
-        if (!keep_on_host) {
-            stbi_image_free(image);
-            image = nullptr;
+    if (!image) {
+        if (!placeholder_cleared) {
+            cmd.clearColorImage(*io[con_out], io[con_out]->get_current_layout(),
+                                vk::ClearColorValue{}, all_levels_and_layers());
+            placeholder_cleared = true;
         }
+        return;
+    }
 
-        needs_run = false;
+    if (image->width != width || image->height != height) {
+        // the file changed since the graph connected.
+        image.reset();
+        run.request_reconnect();
+        return;
     }
+
+    image->cmd_upload(cmd, *io[con_out], run.get_allocator());
+    upload_iteration = run.get_iteration();
+    needs_run = false;
 }
 
 HDRImageRead::NodeStatusFlags HDRImageRead::properties(Properties& config) {
@@ -68,20 +88,23 @@ HDRImageRead::NodeStatusFlags HDRImageRead::properties(Properties& config) {
     if (config.config_text("path", config_filename, true)) {
         needs_rebuild = true;
         filename = context->file_loader.find_file(config_filename).value_or(config_filename);
-        if (image) {
-            stbi_image_free(image);
-            image = nullptr;
-        }
+        // the image might still be in use by an upload, it is released in describe_outputs.
+        decode.cancel();
     }
 
+    // the image is released in process() once the upload finished.
     config.config_bool("keep in host memory", keep_on_host, "");
-    if (!keep_on_host && image) {
-        stbi_image_free(image);
-        image = nullptr;
-    }
-
-    const std::string text = fmt::format("filename: {}\nextent: {}x{}\nhost cached: {}\n",
-                                         filename.string(), width, height, image != nullptr);
+    config.config_bool("wait for load", wait_for_load,
+                       "Blocks the graph until the image is decoded instead of outputting zeros "
+                       "in the meantime.");
+
+    const std::string status = !load_error.empty() ? load_error
+                               : decode.pending()  ? "loading"
+                               : needs_run         ? "waiting for upload"
+                                                   : "loaded";
+    const std::string text =
+        fmt::format("filename: {}\nextent: {}x{}\nstatus: {}\nhost cached: {}\n",
+                    filename.string(), width, height, status, image != nullptr);
 
     config.output_text(text);
 
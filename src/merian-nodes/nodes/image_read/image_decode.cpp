@@ -0,0 +1,176 @@
+#include "merian-nodes/nodes/image_read/image_decode.hpp"
+
+#include "stb_image.h"
+#include "merian-nodes/graph/errors.hpp"
+#include "merian/io/mapped_file.hpp"
+#include "merian/utils/chrono.hpp"
+#include "merian/utils/string.hpp"
+#include "merian/vk/utils/subresource_ranges.hpp"
+
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+namespace merian_nodes {
+
+void DecodedImage::cmd_upload(const vk::CommandBuffer& cmd,
+                              const vk::Image& image,
+                              const ResourceAllocatorHandle& allocator) const {
+    const vk::Extent3D extent{(uint32_t)width, (uint32_t)height, 1};
+
+    if (staging_buffer) {
+        const vk::BufferImageCopy region{0, 0, 0, first_layer(), {0, 0, 0}, extent};
+        cmd.copyBufferToImage(*staging_buffer, image, vk::ImageLayout::eTransferDstOptimal,
+                              region);
+    } else {
+        allocator->getStaging()->cmdToImage(cmd, image, {0, 0, 0}, extent, first_layer(), size,
+                                            pixels.get());
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+ImageDecode::Info ImageDecode::read_info(const std::filesystem::path& path) {
+    if (path.empty()) {
+        throw graph_errors::node_error{"no file set"};
+    }
+    if (!std::filesystem::exists(path)) {
+        throw graph_errors::node_error{fmt::format("file does not exist: {}", path.string())};
+    }
+
+    // the header is at the beginning, do not read ahead.
+    const MappedFile file(path, MappedFile::AccessPattern::RANDOM);
+    Info info;
+    if (!stbi_info_from_memory(reinterpret_cast<const stbi_uc*>(file.get_data().data()),
+                               file.get_size(), &info.width, &info.height, &info.channels)) {
+        throw graph_errors::node_error{"format not supported!"};
+    }
+    return info;
+}
+
+// Runs on the thread pool.
+static DecodedImageHandle decode_image(const std::filesystem::path& path,
+                                       const bool hdr,
+                                       const ResourceAllocatorHandle& allocator,
+                                       const BufferHandle& staging_buffer,
+                                       const std::stop_token& stop_token) {
+    const auto start = std::chrono::steady_clock::now();
+
+    const MappedFile file(path, MappedFile::AccessPattern::SEQUENTIAL, true);
+    const stbi_uc* data = reinterpret_cast<const stbi_uc*>(file.get_data().data());
+
+    DecodedImageHandle image = std::make_shared<DecodedImage>();
+    image->path = path;
+    void* pixels;
+    if (hdr) {
+        pixels = stbi_loadf_from_memory(data, file.get_size(), &image->width, &image->height,
+                                        &image->channels, 4);
+    } else {
+        pixels = stbi_load_from_memory(data, file.get_size(), &image->width, &image->height,
+                                       &image->channels, 4);
+    }
+    if (!pixels) {
+        throw graph_errors::node_error{
+            fmt::format("decoding {} failed: {}", path.string(), stbi_failure_reason())};
+    }
+    image->pixels = std::shared_ptr<void>(pixels, stbi_image_free);
+    image->size = (vk::DeviceSize)image->width * image->height * 4 *
+                  (hdr ? sizeof(float) : sizeof(stbi_uc));
+
+    if (stop_token.stop_requested()) {
+        return nullptr;
+    }
+
+    if (allocator) {
+        // Copy on the worker to keep the memcpy off the graph thread. stb_image cannot decode
+        // into caller-provided memory, otherwise we would decode into the mapping directly.
+        if (staging_buffer && staging_buffer->get_size() >= image->size) {
+            image->staging_buffer = staging_buffer;
+        } else {
+            image->staging_buffer = allocator->createBuffer(
+                image->size, vk::BufferUsageFlagBits::eTransferSrc,
+                MemoryMappingType::HOST_ACCESS_SEQUENTIAL_WRITE, "image decode staging");
+        }
+        const MemoryAllocationHandle& memory = image->staging_buffer->get_memory();
+        std::memcpy(memory->map(), image->pixels.get(), image->size);
+        memory->flush();
+        memory->unmap();
+        image->pixels.reset();
+    }
+
+    image->decode_duration = std::chrono::steady_clock::now() - start;
+    SPDLOG_DEBUG("decoded {} ({}x{}, {} channels, {}) in {:.1f} ms", path.string(), image->width,
+                 image->height, image->channels, format_size(image->size),
+                 to_milliseconds(image->decode_duration));
+
+    return image;
+}
+
+ImageDecode::~ImageDecode() {
+    if (!future.valid()) {
+        return;
+    }
+
+    // the task may still use the allocator, make sure it is done before the graph goes away.
+    // Skipped tasks finish immediately, running tasks are not interruptible.
+    stop_source.request_stop();
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready &&
+           thread_pool->run_pending_task()) {}
+    future.wait();
+}
+
+void ImageDecode::start(ThreadPool& thread_pool,
+                        const std::filesystem::path& path,
+                        const bool hdr,
+                        const ResourceAllocatorHandle& allocator,
+                        const BufferHandle& staging_buffer) {
+    cancel();
+
+    this->thread_pool = &thread_pool;
+    this->path = path;
+    stop_source = std::stop_source();
+
+    const std::stop_token stop_token = stop_source.get_token();
+    const std::function<DecodedImageHandle()> decode = [path, hdr, allocator, staging_buffer,
+                                                        stop_token] {
+        return decode_image(path, hdr, allocator, staging_buffer, stop_token);
+    };
+
+    future = thread_pool.submit<DecodedImageHandle>(
+        decode, {"image decode", ThreadPool::Priority::BACKGROUND, stop_token});
+}
+
+void ImageDecode::cancel() {
+    if (!future.valid()) {
+        return;
+    }
+
+    // does not block, the task discards its result.
+    stop_source.request_stop();
+    future = {};
+}
+
+bool ImageDecode::ready() const {
+    return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+DecodedImageHandle ImageDecode::get(const bool wait) {
+    if (!future.valid()) {
+        return nullptr;
+    }
+    if (!wait && !ready()) {
+        return nullptr;
+    }
+
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready &&
+           thread_pool->run_pending_task()) {}
+    try {
+        return future.get();
+    } catch (const graph_errors::node_error&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw graph_errors::node_error{
+            fmt::format("loading {} failed: {}", path.string(), e.what())};
+    }
+}
+
+} // namespace merian_nodes
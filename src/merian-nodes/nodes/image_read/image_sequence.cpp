@@ -0,0 +1,340 @@
+#include "merian-nodes/nodes/image_read/image_sequence.hpp"
+
+#include "merian-nodes/graph/errors.hpp"
+#include "merian/utils/chrono.hpp"
+#include "merian/utils/string.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace merian_nodes {
+
+#define FORMAT_SRGB 0
+#define FORMAT_LINEAR 1
+#define FORMAT_FLOAT 2
+
+#define MODE_ITERATION 0
+#define MODE_FIXED_RATE 1
+
+static const vk::Format FORMATS[] = {vk::Format::eR8G8B8A8Srgb, vk::Format::eR8G8B8A8Unorm,
+                                     vk::Format::eR32G32B32A32Sfloat};
+
+// stop probing for frames after this many files
+static constexpr uint32_t MAX_SEQUENCE_LENGTH = 1 << 20;
+
+ImageSequenceRead::ImageSequenceRead(const ContextHandle& context,
+                                     const ResourceAllocatorHandle& allocator,
+                                     const std::string& filename_format)
+    : Node(), context(context), allocator(allocator), filename_format(filename_format) {}
+
+std::filesystem::path ImageSequenceRead::get_frame_path(const uint64_t frame) const {
+    fmt::dynamic_format_arg_store<fmt::format_context> arg_store;
+    arg_store.push_back(fmt::arg("frame", first_frame + frame));
+    const std::string filename = fmt::vformat(filename_format, arg_store);
+    return context->file_loader.find_file(filename).value_or(filename);
+}
+
+std::filesystem::path ImageSequenceRead::get_path(const uint64_t index) const {
+    assert(sequence_length > 0);
+    if (loop) {
+        return get_frame_path(index % sequence_length);
+    }
+    return get_frame_path(std::min<uint64_t>(index, sequence_length - 1));
+}
+
+uint32_t ImageSequenceRead::count_frames() const {
+    uint32_t count = 0;
+    while (count < MAX_SEQUENCE_LENGTH && std::filesystem::exists(get_frame_path(count))) {
+        count++;
+    }
+    return count;
+}
+
+std::vector<OutputConnectorHandle>
+ImageSequenceRead::describe_outputs([[maybe_unused]] const NodeIOLayout& io_layout) {
+    if (filename_format.empty()) {
+        throw graph_errors::node_error{"no filename set"};
+    }
+
+    try {
+        sequence_length = frame_count > 0 ? frame_count : count_frames();
+        if (sequence_length == 0) {
+            throw graph_errors::node_error{
+                fmt::format("no frames found: {}", get_frame_path(0).string())};
+        }
+        const ImageDecode::Info info = ImageDecode::read_info(get_frame_path(0));
+        width = info.width;
+        height = info.height;
+    } catch (const fmt::format_error& e) {
+        throw graph_errors::node_error{fmt::format("invalid filename: {}", e.what())};
+    }
+
+    con_out = ManagedVkImageOut::transfer_write("out", FORMATS[format], width, height, 1, true);
+
+    // the graph waited for all in-flight iterations and the iteration counter starts over.
+    for (FreeBuffer& free_buffer : free_buffers) {
+        free_buffer.available_iteration = 0;
+    }
+    current_upload_iteration = 0;
+    const vk::DeviceSize frame_size =
+        (vk::DeviceSize)width * height * 4 * (format == FORMAT_FLOAT ? sizeof(float) : 1);
+    std::erase_if(free_buffers, [&](const FreeBuffer& free_buffer) {
+        return free_buffer.buffer->get_size() < frame_size;
+    });
+    // the output is recreated, the current frame is uploaded again if it still fits.
+    if (current && (current->width != width || current->height != height ||
+                    current->size != frame_size)) {
+        if (current->staging_buffer) {
+            free_buffers.push_back({current->staging_buffer, 0});
+        }
+        current.reset();
+    }
+    output_initialized = false;
+    reset_clock = true;
+
+    return {con_out};
+}
+
+void ImageSequenceRead::release_slot(Slot& slot) {
+    // the decode might still write to the buffer, only reuse it if it finished.
+    if (slot.decode.ready()) {
+        try {
+            const DecodedImageHandle image = slot.decode.get();
+            if (image && image->staging_buffer) {
+                free_buffers.push_back({image->staging_buffer, 0});
+            }
+        } catch (const graph_errors::node_error&) {
+            if (slot.staging_buffer) {
+                free_buffers.push_back({slot.staging_buffer, 0});
+            }
+        }
+    }
+    slot.decode.cancel();
+}
+
+void ImageSequenceRead::clear_ring() {
+    for (auto& slot : ring) {
+        release_slot(*slot);
+    }
+    ring.clear();
+}
+
+void ImageSequenceRead::fill_ring(const uint64_t index, const uint64_t iteration) {
+    if (!ring.empty() && ring.front()->index > index) {
+        // went backwards (e.g. looping was disabled)
+        clear_ring();
+    }
+    while (!ring.empty() && ring.front()->index < index) {
+        release_slot(*ring.front());
+        ring.pop_front();
+    }
+
+    const uint64_t end = loop ? index + read_ahead + 1
+                              : std::min<uint64_t>(index + read_ahead + 1, sequence_length);
+    for (uint64_t next = ring.empty() ? index : ring.back()->index + 1; next < end; next++) {
+        std::unique_ptr<Slot>& slot = ring.emplace_back(std::make_unique<Slot>());
+        slot->index = next;
+
+        if (allocator) {
+            const auto it = std::find_if(free_buffers.begin(), free_buffers.end(),
+                                         [&](const FreeBuffer& free_buffer) {
+                                             return free_buffer.available_iteration <= iteration;
+                                         });
+            if (it != free_buffers.end()) {
+                slot->staging_buffer = it->buffer;
+                free_buffers.erase(it);
+            }
+        }
+
+        slot->decode.start(context->thread_pool, get_path(next), format == FORMAT_FLOAT, allocator,
+                           slot->staging_buffer);
+    }
+}
+
+bool ImageSequenceRead::advance(GraphRun& run, const vk::CommandBuffer& cmd, const NodeIO& io) {
+    const uint64_t next = displayed + 1;
+    uint64_t target;
+    if (pause) {
+        target = displayed >= 0 ? displayed : 0;
+        reset_clock = true;
+    } else if (mode == MODE_FIXED_RATE) {
+        if (reset_clock) {
+            clock_start_time = run.get_elapsed();
+            clock_start_index = next;
+            reset_clock = false;
+        }
+        target = clock_start_index +
+                 (uint64_t)std::floor((run.get_elapsed() - clock_start_time) * frame_rate);
+    } else {
+        target = next;
+    }
+    if (!loop) {
+        target = std::min<uint64_t>(target, sequence_length - 1);
+    }
+
+    if ((int64_t)target == displayed) {
+        fill_ring(next, run.get_iteration());
+        return false;
+    }
+
+    fill_ring(target, run.get_iteration());
+    Slot& slot = *ring.front();
+    assert(slot.index == target);
+
+    DecodedImageHandle image;
+    try {
+        if (!slot.decode.ready()) {
+            stalls++;
+            if (mode == MODE_FIXED_RATE) {
+                // keep the previous frame
+                return false;
+            }
+            const auto stall_start = std::chrono::steady_clock::now();
+            image = slot.decode.get(true);
+            stall_duration += std::chrono::steady_clock::now() - stall_start;
+        } else {
+            image = slot.decode.get();
+        }
+        if (image->width != width || image->height != height) {
+            throw graph_errors::node_error{
+                fmt::format("{} has extent {}x{}, expected {}x{}", image->path.string(),
+                            image->width, image->height, width, height)};
+        }
+    } catch (const graph_errors::node_error& e) {
+        // skip the frame and keep the output.
+        last_error = e.what();
+        SPDLOG_ERROR(last_error);
+        failed_frames++;
+        displayed = target;
+        fill_ring(displayed + 1, run.get_iteration());
+        return false;
+    }
+
+    image->cmd_upload(cmd, *io[con_out], run.get_allocator());
+
+    if (current && current->staging_buffer) {
+        free_buffers.push_back({current->staging_buffer,
+                                current_upload_iteration + run.get_iterations_in_flight()});
+    }
+    current = image;
+    current_upload_iteration = run.get_iteration();
+    // the staging buffer is owned by current now.
+    slot.staging_buffer.reset();
+
+    if (displayed >= 0 && target > next) {
+        skipped_frames += target - next;
+    }
+    displayed = target;
+    uploaded_frames++;
+    uploaded_bytes += image->size;
+    decode_duration += image->decode_duration;
+
+    fill_ring(displayed + 1, run.get_iteration());
+    return true;
+}
+
+void ImageSequenceRead::process(GraphRun& run,
+                                const vk::CommandBuffer& cmd,
+                                [[maybe_unused]] const DescriptorSetHandle& descriptor_set,
+                                const NodeIO& io) {
+    if (advance(run, cmd, io) || output_initialized) {
+        output_initialized = true;
+        return;
+    }
+
+    // the output was recreated and no new frame is available.
+    if (current) {
+        current->cmd_upload(cmd, *io[con_out], run.get_allocator());
+        current_upload_iteration = run.get_iteration();
+    } else {
+        cmd.clearColorImage(*io[con_out], io[con_out]->get_current_layout(), vk::ClearColorValue{},
+                            all_levels_and_layers());
+    }
+    output_initialized = true;
+}
+
+void ImageSequenceRead::restart() {
+    clear_ring();
+    displayed = -1;
+    reset_clock = true;
+}
+
+ImageSequenceRead::NodeStatusFlags ImageSequenceRead::properties(Properties& config) {
+    bool needs_reconnect = false;
+
+    config.st_separate("Input");
+    if (config.config_text(
+            "filename", filename_format, true,
+            "Provide a format string for the path. Supported variables are: frame")) {
+        restart();
+        needs_reconnect = true;
+    }
+    if (config.config_int("first frame", first_frame, 0, std::numeric_limits<int>::max())) {
+        restart();
+        needs_reconnect = true;
+    }
+    if (config.config_int("frame count", frame_count, 0, std::numeric_limits<int>::max(),
+                          "0 detects the number of consecutive frames on disk.")) {
+        needs_reconnect = true;
+    }
+    if (config.config_options("format", format, {"sRGB", "linear", "float"},
+                              Properties::OptionsStyle::COMBO)) {
+        clear_ring();
+        needs_reconnect = true;
+    }
+
+    config.st_separate("Playback");
+    if (config.config_options("mode", mode, {"iteration", "fixed rate"},
+                              Properties::OptionsStyle::COMBO,
+                              "iteration: outputs the next frame every iteration and waits if it "
+                              "is not decoded yet. fixed rate: selects the frame using the graph "
+                              "time and keeps the previous frame if it is not decoded yet.")) {
+        reset_clock = true;
+    }
+    if (mode == MODE_FIXED_RATE && config.config_float("frame rate", frame_rate, 0.1f, 240.f)) {
+        reset_clock = true;
+    }
+    config.config_bool("loop", loop);
+    config.config_bool("pause", pause);
+    config.config_uint("read ahead", read_ahead, 0, 64,
+                       "Number of frames that are decoded ahead on the thread pool.");
+    if (config.config_bool("restart")) {
+        restart();
+    }
+
+    config.st_separate("Status");
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed = to_seconds(now - last_statistics_time);
+    if (elapsed > 0.5) {
+        frames_per_second = (uploaded_frames - last_uploaded_frames) / elapsed;
+        bytes_per_second = (uploaded_bytes - last_uploaded_bytes) / elapsed;
+        last_uploaded_frames = uploaded_frames;
+        last_uploaded_bytes = uploaded_bytes;
+        last_statistics_time = now;
+    }
+    const auto decoded_ahead = std::count_if(ring.begin(), ring.end(),
+                                             [](const auto& slot) { return slot->decode.ready(); });
+
+    const std::string frame =
+        displayed >= 0 && sequence_length > 0 ? fmt::to_string(displayed % sequence_length) : "-";
+    config.output_text(
+        fmt::format("frame: {} / {}\nfile: {}\nextent: {}x{}\ndecoded ahead: {} / {}", frame,
+                    sequence_length, current ? current->path.string() : "<none>", width, height,
+                    decoded_ahead, ring.size()));
+    config.output_text(fmt::format(
+        "throughput: {:.1f} frames/s ({}/s)\nmean decode time: {:.2f} ms\nstalls: {} ({:.1f} ms "
+        "waited)\nskipped: {}\nfailed: {}",
+        frames_per_second, format_size((uint64_t)bytes_per_second),
+        uploaded_frames > 0 ? to_milliseconds(decode_duration) / uploaded_frames : 0.0, stalls,
+        to_milliseconds(stall_duration), skipped_frames, failed_frames));
+    if (!last_error.empty()) {
+        config.output_text(fmt::format("last error: {}", last_error));
+    }
+
+    if (needs_reconnect) {
+        return NEEDS_RECONNECT;
+    }
+    return {};
+}
+
+} // namespace merian_nodes
@@ -1,11 +1,19 @@
 #include "merian-nodes/nodes/image_write/image_write.hpp"
-#include "stb_image_write.h"
 
+#include "merian/utils/chrono.hpp"
 #include "merian/utils/defer.hpp"
+#include "merian/vk/descriptors/descriptor_set_layout_builder.hpp"
+#include "merian/vk/descriptors/descriptor_set_update.hpp"
+#include "merian/vk/pipeline/pipeline_compute.hpp"
+#include "merian/vk/pipeline/pipeline_layout_builder.hpp"
+#include "merian/vk/pipeline/specialization_info_builder.hpp"
 #include "merian/vk/utils/blits.hpp"
 
+#include "yuv420.comp.spv.h"
+
 #include <csignal>
 #include <filesystem>
+#include <fstream>
 
 #include "fmt/args.h"
 
@@ -14,21 +22,447 @@ namespace merian_nodes {
 #define FORMAT_PNG 0
 #define FORMAT_JPG 1
 #define FORMAT_HDR 2
+#define FORMAT_EXR 3
+#define FORMAT_RAW 4
+#define FORMAT_RAW_MULTI_FRAME 5
+#define FORMAT_Y4M 6
+#define FORMAT_YUV 7
+
+#define PRECISION_FLOAT 0
+#define PRECISION_HALF 1
 
 static std::unordered_map<uint32_t, std::string> FILE_EXTENSIONS = {
-    {FORMAT_PNG, ".png"}, {FORMAT_JPG, ".jpg"}, {FORMAT_HDR, ".hdr"}};
+    {FORMAT_PNG, ".png"},    {FORMAT_JPG, ".jpg"},    {FORMAT_HDR, ".hdr"},
+    {FORMAT_EXR, ".exr"},    {FORMAT_RAW, ".frames"}, {FORMAT_RAW_MULTI_FRAME, ".frames"},
+    {FORMAT_Y4M, ".y4m"},    {FORMAT_YUV, ".yuv"}};
+
+static bool is_video_format(const int format) {
+    return format == FORMAT_Y4M || format == FORMAT_YUV;
+}
+
+// The capture is copied in the format the file stores, such that it can be written without
+// conversion on the host.
+static vk::Format get_readback_format(const int format, const int raw_precision) {
+    switch (format) {
+    case FORMAT_PNG:
+    case FORMAT_JPG:
+        return vk::Format::eR8G8B8A8Srgb;
+    case FORMAT_EXR:
+    // the input of the YUV pass, the buffer receives YUV
+    case FORMAT_Y4M:
+    case FORMAT_YUV:
+        return vk::Format::eR16G16B16A16Sfloat;
+    case FORMAT_RAW:
+    case FORMAT_RAW_MULTI_FRAME:
+        return raw_precision == PRECISION_HALF ? vk::Format::eR16G16B16A16Sfloat
+                                               : vk::Format::eR32G32B32A32Sfloat;
+    default:
+        return vk::Format::eR32G32B32A32Sfloat;
+    }
+}
+
+static raw_frames::ComponentType get_component_type(const vk::Format readback_format) {
+    switch (readback_format) {
+    case vk::Format::eR32G32B32A32Sfloat:
+        return raw_frames::ComponentType::FLOAT32;
+    case vk::Format::eR16G16B16A16Sfloat:
+        return raw_frames::ComponentType::FLOAT16;
+    default:
+        return raw_frames::ComponentType::UINT8;
+    }
+}
 
 ImageWrite::ImageWrite(const ContextHandle context,
                        const ResourceAllocatorHandle allocator,
                        const std::string& filename_format)
-    : Node(), context(context), allocator(allocator), filename_format(filename_format) {}
+    : Node(), context(context), allocator(allocator), filename_format(filename_format) {
+    yuv_shader = std::make_shared<ShaderModule>(context, merian_yuv420_comp_spv_size(),
+                                                merian_yuv420_comp_spv());
+    yuv_set_layout = DescriptorSetLayoutBuilder()
+                         .add_binding_storage_image()
+                         .add_binding_storage_buffer()
+                         .build_layout(context);
+    auto pipe_layout = PipelineLayoutBuilder(context)
+                           .add_descriptor_set_layout(yuv_set_layout)
+                           .add_push_constant<YUVPushConstant>()
+                           .build_pipeline_layout();
+    auto spec_builder = SpecializationInfoBuilder();
+    spec_builder.add_entry(yuv_local_size_x);
+    yuv_pipeline = std::make_shared<ComputePipeline>(pipe_layout, yuv_shader, spec_builder.build());
+}
+
+#define BACK_PRESSURE_WAIT 0
+#define BACK_PRESSURE_DROP 1
+#define BACK_PRESSURE_GROW 2
+
+// wait at most this long for outstanding copies on destruction
+static constexpr uint64_t DESTRUCTION_TIMEOUT_NANOS = 5'000'000'000;
+
+ImageWrite::~ImageWrite() {
+    // write the captures whose copy is still in flight.
+    for (auto& slot : ring) {
+        if (slot->state.load(std::memory_order_acquire) == RECORDED &&
+            !iteration_semaphore->wait(slot->ready_value, DESTRUCTION_TIMEOUT_NANOS)) {
+            // The device might still access the buffer and intermediate image, destroying them is
+            // undefined behavior. Waiting for the device could block forever (or throw) if the
+            // device is lost, hence the slot is leaked.
+            SPDLOG_ERROR("capture {} did not finish, dropping it and leaking its readback buffer",
+                         slot->path.string());
+            // finalizes the stream if this was the last reference
+            slot->video_stream.reset();
+            [[maybe_unused]] ReadbackSlot* leaked = slot.release();
+        }
+    }
+    std::erase(ring, nullptr);
+    dispatch_completed_captures();
+
+    // the tasks access this node.
+    std::unique_lock lk(mutex_slots);
+    cv_slots.wait(lk, [&] { return get_pending_captures() == 0; });
+    lk.unlock();
 
-ImageWrite::~ImageWrite() {}
+    close_frames_writer();
+    close_video_stream();
+}
 
 std::vector<InputConnectorHandle> ImageWrite::describe_inputs() {
+    if (cancel_on_reconnect) {
+        cancel_pending_writes();
+    }
     return {con_src};
 }
 
+void ImageWrite::cancel_pending_writes() {
+    pending_writes.request_stop();
+    pending_writes = std::stop_source();
+}
+
+uint32_t ImageWrite::get_pending_captures() const {
+    return std::count_if(ring.begin(), ring.end(), [](const auto& slot) {
+        return slot->state.load(std::memory_order_acquire) != FREE;
+    });
+}
+
+ImageWrite::ReadbackSlot* ImageWrite::acquire_slot(const vk::Extent3D& extent,
+                                                   const vk::Format readback_format,
+                                                   const bool needs_blit,
+                                                   const bool yuv) {
+    // shrink back after the ring was grown or resized.
+    for (auto it = ring.begin(); it != ring.end() && ring.size() > ring_size;) {
+        if ((*it)->state.load(std::memory_order_acquire) == FREE) {
+            it = ring.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    ReadbackSlot* slot = nullptr;
+    while (true) {
+        dispatch_completed_captures();
+
+        // prefer a slot that does not need to be reallocated.
+        for (const auto& candidate : ring) {
+            if (candidate->state.load(std::memory_order_acquire) != FREE) {
+                continue;
+            }
+            slot = candidate.get();
+            if (slot->extent == extent && slot->readback_format == readback_format) {
+                break;
+            }
+        }
+        if (slot == nullptr && ring.size() < ring_size) {
+            slot = ring.emplace_back(std::make_unique<ReadbackSlot>()).get();
+        }
+        if (slot == nullptr && back_pressure == BACK_PRESSURE_GROW) {
+            slot = ring.emplace_back(std::make_unique<ReadbackSlot>()).get();
+            SPDLOG_DEBUG("readback ring grown to {} buffers", ring.size());
+        }
+        if (slot != nullptr || back_pressure == BACK_PRESSURE_DROP) {
+            break;
+        }
+
+        // BACK_PRESSURE_WAIT: wait for the oldest copy or any encoder.
+        stalls++;
+        const auto stall_start = std::chrono::steady_clock::now();
+        uint64_t oldest_recorded = UINT64_MAX;
+        for (const auto& candidate : ring) {
+            if (candidate->state.load(std::memory_order_acquire) == RECORDED) {
+                oldest_recorded = std::min(oldest_recorded, candidate->ready_value);
+            }
+        }
+        if (oldest_recorded != UINT64_MAX) {
+            iteration_semaphore->wait(oldest_recorded);
+        } else {
+            std::unique_lock lk(mutex_slots);
+            cv_slots.wait(lk, [&] { return get_pending_captures() < ring.size(); });
+        }
+        stall_duration += std::chrono::steady_clock::now() - stall_start;
+    }
+
+    if (slot == nullptr) {
+        return nullptr;
+    }
+
+    vk::DeviceSize size;
+    if (yuv) {
+        // the shader writes whole words
+        size = (VideoStreamWriter::get_frame_size(extent.width, extent.height) + 3) / 4 * 4;
+    } else {
+        size = 4 * raw_frames::get_component_size(get_component_type(readback_format)) *
+               extent.width * extent.height;
+    }
+    if (!slot->buffer || slot->buffer->get_size() < size) {
+        slot->buffer = allocator->createBuffer(
+            size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+            MemoryMappingType::HOST_ACCESS_RANDOM, "image write readback");
+    }
+    if (!needs_blit) {
+        slot->intermediate_image.reset();
+        slot->yuv_texture.reset();
+    } else if (!slot->intermediate_image || slot->intermediate_image->get_extent() != extent ||
+               slot->intermediate_image->get_format() != readback_format ||
+               (bool)slot->yuv_texture != yuv) {
+        const vk::ImageCreateInfo intermediate_info{
+            {},
+            vk::ImageType::e2D,
+            readback_format,
+            extent,
+            1,
+            1,
+            vk::SampleCountFlagBits::e1,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc |
+                (yuv ? vk::ImageUsageFlagBits::eStorage : vk::ImageUsageFlagBits{}),
+            vk::SharingMode::eExclusive,
+            {},
+            {},
+            vk::ImageLayout::eUndefined,
+        };
+        slot->intermediate_image = allocator->createImage(intermediate_info);
+        slot->yuv_texture =
+            yuv ? allocator->createTexture(slot->intermediate_image, "image write yuv input")
+                : nullptr;
+    }
+    if (yuv) {
+        // the slot is free, the set is not in use.
+        if (!slot->yuv_set) {
+            slot->yuv_set = allocator->get_descriptor_allocator()->allocate(yuv_set_layout);
+        }
+        DescriptorSetUpdate(slot->yuv_set)
+            .write_descriptor_texture(0, slot->yuv_texture, 0, 1, vk::ImageLayout::eGeneral)
+            .write_descriptor_buffer(1, slot->buffer)
+            .update(context);
+    }
+    slot->extent = extent;
+    slot->readback_format = readback_format;
+
+    return slot;
+}
+
+void ImageWrite::dispatch_completed_captures() {
+    if (!iteration_semaphore) {
+        return;
+    }
+
+    const uint64_t completed = iteration_semaphore->get_counter_value();
+    std::vector<ReadbackSlot*> video_frames;
+    for (const auto& slot : ring) {
+        if (slot->state.load(std::memory_order_acquire) != RECORDED ||
+            slot->ready_value > completed) {
+            continue;
+        }
+        if (slot->stop_token.stop_requested()) {
+            slot->video_stream.reset();
+            slot->state.store(FREE, std::memory_order_release);
+            continue;
+        }
+        if (slot->video_stream) {
+            slot->state.store(ENCODING, std::memory_order_release);
+            video_frames.emplace_back(slot.get());
+            continue;
+        }
+
+        slot->state.store(ENCODING, std::memory_order_release);
+        ReadbackSlot* encode_slot = slot.get();
+        // frees the slot when the task is destroyed, which also happens if it is cancelled.
+        const std::shared_ptr<void> release(nullptr, [this, encode_slot](void*) {
+            {
+                std::lock_guard lk(mutex_slots);
+                encode_slot->state.store(FREE, std::memory_order_release);
+            }
+            cv_slots.notify_all();
+        });
+        context->thread_pool.submit_detached(
+            [this, encode_slot, release] { encode(*encode_slot); },
+            {"image write", ThreadPool::Priority::BACKGROUND, slot->stop_token});
+    }
+
+    if (video_frames.empty()) {
+        return;
+    }
+    // Copies finish in the order they were recorded, all earlier frames completed already and
+    // were queued by this or a previous call.
+    std::sort(video_frames.begin(), video_frames.end(),
+              [](const auto* a, const auto* b) { return a->ready_value < b->ready_value; });
+    for (ReadbackSlot* slot : video_frames) {
+        // schedules the write task before the queue can fill up, push blocks only until it
+        // catches up.
+        video_queue.push(slot);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!video_writing.exchange(true)) {
+            context->thread_pool.submit_detached(
+                [this] { write_video_frames(); },
+                {"image write video", ThreadPool::Priority::BACKGROUND});
+        }
+    }
+}
+
+void ImageWrite::write_video_frames() {
+    while (true) {
+        const std::optional<ReadbackSlot*> next = video_queue.try_pop();
+        if (!next) {
+            video_writing.store(false);
+            // a frame that was pushed before the flag was cleared would not schedule a new task.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (video_queue.empty() || video_writing.exchange(true)) {
+                return;
+            }
+            continue;
+        }
+        ReadbackSlot* slot = *next;
+
+        const auto start = std::chrono::steady_clock::now();
+        const vk::Extent3D& extent = slot->extent;
+        if (!slot->stop_token.stop_requested()) {
+            try {
+                const MemoryAllocationHandle& memory = slot->buffer->get_memory();
+                memory->invalidate();
+                const void* mem = memory->map();
+                defer {
+                    memory->unmap();
+                };
+                slot->video_stream->write_frame(mem);
+            } catch (const std::exception& e) {
+                SPDLOG_ERROR("writing video frame failed: {}", e.what());
+            }
+
+            encoded.fetch_add(1, std::memory_order_relaxed);
+            encoded_pixels.fetch_add((uint64_t)extent.width * extent.height,
+                                     std::memory_order_relaxed);
+            const std::chrono::nanoseconds duration = std::chrono::steady_clock::now() - start;
+            encode_nanos.fetch_add(duration.count(), std::memory_order_relaxed);
+        }
+
+        // closes the stream if it was the last frame
+        slot->video_stream.reset();
+        {
+            std::lock_guard lk(mutex_slots);
+            slot->state.store(FREE, std::memory_order_release);
+        }
+        cv_slots.notify_all();
+    }
+}
+
+void ImageWrite::encode(ReadbackSlot& slot) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::filesystem::path& path = slot.path;
+    const vk::Extent3D& extent = slot.extent;
+
+    try {
+        std::filesystem::create_directories(path.parent_path());
+
+        const MemoryAllocationHandle& memory = slot.buffer->get_memory();
+        memory->invalidate();
+        const void* mem = memory->map();
+        defer {
+            memory->unmap();
+        };
+
+        if (slot.format == FORMAT_RAW_MULTI_FRAME) {
+            // the encoders append in completion order, the frame number restores the order.
+            get_frames_writer(path)->append(extent.width, extent.height, 4,
+                                            get_component_type(slot.readback_format), mem,
+                                            slot.record_iteration, slot.record_time);
+        } else {
+            const std::string tmp_filename =
+                (path.parent_path() / (".interm_" + path.filename().string())).string();
+
+            if (slot.format == FORMAT_RAW) {
+                RawFramesWriter writer(tmp_filename, false);
+                writer.append(extent.width, extent.height, 4,
+                              get_component_type(slot.readback_format), mem,
+                              slot.record_iteration, slot.record_time);
+                writer.finalize();
+            } else {
+                std::ofstream file(tmp_filename, std::ios::out | std::ios::binary);
+                if (!file) {
+                    throw std::runtime_error{fmt::format("cannot open {}", tmp_filename)};
+                }
+                const ImageEncoder encoder(context->thread_pool, slot.encoder_options);
+                switch (slot.format) {
+                case FORMAT_PNG: {
+                    encoder.write_png(file, static_cast<const uint8_t*>(mem), extent.width,
+                                      extent.height);
+                    break;
+                }
+                case FORMAT_JPG: {
+                    encoder.write_jpg(file, static_cast<const uint8_t*>(mem), extent.width,
+                                      extent.height);
+                    break;
+                }
+                case FORMAT_HDR: {
+                    encoder.write_hdr(file, static_cast<const float*>(mem), extent.width,
+                                      extent.height);
+                    break;
+                }
+                case FORMAT_EXR: {
+                    encoder.write_exr(file, static_cast<const uint16_t*>(mem), extent.width,
+                                      extent.height);
+                    break;
+                }
+                }
+                file.close();
+                if (!file) {
+                    throw std::runtime_error{fmt::format("writing {} failed", tmp_filename)};
+                }
+            }
+
+            try {
+                std::filesystem::rename(tmp_filename, path);
+            } catch (std::filesystem::filesystem_error const&) {
+                SPDLOG_WARN("rename failed! Falling back to copy...");
+                std::filesystem::copy(tmp_filename, path);
+                std::filesystem::remove(tmp_filename);
+            }
+        }
+    } catch (const std::exception& e) {
+        SPDLOG_ERROR("writing {} failed: {}", path.string(), e.what());
+    }
+
+    encoded.fetch_add(1, std::memory_order_relaxed);
+    encoded_pixels.fetch_add((uint64_t)extent.width * extent.height, std::memory_order_relaxed);
+    const std::chrono::nanoseconds duration = std::chrono::steady_clock::now() - start;
+    encode_nanos.fetch_add(duration.count(), std::memory_order_relaxed);
+}
+
+RawFramesWriterHandle ImageWrite::get_frames_writer(const std::filesystem::path& path) {
+    std::lock_guard lk(mutex_frames_writer);
+    if (!frames_writer || frames_writer->get_path() != path) {
+        // appends if the file exists
+        frames_writer = std::make_shared<RawFramesWriter>(path);
+    }
+    return frames_writer;
+}
+
+void ImageWrite::close_frames_writer() {
+    std::lock_guard lk(mutex_frames_writer);
+    frames_writer.reset();
+}
+
+void ImageWrite::close_video_stream() {
+    video_stream.reset();
+}
+
 void ImageWrite::record() {
     record_enable = true;
     needs_rebuild |= rebuild_on_record;
@@ -44,6 +478,10 @@ void ImageWrite::record() {
 
 ImageWrite::NodeStatusFlags ImageWrite::pre_process(GraphRun& run,
                                                     [[maybe_unused]] const NodeIO& io) {
+    // completion-driven: hand finished copies to the encoder as soon as possible.
+    iteration_semaphore = run.get_iteration_semaphore();
+    dispatch_completed_captures();
+
     if (!record_enable && ((int64_t)run.get_iteration() == enable_run)) {
         record();
     }
@@ -77,6 +515,10 @@ void ImageWrite::process(GraphRun& run,
     if (exit_after_seconds >= 0 && time_since_record.seconds() >= exit_after_seconds) {
         raise(SIGTERM);
     }
+    if (!record_enable) {
+        // finishes the video (once the queued frames are written)
+        close_video_stream();
+    }
 
     //--------- RECORD TRIGGER
     // RECORD TRIGGER 0: Iteration
@@ -138,70 +580,64 @@ void ImageWrite::process(GraphRun& run,
 
     // RECORD FRAME
 
-    const vk::Format format =
-        this->format == FORMAT_HDR ? vk::Format::eR32G32B32A32Sfloat : vk::Format::eR8G8B8A8Srgb;
-    const vk::FormatProperties format_properties =
-        context->physical_device.physical_device.getFormatProperties(format);
-
-    FrameData& frame_data = io.frame_data<FrameData>();
-    frame_data.intermediate_image.reset();
-
-    vk::ImageCreateInfo linear_info{
-        {},
-        vk::ImageType::e2D,
-        format,
-        scaled,
-        1,
-        1,
-        vk::SampleCountFlagBits::e1,
-        vk::ImageTiling::eLinear,
-        vk::ImageUsageFlagBits::eTransferDst,
-        vk::SharingMode::eExclusive,
-        {},
-        {},
-        vk::ImageLayout::eUndefined,
-    };
-    ImageHandle linear_image =
-        allocator->createImage(linear_info, MemoryMappingType::HOST_ACCESS_RANDOM);
-    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
-                        {}, {}, {},
-                        linear_image->barrier(vk::ImageLayout::eTransferDstOptimal, {},
-                                              vk::AccessFlagBits::eTransferWrite));
-
-    if (format_properties.linearTilingFeatures & vk::FormatFeatureFlagBits::eBlitDst) {
-        // blit directly onto the linear image
-        MERIAN_PROFILE_SCOPE_GPU(run.get_profiler(), cmd, "blit to linear image");
-        cmd_blit_stretch(cmd, *src, src->get_current_layout(), src->get_extent(), *linear_image,
-                         vk::ImageLayout::eTransferDstOptimal, linear_image->get_extent());
+    const bool video = is_video_format(format);
+    if (video && !video_stream) {
+        // a single capture without recording is a video with one frame.
+        try {
+            if (video_command.empty()) {
+                std::filesystem::create_directories(path.parent_path());
+            }
+            video_stream = std::make_shared<VideoStreamWriter>(
+                video_command.empty() ? path.string() : video_command,
+                video_command.empty() ? VideoStreamWriter::Target::PATH
+                                      : VideoStreamWriter::Target::COMMAND,
+                format == FORMAT_Y4M ? VideoStreamWriter::Container::Y4M
+                                     : VideoStreamWriter::Container::RAW,
+                scaled.width, scaled.height, record_framerate);
+        } catch (const std::exception& e) {
+            SPDLOG_ERROR("opening video stream failed: {}", e.what());
+        }
+    }
 
+    const vk::Format readback_format = get_readback_format(format, raw_precision);
+    // the input can be copied as it is if it does not need to be scaled or converted.
+    const bool needs_blit =
+        video || src->get_format() != readback_format || src->get_extent() != scaled;
+
+    iteration_semaphore = run.get_iteration_semaphore();
+    ReadbackSlot* slot = nullptr;
+    if (video && !video_stream) {
+        dropped++;
+    } else if (video && (video_stream->get_width() != scaled.width ||
+                         video_stream->get_height() != scaled.height)) {
+        dropped++;
+        SPDLOG_ERROR("the frames of a video must have the same size, dropping capture");
     } else {
-        // cannot blit directly to the linear image with the desired format
-        // therefore blit first onto a optimal tiled image and then copy to linear tiled image.
-        {
-            MERIAN_PROFILE_SCOPE_GPU(run.get_profiler(), cmd, "blit to optimal tiled image");
-            vk::ImageCreateInfo intermediate_info{
-                {},
-                vk::ImageType::e2D,
-                format,
-                scaled,
-                1,
-                1,
-                vk::SampleCountFlagBits::e1,
-                vk::ImageTiling::eOptimal,
-                vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc,
-                vk::SharingMode::eExclusive,
-                {},
-                {},
-                vk::ImageLayout::eUndefined,
-            };
-            ImageHandle intermediate_image = allocator->createImage(intermediate_info);
-            frame_data.intermediate_image = intermediate_image;
-
+        slot = acquire_slot(scaled, readback_format, needs_blit, video);
+        if (slot == nullptr) {
+            dropped++;
+            SPDLOG_WARN("no readback buffer available, dropping capture {}", path.string());
+        }
+    }
+    if (slot != nullptr) {
+        const vk::BufferImageCopy region{0, 0, 0, first_layer(), {0, 0, 0}, scaled};
+
+        if (!needs_blit) {
+            // the input can be copied as it is
+            MERIAN_PROFILE_SCOPE_GPU(run.get_profiler(), cmd, "copy to readback buffer");
+            cmd.copyImageToBuffer(*src, src->get_current_layout(), *slot->buffer, region);
+        } else {
+            // scale or convert using an optimal tiled image first, linear images usually do not
+            // support blitting.
+            MERIAN_PROFILE_SCOPE_GPU(run.get_profiler(), cmd, "blit and copy to readback buffer");
+            const ImageHandle& intermediate_image = slot->intermediate_image;
             cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
                                 vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
                                 intermediate_image->barrier(vk::ImageLayout::eTransferDstOptimal,
-                                                            {},
-                                                            vk::AccessFlagBits::eTransferWrite));
+                                                            {}, vk::AccessFlagBits::eTransferWrite,
+                                                            VK_QUEUE_FAMILY_IGNORED,
+                                                            VK_QUEUE_FAMILY_IGNORED,
+                                                            all_levels_and_layers(), true));
             cmd_blit_stretch(cmd, *src, src->get_current_layout(), src->get_extent(),
                              *intermediate_image, vk::ImageLayout::eTransferDstOptimal,
                              intermediate_image->get_extent());
@@ -210,75 +646,57 @@ void ImageWrite::process(GraphRun& run,
                                 intermediate_image->barrier(vk::ImageLayout::eTransferSrcOptimal,
                                                             vk::AccessFlagBits::eTransferWrite,
                                                             vk::AccessFlagBits::eTransferRead));
+            if (!video) {
+                cmd.copyImageToBuffer(*intermediate_image,
+                                      intermediate_image->get_current_layout(), *slot->buffer,
+                                      region);
+            }
         }
-        {
-            MERIAN_PROFILE_SCOPE_GPU(run.get_profiler(), cmd, "copy to linear image");
-            cmd.copyImage(*frame_data.intermediate_image.value(),
-                          frame_data.intermediate_image.value()->get_current_layout(),
-                          *linear_image, linear_image->get_current_layout(),
-                          vk::ImageCopy(first_layer(), {}, first_layer(), {},
-                                        frame_data.intermediate_image.value()->get_extent()));
+        if (video) {
+            MERIAN_PROFILE_SCOPE_GPU(run.get_profiler(), cmd, "convert to yuv");
+            const ImageHandle& intermediate_image = slot->intermediate_image;
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eComputeShader, {}, {}, {},
+                                intermediate_image->barrier(vk::ImageLayout::eGeneral,
+                                                            vk::AccessFlagBits::eTransferWrite,
+                                                            vk::AccessFlagBits::eShaderRead));
+            const YUVPushConstant pc{scaled.width, scaled.height, (scaled.width + 1) / 2,
+                                     (scaled.height + 1) / 2};
+            const uint32_t words =
+                (VideoStreamWriter::get_frame_size(scaled.width, scaled.height) + 3) / 4;
+            yuv_pipeline->bind(cmd);
+            yuv_pipeline->bind_descriptor_set(cmd, slot->yuv_set);
+            yuv_pipeline->push_constant(cmd, pc);
+            cmd.dispatch((words + yuv_local_size_x - 1) / yuv_local_size_x, 1, 1);
         }
+        cmd.pipelineBarrier(video ? vk::PipelineStageFlagBits::eComputeShader
+                                  : vk::PipelineStageFlagBits::eTransfer,
+                            vk::PipelineStageFlagBits::eHost, {}, {},
+                            slot->buffer->buffer_barrier(video ? vk::AccessFlagBits::eShaderWrite
+                                                               : vk::AccessFlagBits::eTransferWrite,
+                                                         vk::AccessFlagBits::eHostRead),
+                            {});
+
+        slot->extent = scaled;
+        slot->format = this->format;
+        slot->encoder_options.compression = (ImageEncoder::Compression)compression;
+        slot->encoder_options.quality = jpg_quality;
+        slot->encoder_options.tasks = encoder_threads;
+        // the stripes should not delay the graph's work.
+        slot->encoder_options.priority = ThreadPool::Priority::BACKGROUND;
+        slot->path = path;
+        slot->video_stream = video ? video_stream : nullptr;
+        slot->record_iteration = iteration;
+        slot->record_time = time_since_record.seconds();
+        slot->ready_value = run.get_total_iteration() + 1;
+        slot->stop_token = pending_writes.get_token();
+        slot->state.store(RECORDED, std::memory_order_release);
+        captured++;
     }
-    cmd.pipelineBarrier(
-        vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, {}, {},
-        linear_image->barrier(vk::ImageLayout::eGeneral, vk::AccessFlagBits::eTransferWrite,
-                              vk::AccessFlagBits::eHostRead));
-
-    TimelineSemaphoreHandle image_ready = std::make_shared<TimelineSemaphore>(context, 0);
-    run.add_signal_semaphore(image_ready, 1);
-
-    std::unique_lock lk(mutex_concurrent);
-    cv_concurrent.wait(lk, [&] { return concurrent_tasks < max_concurrent_tasks; });
-    concurrent_tasks++;
-    lk.unlock();
-
-    std::filesystem::create_directories(path.parent_path());
-    const std::string tmp_filename =
-        (path.parent_path() / (".interm_" + path.filename().string())).string();
-
-    const std::function<void()> write_task =
-        ([this, image_ready, linear_image, path, tmp_filename]() {
-            image_ready->wait(1);
-            void* mem = linear_image->get_memory()->map();
-
-            switch (this->format) {
-            case FORMAT_PNG: {
-                stbi_write_png(tmp_filename.c_str(), linear_image->get_extent().width,
-                               linear_image->get_extent().height, 4, mem,
-                               linear_image->get_extent().width * 4);
-                break;
-            }
-            case FORMAT_JPG: {
-                stbi_write_jpg(tmp_filename.c_str(), linear_image->get_extent().width,
-                               linear_image->get_extent().height, 4, mem, 100);
-                break;
-            }
-            case FORMAT_HDR: {
-                stbi_write_hdr(tmp_filename.c_str(), linear_image->get_extent().width,
-                               linear_image->get_extent().height, 4, static_cast<float*>(mem));
-                break;
-            }
-            }
-
-            try {
-                std::filesystem::rename(tmp_filename, path);
-            } catch (std::filesystem::filesystem_error const&) {
-                SPDLOG_WARN("rename failed! Falling back to copy...");
-                std::filesystem::copy(tmp_filename, path);
-                std::filesystem::remove(tmp_filename);
-            }
-
-            linear_image->get_memory()->unmap();
-            std::unique_lock lk(mutex_concurrent);
-            concurrent_tasks--;
-            lk.unlock();
-            cv_concurrent.notify_all();
-            return;
-        });
-
-    context->thread_pool.submit(write_task);
 
+    if (!record_enable) {
+        close_video_stream();
+    }
     if (rebuild_after_capture)
         run.request_reconnect();
     if (callback_after_capture && callback)
@@ -291,7 +709,64 @@ void ImageWrite::process(GraphRun& run,
 
 ImageWrite::NodeStatusFlags ImageWrite::properties([[maybe_unused]] Properties& config) {
     config.st_separate("General");
-    config.config_options("format", format, {"PNG", "JPG", "HDR"}, Properties::OptionsStyle::COMBO);
+    const int old_format = format;
+    config.config_options("format", format,
+                          {"PNG", "JPG", "HDR", "EXR", "raw", "raw multi-frame", "Y4M video",
+                           "raw YUV video"},
+                          Properties::OptionsStyle::COMBO,
+                          "raw writes the pixels uncompressed with a small header (see "
+                          "RawFramesReader), raw multi-frame appends all captures to one file. Use "
+                          "a filename without per-capture variables for multi-frame files. The "
+                          "video formats stream YUV 4:2:0 frames to one file per recording.");
+    if (format != old_format) {
+        close_video_stream();
+    }
+    if (format == FORMAT_PNG) {
+        config.config_options("compression", compression,
+                              {"none", "fastest", "fast", "default", "best"},
+                              Properties::OptionsStyle::COMBO,
+                              "Effort of the compressor. Lower levels encode faster but produce "
+                              "larger files, none only filters the rows.");
+    }
+    if (format == FORMAT_JPG) {
+        config.config_int("quality", jpg_quality, 1, 100,
+                          "JPEG quality, chroma is subsampled below 90.");
+    }
+    if (format == FORMAT_RAW || format == FORMAT_RAW_MULTI_FRAME) {
+        config.config_options("precision", raw_precision, {"float", "half"},
+                              Properties::OptionsStyle::COMBO,
+                              "Components are converted to half floats on the GPU.");
+    }
+    if (format == FORMAT_RAW_MULTI_FRAME) {
+        uint32_t frame_count = 0;
+        {
+            std::lock_guard lk(mutex_frames_writer);
+            if (frames_writer) {
+                frame_count = frames_writer->get_frame_count();
+            }
+        }
+        config.output_text(fmt::format("frames in file: {}", frame_count));
+        if (config.config_bool("close multi-frame file",
+                               "Writes the index. The file is closed automatically when the node "
+                               "is destroyed, later captures are appended.")) {
+            close_frames_writer();
+        }
+    }
+    if (is_video_format(format)) {
+        std::ignore = config.config_text(
+            "command", video_command, true,
+            "If not empty the video is piped to the stdin of this command instead of written to "
+            "the file, e.g. ffmpeg -y -i - -c:v libx264 out.mp4 (for raw YUV pass size and "
+            "frame rate with -f rawvideo -pix_fmt yuv420p -s WxH -r R). The frame rate is the "
+            "record framerate.");
+        config.output_text(fmt::format("frames in stream: {}",
+                                       video_stream ? video_stream->get_frame_count() : 0));
+        if (config.config_bool("close video stream",
+                               "Finishes the video, the next capture starts a new one. Happens "
+                               "automatically when recording stops.")) {
+            close_video_stream();
+        }
+    }
     config.config_bool("rebuild after capture", rebuild_after_capture,
                        "forces a graph rebuild after every capture");
     std::ignore =
@@ -352,9 +827,34 @@ ImageWrite::NodeStatusFlags ImageWrite::properties([[maybe_unused]] Properties&
     }
     config.st_separate();
     if (config.st_begin_child("advanced", "Advanced")) {
-        config.config_uint("concurrency", max_concurrent_tasks, 1,
-                           std::thread::hardware_concurrency(),
-                           "Limit the maximum concurrency. Might be necessary with low memory.");
+        config.config_uint("ring size", ring_size, 1, 256,
+                           "Number of readback buffers. Limits the captures that are in flight or "
+                           "being encoded, might be necessary with low memory.");
+        config.config_options("back-pressure", back_pressure, {"wait", "drop", "grow"},
+                              Properties::OptionsStyle::COMBO,
+                              "What happens if all readback buffers are in use. wait: block the "
+                              "graph until a buffer is free (lossless). drop: skip the capture. "
+                              "grow: add a buffer to the ring (lossless, unbounded memory).");
+        config.config_uint("encoder threads", encoder_threads, 1,
+                           std::max(1u, std::thread::hardware_concurrency()),
+                           "Maximum number of stripes of one image that are encoded in parallel. "
+                           "Multiple captures are encoded concurrently as well.");
+        dispatch_completed_captures();
+        const uint64_t encoded_count = encoded.load(std::memory_order_relaxed);
+        const uint64_t nanos = encode_nanos.load(std::memory_order_relaxed);
+        config.output_text(fmt::format(
+            "pending writes: {} / {}\ncaptured: {}\nencoded: {} (mean {:.1f} ms, {:.1f} "
+            "MP/s)\ndropped: {}\nstalls: {} ({:.1f} ms waited)",
+            get_pending_captures(), ring.size(), captured, encoded_count,
+            encoded_count > 0 ? nanos / 1e6 / encoded_count : 0.0,
+            nanos > 0 ? encoded_pixels.load(std::memory_order_relaxed) * 1e3 / nanos : 0.0,
+            dropped, stalls, to_milliseconds(stall_duration)));
+        if (config.config_bool("cancel pending writes")) {
+            cancel_pending_writes();
+        }
+        config.config_bool("cancel on reconnect", cancel_on_reconnect,
+                           "Cancels writes that did not start yet when the graph reconnects. Do "
+                           "not combine with rebuild after capture.");
         config.config_percent("scale", scale);
         config.st_separate();
         config.config_int(
@@ -391,8 +891,9 @@ ImageWrite::NodeStatusFlags ImageWrite::properties([[maybe_unused]] Properties&
     }
     config.st_separate();
     config.output_text(
-        "Hint: convert to video with ffmpeg -framerate <framerate> -pattern_type glob -i "
-        "'*.jpg' -level 3.0 -pix_fmt yuv420p out.mp4");
+        "Hint: use a video format to avoid writing images, or convert images to video with "
+        "ffmpeg -framerate <framerate> -pattern_type glob -i '*.jpg' -level 3.0 -pix_fmt yuv420p "
+        "out.mp4");
     return {};
 }
 
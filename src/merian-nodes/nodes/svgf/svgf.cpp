@@ -68,13 +68,12 @@ SVGF::NodeStatusFlags SVGF::on_connected([[maybe_unused]] const NodeIOLayout& io
                                .add_binding_storage_image()
                                .build_layout(context);
     }
-    filter_pool = std::make_shared<DescriptorPool>(ping_pong_layout, 2); // ping pong
-
     // Ping pong textures
     irr_create_info.usage |= vk::ImageUsageFlagBits::eSampled;
     for (int i = 0; i < 2; i++) {
         if (!ping_pong_res[i].set)
-            ping_pong_res[i].set = std::make_shared<DescriptorSet>(filter_pool);
+            ping_pong_res[i].set =
+                allocator->get_descriptor_allocator()->allocate(ping_pong_layout);
 
         ImageHandle tmp_irr_image = allocator->createImage(irr_create_info, MemoryMappingType::NONE,
                                                            fmt::format("SVGF ping pong: {}", i));
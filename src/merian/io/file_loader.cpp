@@ -9,6 +9,29 @@
 
 namespace merian {
 
+// Results for files that were not found are recomputed after this time, since they might have been
+// created in the meantime.
+static constexpr std::chrono::seconds NEGATIVE_ENTRY_LIFETIME{1};
+// The cache is cleared if it grows larger, stale entries are only replaced lazily.
+static constexpr std::size_t MAX_CACHE_SIZE = 4096;
+
+FileLoader::FileLoader(const FileLoader& other)
+    : search_paths(other.search_paths), enable_search_cwd_parents(other.enable_search_cwd_parents),
+      cache_enabled(other.cache_enabled) {}
+
+FileLoader& FileLoader::operator=(const FileLoader& other) {
+    if (this == &other) {
+        return *this;
+    }
+
+    search_paths = other.search_paths;
+    enable_search_cwd_parents = other.enable_search_cwd_parents;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_enabled = other.cache_enabled;
+    generation++;
+    return *this;
+}
+
 bool FileLoader::exists(const std::filesystem::path& path,
                         std::filesystem::file_status file_status) {
     return (std::filesystem::status_known(file_status) ? std::filesystem::exists(file_status)
@@ -20,25 +43,35 @@ std::string FileLoader::load_file(const std::filesystem::path& path) {
         throw std::runtime_error{fmt::format("failed to load {} (does not exist)", path.string())};
     }
 
-    // Open the stream to 'lock' the file.
-    std::ifstream f(path, std::ios::in | std::ios::binary);
-    const std::size_t size = std::filesystem::file_size(path);
-
-    std::string result(size, '\0');
-    f.read(result.data(), (std::streamsize)size);
+    // Copying from a mapping would keep the touched pages resident next to the copy (twice the
+    // file size at the peak), read directly into the string instead.
+    std::string result(std::filesystem::file_size(path), '\0');
+    read_file(path, result.data(), result.size());
+    return result;
+}
 
+void FileLoader::read_file(const std::filesystem::path& path, void* data, const std::size_t size) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.read(static_cast<char*>(data), (std::streamsize)size)) {
+        throw std::runtime_error{fmt::format("failed to read {}", path.string())};
+    }
     SPDLOG_DEBUG("load {} of data from {}", format_size(size), path.string());
+}
 
-    return result;
+MappedFileHandle FileLoader::map_file(const std::filesystem::path& path,
+                                      const MappedFile::AccessPattern access_pattern,
+                                      const bool prefetch) {
+    return std::make_shared<MappedFile>(path, access_pattern, prefetch);
 }
 
 // returns empty path if not found.
-std::optional<std::filesystem::path>
-FileLoader::search_cwd_parents(const std::filesystem::path& path) {
+static std::optional<std::filesystem::path> search_cwd_parents(const std::filesystem::path& path,
+                                                               uint64_t& stat_calls) {
     std::filesystem::path current = std::filesystem::current_path();
     while (true) {
         const std::filesystem::path full_path = current / path;
-        if (exists(full_path)) {
+        stat_calls++;
+        if (FileLoader::exists(full_path)) {
             return std::filesystem::weakly_canonical(full_path);
         }
         if (current.parent_path() == current) {
@@ -50,21 +83,50 @@ FileLoader::search_cwd_parents(const std::filesystem::path& path) {
     return std::nullopt;
 }
 
+// returns empty path if not found.
+std::optional<std::filesystem::path>
+FileLoader::search_cwd_parents(const std::filesystem::path& path) {
+    uint64_t stat_calls = 0;
+    return merian::search_cwd_parents(path, stat_calls);
+}
+
 // Searches the file in cwd and search paths and returns the full
 // path to the file. If the filename is relative parents are searched if configured.
 std::optional<std::filesystem::path>
 FileLoader::find_file(const std::filesystem::path& path) const {
+    return cached(path.string(),
+                  [&](uint64_t& stat_calls) { return resolve(path, stat_calls); });
+}
+
+std::optional<std::filesystem::path>
+FileLoader::find_file(const std::filesystem::path& filename,
+                      const std::filesystem::path& relative_to_file_or_directory) const {
+    return cached(filename.string() + '\0' + relative_to_file_or_directory.string(),
+                  [&](uint64_t& stat_calls) {
+                      stat_calls++;
+                      const std::filesystem::path relative_to =
+                          std::filesystem::is_directory(filename)
+                              ? relative_to_file_or_directory
+                              : relative_to_file_or_directory.parent_path();
+                      return resolve(relative_to / filename, stat_calls);
+                  });
+}
+
+std::optional<std::filesystem::path> FileLoader::resolve(const std::filesystem::path& path,
+                                                         uint64_t& stat_calls) const {
+    stat_calls++;
     if (exists(path)) {
         return std::filesystem::weakly_canonical(path);
     }
     if (enable_search_cwd_parents && path.is_relative()) {
-        const auto match_in_parents = search_cwd_parents(path);
+        const auto match_in_parents = merian::search_cwd_parents(path, stat_calls);
         if (match_in_parents) {
             return *match_in_parents;
         }
     }
     for (const auto& search_path : search_paths) {
         const std::filesystem::path full_path = search_path / path;
+        stat_calls++;
         if (exists(full_path))
             return std::filesystem::weakly_canonical(full_path);
     }
@@ -73,13 +135,40 @@ FileLoader::find_file(const std::filesystem::path& path) const {
     return std::nullopt;
 }
 
-std::optional<std::filesystem::path>
-FileLoader::find_file(const std::filesystem::path& filename,
-                      const std::filesystem::path& relative_to_file_or_directory) const {
-    const std::filesystem::path relative_to = std::filesystem::is_directory(filename)
-                                                  ? relative_to_file_or_directory
-                                                  : relative_to_file_or_directory.parent_path();
-    return find_file(relative_to / filename);
+std::optional<std::filesystem::path> FileLoader::cached(
+    const std::string& key,
+    const std::function<std::optional<std::filesystem::path>(uint64_t& stat_calls)>&
+        resolve_uncached) const {
+    std::unique_lock<std::mutex> lock(cache_mutex);
+    const uint64_t lookup_generation = generation;
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (cache_enabled) {
+        const auto it = cache.find(key);
+        if (it != cache.end() && it->second.generation == lookup_generation &&
+            (it->second.result || now - it->second.created < NEGATIVE_ENTRY_LIFETIME)) {
+            cache_statistics.hits++;
+            return it->second.result;
+        }
+    }
+    cache_statistics.misses++;
+    const bool store = cache_enabled;
+    // do not hold the lock while querying the file system.
+    lock.unlock();
+
+    uint64_t stat_calls = 0;
+    std::optional<std::filesystem::path> result = resolve_uncached(stat_calls);
+
+    lock.lock();
+    cache_statistics.stat_calls += stat_calls;
+    if (store) {
+        if (cache.size() >= MAX_CACHE_SIZE) {
+            cache.clear();
+        }
+        // if the generation changed in the meantime the entry is stale immediately.
+        cache[key] = {result, lookup_generation, now};
+    }
+
+    return result;
 }
 
 std::optional<std::string>
@@ -108,15 +197,37 @@ void FileLoader::add_search_path(const std::filesystem::path& path) {
         resolved = std::filesystem::weakly_canonical(path);
     }
     search_paths.insert(*resolved);
+    invalidate_cache();
     SPDLOG_DEBUG("added search path {}", resolved->string());
 }
 
 bool FileLoader::remove_search_path(const std::filesystem::path& path) {
-    return search_paths.erase(std::filesystem::weakly_canonical(path)) > 0;
+    if (search_paths.erase(std::filesystem::weakly_canonical(path)) > 0) {
+        invalidate_cache();
+        return true;
+    }
+    return false;
 }
 
 void FileLoader::set_cwd_search_parents(const bool search_parents) {
     this->enable_search_cwd_parents = search_parents;
+    invalidate_cache();
+}
+
+void FileLoader::invalidate_cache() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    generation++;
+}
+
+void FileLoader::set_cache_enabled(const bool enable) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_enabled = enable;
+    generation++;
+}
+
+FileLoader::CacheStatistics FileLoader::get_cache_statistics() const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return cache_statistics;
 }
 
 } // namespace merian
@@ -0,0 +1,609 @@
+#include "merian/io/gltf.hpp"
+#include "merian/utils/defer.hpp"
+#include "merian/utils/string.hpp"
+#include "merian/vk/command/command_pool.hpp"
+
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "stb_image.h"
+#include "tiny_gltf.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <deque>
+#include <fmt/format.h>
+#include <future>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace merian {
+
+namespace {
+
+// Batches that are recorded but possibly not finished on the device. With two batches the
+// conversion of a batch overlaps with the transfer of the previous one.
+constexpr uint32_t MAX_BATCHES_IN_FLIGHT = 2;
+
+// A typed view into a glTF buffer, validated against the buffer size.
+struct AccessorView {
+    const unsigned char* data;
+    std::size_t stride;
+    std::size_t count;
+    int component_type;
+    bool normalized;
+};
+
+// A triangle primitive of the file, converted into the staging memory of its batch.
+struct PrimitiveSource {
+    AccessorView position;
+    std::optional<AccessorView> normal;
+    std::optional<AccessorView> uv;
+    std::optional<AccessorView> indices;
+};
+
+struct Batch {
+    uint32_t first_primitive;
+    uint32_t primitive_count;
+    vk::DeviceSize vertex_size;
+    vk::DeviceSize index_size;
+};
+
+// Tracks the (estimated) host memory of a load. Thread-safe.
+class MemoryTracker {
+  public:
+    void add(const std::size_t size) {
+        const std::size_t current = this->current.fetch_add(size) + size;
+        std::size_t peak = this->peak.load();
+        while (current > peak && !this->peak.compare_exchange_weak(peak, current)) {}
+    }
+
+    void sub(const std::size_t size) {
+        current.fetch_sub(size);
+    }
+
+    std::size_t get_peak() const {
+        return peak.load();
+    }
+
+  private:
+    std::atomic<std::size_t> current{0};
+    std::atomic<std::size_t> peak{0};
+};
+
+// Keeps the encoded image, such that images are decoded on the thread pool and not while parsing.
+bool store_encoded_image(tinygltf::Image* image,
+                         const int /*image_index*/,
+                         std::string* /*error*/,
+                         std::string* /*warning*/,
+                         int /*requested_width*/,
+                         int /*requested_height*/,
+                         const unsigned char* bytes,
+                         int size,
+                         void* /*user_data*/) {
+    image->image.assign(bytes, bytes + size);
+    image->width = -1;
+    image->height = -1;
+    return true;
+}
+
+AccessorView get_accessor_view(const tinygltf::Model& model,
+                               const int accessor_index,
+                               const int type,
+                               const std::initializer_list<int> component_types) {
+    if (accessor_index < 0 || accessor_index >= (int)model.accessors.size()) {
+        throw std::runtime_error{fmt::format("accessor {} does not exist", accessor_index)};
+    }
+    const tinygltf::Accessor& accessor = model.accessors[accessor_index];
+    if (accessor.sparse.isSparse) {
+        throw std::runtime_error{fmt::format("accessor {} is sparse, this is not supported",
+                                             accessor_index)};
+    }
+    if (accessor.type != type ||
+        std::find(component_types.begin(), component_types.end(), accessor.componentType) ==
+            component_types.end()) {
+        throw std::runtime_error{
+            fmt::format("accessor {} has an unsupported type or component type", accessor_index)};
+    }
+    if (accessor.bufferView < 0 || accessor.bufferView >= (int)model.bufferViews.size()) {
+        throw std::runtime_error{
+            fmt::format("accessor {} has no buffer view, this is not supported", accessor_index)};
+    }
+    const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+    if (view.buffer < 0 || view.buffer >= (int)model.buffers.size()) {
+        throw std::runtime_error{fmt::format("buffer view {} does not exist", accessor.bufferView)};
+    }
+    const std::vector<unsigned char>& buffer = model.buffers[view.buffer].data;
+
+    const int stride = accessor.ByteStride(view);
+    if (stride <= 0) {
+        throw std::runtime_error{fmt::format("accessor {} has an invalid stride", accessor_index)};
+    }
+    const std::size_t element_size = (std::size_t)tinygltf::GetComponentSizeInBytes(
+                                         accessor.componentType) *
+                                     tinygltf::GetNumComponentsInType(accessor.type);
+    const std::size_t offset = view.byteOffset + accessor.byteOffset;
+    if (accessor.count > 0 &&
+        offset + (accessor.count - 1) * stride + element_size > buffer.size()) {
+        throw std::runtime_error{fmt::format("accessor {} is out of bounds", accessor_index)};
+    }
+
+    return {buffer.data() + offset, (std::size_t)stride, accessor.count, accessor.componentType,
+            accessor.normalized};
+}
+
+// Normalized integers are mapped to [0, 1] (the only allowed signed case, normals, is float).
+template <uint32_t N> glm::vec<N, float> read_vec(const AccessorView& view, const std::size_t i) {
+    const unsigned char* element = view.data + i * view.stride;
+    glm::vec<N, float> result;
+    switch (view.component_type) {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+        std::memcpy(&result, element, sizeof(result));
+        break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        for (uint32_t c = 0; c < N; c++) {
+            result[c] = element[c] / 255.f;
+        }
+        break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+        for (uint32_t c = 0; c < N; c++) {
+            uint16_t value;
+            std::memcpy(&value, element + c * sizeof(value), sizeof(value));
+            result[c] = value / 65535.f;
+        }
+        break;
+    default:
+        assert(0 && "validated in get_accessor_view");
+    }
+    return result;
+}
+
+uint32_t read_index(const AccessorView& view, const std::size_t i) {
+    const unsigned char* element = view.data + i * view.stride;
+    switch (view.component_type) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        return *element;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        uint16_t value;
+        std::memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    default: {
+        uint32_t value;
+        std::memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    }
+}
+
+// Runs on the thread pool.
+void convert_primitive(const PrimitiveSource& source,
+                       GLTFScene::Vertex* vertices,
+                       uint32_t* indices) {
+    const std::size_t vertex_count = source.position.count;
+    for (std::size_t i = 0; i < vertex_count; i++) {
+        GLTFScene::Vertex& vertex = vertices[i];
+        vertex.position = read_vec<3>(source.position, i);
+        vertex.normal = source.normal ? read_vec<3>(*source.normal, i) : glm::vec3(0);
+        vertex.uv = source.uv ? read_vec<2>(*source.uv, i) : glm::vec2(0);
+    }
+
+    if (!source.indices) {
+        for (uint32_t i = 0; i < vertex_count; i++) {
+            indices[i] = i;
+        }
+        return;
+    }
+    for (std::size_t i = 0; i < source.indices->count; i++) {
+        indices[i] = read_index(*source.indices, i);
+        if (indices[i] >= vertex_count) {
+            throw std::runtime_error{
+                fmt::format("index {} is out of range ({} vertices)", indices[i], vertex_count)};
+        }
+    }
+}
+
+int32_t get_texture_image(const tinygltf::Model& model, const int texture) {
+    if (texture < 0 || texture >= (int)model.textures.size()) {
+        return -1;
+    }
+    return model.textures[texture].source;
+}
+
+glm::mat4 get_local_transform(const tinygltf::Node& node) {
+    if (node.matrix.size() == 16) {
+        glm::mat4 matrix;
+        for (uint32_t i = 0; i < 16; i++) {
+            glm::value_ptr(matrix)[i] = (float)node.matrix[i];
+        }
+        return matrix;
+    }
+
+    glm::mat4 transform(1);
+    if (node.translation.size() == 3) {
+        transform = glm::translate(
+            transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+    }
+    if (node.rotation.size() == 4) {
+        // glTF stores x, y, z, w
+        transform *= glm::mat4_cast(glm::quat((float)node.rotation[3], (float)node.rotation[0],
+                                              (float)node.rotation[1], (float)node.rotation[2]));
+    }
+    if (node.scale.size() == 3) {
+        transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+    }
+    return transform;
+}
+
+} // namespace
+
+GLTFSceneHandle GLTFScene::load(const std::filesystem::path& path,
+                                const ResourceAllocatorHandle& allocator,
+                                const QueueHandle& queue,
+                                ThreadPool& thread_pool,
+                                const vk::DeviceSize batch_size) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::shared_ptr<GLTFScene> scene(new GLTFScene());
+    MemoryTracker memory;
+
+    // Parse
+
+    tinygltf::Model model;
+    {
+        tinygltf::TinyGLTF loader;
+        loader.SetImageLoader(store_encoded_image, nullptr);
+        std::string error;
+        std::string warning;
+        const bool binary = path.extension() == ".glb";
+        const bool success =
+            binary ? loader.LoadBinaryFromFile(&model, &error, &warning, path.string())
+                   : loader.LoadASCIIFromFile(&model, &error, &warning, path.string());
+        if (!warning.empty()) {
+            SPDLOG_WARN("{}: {}", path.string(), warning);
+        }
+        if (!success) {
+            throw std::runtime_error{fmt::format("loading {} failed: {}", path.string(), error)};
+        }
+    }
+    scene->statistics.parse_duration = std::chrono::steady_clock::now() - start;
+
+    std::size_t buffer_memory = 0;
+    for (const tinygltf::Buffer& buffer : model.buffers) {
+        buffer_memory += buffer.data.size();
+    }
+    memory.add(buffer_memory);
+
+    // Decode images in the background
+
+    scene->images.resize(model.images.size());
+    std::atomic<std::chrono::nanoseconds> decode_end{std::chrono::nanoseconds::zero()};
+    std::vector<std::future<void>> image_decodes;
+    // the tasks reference the model and scene, wait for them also if the upload fails
+    defer {
+        for (std::future<void>& decode : image_decodes) {
+            while (decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready &&
+                   thread_pool.run_pending_task()) {}
+            decode.wait();
+        }
+    };
+    for (uint32_t i = 0; i < model.images.size(); i++) {
+        memory.add(model.images[i].image.size());
+        image_decodes.emplace_back(thread_pool.submit<void>(
+            [&model, &scene, &memory, &decode_end, &path, &start, i] {
+                tinygltf::Image& source = model.images[i];
+                Image& image = scene->images[i];
+                image.name = source.name;
+                if (source.image.empty()) {
+                    SPDLOG_WARN("image {} of {} has no data", i, path.string());
+                    return;
+                }
+
+                int width, height, channels;
+                stbi_uc* pixels = stbi_load_from_memory(source.image.data(),
+                                                        (int)source.image.size(), &width,
+                                                        &height, &channels, 4);
+                const std::chrono::nanoseconds decoded =
+                    std::chrono::steady_clock::now() - start;
+                std::chrono::nanoseconds latest = decode_end.load();
+                while (decoded > latest && !decode_end.compare_exchange_weak(latest, decoded)) {}
+                if (pixels) {
+                    image.width = width;
+                    image.height = height;
+                    image.pixels = std::shared_ptr<const void>(pixels, stbi_image_free);
+                    memory.add((std::size_t)width * height * 4);
+                } else {
+                    SPDLOG_WARN("decoding image {} of {} failed: {}", i, path.string(),
+                                stbi_failure_reason());
+                }
+
+                memory.sub(source.image.size());
+                std::vector<unsigned char>().swap(source.image);
+            },
+            {"gltf image decode"}));
+    }
+
+    // Materials
+
+    for (const tinygltf::Material& source : model.materials) {
+        const tinygltf::PbrMetallicRoughness& pbr = source.pbrMetallicRoughness;
+        Material& material = scene->materials.emplace_back();
+        material.name = source.name;
+        material.base_color_factor = glm::vec4(1);
+        for (uint32_t c = 0; c < std::min<std::size_t>(4, pbr.baseColorFactor.size()); c++) {
+            material.base_color_factor[c] = (float)pbr.baseColorFactor[c];
+        }
+        material.metallic_factor = (float)pbr.metallicFactor;
+        material.roughness_factor = (float)pbr.roughnessFactor;
+        material.emissive_factor = glm::vec3(0);
+        for (uint32_t c = 0; c < std::min<std::size_t>(3, source.emissiveFactor.size()); c++) {
+            material.emissive_factor[c] = (float)source.emissiveFactor[c];
+        }
+        material.base_color_image = get_texture_image(model, pbr.baseColorTexture.index);
+        material.metallic_roughness_image =
+            get_texture_image(model, pbr.metallicRoughnessTexture.index);
+        material.normal_image = get_texture_image(model, source.normalTexture.index);
+        material.emissive_image = get_texture_image(model, source.emissiveTexture.index);
+        material.double_sided = source.doubleSided;
+    }
+
+    // Collect primitives and split them into batches
+
+    std::vector<PrimitiveSource> sources;
+    std::vector<Batch> batches;
+    for (uint32_t mesh_index = 0; mesh_index < model.meshes.size(); mesh_index++) {
+        const tinygltf::Mesh& mesh = model.meshes[mesh_index];
+        scene->meshes.push_back({mesh.name, (uint32_t)scene->primitives.size(), 0});
+
+        for (uint32_t primitive_index = 0; primitive_index < mesh.primitives.size();
+             primitive_index++) {
+            const tinygltf::Primitive& primitive = mesh.primitives[primitive_index];
+            if (primitive.mode != -1 && primitive.mode != TINYGLTF_MODE_TRIANGLES) {
+                SPDLOG_WARN("{}: skipping primitive {} of mesh {}: mode {} is not supported",
+                            path.string(), primitive_index, mesh_index, primitive.mode);
+                continue;
+            }
+            const auto position = primitive.attributes.find("POSITION");
+            if (position == primitive.attributes.end()) {
+                SPDLOG_WARN("{}: skipping primitive {} of mesh {}: no positions", path.string(),
+                            primitive_index, mesh_index);
+                continue;
+            }
+
+            PrimitiveSource& source = sources.emplace_back();
+            try {
+                source.position = get_accessor_view(model, position->second, TINYGLTF_TYPE_VEC3,
+                                                    {TINYGLTF_COMPONENT_TYPE_FLOAT});
+                if (const auto normal = primitive.attributes.find("NORMAL");
+                    normal != primitive.attributes.end()) {
+                    source.normal = get_accessor_view(model, normal->second, TINYGLTF_TYPE_VEC3,
+                                                      {TINYGLTF_COMPONENT_TYPE_FLOAT});
+                }
+                if (const auto uv = primitive.attributes.find("TEXCOORD_0");
+                    uv != primitive.attributes.end()) {
+                    source.uv = get_accessor_view(model, uv->second, TINYGLTF_TYPE_VEC2,
+                                                  {TINYGLTF_COMPONENT_TYPE_FLOAT,
+                                                   TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+                                                   TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT});
+                }
+                if (primitive.indices >= 0) {
+                    source.indices = get_accessor_view(model, primitive.indices,
+                                                       TINYGLTF_TYPE_SCALAR,
+                                                       {TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+                                                        TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+                                                        TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT});
+                }
+                if ((source.normal && source.normal->count != source.position.count) ||
+                    (source.uv && source.uv->count != source.position.count)) {
+                    throw std::runtime_error{"attributes have different counts"};
+                }
+            } catch (const std::runtime_error& e) {
+                throw std::runtime_error{fmt::format("{}: primitive {} of mesh {} is not valid: {}",
+                                                     path.string(), primitive_index, mesh_index,
+                                                     e.what())};
+            }
+
+            const std::size_t index_count =
+                source.indices ? source.indices->count : source.position.count;
+            if (index_count == 0) {
+                SPDLOG_WARN("{}: skipping primitive {} of mesh {}: no triangles", path.string(),
+                            primitive_index, mesh_index);
+                sources.pop_back();
+                continue;
+            }
+            if (index_count % 3 != 0 || source.position.count > UINT32_MAX ||
+                index_count > UINT32_MAX) {
+                throw std::runtime_error{
+                    fmt::format("{}: primitive {} of mesh {} is not a valid triangle list",
+                                path.string(), primitive_index, mesh_index)};
+            }
+
+            const vk::DeviceSize vertex_size = source.position.count * sizeof(Vertex);
+            const vk::DeviceSize index_size = index_count * sizeof(uint32_t);
+            if (batches.empty() ||
+                (batches.back().primitive_count > 0 &&
+                 batches.back().vertex_size + batches.back().index_size + vertex_size +
+                         index_size >
+                     batch_size)) {
+                batches.push_back({(uint32_t)scene->primitives.size(), 0, 0, 0});
+            }
+            Batch& batch = batches.back();
+
+            scene->primitives.push_back({nullptr, batch.vertex_size,
+                                         (uint32_t)source.position.count, nullptr,
+                                         batch.index_size, (uint32_t)index_count,
+                                         primitive.material});
+            batch.primitive_count++;
+            batch.vertex_size += vertex_size;
+            batch.index_size += index_size;
+            scene->meshes.back().primitive_count++;
+        }
+    }
+
+    // Convert and upload
+
+    const auto upload_start = std::chrono::steady_clock::now();
+    {
+        const vk::Device& device = queue->get_context()->device;
+        // Not the staging manager of the allocator: it is not thread-safe and would hand out
+        // allocations of other users of the allocator with finalizeResourceSet(). One block
+        // usually holds a batch.
+        const StagingMemoryManagerHandle staging = std::make_shared<StagingMemoryManager>(
+            queue->get_context(), allocator->getMemoryAllocator(), batch_size);
+        const CommandPoolHandle cmd_pool = std::make_shared<CommandPool>(queue);
+
+        struct InFlight {
+            vk::Fence fence;
+            StagingMemoryManager::SetID staging_set;
+            vk::DeviceSize size;
+        };
+        std::deque<InFlight> in_flight;
+        const auto retire_batch = [&]() {
+            const InFlight& batch = in_flight.front();
+            if (device.waitForFences(batch.fence, VK_TRUE, UINT64_MAX) != vk::Result::eSuccess) {
+                throw std::runtime_error{"waiting for the upload failed"};
+            }
+            device.destroyFence(batch.fence);
+            staging->releaseResourceSet(batch.staging_set);
+            memory.sub(batch.size);
+            in_flight.pop_front();
+        };
+        defer {
+            // only if an exception occurred
+            for (const InFlight& batch : in_flight) {
+                [[maybe_unused]] const vk::Result result =
+                    device.waitForFences(batch.fence, VK_TRUE, UINT64_MAX);
+                device.destroyFence(batch.fence);
+                staging->releaseResourceSet(batch.staging_set);
+            }
+        };
+
+        for (uint32_t batch_index = 0; batch_index < batches.size(); batch_index++) {
+            const Batch& batch = batches[batch_index];
+            while (in_flight.size() >= MAX_BATCHES_IN_FLIGHT) {
+                retire_batch();
+            }
+
+            const BufferHandle vertex_buffer = allocator->createBuffer(
+                batch.vertex_size, VERTEX_BUFFER_USAGE, MemoryMappingType::NONE,
+                fmt::format("{} vertices {}", path.filename().string(), batch_index));
+            const BufferHandle index_buffer = allocator->createBuffer(
+                batch.index_size, INDEX_BUFFER_USAGE, MemoryMappingType::NONE,
+                fmt::format("{} indices {}", path.filename().string(), batch_index));
+            scene->buffers.emplace_back(vertex_buffer);
+            scene->buffers.emplace_back(index_buffer);
+
+            const vk::CommandBuffer cmd = cmd_pool->create_and_begin();
+            // convert directly into the staging memory
+            Vertex* vertices =
+                staging->cmdToBufferT<Vertex>(cmd, *vertex_buffer, 0, batch.vertex_size);
+            uint32_t* indices =
+                staging->cmdToBufferT<uint32_t>(cmd, *index_buffer, 0, batch.index_size);
+            const vk::DeviceSize size = batch.vertex_size + batch.index_size;
+            memory.add(size);
+
+            try {
+                parallel_for(
+                    batch.primitive_count,
+                    [&](const uint32_t i, const uint32_t /*thread_index*/) {
+                        Primitive& primitive = scene->primitives[batch.first_primitive + i];
+                        primitive.vertex_buffer = vertex_buffer;
+                        primitive.index_buffer = index_buffer;
+                        convert_primitive(
+                            sources[batch.first_primitive + i],
+                            vertices + primitive.vertex_offset / sizeof(Vertex),
+                            indices + primitive.index_offset / sizeof(uint32_t));
+                    },
+                    thread_pool);
+            } catch (const std::runtime_error& e) {
+                cmd.end();
+                staging->releaseResourceSet(staging->finalizeResourceSet());
+                throw std::runtime_error{fmt::format("{}: {}", path.string(), e.what())};
+            }
+            cmd.end();
+
+            const vk::Fence fence = device.createFence({});
+            queue->submit(cmd, fence);
+            in_flight.push_back({fence, staging->finalizeResourceSet(), size});
+            scene->statistics.uploaded_bytes += size;
+        }
+
+        while (!in_flight.empty()) {
+            retire_batch();
+        }
+    }
+    scene->statistics.upload_batches = batches.size();
+    scene->statistics.upload_duration = std::chrono::steady_clock::now() - upload_start;
+
+    // the geometry is on the device, release the buffers while images are still decoding
+    std::vector<tinygltf::Buffer>().swap(model.buffers);
+    memory.sub(buffer_memory);
+
+    // Instances of the default scene
+
+    const auto add_instances = [&](const int root) {
+        // (node, parent transform), iterative to support deep hierarchies
+        std::vector<std::pair<int, glm::mat4>> stack{{root, glm::mat4(1)}};
+        // a tree visits every node at most once, more visits indicate a cycle
+        std::size_t visited = 0;
+        while (!stack.empty()) {
+            const auto [node_index, parent_transform] = stack.back();
+            stack.pop_back();
+            if (node_index < 0 || node_index >= (int)model.nodes.size() ||
+                ++visited > model.nodes.size()) {
+                throw std::runtime_error{
+                    fmt::format("{}: the node hierarchy is not valid", path.string())};
+            }
+            const tinygltf::Node& node = model.nodes[node_index];
+            const glm::mat4 transform = parent_transform * get_local_transform(node);
+            if (node.mesh >= 0 && node.mesh < (int)scene->meshes.size()) {
+                scene->instances.push_back({(uint32_t)node.mesh, transform});
+            }
+            for (const int child : node.children) {
+                stack.emplace_back(child, transform);
+            }
+        }
+    };
+    if (!model.scenes.empty()) {
+        const int scene_index = model.defaultScene >= 0 ? model.defaultScene : 0;
+        for (const int node : model.scenes[scene_index].nodes) {
+            add_instances(node);
+        }
+    } else {
+        for (uint32_t mesh = 0; mesh < scene->meshes.size(); mesh++) {
+            scene->instances.push_back({mesh, glm::mat4(1)});
+        }
+    }
+
+    // Wait for the images (helps out decoding)
+
+    for (std::future<void>& decode : image_decodes) {
+        while (decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready &&
+               thread_pool.run_pending_task()) {}
+        decode.get();
+    }
+    image_decodes.clear();
+
+    const auto end = std::chrono::steady_clock::now();
+    Statistics& statistics = scene->statistics;
+    statistics.decode_duration = decode_end.load();
+    statistics.total_duration = end - start;
+    statistics.peak_host_memory = memory.get_peak();
+
+    SPDLOG_INFO("loaded {} in {:.2f} ms (parse {:.2f} ms, upload {:.2f} ms): {} meshes, {} "
+                "primitives, {} instances, {} images. Uploaded {} in {} batches ({}/s), peak "
+                "host memory about {}",
+                path.string(), to_milliseconds(statistics.total_duration),
+                to_milliseconds(statistics.parse_duration),
+                to_milliseconds(statistics.upload_duration), scene->meshes.size(),
+                scene->primitives.size(), scene->instances.size(), scene->images.size(),
+                format_size(statistics.uploaded_bytes), statistics.upload_batches,
+                format_size((uint64_t)statistics.get_upload_bandwidth()),
+                format_size(statistics.peak_host_memory));
+
+    return scene;
+}
+
+} // namespace merian
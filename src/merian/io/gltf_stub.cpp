@@ -0,0 +1,16 @@
+#include "merian/io/gltf.hpp"
+
+#include <stdexcept>
+
+namespace merian {
+
+GLTFSceneHandle GLTFScene::load([[maybe_unused]] const std::filesystem::path& path,
+                                [[maybe_unused]] const ResourceAllocatorHandle& allocator,
+                                [[maybe_unused]] const QueueHandle& queue,
+                                [[maybe_unused]] ThreadPool& thread_pool,
+                                [[maybe_unused]] const vk::DeviceSize batch_size) {
+    throw std::runtime_error{
+        "tinygltf is not available (was not found or enabled at compile time)"};
+}
+
+} // namespace merian
@@ -0,0 +1,1504 @@
+#include "merian/io/image_encoder.hpp"
+#include "merian/utils/concurrent/utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <numbers>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+namespace merian {
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+void put_u16_be(Bytes& out, const uint32_t value) {
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+void put_u32_be(Bytes& out, const uint32_t value) {
+    put_u16_be(out, value >> 16);
+    put_u16_be(out, value);
+}
+
+void put_u16_le(Bytes& out, const uint32_t value) {
+    out.push_back(value);
+    out.push_back(value >> 8);
+}
+
+void write(std::ostream& out, const Bytes& bytes) {
+    out.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize)bytes.size());
+}
+
+uint32_t bit_length(uint32_t value) {
+    uint32_t length = 0;
+    while (value > 0) {
+        value >>= 1;
+        length++;
+    }
+    return length;
+}
+
+// ---------------------------------------------------------------------------
+// Checksums
+
+constexpr std::array<uint32_t, 256> CRC32_TABLE = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (uint32_t k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+    return table;
+}();
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, const std::size_t size) {
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++) {
+        crc = CRC32_TABLE[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+constexpr uint32_t ADLER_MOD = 65521;
+// largest n such that the sums cannot overflow before the modulo is applied
+constexpr std::size_t ADLER_BLOCK = 5552;
+
+uint32_t adler32(const uint32_t adler, const uint8_t* data, std::size_t size) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        const std::size_t n = std::min(size, ADLER_BLOCK);
+        for (std::size_t i = 0; i < n; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+        data += n;
+        size -= n;
+    }
+    return b << 16 | a;
+}
+
+// Returns the checksum of the concatenation, size2 is the length of the second part.
+uint32_t adler32_combine(const uint32_t adler1, const uint32_t adler2, const std::size_t size2) {
+    const uint64_t a1 = adler1 & 0xffff;
+    const uint64_t b1 = adler1 >> 16;
+    const uint64_t a2 = adler2 & 0xffff;
+    const uint64_t b2 = adler2 >> 16;
+
+    const uint64_t a = (a1 + a2 + ADLER_MOD - 1) % ADLER_MOD;
+    const uint64_t b =
+        (b1 + b2 + (size2 % ADLER_MOD) * ((a1 + ADLER_MOD - 1) % ADLER_MOD)) % ADLER_MOD;
+    return b << 16 | a;
+}
+
+// ---------------------------------------------------------------------------
+// Deflate (RFC 1951)
+
+// Writes bits LSB first.
+class DeflateBitWriter {
+  public:
+    DeflateBitWriter(Bytes& out) : out(out) {}
+
+    void put(const uint32_t bits, const uint32_t count) {
+        buffer |= (uint64_t)bits << fill;
+        fill += count;
+        while (fill >= 8) {
+            out.push_back(buffer);
+            buffer >>= 8;
+            fill -= 8;
+        }
+    }
+
+    // Pads with zeros to the next byte boundary.
+    void align() {
+        if (fill > 0) {
+            put(0, 8 - fill);
+        }
+    }
+
+  private:
+    Bytes& out;
+    uint64_t buffer = 0;
+    uint32_t fill = 0;
+};
+
+constexpr uint32_t reverse_bits(uint32_t code, const uint32_t length) {
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        reversed = reversed << 1 | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+// The fixed Huffman codes, bit-reversed such that they can be written LSB first.
+struct FixedHuffmanCodes {
+    std::array<uint16_t, 288> literal_code;
+    std::array<uint8_t, 288> literal_length;
+    std::array<uint8_t, 30> distance_code;
+};
+
+constexpr FixedHuffmanCodes FIXED_CODES = [] {
+    FixedHuffmanCodes codes{};
+    for (uint32_t symbol = 0; symbol < 288; symbol++) {
+        uint32_t code, length;
+        if (symbol < 144) {
+            code = 0x30 + symbol;
+            length = 8;
+        } else if (symbol < 256) {
+            code = 0x190 + symbol - 144;
+            length = 9;
+        } else if (symbol < 280) {
+            code = symbol - 256;
+            length = 7;
+        } else {
+            code = 0xc0 + symbol - 280;
+            length = 8;
+        }
+        codes.literal_code[symbol] = reverse_bits(code, length);
+        codes.literal_length[symbol] = length;
+    }
+    for (uint32_t symbol = 0; symbol < 30; symbol++) {
+        codes.distance_code[symbol] = reverse_bits(symbol, 5);
+    }
+    return codes;
+}();
+
+constexpr std::array<uint16_t, 29> LENGTH_BASE = {3,  4,  5,  6,  7,  8,  9,  10,  11,  13,
+                                                  15, 17, 19, 23, 27, 31, 35, 43,  51,  59,
+                                                  67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::array<uint8_t, 29> LENGTH_EXTRA = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                  2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::array<uint16_t, 30> DISTANCE_BASE = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::array<uint8_t, 30> DISTANCE_EXTRA = {0, 0, 0,  0,  1,  1,  2,  2,  3,  3,
+                                                    4, 4, 5,  5,  6,  6,  7,  7,  8,  8,
+                                                    9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+constexpr uint32_t END_OF_BLOCK = 256;
+constexpr uint32_t MIN_MATCH = 3;
+constexpr uint32_t MAX_MATCH = 258;
+constexpr uint32_t WINDOW_SIZE = 1 << 15;
+// one less than allowed, the hash chain only covers WINDOW_SIZE positions.
+constexpr uint32_t MAX_DISTANCE = WINDOW_SIZE - 1;
+constexpr uint32_t HASH_BITS = 15;
+
+struct CompressionParameters {
+    // choose the PNG filter per row, else Paeth is used.
+    bool adaptive_filter;
+    // number of candidates that are compared
+    uint32_t max_chain;
+    // defer a match if the next position has a longer one
+    bool lazy;
+    // stop searching if a match of this length was found
+    uint32_t nice_length;
+    // Huffman codes per block instead of the fixed codes
+    bool dynamic_codes;
+    // FLG byte of the zlib header (includes the level hint)
+    uint8_t zlib_flags;
+};
+
+CompressionParameters get_parameters(const ImageEncoder::Compression compression) {
+    switch (compression) {
+    case ImageEncoder::Compression::NONE:
+        return {false, 0, false, 0, false, 0x01};
+    case ImageEncoder::Compression::FASTEST:
+        return {false, 1, false, 32, false, 0x01};
+    case ImageEncoder::Compression::FAST:
+        return {true, 4, false, 64, false, 0x5e};
+    case ImageEncoder::Compression::DEFAULT:
+        return {true, 32, true, 128, false, 0x9c};
+    case ImageEncoder::Compression::BEST:
+        return {true, 256, true, MAX_MATCH, true, 0xda};
+    }
+    throw std::invalid_argument{"unknown compression"};
+}
+
+// A literal (distance_symbol == NO_DISTANCE) or a match in the symbols of the deflate alphabets.
+struct DeflateToken {
+    uint16_t symbol;
+    uint16_t length_extra;
+    uint16_t distance_extra;
+    uint8_t distance_symbol;
+};
+
+constexpr uint8_t NO_DISTANCE = 0xff;
+
+DeflateToken literal_token(const uint8_t value) {
+    return {value, 0, 0, NO_DISTANCE};
+}
+
+DeflateToken match_token(const uint32_t length, const uint32_t distance) {
+    const uint32_t l = std::upper_bound(LENGTH_BASE.begin(), LENGTH_BASE.end(), length) -
+                       LENGTH_BASE.begin() - 1;
+    const uint32_t d = std::upper_bound(DISTANCE_BASE.begin(), DISTANCE_BASE.end(), distance) -
+                       DISTANCE_BASE.begin() - 1;
+    return {(uint16_t)(257 + l), (uint16_t)(length - LENGTH_BASE[l]),
+            (uint16_t)(distance - DISTANCE_BASE[d]), (uint8_t)d};
+}
+
+void put_literal(DeflateBitWriter& writer, const uint32_t symbol) {
+    writer.put(FIXED_CODES.literal_code[symbol], FIXED_CODES.literal_length[symbol]);
+}
+
+void put_token_fixed(DeflateBitWriter& writer, const DeflateToken& token) {
+    put_literal(writer, token.symbol);
+    if (token.distance_symbol != NO_DISTANCE) {
+        writer.put(token.length_extra, LENGTH_EXTRA[token.symbol - 257]);
+        writer.put(FIXED_CODES.distance_code[token.distance_symbol], 5);
+        writer.put(token.distance_extra, DISTANCE_EXTRA[token.distance_symbol]);
+    }
+}
+
+// LZ77 on data[begin, end), matches may reference the 32 KiB before begin, size is the readable
+// size of data. Calls emit(const DeflateToken&) for every literal and match in order.
+template <typename Emit>
+void lz77(const uint8_t* data,
+          const std::size_t begin,
+          const std::size_t end,
+          const std::size_t size,
+          const CompressionParameters& parameters,
+          const Emit& emit) {
+    // positions are relative to the start of the window
+    const std::size_t base = begin > WINDOW_SIZE ? begin - WINDOW_SIZE : 0;
+    const uint8_t* window = data + base;
+    const std::size_t start = begin - base;
+    const std::size_t length = end - base;
+    const std::size_t readable = size - base;
+
+    std::vector<int32_t> head(1 << HASH_BITS, -1);
+    std::vector<int32_t> prev(WINDOW_SIZE);
+
+    const auto hash = [&](const std::size_t pos) {
+        const uint32_t value = window[pos] | window[pos + 1] << 8 | window[pos + 2] << 16;
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    };
+    const auto insert = [&](const std::size_t pos) {
+        if (pos + MIN_MATCH <= readable) {
+            const uint32_t h = hash(pos);
+            prev[pos & (WINDOW_SIZE - 1)] = head[h];
+            head[h] = pos;
+        }
+    };
+
+    struct Match {
+        uint32_t length = 0;
+        uint32_t distance = 0;
+    };
+    const auto find = [&](const std::size_t pos) {
+        Match best;
+        const uint32_t max_length = std::min<std::size_t>(MAX_MATCH, length - pos);
+        if (max_length < MIN_MATCH || pos + MIN_MATCH > readable) {
+            return best;
+        }
+
+        const uint8_t* current = window + pos;
+        int32_t candidate = head[hash(pos)];
+        for (uint32_t chain = parameters.max_chain;
+             candidate >= 0 && pos - candidate <= MAX_DISTANCE && chain > 0; chain--) {
+            const uint8_t* previous = window + candidate;
+            if (previous[best.length] == current[best.length] && previous[0] == current[0] &&
+                previous[1] == current[1]) {
+                uint32_t l = 2;
+                while (l < max_length && previous[l] == current[l]) {
+                    l++;
+                }
+                if (l >= MIN_MATCH && l > best.length) {
+                    best = {l, (uint32_t)(pos - candidate)};
+                    if (l >= parameters.nice_length || l == max_length) {
+                        break;
+                    }
+                }
+            }
+            candidate = prev[candidate & (WINDOW_SIZE - 1)];
+        }
+        return best;
+    };
+
+    for (std::size_t pos = 0; pos < start; pos++) {
+        insert(pos);
+    }
+
+    std::size_t pos = start;
+    Match next;
+    bool has_next = false;
+    while (pos < length) {
+        const Match match = has_next ? next : find(pos);
+        has_next = false;
+
+        if (match.length >= MIN_MATCH && parameters.lazy &&
+            match.length < parameters.nice_length && pos + 1 < length) {
+            insert(pos);
+            next = find(pos + 1);
+            if (next.length > match.length) {
+                emit(literal_token(window[pos]));
+                pos++;
+                has_next = true;
+                continue;
+            }
+            emit(match_token(match.length, match.distance));
+            for (std::size_t p = pos + 1; p < pos + match.length; p++) {
+                insert(p);
+            }
+            pos += match.length;
+        } else if (match.length >= MIN_MATCH) {
+            emit(match_token(match.length, match.distance));
+            for (std::size_t p = pos; p < pos + match.length; p++) {
+                insert(p);
+            }
+            pos += match.length;
+        } else {
+            insert(pos);
+            emit(literal_token(window[pos]));
+            pos++;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Dynamic Huffman codes
+
+constexpr uint32_t MAX_CODE_LENGTH = 15;
+constexpr uint32_t MAX_CODE_LENGTH_CODE_LENGTH = 7;
+// literal/length symbols that can be used in a dynamic block (286 and 287 are reserved)
+constexpr uint32_t LITERAL_SYMBOLS = 286;
+constexpr uint32_t DISTANCE_SYMBOLS = 30;
+constexpr std::array<uint8_t, 19> CODE_LENGTH_ORDER = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                                       11, 4,  12, 3, 13, 2, 14, 1, 15};
+constexpr std::array<uint8_t, 19> CODE_LENGTH_EXTRA = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                       0, 0, 0, 0, 0, 0, 2, 3, 7};
+// Every block gets its own codes, adapting to the content of the image.
+constexpr std::size_t DYNAMIC_BLOCK_TOKENS = 1 << 16;
+
+// Returns the code lengths of a Huffman code for the frequencies, limited to max_length. The code
+// is complete (as required by zlib), unused symbols get length 0.
+std::vector<uint8_t> huffman_code_lengths(const std::vector<uint32_t>& frequencies,
+                                          const uint32_t max_length) {
+    std::vector<uint8_t> lengths(frequencies.size(), 0);
+
+    std::vector<uint32_t> symbols;
+    for (uint32_t symbol = 0; symbol < frequencies.size(); symbol++) {
+        if (frequencies[symbol] > 0) {
+            symbols.push_back(symbol);
+        }
+    }
+    if (symbols.size() < 2) {
+        // a single code cannot be complete, add a second unused one.
+        const uint32_t used = symbols.empty() ? 0 : symbols[0];
+        lengths[used] = 1;
+        lengths[used == 0 ? 1 : 0] = 1;
+        return lengths;
+    }
+
+    // Huffman tree: leaves are [0, symbols.size()), parents are appended and have larger indices.
+    std::vector<uint64_t> weights;
+    for (const uint32_t symbol : symbols) {
+        weights.push_back(frequencies[symbol]);
+    }
+    std::vector<uint32_t> parents(symbols.size());
+    using Node = std::pair<uint64_t, uint32_t>;
+    std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+    for (uint32_t i = 0; i < symbols.size(); i++) {
+        queue.emplace(weights[i], i);
+    }
+    while (queue.size() > 1) {
+        const Node a = queue.top();
+        queue.pop();
+        const Node b = queue.top();
+        queue.pop();
+        const uint32_t parent = weights.size();
+        weights.push_back(a.first + b.first);
+        parents.push_back(0);
+        parents[a.second] = parents[b.second] = parent;
+        queue.emplace(a.first + b.first, parent);
+    }
+    std::vector<uint32_t> depths(weights.size(), 0);
+    for (uint32_t node = weights.size() - 1; node-- > 0;) {
+        depths[node] = depths[parents[node]] + 1;
+    }
+
+    // Clip to max_length and repair the Kraft sum (in units of 2^-max_length).
+    const uint64_t capacity = uint64_t(1) << max_length;
+    uint64_t kraft = 0;
+    for (uint32_t i = 0; i < symbols.size(); i++) {
+        lengths[symbols[i]] = std::min(depths[i], max_length);
+        kraft += capacity >> lengths[symbols[i]];
+    }
+    // Over-subscribed: lengthen the least frequent of the longest codes below the limit.
+    while (kraft > capacity) {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < symbols.size(); i++) {
+            const uint8_t length = lengths[symbols[i]];
+            const uint8_t best_length = lengths[symbols[best]];
+            if (length < max_length &&
+                (best_length == max_length || length > best_length ||
+                 (length == best_length && weights[i] < weights[best]))) {
+                best = i;
+            }
+        }
+        kraft -= capacity >> (lengths[symbols[best]] + 1);
+        lengths[symbols[best]]++;
+    }
+    // Incomplete: shorten the most frequent of the longest codes. The missing sum is a multiple of
+    // the weight of the longest code, which therefore always fits.
+    while (kraft < capacity) {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < symbols.size(); i++) {
+            const uint8_t length = lengths[symbols[i]];
+            const uint8_t best_length = lengths[symbols[best]];
+            if (length > best_length || (length == best_length && weights[i] > weights[best])) {
+                best = i;
+            }
+        }
+        kraft += capacity >> lengths[symbols[best]];
+        lengths[symbols[best]]--;
+    }
+
+    return lengths;
+}
+
+// Canonical codes (RFC 1951 3.2.2) for the lengths, bit-reversed to be written LSB first.
+std::vector<uint16_t> canonical_codes(const std::vector<uint8_t>& lengths) {
+    std::array<uint32_t, MAX_CODE_LENGTH + 1> length_count{};
+    for (const uint8_t length : lengths) {
+        length_count[length]++;
+    }
+    length_count[0] = 0;
+    std::array<uint32_t, MAX_CODE_LENGTH + 1> next_code{};
+    uint32_t code = 0;
+    for (uint32_t length = 1; length <= MAX_CODE_LENGTH; length++) {
+        code = (code + length_count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    std::vector<uint16_t> codes(lengths.size(), 0);
+    for (uint32_t symbol = 0; symbol < lengths.size(); symbol++) {
+        if (lengths[symbol] > 0) {
+            codes[symbol] = reverse_bits(next_code[lengths[symbol]]++, lengths[symbol]);
+        }
+    }
+    return codes;
+}
+
+struct CodeLengthToken {
+    uint8_t symbol;
+    uint8_t extra;
+};
+
+// Run-length encodes the code lengths with the symbols 16 (repeat previous), 17 and 18 (zeros).
+std::vector<CodeLengthToken> encode_code_lengths(const std::vector<uint8_t>& lengths) {
+    std::vector<CodeLengthToken> tokens;
+    for (std::size_t i = 0; i < lengths.size();) {
+        const uint8_t length = lengths[i];
+        std::size_t run = 1;
+        while (i + run < lengths.size() && lengths[i + run] == length) {
+            run++;
+        }
+        i += run;
+
+        if (length == 0) {
+            while (run >= 11) {
+                const std::size_t n = std::min<std::size_t>(run, 138);
+                tokens.push_back({18, (uint8_t)(n - 11)});
+                run -= n;
+            }
+            if (run >= 3) {
+                tokens.push_back({17, (uint8_t)(run - 3)});
+                run = 0;
+            }
+        } else {
+            tokens.push_back({length, 0});
+            run--;
+            while (run >= 3) {
+                const std::size_t n = std::min<std::size_t>(run, 6);
+                tokens.push_back({16, (uint8_t)(n - 3)});
+                run -= n;
+            }
+        }
+        for (; run > 0; run--) {
+            tokens.push_back({length, 0});
+        }
+    }
+    return tokens;
+}
+
+// Writes the tokens as one block with dynamic Huffman codes, or with the fixed codes if that is
+// smaller.
+void put_block(DeflateBitWriter& writer,
+               const std::vector<DeflateToken>& tokens,
+               const bool final) {
+    std::vector<uint32_t> literal_frequencies(LITERAL_SYMBOLS, 0);
+    std::vector<uint32_t> distance_frequencies(DISTANCE_SYMBOLS, 0);
+    for (const DeflateToken& token : tokens) {
+        literal_frequencies[token.symbol]++;
+        if (token.distance_symbol != NO_DISTANCE) {
+            distance_frequencies[token.distance_symbol]++;
+        }
+    }
+    literal_frequencies[END_OF_BLOCK]++;
+
+    const std::vector<uint8_t> literal_lengths =
+        huffman_code_lengths(literal_frequencies, MAX_CODE_LENGTH);
+    const std::vector<uint8_t> distance_lengths =
+        huffman_code_lengths(distance_frequencies, MAX_CODE_LENGTH);
+    uint32_t literal_count = LITERAL_SYMBOLS;
+    while (literal_count > 257 && literal_lengths[literal_count - 1] == 0) {
+        literal_count--;
+    }
+    uint32_t distance_count = DISTANCE_SYMBOLS;
+    while (distance_count > 1 && distance_lengths[distance_count - 1] == 0) {
+        distance_count--;
+    }
+
+    std::vector<uint8_t> lengths(literal_lengths.begin(), literal_lengths.begin() + literal_count);
+    lengths.insert(lengths.end(), distance_lengths.begin(),
+                   distance_lengths.begin() + distance_count);
+    const std::vector<CodeLengthToken> length_tokens = encode_code_lengths(lengths);
+    std::vector<uint32_t> code_length_frequencies(CODE_LENGTH_ORDER.size(), 0);
+    for (const CodeLengthToken& token : length_tokens) {
+        code_length_frequencies[token.symbol]++;
+    }
+    const std::vector<uint8_t> code_length_lengths =
+        huffman_code_lengths(code_length_frequencies, MAX_CODE_LENGTH_CODE_LENGTH);
+    uint32_t code_length_count = CODE_LENGTH_ORDER.size();
+    while (code_length_count > 4 &&
+           code_length_lengths[CODE_LENGTH_ORDER[code_length_count - 1]] == 0) {
+        code_length_count--;
+    }
+
+    // compare the sizes in bits (without the common block header and extra bits)
+    uint64_t fixed_bits = FIXED_CODES.literal_length[END_OF_BLOCK];
+    uint64_t dynamic_bits = 5 + 5 + 4 + 3 * code_length_count + literal_lengths[END_OF_BLOCK];
+    for (const CodeLengthToken& token : length_tokens) {
+        dynamic_bits += code_length_lengths[token.symbol] + CODE_LENGTH_EXTRA[token.symbol];
+    }
+    for (uint32_t symbol = 0; symbol < LITERAL_SYMBOLS; symbol++) {
+        if (symbol != END_OF_BLOCK) {
+            const uint64_t frequency = literal_frequencies[symbol];
+            fixed_bits += frequency * FIXED_CODES.literal_length[symbol];
+            dynamic_bits += frequency * literal_lengths[symbol];
+        }
+    }
+    for (uint32_t symbol = 0; symbol < DISTANCE_SYMBOLS; symbol++) {
+        fixed_bits += (uint64_t)distance_frequencies[symbol] * 5;
+        dynamic_bits += (uint64_t)distance_frequencies[symbol] * distance_lengths[symbol];
+    }
+
+    writer.put(final ? 1 : 0, 1);
+    if (fixed_bits <= dynamic_bits) {
+        // BTYPE 01: fixed Huffman codes
+        writer.put(1, 2);
+        for (const DeflateToken& token : tokens) {
+            put_token_fixed(writer, token);
+        }
+        put_literal(writer, END_OF_BLOCK);
+        return;
+    }
+
+    // BTYPE 10: dynamic Huffman codes
+    writer.put(2, 2);
+    writer.put(literal_count - 257, 5);
+    writer.put(distance_count - 1, 5);
+    writer.put(code_length_count - 4, 4);
+    for (uint32_t i = 0; i < code_length_count; i++) {
+        writer.put(code_length_lengths[CODE_LENGTH_ORDER[i]], 3);
+    }
+    const std::vector<uint16_t> code_length_codes = canonical_codes(code_length_lengths);
+    for (const CodeLengthToken& token : length_tokens) {
+        writer.put(code_length_codes[token.symbol], code_length_lengths[token.symbol]);
+        writer.put(token.extra, CODE_LENGTH_EXTRA[token.symbol]);
+    }
+
+    const std::vector<uint16_t> literal_codes = canonical_codes(literal_lengths);
+    const std::vector<uint16_t> distance_codes = canonical_codes(distance_lengths);
+    for (const DeflateToken& token : tokens) {
+        writer.put(literal_codes[token.symbol], literal_lengths[token.symbol]);
+        if (token.distance_symbol != NO_DISTANCE) {
+            writer.put(token.length_extra, LENGTH_EXTRA[token.symbol - 257]);
+            writer.put(distance_codes[token.distance_symbol],
+                       distance_lengths[token.distance_symbol]);
+            writer.put(token.distance_extra, DISTANCE_EXTRA[token.distance_symbol]);
+        }
+    }
+    writer.put(literal_codes[END_OF_BLOCK], literal_lengths[END_OF_BLOCK]);
+}
+
+// Compresses data[begin, end) with LZ77 and Huffman codes (fixed, or dynamic if
+// parameters.dynamic_codes is set). Matches may reference the 32 KiB before begin, size is the
+// readable size of data.
+//
+// The output is byte aligned: if last is set the final bit is set, otherwise an empty stored block
+// follows (sync flush), such that the next stripe can simply be appended.
+void deflate_compressed(Bytes& out,
+                        const uint8_t* data,
+                        const std::size_t begin,
+                        const std::size_t end,
+                        const std::size_t size,
+                        const CompressionParameters& parameters,
+                        const bool last) {
+    DeflateBitWriter writer(out);
+
+    if (parameters.dynamic_codes) {
+        std::vector<DeflateToken> tokens;
+        tokens.reserve(std::min(end - begin, DYNAMIC_BLOCK_TOKENS));
+        lz77(data, begin, end, size, parameters, [&](const DeflateToken& token) {
+            tokens.push_back(token);
+            if (tokens.size() == DYNAMIC_BLOCK_TOKENS) {
+                put_block(writer, tokens, false);
+                tokens.clear();
+            }
+        });
+        put_block(writer, tokens, last);
+    } else {
+        writer.put(last ? 1 : 0, 1);
+        // BTYPE 01: fixed Huffman codes
+        writer.put(1, 2);
+        lz77(data, begin, end, size, parameters,
+             [&](const DeflateToken& token) { put_token_fixed(writer, token); });
+        put_literal(writer, END_OF_BLOCK);
+    }
+
+    if (!last) {
+        // empty stored block: BFINAL 0, BTYPE 00, aligned LEN 0 and NLEN 0xffff
+        writer.put(0, 3);
+        writer.align();
+        out.insert(out.end(), {0x00, 0x00, 0xff, 0xff});
+    } else {
+        writer.align();
+    }
+}
+
+// Writes the data as stored blocks, the output must be byte aligned.
+void deflate_stored(Bytes& out, const uint8_t* data, std::size_t size, const bool last) {
+    do {
+        const std::size_t n = std::min<std::size_t>(size, 0xffff);
+        out.push_back(last && n == size ? 1 : 0);
+        put_u16_le(out, n);
+        put_u16_le(out, ~n & 0xffff);
+        out.insert(out.end(), data, data + n);
+        data += n;
+        size -= n;
+    } while (size > 0);
+}
+
+// ---------------------------------------------------------------------------
+// PNG
+
+constexpr uint32_t PNG_BYTES_PER_PIXEL = 4;
+
+enum PngFilter : uint8_t {
+    PNG_FILTER_NONE,
+    PNG_FILTER_SUB,
+    PNG_FILTER_UP,
+    PNG_FILTER_AVERAGE,
+    PNG_FILTER_PAETH,
+};
+
+uint8_t paeth(const int a, const int b, const int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+void filter_row(uint8_t* out,
+                const uint8_t* row,
+                const uint8_t* prior,
+                const std::size_t size,
+                const PngFilter filter) {
+    constexpr uint32_t bpp = PNG_BYTES_PER_PIXEL;
+    switch (filter) {
+    case PNG_FILTER_NONE:
+        std::copy(row, row + size, out);
+        break;
+    case PNG_FILTER_SUB:
+        std::copy(row, row + bpp, out);
+        for (std::size_t i = bpp; i < size; i++) {
+            out[i] = row[i] - row[i - bpp];
+        }
+        break;
+    case PNG_FILTER_UP:
+        for (std::size_t i = 0; i < size; i++) {
+            out[i] = row[i] - prior[i];
+        }
+        break;
+    case PNG_FILTER_AVERAGE:
+        for (std::size_t i = 0; i < bpp; i++) {
+            out[i] = row[i] - (prior[i] >> 1);
+        }
+        for (std::size_t i = bpp; i < size; i++) {
+            out[i] = row[i] - ((row[i - bpp] + prior[i]) >> 1);
+        }
+        break;
+    case PNG_FILTER_PAETH:
+        for (std::size_t i = 0; i < bpp; i++) {
+            out[i] = row[i] - prior[i];
+        }
+        for (std::size_t i = bpp; i < size; i++) {
+            out[i] = row[i] - paeth(row[i - bpp], prior[i], prior[i - bpp]);
+        }
+        break;
+    }
+}
+
+// Sum of absolute values interpreted as signed, the usual heuristic to select a filter.
+uint64_t filter_cost(const uint8_t* filtered, const std::size_t size) {
+    uint64_t cost = 0;
+    for (std::size_t i = 0; i < size; i++) {
+        cost += std::abs((int8_t)filtered[i]);
+    }
+    return cost;
+}
+
+void begin_chunk(Bytes& out, const char* type) {
+    put_u32_be(out, 0);
+    out.insert(out.end(), type, type + 4);
+}
+
+// Fills in the length and appends the CRC of the chunk that starts at chunk_begin.
+void end_chunk(Bytes& out, const std::size_t chunk_begin) {
+    const uint32_t length = out.size() - chunk_begin - 8;
+    out[chunk_begin + 0] = length >> 24;
+    out[chunk_begin + 1] = length >> 16;
+    out[chunk_begin + 2] = length >> 8;
+    out[chunk_begin + 3] = length;
+    put_u32_be(out, crc32(0, out.data() + chunk_begin + 4, length + 4));
+}
+
+// ---------------------------------------------------------------------------
+// JPEG (baseline, ITU T.81)
+
+// clang-format off
+constexpr std::array<uint8_t, 64> ZIGZAG = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// Annex K.1, natural order
+constexpr std::array<uint8_t, 64> LUMINANCE_QUANTIZATION = {
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99,
+};
+
+constexpr std::array<uint8_t, 64> CHROMINANCE_QUANTIZATION = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+// Annex K.3, number of codes per length and the symbols
+constexpr std::array<uint8_t, 16> DC_LUMINANCE_BITS = {
+    0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+constexpr std::array<uint8_t, 16> DC_CHROMINANCE_BITS = {
+    0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+constexpr std::array<uint8_t, 12> DC_VALUES = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+constexpr std::array<uint8_t, 16> AC_LUMINANCE_BITS = {
+    0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+constexpr std::array<uint8_t, 162> AC_LUMINANCE_VALUES = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+constexpr std::array<uint8_t, 16> AC_CHROMINANCE_BITS = {
+    0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+constexpr std::array<uint8_t, 162> AC_CHROMINANCE_VALUES = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+// clang-format on
+
+struct HuffmanTable {
+    std::array<uint16_t, 256> code{};
+    std::array<uint8_t, 256> length{};
+};
+
+// Assigns the canonical codes.
+template <std::size_t N>
+constexpr HuffmanTable build_huffman_table(const std::array<uint8_t, 16>& bits,
+                                           const std::array<uint8_t, N>& values) {
+    HuffmanTable table;
+    uint32_t code = 0;
+    std::size_t k = 0;
+    for (uint32_t length = 1; length <= 16; length++) {
+        for (uint32_t i = 0; i < bits[length - 1]; i++) {
+            table.code[values[k]] = code++;
+            table.length[values[k]] = length;
+            k++;
+        }
+        code <<= 1;
+    }
+    return table;
+}
+
+constexpr HuffmanTable DC_LUMINANCE = build_huffman_table(DC_LUMINANCE_BITS, DC_VALUES);
+constexpr HuffmanTable DC_CHROMINANCE = build_huffman_table(DC_CHROMINANCE_BITS, DC_VALUES);
+constexpr HuffmanTable AC_LUMINANCE = build_huffman_table(AC_LUMINANCE_BITS, AC_LUMINANCE_VALUES);
+constexpr HuffmanTable AC_CHROMINANCE =
+    build_huffman_table(AC_CHROMINANCE_BITS, AC_CHROMINANCE_VALUES);
+
+constexpr uint8_t JPEG_ZRL = 0xf0;
+constexpr uint8_t JPEG_EOB = 0x00;
+
+// Writes bits MSB first and stuffs a zero byte after every 0xff.
+class JpegBitWriter {
+  public:
+    JpegBitWriter(Bytes& out) : out(out) {}
+
+    void put(const uint32_t bits, const uint32_t count) {
+        buffer = buffer << count | (bits & ((1u << count) - 1));
+        fill += count;
+        while (fill >= 8) {
+            const uint8_t byte = buffer >> (fill - 8);
+            out.push_back(byte);
+            if (byte == 0xff) {
+                out.push_back(0);
+            }
+            fill -= 8;
+        }
+    }
+
+    void put_symbol(const HuffmanTable& table, const uint8_t symbol) {
+        put(table.code[symbol], table.length[symbol]);
+    }
+
+    // Pads with ones to the next byte boundary.
+    void flush() {
+        if (fill > 0) {
+            put(0xff, 8 - fill);
+        }
+    }
+
+  private:
+    Bytes& out;
+    uint32_t buffer = 0;
+    uint32_t fill = 0;
+};
+
+// Quantization tables scaled by quality (like libjpeg) and their reciprocals in natural order.
+struct JpegQuantization {
+    std::array<uint8_t, 64> table;
+    std::array<float, 64> reciprocal;
+
+    JpegQuantization(const std::array<uint8_t, 64>& base, const int quality) {
+        const int scale = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+        for (uint32_t i = 0; i < 64; i++) {
+            table[i] = std::clamp((base[i] * scale + 50) / 100, 1, 255);
+            reciprocal[i] = 1.f / table[i];
+        }
+    }
+};
+
+// DCT_MATRIX[u][x] = C(u) / 2 * cos((2x + 1) u pi / 16)
+const std::array<std::array<float, 8>, 8> DCT_MATRIX = [] {
+    std::array<std::array<float, 8>, 8> matrix;
+    for (uint32_t u = 0; u < 8; u++) {
+        const double c = u == 0 ? std::numbers::sqrt2 / 2 : 1.;
+        for (uint32_t x = 0; x < 8; x++) {
+            matrix[u][x] = c / 2 * std::cos((2 * x + 1) * u * std::numbers::pi / 16);
+        }
+    }
+    return matrix;
+}();
+
+// Transforms, quantizes and encodes a block of level shifted samples (natural order).
+void encode_block(JpegBitWriter& writer,
+                  const float* samples,
+                  const JpegQuantization& quantization,
+                  const HuffmanTable& dc_table,
+                  const HuffmanTable& ac_table,
+                  int& dc_prediction) {
+    // separable 2D DCT: rows first, then columns
+    std::array<float, 64> rows;
+    for (uint32_t y = 0; y < 8; y++) {
+        for (uint32_t u = 0; u < 8; u++) {
+            float sum = 0;
+            for (uint32_t x = 0; x < 8; x++) {
+                sum += samples[y * 8 + x] * DCT_MATRIX[u][x];
+            }
+            rows[y * 8 + u] = sum;
+        }
+    }
+    std::array<int, 64> natural;
+    for (uint32_t v = 0; v < 8; v++) {
+        for (uint32_t u = 0; u < 8; u++) {
+            float sum = 0;
+            for (uint32_t y = 0; y < 8; y++) {
+                sum += DCT_MATRIX[v][y] * rows[y * 8 + u];
+            }
+            // baseline allows 11 bit coefficients
+            natural[v * 8 + u] =
+                std::clamp((int)std::lround(sum * quantization.reciprocal[v * 8 + u]), -1023, 1023);
+        }
+    }
+
+    const auto put_value = [&](const int value, const uint32_t size) {
+        writer.put(value < 0 ? value - 1 : value, size);
+    };
+
+    const int dc = natural[0];
+    const int diff = dc - dc_prediction;
+    dc_prediction = dc;
+    const uint32_t dc_size = bit_length(std::abs(diff));
+    writer.put_symbol(dc_table, dc_size);
+    put_value(diff, dc_size);
+
+    uint32_t run = 0;
+    for (uint32_t i = 1; i < 64; i++) {
+        const int ac = natural[ZIGZAG[i]];
+        if (ac == 0) {
+            run++;
+            continue;
+        }
+        while (run >= 16) {
+            writer.put_symbol(ac_table, JPEG_ZRL);
+            run -= 16;
+        }
+        const uint32_t ac_size = bit_length(std::abs(ac));
+        writer.put_symbol(ac_table, run << 4 | ac_size);
+        put_value(ac, ac_size);
+        run = 0;
+    }
+    if (run > 0) {
+        writer.put_symbol(ac_table, JPEG_EOB);
+    }
+}
+
+void put_huffman_table(Bytes& out,
+                       const uint8_t table_class_and_id,
+                       const std::array<uint8_t, 16>& bits,
+                       const uint8_t* values,
+                       const std::size_t value_count) {
+    out.push_back(table_class_and_id);
+    out.insert(out.end(), bits.begin(), bits.end());
+    out.insert(out.end(), values, values + value_count);
+}
+
+// ---------------------------------------------------------------------------
+// Radiance HDR
+
+void to_rgbe(uint8_t* rgbe, const float* rgb) {
+    const float max_component = std::max({rgb[0], rgb[1], rgb[2]});
+    if (max_component < 1e-32f) {
+        std::fill(rgbe, rgbe + 4, 0);
+        return;
+    }
+    int exponent;
+    const float normalize = std::frexp(max_component, &exponent) * 256.f / max_component;
+    for (uint32_t c = 0; c < 3; c++) {
+        rgbe[c] = (uint8_t)std::max(rgb[c] * normalize, 0.f);
+    }
+    rgbe[3] = exponent + 128;
+}
+
+// Run-length encodes one component of a scanline: runs of at least 4 bytes are written as
+// (128 + length, value), everything else as (count, values...).
+void put_rle_component(Bytes& out, const uint8_t* data, const std::size_t size) {
+    constexpr std::size_t MIN_RUN = 4;
+    constexpr std::size_t MAX_RUN = 127;
+    constexpr std::size_t MAX_LITERAL = 128;
+
+    std::size_t x = 0;
+    while (x < size) {
+        std::size_t run = 1;
+        while (x + run < size && run < MAX_RUN && data[x + run] == data[x]) {
+            run++;
+        }
+        if (run >= MIN_RUN) {
+            out.push_back(128 + run);
+            out.push_back(data[x]);
+            x += run;
+            continue;
+        }
+
+        std::size_t end = x + 1;
+        while (end < size && end - x < MAX_LITERAL &&
+               !(end + MIN_RUN <= size && data[end] == data[end + 1] &&
+                 data[end] == data[end + 2] && data[end] == data[end + 3])) {
+            end++;
+        }
+        out.push_back(end - x);
+        out.insert(out.end(), data + x, data + end);
+        x = end;
+    }
+}
+
+void put_hdr_scanline(Bytes& out, const float* row, const uint32_t width, Bytes& rgbe) {
+    for (uint32_t x = 0; x < width; x++) {
+        to_rgbe(rgbe.data() + 4 * x, row + 4 * x);
+    }
+
+    // the run-length encoding is only defined for these widths
+    if (width < 8 || width >= 32768) {
+        out.insert(out.end(), rgbe.begin(), rgbe.begin() + 4 * width);
+        return;
+    }
+
+    out.insert(out.end(), {2, 2, (uint8_t)(width >> 8), (uint8_t)width});
+    Bytes component(width);
+    for (uint32_t c = 0; c < 4; c++) {
+        for (uint32_t x = 0; x < width; x++) {
+            component[x] = rgbe[4 * x + c];
+        }
+        put_rle_component(out, component.data(), width);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// OpenEXR
+
+void put_u32_le(Bytes& out, const uint32_t value) {
+    put_u16_le(out, value);
+    put_u16_le(out, value >> 16);
+}
+
+void put_f32_le(Bytes& out, const float value) {
+    put_u32_le(out, std::bit_cast<uint32_t>(value));
+}
+
+void put_exr_attribute(Bytes& out, const char* name, const char* type, const Bytes& value) {
+    out.insert(out.end(), name, name + std::strlen(name) + 1);
+    out.insert(out.end(), type, type + std::strlen(type) + 1);
+    put_u32_le(out, value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+ImageEncoder::ImageEncoder(ThreadPool& thread_pool, const Options& options)
+    : thread_pool(thread_pool), options(options) {}
+
+uint32_t ImageEncoder::get_stripe_height(const uint32_t height, const uint32_t alignment) const {
+    uint32_t stripe_height = options.stripe_height;
+    if (stripe_height == 0) {
+        // a few stripes per task for load balancing, but not too small to compress well.
+        const uint32_t stripe_count = 4 * std::max(1u, options.tasks);
+        stripe_height = std::max(16u, (height + stripe_count - 1) / stripe_count);
+    }
+    return (stripe_height + alignment - 1) / alignment * alignment;
+}
+
+void ImageEncoder::write_png(std::ostream& out,
+                             const uint8_t* pixels,
+                             const uint32_t width,
+                             const uint32_t height) const {
+    const CompressionParameters parameters = get_parameters(options.compression);
+    const std::size_t row_size = (std::size_t)width * PNG_BYTES_PER_PIXEL;
+    const std::size_t filtered_row_size = row_size + 1;
+    const uint32_t stripe_height = get_stripe_height(height, 1);
+    const uint32_t stripe_count = (height + stripe_height - 1) / stripe_height;
+
+    // Filter all rows first, the compressor reads the previous stripe to prime its window.
+    Bytes filtered(filtered_row_size * height);
+    const Bytes zero_row(row_size, 0);
+    parallel_for(
+        stripe_count,
+        [&](const uint32_t stripe, [[maybe_unused]] const uint32_t thread_index) {
+            Bytes candidate(row_size);
+            const uint32_t end = std::min(height, (stripe + 1) * stripe_height);
+            for (uint32_t y = stripe * stripe_height; y < end; y++) {
+                const uint8_t* row = pixels + y * row_size;
+                const uint8_t* prior = y > 0 ? row - row_size : zero_row.data();
+                uint8_t* out_row = filtered.data() + y * filtered_row_size;
+
+                if (options.compression == Compression::NONE) {
+                    out_row[0] = PNG_FILTER_NONE;
+                    filter_row(out_row + 1, row, prior, row_size, PNG_FILTER_NONE);
+                } else if (!parameters.adaptive_filter) {
+                    out_row[0] = PNG_FILTER_PAETH;
+                    filter_row(out_row + 1, row, prior, row_size, PNG_FILTER_PAETH);
+                } else {
+                    uint64_t best_cost = UINT64_MAX;
+                    for (const PngFilter filter : {PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP,
+                                                   PNG_FILTER_AVERAGE, PNG_FILTER_PAETH}) {
+                        filter_row(candidate.data(), row, prior, row_size, filter);
+                        const uint64_t cost = filter_cost(candidate.data(), row_size);
+                        if (cost < best_cost) {
+                            best_cost = cost;
+                            out_row[0] = filter;
+                            std::copy(candidate.begin(), candidate.end(), out_row + 1);
+                        }
+                    }
+                }
+            }
+        },
+        thread_pool, options.tasks, options.priority);
+
+    // Every stripe becomes an IDAT chunk, the zlib header goes into the first.
+    std::vector<Bytes> chunks(stripe_count);
+    std::vector<uint32_t> checksums(stripe_count);
+    parallel_for(
+        stripe_count,
+        [&](const uint32_t stripe, [[maybe_unused]] const uint32_t thread_index) {
+            const std::size_t begin = stripe * stripe_height * filtered_row_size;
+            const std::size_t end =
+                std::min(height, (stripe + 1) * stripe_height) * filtered_row_size;
+            const bool last = stripe + 1 == stripe_count;
+
+            Bytes& chunk = chunks[stripe];
+            chunk.reserve((end - begin) / 2);
+            begin_chunk(chunk, "IDAT");
+            if (stripe == 0) {
+                chunk.insert(chunk.end(), {0x78, parameters.zlib_flags});
+            }
+            if (options.compression == Compression::NONE) {
+                deflate_stored(chunk, filtered.data() + begin, end - begin, last);
+            } else {
+                deflate_compressed(chunk, filtered.data(), begin, end, filtered.size(),
+                                   parameters, last);
+            }
+            end_chunk(chunk, 0);
+
+            checksums[stripe] = adler32(1, filtered.data() + begin, end - begin);
+        },
+        thread_pool, options.tasks, options.priority);
+
+    uint32_t checksum = checksums[0];
+    for (uint32_t stripe = 1; stripe < stripe_count; stripe++) {
+        const std::size_t stripe_size =
+            (std::min(height, (stripe + 1) * stripe_height) - stripe * stripe_height) *
+            filtered_row_size;
+        checksum = adler32_combine(checksum, checksums[stripe], stripe_size);
+    }
+
+    Bytes header = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    begin_chunk(header, "IHDR");
+    put_u32_be(header, width);
+    put_u32_be(header, height);
+    // 8 bit RGBA, deflate, no interlacing
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+    end_chunk(header, 8);
+    write(out, header);
+
+    for (const Bytes& chunk : chunks) {
+        write(out, chunk);
+    }
+
+    Bytes trailer;
+    begin_chunk(trailer, "IDAT");
+    put_u32_be(trailer, checksum);
+    end_chunk(trailer, 0);
+    const std::size_t end_begin = trailer.size();
+    begin_chunk(trailer, "IEND");
+    end_chunk(trailer, end_begin);
+    write(out, trailer);
+
+    if (!out) {
+        throw std::runtime_error{"writing PNG failed"};
+    }
+}
+
+void ImageEncoder::write_jpg(std::ostream& out,
+                             const uint8_t* pixels,
+                             const uint32_t width,
+                             const uint32_t height) const {
+    const int quality = std::clamp(options.quality, 1, 100);
+    const bool subsample = quality < 90;
+    const uint32_t mcu_size = subsample ? 16 : 8;
+    const uint32_t mcus_x = (width + mcu_size - 1) / mcu_size;
+    const uint32_t mcus_y = (height + mcu_size - 1) / mcu_size;
+    if (mcus_x > 0xffff || height > 0xffff || width > 0xffff) {
+        throw std::invalid_argument{fmt::format("image too large for JPEG: {}x{}", width, height)};
+    }
+
+    const JpegQuantization luminance(LUMINANCE_QUANTIZATION, quality);
+    const JpegQuantization chrominance(CHROMINANCE_QUANTIZATION, quality);
+
+    // Every row of MCUs is a restart interval: it resets the DC prediction and starts at a byte
+    // boundary, such that the rows can be encoded independently.
+    const uint32_t stripe_rows = get_stripe_height(height, mcu_size) / mcu_size;
+    const uint32_t stripe_count = (mcus_y + stripe_rows - 1) / stripe_rows;
+    std::vector<Bytes> stripes(stripe_count);
+    parallel_for(
+        stripe_count,
+        [&](const uint32_t stripe, [[maybe_unused]] const uint32_t thread_index) {
+            Bytes& data = stripes[stripe];
+            JpegBitWriter writer(data);
+
+            // YCbCr of one MCU with the level shift applied, edge pixels are repeated.
+            std::array<float, 256> y_samples, cb_samples, cr_samples;
+            std::array<float, 64> block;
+
+            const uint32_t row_end = std::min(mcus_y, (stripe + 1) * stripe_rows);
+            for (uint32_t mcu_y = stripe * stripe_rows; mcu_y < row_end; mcu_y++) {
+                int y_prediction = 0, cb_prediction = 0, cr_prediction = 0;
+                for (uint32_t mcu_x = 0; mcu_x < mcus_x; mcu_x++) {
+                    for (uint32_t j = 0; j < mcu_size; j++) {
+                        const uint32_t py = std::min(mcu_y * mcu_size + j, height - 1);
+                        for (uint32_t i = 0; i < mcu_size; i++) {
+                            const uint32_t px = std::min(mcu_x * mcu_size + i, width - 1);
+                            const uint8_t* p = pixels + ((std::size_t)py * width + px) * 4;
+                            const float r = p[0], g = p[1], b = p[2];
+                            const uint32_t k = j * mcu_size + i;
+                            y_samples[k] = 0.299f * r + 0.587f * g + 0.114f * b - 128.f;
+                            cb_samples[k] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+                            cr_samples[k] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+                        }
+                    }
+
+                    if (!subsample) {
+                        encode_block(writer, y_samples.data(), luminance, DC_LUMINANCE,
+                                     AC_LUMINANCE, y_prediction);
+                        encode_block(writer, cb_samples.data(), chrominance, DC_CHROMINANCE,
+                                     AC_CHROMINANCE, cb_prediction);
+                        encode_block(writer, cr_samples.data(), chrominance, DC_CHROMINANCE,
+                                     AC_CHROMINANCE, cr_prediction);
+                        continue;
+                    }
+
+                    // four luminance blocks, then the averaged chrominance
+                    for (uint32_t by = 0; by < 2; by++) {
+                        for (uint32_t bx = 0; bx < 2; bx++) {
+                            for (uint32_t j = 0; j < 8; j++) {
+                                for (uint32_t i = 0; i < 8; i++) {
+                                    block[j * 8 + i] = y_samples[(by * 8 + j) * 16 + bx * 8 + i];
+                                }
+                            }
+                            encode_block(writer, block.data(), luminance, DC_LUMINANCE,
+                                         AC_LUMINANCE, y_prediction);
+                        }
+                    }
+                    const auto downsample = [&](const std::array<float, 256>& samples) {
+                        for (uint32_t j = 0; j < 8; j++) {
+                            for (uint32_t i = 0; i < 8; i++) {
+                                const uint32_t k = 2 * j * 16 + 2 * i;
+                                block[j * 8 + i] = 0.25f * (samples[k] + samples[k + 1] +
+                                                            samples[k + 16] + samples[k + 17]);
+                            }
+                        }
+                    };
+                    downsample(cb_samples);
+                    encode_block(writer, block.data(), chrominance, DC_CHROMINANCE,
+                                 AC_CHROMINANCE, cb_prediction);
+                    downsample(cr_samples);
+                    encode_block(writer, block.data(), chrominance, DC_CHROMINANCE,
+                                 AC_CHROMINANCE, cr_prediction);
+                }
+
+                writer.flush();
+                if (mcu_y + 1 < mcus_y) {
+                    // RSTm, m cycles through 0-7
+                    data.push_back(0xff);
+                    data.push_back(0xd0 + mcu_y % 8);
+                }
+            }
+        },
+        thread_pool, options.tasks, options.priority);
+
+    Bytes header = {0xff, 0xd8};
+
+    // APP0 (JFIF 1.1, no density, no thumbnail)
+    header.insert(header.end(),
+                  {0xff, 0xe0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0});
+
+    // DQT, the tables are stored in zigzag order
+    header.insert(header.end(), {0xff, 0xdb});
+    put_u16_be(header, 2 + 2 * 65);
+    const auto put_quantization_table = [&](const uint8_t id,
+                                            const JpegQuantization& quantization) {
+        header.push_back(id);
+        for (uint32_t i = 0; i < 64; i++) {
+            header.push_back(quantization.table[ZIGZAG[i]]);
+        }
+    };
+    put_quantization_table(0, luminance);
+    put_quantization_table(1, chrominance);
+
+    // SOF0: 8 bit, three components
+    header.insert(header.end(), {0xff, 0xc0});
+    put_u16_be(header, 8 + 3 * 3);
+    header.push_back(8);
+    put_u16_be(header, height);
+    put_u16_be(header, width);
+    header.insert(header.end(),
+                  {3, 1, (uint8_t)(subsample ? 0x22 : 0x11), 0, 2, 0x11, 1, 3, 0x11, 1});
+
+    // DHT
+    header.insert(header.end(), {0xff, 0xc4});
+    put_u16_be(header, 2 + 4 * 17 + 2 * DC_VALUES.size() + AC_LUMINANCE_VALUES.size() +
+                           AC_CHROMINANCE_VALUES.size());
+    put_huffman_table(header, 0x00, DC_LUMINANCE_BITS, DC_VALUES.data(), DC_VALUES.size());
+    put_huffman_table(header, 0x10, AC_LUMINANCE_BITS, AC_LUMINANCE_VALUES.data(),
+                      AC_LUMINANCE_VALUES.size());
+    put_huffman_table(header, 0x01, DC_CHROMINANCE_BITS, DC_VALUES.data(), DC_VALUES.size());
+    put_huffman_table(header, 0x11, AC_CHROMINANCE_BITS, AC_CHROMINANCE_VALUES.data(),
+                      AC_CHROMINANCE_VALUES.size());
+
+    // DRI: one row of MCUs
+    header.insert(header.end(), {0xff, 0xdd, 0, 4});
+    put_u16_be(header, mcus_x);
+
+    // SOS: all components, full spectral range
+    header.insert(header.end(), {0xff, 0xda});
+    put_u16_be(header, 6 + 2 * 3);
+    header.insert(header.end(), {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0});
+    write(out, header);
+
+    for (const Bytes& stripe : stripes) {
+        write(out, stripe);
+    }
+    write(out, {0xff, 0xd9});
+
+    if (!out) {
+        throw std::runtime_error{"writing JPEG failed"};
+    }
+}
+
+void ImageEncoder::write_hdr(std::ostream& out,
+                             const float* pixels,
+                             const uint32_t width,
+                             const uint32_t height) const {
+    const uint32_t stripe_height = get_stripe_height(height, 1);
+    const uint32_t stripe_count = (height + stripe_height - 1) / stripe_height;
+
+    std::vector<Bytes> stripes(stripe_count);
+    parallel_for(
+        stripe_count,
+        [&](const uint32_t stripe, [[maybe_unused]] const uint32_t thread_index) {
+            Bytes& data = stripes[stripe];
+            Bytes rgbe(4 * width);
+            const uint32_t end = std::min(height, (stripe + 1) * stripe_height);
+            for (uint32_t y = stripe * stripe_height; y < end; y++) {
+                put_hdr_scanline(data, pixels + (std::size_t)y * width * 4, width, rgbe);
+            }
+        },
+        thread_pool, options.tasks, options.priority);
+
+    out << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n" << fmt::format("-Y {} +X {}\n", height, width);
+    for (const Bytes& stripe : stripes) {
+        write(out, stripe);
+    }
+
+    if (!out) {
+        throw std::runtime_error{"writing HDR failed"};
+    }
+}
+
+void ImageEncoder::write_exr(std::ostream& out,
+                             const uint16_t* pixels,
+                             const uint32_t width,
+                             const uint32_t height) const {
+    // channels must be sorted by name
+    constexpr std::array<std::pair<const char*, uint32_t>, 4> CHANNELS = {
+        {{"A", 3}, {"B", 2}, {"G", 1}, {"R", 0}}};
+    constexpr uint32_t PIXEL_TYPE_HALF = 1;
+    constexpr uint8_t NO_COMPRESSION = 0;
+    constexpr uint8_t INCREASING_Y = 0;
+
+    Bytes header = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};
+
+    Bytes channels;
+    for (const auto& [name, component] : CHANNELS) {
+        channels.insert(channels.end(), {(uint8_t)name[0], 0});
+        put_u32_le(channels, PIXEL_TYPE_HALF);
+        // pLinear and reserved
+        put_u32_le(channels, 0);
+        // x and y sampling
+        put_u32_le(channels, 1);
+        put_u32_le(channels, 1);
+    }
+    channels.push_back(0);
+    put_exr_attribute(header, "channels", "chlist", channels);
+    put_exr_attribute(header, "compression", "compression", {NO_COMPRESSION});
+
+    Bytes window;
+    put_u32_le(window, 0);
+    put_u32_le(window, 0);
+    put_u32_le(window, width - 1);
+    put_u32_le(window, height - 1);
+    put_exr_attribute(header, "dataWindow", "box2i", window);
+    put_exr_attribute(header, "displayWindow", "box2i", window);
+    put_exr_attribute(header, "lineOrder", "lineOrder", {INCREASING_Y});
+
+    Bytes value;
+    put_f32_le(value, 1.f);
+    put_exr_attribute(header, "pixelAspectRatio", "float", value);
+    put_exr_attribute(header, "screenWindowWidth", "float", value);
+    value.clear();
+    put_f32_le(value, 0.f);
+    put_f32_le(value, 0.f);
+    put_exr_attribute(header, "screenWindowCenter", "v2f", value);
+    header.push_back(0);
+
+    // offset table, every scanline is a block: y, size, then the channels one after another.
+    const uint32_t line_size = width * CHANNELS.size() * sizeof(uint16_t);
+    const uint64_t first_line = header.size() + (uint64_t)height * sizeof(uint64_t);
+    for (uint32_t y = 0; y < height; y++) {
+        const uint64_t offset = first_line + (uint64_t)y * (2 * sizeof(uint32_t) + line_size);
+        put_u32_le(header, offset);
+        put_u32_le(header, offset >> 32);
+    }
+    write(out, header);
+
+    Bytes line;
+    line.reserve(2 * sizeof(uint32_t) + line_size);
+    for (uint32_t y = 0; y < height; y++) {
+        line.clear();
+        put_u32_le(line, y);
+        put_u32_le(line, line_size);
+        const uint16_t* row = pixels + (std::size_t)y * width * 4;
+        for (const auto& [name, component] : CHANNELS) {
+            for (uint32_t x = 0; x < width; x++) {
+                put_u16_le(line, row[4 * x + component]);
+            }
+        }
+        write(out, line);
+    }
+
+    if (!out) {
+        throw std::runtime_error{"writing EXR failed"};
+    }
+}
+
+} // namespace merian
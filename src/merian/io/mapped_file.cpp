@@ -0,0 +1,92 @@
+#include "merian/io/mapped_file.hpp"
+#include "merian/utils/string.hpp"
+
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MERIAN_MAPPED_FILE_MMAP
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace merian {
+
+MappedFile::MappedFile(const std::filesystem::path& path,
+                       [[maybe_unused]] const AccessPattern access_pattern,
+                       [[maybe_unused]] const bool prefetch)
+    : path(path) {
+    if (!std::filesystem::exists(path)) {
+        throw std::runtime_error{fmt::format("failed to map {} (does not exist)", path.string())};
+    }
+
+#ifdef MERIAN_MAPPED_FILE_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0) {
+            size = file_stat.st_size;
+            if (size == 0) {
+                // mapping zero bytes is not allowed.
+                close(fd);
+                return;
+            }
+
+            void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            // the mapping keeps the file referenced.
+            close(fd);
+
+            if (address != MAP_FAILED) {
+                data = static_cast<const std::byte*>(address);
+                mapped = true;
+
+                switch (access_pattern) {
+                case AccessPattern::NORMAL:
+                    break;
+                case AccessPattern::SEQUENTIAL:
+                    madvise(address, size, MADV_SEQUENTIAL);
+                    break;
+                case AccessPattern::RANDOM:
+                    madvise(address, size, MADV_RANDOM);
+                    break;
+                }
+                if (prefetch) {
+                    madvise(address, size, MADV_WILLNEED);
+                }
+
+                SPDLOG_DEBUG("mapped {} of data from {}", format_size(size), path.string());
+                return;
+            }
+        } else {
+            close(fd);
+        }
+    }
+    SPDLOG_DEBUG("mapping {} failed ({}), falling back to reading", path.string(),
+                 std::strerror(errno));
+#endif
+
+    std::ifstream f(path, std::ios::in | std::ios::binary);
+    size = std::filesystem::file_size(path);
+    // not zero-initialized, the read overwrites everything.
+    buffer = std::make_unique_for_overwrite<std::byte[]>(size);
+    if (!f.read(reinterpret_cast<char*>(buffer.get()), (std::streamsize)size)) {
+        throw std::runtime_error{fmt::format("failed to read {}", path.string())};
+    }
+    data = buffer.get();
+
+    SPDLOG_DEBUG("load {} of data from {}", format_size(size), path.string());
+}
+
+MappedFile::~MappedFile() {
+#ifdef MERIAN_MAPPED_FILE_MMAP
+    if (mapped) {
+        munmap(const_cast<std::byte*>(data), size);
+    }
+#endif
+}
+
+} // namespace merian
@@ -0,0 +1,585 @@
+#include "merian/io/mesh.hpp"
+#include "merian/utils/hash.hpp"
+
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace merian {
+
+// the cache is written as it is in memory.
+static_assert(std::endian::native == std::endian::little);
+
+namespace {
+
+// OBJ files are split into chunks of about this size (at line boundaries).
+constexpr std::size_t OBJ_CHUNK_SIZE = 1 << 20;
+// the source is hashed in blocks of this size in parallel
+constexpr std::size_t HASH_BLOCK_SIZE = 1 << 22;
+
+constexpr int32_t MISSING_INDEX = INT32_MIN;
+
+// A face vertex as written in the file. Absolute indices are 0-based, relative (negative) indices
+// are relative to the start of the chunk and resolved once all chunks are parsed.
+struct ObjCorner {
+    int32_t index[3];
+    uint8_t relative;
+};
+
+// A change of the object/group name or material before the face with the given index.
+struct ObjEvent {
+    uint32_t face;
+    bool is_material;
+    std::string name;
+};
+
+struct ObjChunk {
+    std::string_view text;
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<ObjCorner> corners;
+    std::vector<uint32_t> face_sizes;
+    std::vector<ObjEvent> events;
+
+    uint32_t lines = 0;
+    // set if parsing failed, the line is local to the chunk.
+    std::optional<std::pair<uint32_t, std::string>> error;
+
+    // after deduplication
+    std::vector<Mesh::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    // the index of the first triangle index of every event
+    std::vector<uint32_t> event_indices;
+};
+
+bool is_space(const char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && is_space(s.front()))
+        s.remove_prefix(1);
+    while (!s.empty() && is_space(s.back()))
+        s.remove_suffix(1);
+    return s;
+}
+
+// Returns the next whitespace separated token and removes it from line.
+std::string_view next_token(std::string_view& line) {
+    line = trim(line);
+    std::size_t end = 0;
+    while (end < line.size() && !is_space(line[end]))
+        end++;
+    const std::string_view token = line.substr(0, end);
+    line.remove_prefix(end);
+    return token;
+}
+
+float parse_float(std::string_view& line) {
+    const std::string_view token = next_token(line);
+    float value;
+    // from_chars does not accept a leading '+'
+    const char* begin = token.data() + (!token.empty() && token.front() == '+' ? 1 : 0);
+    const auto [ptr, ec] = std::from_chars(begin, token.data() + token.size(), value);
+    if (ec != std::errc() || ptr != token.data() + token.size() || token.empty()) {
+        throw std::runtime_error{fmt::format("invalid number '{}'", token)};
+    }
+    return value;
+}
+
+// Parses an index of a face vertex, count is the number of elements before this line.
+void parse_index(std::string_view token, const uint32_t count, ObjCorner& corner, const int i) {
+    if (token.empty()) {
+        corner.index[i] = MISSING_INDEX;
+        return;
+    }
+    int32_t value;
+    const auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (ec != std::errc() || ptr != token.data() + token.size() || value == 0) {
+        throw std::runtime_error{fmt::format("invalid index '{}'", token)};
+    }
+    if (value > 0) {
+        corner.index[i] = value - 1;
+    } else {
+        corner.index[i] = (int32_t)count + value;
+        corner.relative |= 1 << i;
+    }
+}
+
+void parse_face(std::string_view line, ObjChunk& chunk) {
+    uint32_t size = 0;
+    for (std::string_view token = next_token(line); !token.empty(); token = next_token(line)) {
+        ObjCorner corner{{MISSING_INDEX, MISSING_INDEX, MISSING_INDEX}, 0};
+        // v, v/t, v//n or v/t/n
+        const std::size_t first_slash = token.find('/');
+        parse_index(token.substr(0, first_slash), chunk.positions.size(), corner, 0);
+        if (corner.index[0] == MISSING_INDEX) {
+            throw std::runtime_error{"face without position"};
+        }
+        if (first_slash != std::string_view::npos) {
+            const std::string_view rest = token.substr(first_slash + 1);
+            const std::size_t second_slash = rest.find('/');
+            parse_index(rest.substr(0, second_slash), chunk.uvs.size(), corner, 1);
+            if (second_slash != std::string_view::npos) {
+                parse_index(rest.substr(second_slash + 1), chunk.normals.size(), corner, 2);
+            }
+        }
+        chunk.corners.emplace_back(corner);
+        size++;
+    }
+    chunk.face_sizes.emplace_back(size);
+}
+
+void parse_line(std::string_view line, ObjChunk& chunk) {
+    const std::string_view keyword = next_token(line);
+    if (keyword == "v") {
+        const float x = parse_float(line);
+        const float y = parse_float(line);
+        const float z = parse_float(line);
+        // ignores w and vertex colors
+        chunk.positions.emplace_back(x, y, z);
+    } else if (keyword == "vn") {
+        const float x = parse_float(line);
+        const float y = parse_float(line);
+        const float z = parse_float(line);
+        chunk.normals.emplace_back(x, y, z);
+    } else if (keyword == "vt") {
+        const float u = parse_float(line);
+        const float v = trim(line).empty() ? 0 : parse_float(line);
+        chunk.uvs.emplace_back(u, v);
+    } else if (keyword == "f") {
+        parse_face(line, chunk);
+    } else if (keyword == "o" || keyword == "g") {
+        chunk.events.emplace_back(chunk.face_sizes.size(), false, std::string(trim(line)));
+    } else if (keyword == "usemtl") {
+        chunk.events.emplace_back(chunk.face_sizes.size(), true, std::string(trim(line)));
+    }
+    // comments, mtllib, smoothing groups, lines and points are ignored.
+}
+
+void parse_chunk(ObjChunk& chunk) {
+    std::string_view text = chunk.text;
+    while (!text.empty()) {
+        const std::size_t end = text.find('\n');
+        const std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+        if (!chunk.error) {
+            try {
+                parse_line(line, chunk);
+            } catch (const std::exception& e) {
+                // keep counting lines for the error message.
+                chunk.error = {chunk.lines, e.what()};
+            }
+        }
+        chunk.lines++;
+    }
+}
+
+struct CornerKey {
+    uint32_t position;
+    uint32_t uv;
+    uint32_t normal;
+
+    bool operator==(const CornerKey& other) const = default;
+};
+
+struct CornerKeyHash {
+    std::size_t operator()(const CornerKey& key) const {
+        uint64_t h = key.position * 0x9e3779b97f4a7c15ull;
+        h ^= (key.uv + 0x632be59bd9b4e019ull + (h << 6) + (h >> 2)) * 0xbf58476d1ce4e5b9ull;
+        h ^= (key.normal + 0x94d049bb133111ebull + (h << 6) + (h >> 2)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+};
+
+template <typename T> void write_section(std::ofstream& out, const std::span<const T> data) {
+    static constexpr char ZEROS[Mesh::CACHE_ALIGNMENT] = {};
+    out.write(reinterpret_cast<const char*>(data.data()), data.size_bytes());
+    const std::size_t padding =
+        (Mesh::CACHE_ALIGNMENT - data.size_bytes() % Mesh::CACHE_ALIGNMENT) % Mesh::CACHE_ALIGNMENT;
+    out.write(ZEROS, padding);
+}
+
+// Throws if the section is not aligned or out of bounds.
+template <typename T>
+std::span<const T>
+get_section(const std::span<const std::byte> data, const uint64_t offset, const uint64_t count) {
+    if (offset % Mesh::CACHE_ALIGNMENT != 0 || offset > data.size() ||
+        count > (data.size() - offset) / sizeof(T)) {
+        throw std::runtime_error{"section out of bounds"};
+    }
+    return {reinterpret_cast<const T*>(data.data() + offset), count};
+}
+
+uint64_t align_up(const uint64_t value) {
+    return (value + Mesh::CACHE_ALIGNMENT - 1) / Mesh::CACHE_ALIGNMENT * Mesh::CACHE_ALIGNMENT;
+}
+
+} // namespace
+
+MeshHandle
+Mesh::parse_obj(const std::filesystem::path& path, ThreadPool& thread_pool, const uint32_t tasks) {
+    const MappedFile file(path, MappedFile::AccessPattern::SEQUENTIAL, true);
+    const std::string_view text = file.get_string_view();
+
+    // split at line boundaries
+    const std::size_t chunk_count =
+        std::clamp<std::size_t>(text.size() / OBJ_CHUNK_SIZE, 1, std::max(1u, tasks) * 8);
+    std::vector<ObjChunk> chunks(chunk_count);
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < chunk_count; i++) {
+        std::size_t end = i + 1 == chunk_count ? text.size() : text.size() * (i + 1) / chunk_count;
+        end = std::max(begin, end);
+        if (end < text.size()) {
+            const std::size_t newline = text.find('\n', end);
+            end = newline == std::string_view::npos ? text.size() : newline + 1;
+        }
+        chunks[i].text = text.substr(begin, end - begin);
+        begin = end;
+    }
+
+    parallel_for(chunk_count, [&](const uint32_t i, uint32_t) { parse_chunk(chunks[i]); },
+                 thread_pool, tasks);
+
+    // resolve relative indices and report the first error
+    std::vector<uint32_t> position_base(chunk_count + 1, 0);
+    std::vector<uint32_t> uv_base(chunk_count + 1, 0);
+    std::vector<uint32_t> normal_base(chunk_count + 1, 0);
+    uint32_t line_base = 0;
+    for (std::size_t i = 0; i < chunk_count; i++) {
+        if (chunks[i].error) {
+            throw std::runtime_error{fmt::format("{}:{}: {}", path.string(),
+                                                 line_base + chunks[i].error->first + 1,
+                                                 chunks[i].error->second)};
+        }
+        line_base += chunks[i].lines;
+        position_base[i + 1] = position_base[i] + chunks[i].positions.size();
+        uv_base[i + 1] = uv_base[i] + chunks[i].uvs.size();
+        normal_base[i + 1] = normal_base[i] + chunks[i].normals.size();
+    }
+
+    // merge all attributes, they are referenced across chunks
+    std::vector<glm::vec3> positions(position_base.back());
+    std::vector<glm::vec2> uvs(uv_base.back());
+    std::vector<glm::vec3> normals(normal_base.back());
+    parallel_for(
+        chunk_count,
+        [&](const uint32_t i, uint32_t) {
+            std::copy(chunks[i].positions.begin(), chunks[i].positions.end(),
+                      positions.begin() + position_base[i]);
+            std::copy(chunks[i].uvs.begin(), chunks[i].uvs.end(), uvs.begin() + uv_base[i]);
+            std::copy(chunks[i].normals.begin(), chunks[i].normals.end(),
+                      normals.begin() + normal_base[i]);
+        },
+        thread_pool, tasks);
+
+    // deduplicate and triangulate per chunk
+    std::atomic<bool> index_out_of_range = false;
+    parallel_for(
+        chunk_count,
+        [&](const uint32_t i, uint32_t) {
+            ObjChunk& chunk = chunks[i];
+            const uint32_t bases[3] = {position_base[i], uv_base[i], normal_base[i]};
+            const std::size_t counts[3] = {positions.size(), uvs.size(), normals.size()};
+
+            std::unordered_map<CornerKey, uint32_t, CornerKeyHash> unique;
+            unique.reserve(chunk.corners.size());
+            std::vector<uint32_t> face_indices;
+            std::size_t corner = 0;
+            std::size_t event = 0;
+            for (uint32_t face = 0; face < chunk.face_sizes.size(); face++) {
+                for (; event < chunk.events.size() && chunk.events[event].face == face; event++) {
+                    chunk.event_indices.emplace_back(chunk.indices.size());
+                }
+
+                face_indices.clear();
+                for (uint32_t j = 0; j < chunk.face_sizes[face]; j++, corner++) {
+                    const ObjCorner& c = chunk.corners[corner];
+                    uint32_t resolved[3];
+                    for (int k = 0; k < 3; k++) {
+                        if (c.index[k] == MISSING_INDEX) {
+                            resolved[k] = UINT32_MAX;
+                            continue;
+                        }
+                        const int64_t index =
+                            (int64_t)c.index[k] + ((c.relative >> k) & 1 ? bases[k] : 0);
+                        if (index < 0 || (uint64_t)index >= counts[k]) {
+                            index_out_of_range.store(true, std::memory_order_relaxed);
+                            return;
+                        }
+                        resolved[k] = index;
+                    }
+
+                    const CornerKey key{resolved[0], resolved[1], resolved[2]};
+                    const auto [it, inserted] = unique.try_emplace(key, chunk.vertices.size());
+                    if (inserted) {
+                        chunk.vertices.emplace_back(
+                            positions[key.position],
+                            key.normal == UINT32_MAX ? glm::vec3(0) : normals[key.normal],
+                            key.uv == UINT32_MAX ? glm::vec2(0) : uvs[key.uv]);
+                    }
+                    face_indices.emplace_back(it->second);
+                }
+
+                // fan, faces with less than three vertices are skipped
+                for (uint32_t j = 2; j < face_indices.size(); j++) {
+                    chunk.indices.insert(chunk.indices.end(),
+                                         {face_indices[0], face_indices[j - 1], face_indices[j]});
+                }
+            }
+            for (; event < chunk.events.size(); event++) {
+                chunk.event_indices.emplace_back(chunk.indices.size());
+            }
+
+            // free memory early
+            chunk.corners = {};
+            chunk.face_sizes = {};
+        },
+        thread_pool, tasks);
+    if (index_out_of_range) {
+        throw std::runtime_error{fmt::format("{}: face index out of range", path.string())};
+    }
+
+    MeshHandle mesh = std::shared_ptr<Mesh>(new Mesh());
+
+    // parts and materials
+    std::vector<uint32_t> vertex_base(chunk_count + 1, 0);
+    std::vector<uint32_t> index_base(chunk_count + 1, 0);
+    std::unordered_map<std::string, int32_t> material_ids;
+    std::string current_name;
+    int32_t current_material = -1;
+    uint32_t part_begin = 0;
+    const auto close_part = [&](const uint32_t end) {
+        if (end > part_begin) {
+            mesh->part_storage.emplace_back(part_begin, end - part_begin, current_material,
+                                            mesh->string_storage.size(), current_name.size(), 0);
+            mesh->string_storage.insert(mesh->string_storage.end(), current_name.begin(),
+                                        current_name.end());
+        }
+        part_begin = end;
+    };
+    for (std::size_t i = 0; i < chunk_count; i++) {
+        vertex_base[i + 1] = vertex_base[i] + chunks[i].vertices.size();
+        index_base[i + 1] = index_base[i] + chunks[i].indices.size();
+
+        for (std::size_t j = 0; j < chunks[i].events.size(); j++) {
+            close_part(index_base[i] + chunks[i].event_indices[j]);
+            ObjEvent& event = chunks[i].events[j];
+            if (!event.is_material) {
+                current_name = std::move(event.name);
+                continue;
+            }
+            const auto [it, inserted] =
+                material_ids.try_emplace(event.name, mesh->material_storage.size());
+            if (inserted) {
+                mesh->material_storage.emplace_back(mesh->string_storage.size(),
+                                                    event.name.size());
+                mesh->string_storage.insert(mesh->string_storage.end(), event.name.begin(),
+                                            event.name.end());
+            }
+            current_material = it->second;
+        }
+    }
+    close_part(index_base.back());
+
+    mesh->vertex_storage.resize(vertex_base.back());
+    mesh->index_storage.resize(index_base.back());
+    parallel_for(
+        chunk_count,
+        [&](const uint32_t i, uint32_t) {
+            std::copy(chunks[i].vertices.begin(), chunks[i].vertices.end(),
+                      mesh->vertex_storage.begin() + vertex_base[i]);
+            std::transform(chunks[i].indices.begin(), chunks[i].indices.end(),
+                           mesh->index_storage.begin() + index_base[i],
+                           [&](const uint32_t index) { return index + vertex_base[i]; });
+        },
+        thread_pool, tasks);
+
+    mesh->vertices = mesh->vertex_storage;
+    mesh->indices = mesh->index_storage;
+    mesh->parts = mesh->part_storage;
+    mesh->materials = mesh->material_storage;
+    mesh->strings = mesh->string_storage;
+
+    SPDLOG_DEBUG("parsed {} in {} chunks: {} vertices, {} triangles, {} parts, {} materials",
+                 path.string(), chunk_count, mesh->vertices.size(), mesh->indices.size() / 3,
+                 mesh->parts.size(), mesh->materials.size());
+
+    return mesh;
+}
+
+Mesh::SourceStamp Mesh::get_source_stamp(const std::filesystem::path& path,
+                                         const bool with_hash,
+                                         ThreadPool& thread_pool) {
+    SourceStamp stamp{};
+    stamp.size = std::filesystem::file_size(path);
+    stamp.mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::filesystem::last_write_time(path).time_since_epoch())
+                      .count();
+
+    if (with_hash) {
+        const MappedFile file(path, MappedFile::AccessPattern::SEQUENTIAL, true);
+        const std::span<const std::byte> data = file.get_data();
+        const std::size_t block_count = (data.size() + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE;
+        std::vector<uint64_t> block_hashes(block_count);
+        parallel_for(
+            block_count,
+            [&](const uint32_t i, uint32_t) {
+                const std::span<const std::byte> block =
+                    data.subspan(i * HASH_BLOCK_SIZE,
+                                 std::min(HASH_BLOCK_SIZE, data.size() - i * HASH_BLOCK_SIZE));
+                block_hashes[i] = hash_fnv1a(block.data(), block.size());
+            },
+            thread_pool);
+        stamp.hash = hash_fnv1a(block_hashes.data(), block_hashes.size() * sizeof(uint64_t),
+                                0xcbf29ce484222325ull ^ data.size());
+    }
+
+    return stamp;
+}
+
+void Mesh::write_cache(const std::filesystem::path& cache_path, const SourceStamp& source) const {
+    CacheHeader header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.vertex_stride = sizeof(Vertex);
+    header.source = source;
+    header.vertex_offset = align_up(sizeof(CacheHeader));
+    header.vertex_count = vertices.size();
+    header.index_offset = align_up(header.vertex_offset + vertices.size_bytes());
+    header.index_count = indices.size();
+    header.part_offset = align_up(header.index_offset + indices.size_bytes());
+    header.part_count = parts.size();
+    header.material_offset = align_up(header.part_offset + parts.size_bytes());
+    header.material_count = materials.size();
+    header.strings_offset = align_up(header.material_offset + materials.size_bytes());
+    header.strings_size = strings.size();
+
+    const std::filesystem::path tmp_path = cache_path.string() + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        write_section(out, std::span<const CacheHeader>(&header, 1));
+        write_section(out, vertices);
+        write_section(out, indices);
+        write_section(out, parts);
+        write_section(out, materials);
+        write_section(out, strings);
+        out.close();
+        if (!out) {
+            std::filesystem::remove(tmp_path);
+            throw std::runtime_error{fmt::format("writing {} failed", tmp_path.string())};
+        }
+    }
+    std::filesystem::rename(tmp_path, cache_path);
+}
+
+void Mesh::update_cache_stamp(const std::filesystem::path& cache_path, const SourceStamp& source) {
+    std::fstream file(cache_path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offsetof(CacheHeader, source));
+    file.write(reinterpret_cast<const char*>(&source), sizeof(source));
+    file.close();
+    if (!file) {
+        throw std::runtime_error{fmt::format("writing {} failed", cache_path.string())};
+    }
+}
+
+MeshHandle Mesh::read_cache(const std::filesystem::path& cache_path) {
+    MeshHandle mesh = std::shared_ptr<Mesh>(new Mesh());
+    mesh->cache = std::make_unique<const MappedFile>(cache_path,
+                                                     MappedFile::AccessPattern::SEQUENTIAL, true);
+    const std::span<const std::byte> data = mesh->cache->get_data();
+
+    try {
+        CacheHeader header;
+        if (data.size() < sizeof(header)) {
+            throw std::runtime_error{"too small"};
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+            throw std::runtime_error{"wrong magic"};
+        }
+        if (header.version != CACHE_VERSION || header.vertex_stride != sizeof(Vertex)) {
+            throw std::runtime_error{fmt::format("unsupported version {}", header.version)};
+        }
+
+        mesh->vertices = get_section<Vertex>(data, header.vertex_offset, header.vertex_count);
+        mesh->indices = get_section<uint32_t>(data, header.index_offset, header.index_count);
+        mesh->parts = get_section<Part>(data, header.part_offset, header.part_count);
+        mesh->materials =
+            get_section<Material>(data, header.material_offset, header.material_count);
+        mesh->strings = get_section<char>(data, header.strings_offset, header.strings_size);
+        mesh->source = header.source;
+
+        // cheap checks such that the accessors stay in bounds, the indices are not checked.
+        for (const Material& material : mesh->materials) {
+            if ((uint64_t)material.offset + material.size > mesh->strings.size()) {
+                throw std::runtime_error{"material name out of bounds"};
+            }
+        }
+        for (const Part& part : mesh->parts) {
+            if ((uint64_t)part.first_index + part.index_count > mesh->indices.size() ||
+                (uint64_t)part.name_offset + part.name_size > mesh->strings.size() ||
+                part.material >= (int64_t)mesh->materials.size() || part.material < -1) {
+                throw std::runtime_error{"part out of bounds"};
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error{
+            fmt::format("{} is not a valid mesh cache: {}", cache_path.string(), e.what())};
+    }
+
+    return mesh;
+}
+
+MeshHandle Mesh::load_obj(const std::filesystem::path& path,
+                          const std::optional<std::filesystem::path>& cache_path,
+                          ThreadPool& thread_pool) {
+    const std::filesystem::path cache = cache_path.value_or(path.string() + ".meshcache");
+    SourceStamp stamp = get_source_stamp(path, false, thread_pool);
+
+    if (std::filesystem::exists(cache)) {
+        try {
+            MeshHandle mesh = read_cache(cache);
+            const SourceStamp& cached = mesh->get_source();
+            if (cached.size == stamp.size && cached.mtime == stamp.mtime) {
+                SPDLOG_DEBUG("using mesh cache {}", cache.string());
+                return mesh;
+            }
+            if (cached.size == stamp.size) {
+                stamp = get_source_stamp(path, true, thread_pool);
+                if (cached.hash == stamp.hash) {
+                    SPDLOG_DEBUG("using mesh cache {} (content unchanged)", cache.string());
+                    try {
+                        update_cache_stamp(cache, stamp);
+                        mesh->source = stamp;
+                    } catch (const std::exception& e) {
+                        SPDLOG_WARN("could not update mesh cache: {}", e.what());
+                    }
+                    return mesh;
+                }
+            }
+            SPDLOG_DEBUG("mesh cache {} is outdated", cache.string());
+        } catch (const std::exception& e) {
+            SPDLOG_WARN("ignoring mesh cache: {}", e.what());
+        }
+    }
+
+    const MeshHandle mesh = parse_obj(path, thread_pool);
+    try {
+        mesh->write_cache(cache, get_source_stamp(path, true, thread_pool));
+    } catch (const std::exception& e) {
+        SPDLOG_WARN("could not write mesh cache: {}", e.what());
+    }
+    return mesh;
+}
+
+} // namespace merian
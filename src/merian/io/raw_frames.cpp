@@ -0,0 +1,223 @@
+#include "merian/io/raw_frames.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace merian {
+
+using namespace raw_frames;
+
+static uint64_t align_up(const uint64_t value) {
+    return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+uint32_t raw_frames::get_component_size(const ComponentType type) {
+    switch (type) {
+    case ComponentType::FLOAT32:
+        return 4;
+    case ComponentType::FLOAT16:
+        return 2;
+    case ComponentType::UINT8:
+        return 1;
+    }
+    throw std::invalid_argument{"unknown component type"};
+}
+
+// ---------------------------------------------------------------------------
+
+RawFramesWriter::RawFramesWriter(const std::filesystem::path& path, const bool append)
+    : path(path) {
+    std::ios::openmode mode = std::ios::in | std::ios::out | std::ios::binary;
+    if (append && std::filesystem::exists(path) && std::filesystem::file_size(path) > 0) {
+        {
+            const RawFramesReader reader(path);
+            for (uint32_t i = 0; i < reader.get_frame_count(); i++) {
+                frames.push_back(reader.get_frame(i));
+            }
+        }
+        std::sort(frames.begin(), frames.end(), [](const auto& a, const auto& b) {
+            return a.payload_offset < b.payload_offset;
+        });
+        end = frames.empty() ? ALIGNMENT
+                             : align_up(frames.back().payload_offset + frames.back().payload_size);
+        // drop the index and anything that could not be read.
+        std::filesystem::resize_file(path, std::min(end, std::filesystem::file_size(path)));
+        SPDLOG_DEBUG("continuing {} with {} frames", path.string(), frames.size());
+    } else {
+        mode |= std::ios::trunc;
+        end = ALIGNMENT;
+    }
+
+    file.open(path, mode);
+    if (!file) {
+        throw std::runtime_error{fmt::format("cannot open {}", path.string())};
+    }
+
+    // not finalized until finalize() was called.
+    FileHeader header{};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = VERSION;
+    header.frame_count = frames.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!file) {
+        throw std::runtime_error{fmt::format("writing {} failed", path.string())};
+    }
+}
+
+RawFramesWriter::~RawFramesWriter() {
+    try {
+        finalize();
+    } catch (const std::exception& e) {
+        SPDLOG_ERROR("finalizing {} failed: {}", path.string(), e.what());
+    }
+}
+
+uint32_t RawFramesWriter::append(const uint32_t width,
+                                 const uint32_t height,
+                                 const uint32_t channels,
+                                 const ComponentType component_type,
+                                 const void* data,
+                                 const uint64_t frame_number,
+                                 const double time) {
+    FrameHeader header{};
+    std::memcpy(header.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC));
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.component_type = component_type;
+    header.frame_number = frame_number;
+    header.time = time;
+    header.payload_size =
+        (uint64_t)width * height * channels * get_component_size(component_type);
+
+    std::lock_guard lk(mutex);
+    if (finalized) {
+        // the frame overwrites the index, the header must not point to it anymore.
+        FileHeader file_header{};
+        std::memcpy(file_header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+        file_header.version = VERSION;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&file_header), sizeof(file_header));
+        file.flush();
+        finalized = false;
+    }
+
+    header.payload_offset = end + ALIGNMENT;
+    // seeking past the end leaves zeros (or a hole) as padding.
+    file.seekp(end);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.seekp(header.payload_offset);
+    file.write(static_cast<const char*>(data), header.payload_size);
+    if (!file) {
+        file.clear();
+        throw std::runtime_error{fmt::format("writing {} failed", path.string())};
+    }
+
+    end = align_up(header.payload_offset + header.payload_size);
+    frames.push_back(header);
+    return frames.size() - 1;
+}
+
+void RawFramesWriter::finalize() {
+    std::lock_guard lk(mutex);
+    if (finalized) {
+        return;
+    }
+
+    file.seekp(end);
+    file.write(reinterpret_cast<const char*>(frames.data()), frames.size() * sizeof(FrameHeader));
+
+    FileHeader header{};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = VERSION;
+    header.frame_count = frames.size();
+    header.index_offset = end;
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.flush();
+    if (!file) {
+        file.clear();
+        throw std::runtime_error{fmt::format("writing index of {} failed", path.string())};
+    }
+
+    finalized = true;
+    SPDLOG_DEBUG("finalized {} with {} frames", path.string(), frames.size());
+}
+
+uint32_t RawFramesWriter::get_frame_count() {
+    std::lock_guard lk(mutex);
+    return frames.size();
+}
+
+// ---------------------------------------------------------------------------
+
+RawFramesReader::RawFramesReader(const std::filesystem::path& path)
+    : file(path, MappedFile::AccessPattern::RANDOM) {
+    const std::span<const std::byte> data = file.get_data();
+
+    FileHeader header;
+    if (data.size() < sizeof(header)) {
+        throw std::runtime_error{fmt::format("{} is not a raw frames file", path.string())};
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+        throw std::runtime_error{fmt::format("{} is not a raw frames file", path.string())};
+    }
+    if (header.version != VERSION) {
+        throw std::runtime_error{
+            fmt::format("{} has unsupported version {}", path.string(), header.version)};
+    }
+
+    const auto valid = [&](const FrameHeader& frame) {
+        return std::memcmp(frame.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC)) == 0 &&
+               frame.component_type <= ComponentType::UINT8 &&
+               frame.payload_offset % ALIGNMENT == 0 && frame.payload_offset <= data.size() &&
+               frame.payload_size <= data.size() - frame.payload_offset &&
+               frame.payload_size == (uint64_t)frame.width * frame.height * frame.channels *
+                                         get_component_size(frame.component_type);
+    };
+
+    if (header.index_offset != 0 && header.index_offset <= data.size() &&
+        header.frame_count <= (data.size() - header.index_offset) / sizeof(FrameHeader)) {
+        frames.resize(header.frame_count);
+        std::memcpy(frames.data(), data.data() + header.index_offset,
+                    header.frame_count * sizeof(FrameHeader));
+        if (!std::all_of(frames.begin(), frames.end(), valid)) {
+            throw std::runtime_error{fmt::format("{} has a corrupted index", path.string())};
+        }
+        finalized = true;
+    } else {
+        // not finalized: walk the frames, stop at the first incomplete one.
+        for (uint64_t position = ALIGNMENT; position + sizeof(FrameHeader) <= data.size();) {
+            FrameHeader frame;
+            std::memcpy(&frame, data.data() + position, sizeof(frame));
+            if (frame.payload_offset != position + ALIGNMENT || !valid(frame)) {
+                break;
+            }
+            frames.push_back(frame);
+            position = align_up(frame.payload_offset + frame.payload_size);
+        }
+        SPDLOG_DEBUG("{} was not finalized, found {} frames", path.string(), frames.size());
+    }
+
+    std::stable_sort(frames.begin(), frames.end(), [](const auto& a, const auto& b) {
+        return a.frame_number < b.frame_number;
+    });
+}
+
+std::span<const std::byte> RawFramesReader::get_payload(const uint32_t index) const {
+    const FrameHeader& frame = frames[index];
+    return file.get_data().subspan(frame.payload_offset, frame.payload_size);
+}
+
+uint32_t RawFramesReader::find_frame(const uint64_t frame_number) const {
+    return std::partition_point(
+               frames.begin(), frames.end(),
+               [&](const FrameHeader& frame) { return frame.frame_number < frame_number; }) -
+           frames.begin();
+}
+
+} // namespace merian
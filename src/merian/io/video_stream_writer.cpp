@@ -0,0 +1,89 @@
+#include "merian/io/video_stream_writer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fmt/format.h>
+#include <numeric>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define POPEN_WRITE_MODE "wb"
+#else
+// POSIX pipes have no text mode
+#define POPEN_WRITE_MODE "w"
+#endif
+
+namespace merian {
+
+VideoStreamWriter::VideoStreamWriter(const std::string& target,
+                                     const Target target_type,
+                                     const Container container,
+                                     const uint32_t width,
+                                     const uint32_t height,
+                                     const double framerate)
+    : target(target), target_type(target_type), container(container), width(width),
+      height(height), framerate(framerate) {
+    if (width == 0 || height == 0) {
+        throw std::invalid_argument{"video stream with empty frames"};
+    }
+}
+
+VideoStreamWriter::~VideoStreamWriter() {
+    if (file == nullptr) {
+        return;
+    }
+
+    if (target_type == Target::COMMAND) {
+        const int status = pclose(file);
+        if (status != 0) {
+            SPDLOG_WARN("'{}' exited with status {}", target, status);
+        }
+    } else if (std::fclose(file) != 0) {
+        SPDLOG_ERROR("closing {} failed", target);
+    }
+    SPDLOG_DEBUG("closed video stream {} after {} frames", target, get_frame_count());
+}
+
+std::size_t VideoStreamWriter::get_frame_size(const uint32_t width, const uint32_t height) {
+    const std::size_t chroma_size = (std::size_t)((width + 1) / 2) * ((height + 1) / 2);
+    return (std::size_t)width * height + 2 * chroma_size;
+}
+
+void VideoStreamWriter::write_frame(const void* yuv) {
+    if (file == nullptr) {
+        file = target_type == Target::COMMAND ? popen(target.c_str(), POPEN_WRITE_MODE)
+                                              : std::fopen(target.c_str(), "wb");
+        if (file == nullptr) {
+            throw std::runtime_error{fmt::format("cannot open {}", target)};
+        }
+
+        if (container == Container::Y4M) {
+            // the rate as fraction with millihertz precision
+            uint64_t numerator = std::llround(framerate * 1000);
+            uint64_t denominator = 1000;
+            const uint64_t divisor = std::gcd(numerator, denominator);
+            numerator /= std::max(divisor, (uint64_t)1);
+            denominator /= std::max(divisor, (uint64_t)1);
+            // 420jpeg: chroma is sited in the center of each 2x2 block.
+            const std::string header =
+                fmt::format("YUV4MPEG2 W{} H{} F{}:{} Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+                            width, height, numerator, denominator);
+            std::fwrite(header.data(), 1, header.size(), file);
+        }
+    }
+
+    static constexpr char FRAME_HEADER[] = "FRAME\n";
+    if (container == Container::Y4M) {
+        std::fwrite(FRAME_HEADER, 1, sizeof(FRAME_HEADER) - 1, file);
+    }
+    const std::size_t size = get_frame_size();
+    if (std::fwrite(yuv, 1, size, file) != size) {
+        throw std::runtime_error{fmt::format("writing to {} failed", target)};
+    }
+    frame_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace merian
@@ -1,6 +1,9 @@
 #include "merian/utils/audio/sdl_audio_device.hpp"
 
 #include "SDL.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <spdlog/spdlog.h>
 #include <stdexcept>
 
@@ -85,7 +88,16 @@ std::optional<SDLAudioDevice::AudioSpec>
 SDLAudioDevice::open_device(const AudioSpec& desired_audio_spec,
                             const std::function<void(uint8_t* stream, int len)>& callback,
                             const AllowedChangesFlags& allowed_changes) {
-    this->callback = callback;
+    close_device();
+
+    // SDL_QueueAudio locks the device against the audio thread, feed the device from our own
+    // queue instead.
+    push_mode = !callback;
+    if (push_mode) {
+        this->callback = [this](uint8_t* stream, int len) { pull_queued_audio(stream, len); };
+    } else {
+        this->callback = callback;
+    }
 
     int sdl_allowed_changes = 0;
     sdl_allowed_changes |= allowed_changes & AllowedChangesFlagBits::CHANNELS_CHANGE
@@ -109,7 +121,7 @@ SDLAudioDevice::open_device(const AudioSpec& desired_audio_spec,
         0,
         0,
         sdl_callback,
-        callback ? &this->callback : nullptr,
+        &this->callback,
     };
     SDL_AudioSpec audio_spec;
     audio_device_id = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &audio_spec, sdl_allowed_changes);
@@ -120,6 +132,7 @@ SDLAudioDevice::open_device(const AudioSpec& desired_audio_spec,
             audio_spec.freq,
             audio_spec.channels,
         };
+        silence = audio_spec.silence;
 
         SPDLOG_DEBUG("SDL audio device opened: {} Hz, {} samples, {} channels",
                      this->audio_spec->samplerate, this->audio_spec->buffersize,
@@ -135,6 +148,11 @@ void SDLAudioDevice::close_device() {
         audio_device_id = 0;
         audio_spec.reset();
     }
+
+    // the audio thread is stopped, discard what was not played.
+    while (queued_audio.try_pop()) {}
+    current_chunk.size = 0;
+    current_offset = 0;
 }
 
 // returns a audio spec if the device is open
@@ -142,11 +160,56 @@ std::optional<SDLAudioDevice::AudioSpec> SDLAudioDevice::get_audio_spec() {
     return audio_spec;
 }
 
-void SDLAudioDevice::queue_audio(const void* data, uint32_t len) {
-    assert(!callback);
+uint32_t SDLAudioDevice::queue_audio(const void* data, uint32_t len) {
+    assert(push_mode);
 
-    if (audio_device_id) {
-        SDL_QueueAudio(audio_device_id, data, len);
+    if (!audio_device_id) {
+        return 0;
+    }
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t queued = 0;
+    AudioChunk chunk;
+    while (queued < len) {
+        chunk.size = std::min(len - queued, (uint32_t)chunk.data.size());
+        std::memcpy(chunk.data.data(), bytes + queued, chunk.size);
+        if (!queued_audio.try_push(chunk)) {
+            rejected_bytes += len - queued;
+            if (!warned_full) {
+                SPDLOG_WARN("audio queue full, {} bytes were not queued. Queue less audio ahead "
+                            "or retry with the remaining bytes.",
+                            len - queued);
+                warned_full = true;
+            } else {
+                SPDLOG_DEBUG("audio queue full, {} bytes not queued ({} total)", len - queued,
+                             rejected_bytes);
+            }
+            return queued;
+        }
+        queued += chunk.size;
+    }
+
+    return queued;
+}
+
+void SDLAudioDevice::pull_queued_audio(uint8_t* stream, int len) {
+    while (len > 0) {
+        if (current_offset == current_chunk.size) {
+            std::optional<AudioChunk> next = queued_audio.try_pop();
+            if (!next) {
+                // not enough audio
+                std::memset(stream, silence, len);
+                return;
+            }
+            current_chunk = *next;
+            current_offset = 0;
+        }
+
+        const uint32_t count = std::min((uint32_t)len, current_chunk.size - current_offset);
+        std::memcpy(stream, current_chunk.data.data() + current_offset, count);
+        current_offset += count;
+        stream += count;
+        len -= count;
     }
 }
 
@@ -0,0 +1,193 @@
+#include "merian/utils/concurrent/task_graph.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+namespace merian {
+
+struct TaskGraph::RunState {
+    RunState(ThreadPool& thread_pool, const std::size_t task_count)
+        : thread_pool(thread_pool), join_counters(new std::atomic<uint32_t>[task_count]),
+          remaining(task_count) {}
+
+    ThreadPool& thread_pool;
+    std::unique_ptr<std::atomic<uint32_t>[]> join_counters;
+    std::atomic<std::size_t> remaining;
+    // skip remaining tasks after an exception.
+    std::atomic<bool> failed{false};
+
+    // set by the last task while holding the mutex, run() waits for it before returning to ensure
+    // no task accesses the state anymore.
+    std::mutex mutex;
+    std::condition_variable cv_done;
+    bool done = false;
+    std::exception_ptr exception;
+};
+
+TaskGraph::TaskID TaskGraph::add_task(const std::string& name,
+                                      const std::function<void()>& function) {
+    TaskInfo& info = tasks.emplace_back();
+    info.name = name;
+    info.function = function;
+    return tasks.size() - 1;
+}
+
+void TaskGraph::add_dependency(const TaskID before, const TaskID after) {
+    assert(before < tasks.size() && after < tasks.size() && before != after);
+    tasks[before].successors.emplace_back(after);
+    tasks[after].predecessor_count++;
+}
+
+void TaskGraph::clear() {
+    tasks.clear();
+    critical_path.clear();
+    critical_path_duration = work_duration = run_duration = std::chrono::nanoseconds::zero();
+}
+
+void TaskGraph::run(ThreadPool& thread_pool) {
+    if (tasks.empty()) {
+        return;
+    }
+
+    const clock::time_point run_start = clock::now();
+    RunState state(thread_pool, tasks.size());
+
+    std::vector<TaskID> roots;
+    for (TaskID task = 0; task < tasks.size(); task++) {
+        state.join_counters[task].store(tasks[task].predecessor_count, std::memory_order_relaxed);
+        if (tasks[task].predecessor_count == 0) {
+            roots.emplace_back(task);
+        }
+    }
+    if (roots.empty()) {
+        throw std::invalid_argument{"task graph contains a cycle"};
+    }
+
+    for (uint32_t i = 1; i < roots.size(); i++) {
+        thread_pool.submit_detached([this, &state, task = roots[i]] { execute(state, task); },
+                                    "TaskGraph");
+    }
+    execute(state, roots[0]);
+
+    while (state.remaining.load(std::memory_order_acquire) > 0 &&
+           thread_pool.run_pending_task()) {}
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.cv_done.wait(lock, [&] { return state.done; });
+    lock.unlock();
+
+    run_duration = clock::now() - run_start;
+    compute_critical_path();
+
+    if (state.exception) {
+        std::rethrow_exception(state.exception);
+    }
+}
+
+void TaskGraph::execute(RunState& state, TaskID task) {
+    while (true) {
+        TaskInfo& info = tasks[task];
+
+        const bool traced = state.thread_pool.get_tracing_enabled();
+        const ThreadPool::clock::time_point trace_start =
+            traced ? ThreadPool::clock::now() : ThreadPool::clock::time_point();
+        info.start = clock::now();
+        if (!state.failed.load(std::memory_order_relaxed)) {
+            try {
+                info.function();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (!state.exception)
+                    state.exception = std::current_exception();
+                state.failed.store(true, std::memory_order_relaxed);
+            }
+        }
+        info.end = clock::now();
+        // One event per graph task, a pool task runs a chain of continuations. Must happen before
+        // the run can complete, the name is freed with the graph.
+        if (traced) {
+            state.thread_pool.add_trace_event(info.name.c_str(), trace_start,
+                                              ThreadPool::clock::now());
+        }
+
+        // continue with the first ready successor on this thread, submit the others.
+        std::optional<TaskID> continuation;
+        for (const TaskID successor : info.successors) {
+            if (state.join_counters[successor].fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                continue;
+            }
+            if (!continuation) {
+                continuation = successor;
+            } else {
+                state.thread_pool.submit_detached(
+                    [this, &state, successor] { execute(state, successor); }, "TaskGraph");
+            }
+        }
+
+        if (state.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            assert(!continuation);
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.done = true;
+            state.cv_done.notify_one();
+            return;
+        }
+
+        if (!continuation) {
+            return;
+        }
+        task = *continuation;
+    }
+}
+
+void TaskGraph::compute_critical_path() {
+    // longest path (by duration) in topological order
+    std::vector<uint32_t> pending(tasks.size());
+    std::vector<std::chrono::nanoseconds> path_duration(tasks.size(),
+                                                        std::chrono::nanoseconds::zero());
+    std::vector<TaskID> path_predecessor(tasks.size(), UINT32_MAX);
+    std::vector<TaskID> ready;
+    for (TaskID task = 0; task < tasks.size(); task++) {
+        pending[task] = tasks[task].predecessor_count;
+        if (pending[task] == 0) {
+            ready.emplace_back(task);
+        }
+    }
+
+    TaskID last = 0;
+    std::chrono::nanoseconds longest = std::chrono::nanoseconds::zero();
+    work_duration = std::chrono::nanoseconds::zero();
+    while (!ready.empty()) {
+        const TaskID task = ready.back();
+        ready.pop_back();
+
+        path_duration[task] += get_duration(task);
+        work_duration += get_duration(task);
+        if (path_duration[task] >= longest) {
+            longest = path_duration[task];
+            last = task;
+        }
+
+        for (const TaskID successor : tasks[task].successors) {
+            if (path_duration[task] > path_duration[successor]) {
+                path_duration[successor] = path_duration[task];
+                path_predecessor[successor] = task;
+            }
+            if (--pending[successor] == 0) {
+                ready.emplace_back(successor);
+            }
+        }
+    }
+
+    critical_path.clear();
+    for (TaskID task = last; task != UINT32_MAX; task = path_predecessor[task]) {
+        critical_path.emplace_back(task);
+    }
+    std::reverse(critical_path.begin(), critical_path.end());
+    critical_path_duration = longest;
+}
+
+} // namespace merian
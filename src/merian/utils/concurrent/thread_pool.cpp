@@ -1,37 +1,568 @@
 #include "merian/utils/concurrent/thread_pool.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
 
 namespace merian {
 
-ThreadPool::ThreadPool(const uint32_t concurrency) {
+// Number of unsuccessful searches for work before an idle worker parks.
+static constexpr uint32_t SPIN_COUNT = 64;
+// After this many unsuccessful searches idle workers yield between searches.
+static constexpr uint32_t YIELD_AFTER = 16;
+// Capacity of the trace buffer for tasks that are run by non-worker threads.
+static constexpr uint32_t EXTERNAL_TRACE_BUFFER_SIZE = 1024;
+
+namespace {
+
+// Identifies the worker of the current thread (if any) to push nested submissions to its deque.
+struct WorkerIdentity {
+    const ThreadPool* pool = nullptr;
+    uint32_t index = 0;
+};
+
+thread_local WorkerIdentity current_worker;
+// victim selection for stealing.
+thread_local uint32_t steal_rng_state = 0x2545F491u;
+
+void copy_trace_name(char (&destination)[ThreadPool::TRACE_NAME_SIZE], const char* name) {
+    std::strncpy(destination, name ? name : "unnamed", ThreadPool::TRACE_NAME_SIZE - 1);
+    destination[ThreadPool::TRACE_NAME_SIZE - 1] = '\0';
+}
+
+uint32_t xorshift32(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// InjectionLane
+
+void ThreadPool::InjectionLane::push(QueuedTask* task) {
+    if (overflow_size.load(std::memory_order_acquire) > 0 || !queue.try_push(task)) {
+        std::lock_guard<std::mutex> lock(overflow_mutex);
+        overflow.push_back(task);
+        overflow_size.fetch_add(1, std::memory_order_release);
+    }
+}
+
+ThreadPool::QueuedTask* ThreadPool::InjectionLane::pop() {
+    if (const std::optional<QueuedTask*> task = queue.try_pop()) {
+        return *task;
+    }
+
+    if (overflow_size.load(std::memory_order_acquire) == 0) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(overflow_mutex);
+    if (overflow.empty()) {
+        return nullptr;
+    }
+    QueuedTask* task = overflow.front();
+    overflow.pop_front();
+    overflow_size.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+bool ThreadPool::InjectionLane::empty() const {
+    return queue.empty() && overflow_size.load(std::memory_order_relaxed) == 0;
+}
+
+uint32_t ThreadPool::InjectionLane::size() const {
+    return queue.size() + overflow_size.load(std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// ThreadPool
+
+ThreadPool::ThreadPool(const uint32_t concurrency)
+    : external_trace(EXTERNAL_TRACE_BUFFER_SIZE), created(clock::now()),
+      last_statistics_time(created) {
     assert(concurrency);
 
-    for (uint32_t i = threads.size(); i < concurrency; i++) {
-        threads.emplace_back([&] {
-            while (true) {
-                const std::optional<std::function<void()>> task = tasks.pop();
-                if (task) {
-                    task.value()();
-                } else {
-                    return;
-                }
-            }
-        });
+    // create all deques before starting the threads, workers steal from each other.
+    for (uint32_t i = 0; i < concurrency; i++) {
+        workers.emplace_back(std::make_unique<Worker>());
+    }
+    for (uint32_t i = 0; i < concurrency; i++) {
+        workers[i]->thread = std::thread([this, i] { worker_main(i); });
     }
+    last_statistics.busy.resize(concurrency + 1);
 }
 
 ThreadPool::~ThreadPool() {
-    for (uint32_t i = 0; i < threads.size(); i++) {
-        tasks.push(std::nullopt);
-    }
-    for (auto& t : threads) {
-        t.join();
+    stop.store(true, std::memory_order_seq_cst);
+    idle_workers.notify_all();
+
+    for (auto& worker : workers) {
+        worker->thread.join();
     }
+
+    assert(std::all_of(lanes.begin(), lanes.end(),
+                       [](const InjectionLane& lane) { return lane.empty(); }));
 }
 
 uint32_t ThreadPool::size() {
-    return threads.size();
+    return workers.size();
+}
+
+void ThreadPool::enqueue(Task&& task, const TaskOptions& options) {
+    QueuedTask* node = new QueuedTask{std::move(task), options.stop_token, options.deadline};
+    if (statistics_enabled.load(std::memory_order_relaxed)) {
+        node->enqueued = clock::now();
+        // copied now, callers may free the name as soon as the task completed (which can be
+        // before the pool returns from executing it).
+        if (tracing_enabled.load(std::memory_order_relaxed)) {
+            node->traced = true;
+            copy_trace_name(node->name, options.name);
+        }
+    }
+    submitted.fetch_add(1, std::memory_order_relaxed);
+
+    // The worker deques only hold normal priority tasks, high priority tasks are made available
+    // to all workers immediately.
+    if (options.priority == Priority::NORMAL && is_worker_thread()) {
+        workers[current_worker.index]->deque.push(node);
+    } else {
+        lanes[static_cast<uint32_t>(options.priority)].push(node);
+    }
+
+    if (options.priority == Priority::BACKGROUND &&
+        reserved_workers.load(std::memory_order_relaxed) > 0) {
+        // a single notification could wake a reserved worker that ignores the task.
+        idle_workers.notify_all();
+    } else {
+        idle_workers.notify_one();
+    }
+}
+
+bool ThreadPool::run_pending_task() {
+    const uint32_t worker_index = is_worker_thread() ? current_worker.index : NO_WORKER;
+    QueuedTask* task = find_task(worker_index, steal_rng_state);
+    if (!task) {
+        return false;
+    }
+
+    execute(task, worker_index);
+    return true;
+}
+
+bool ThreadPool::is_worker_thread() const {
+    return current_worker.pool == this;
+}
+
+void ThreadPool::set_reserved_workers(const uint32_t count) {
+    reserved_workers.store(std::min<uint32_t>(count, workers.size() - 1),
+                           std::memory_order_relaxed);
+    // reserved workers might have been woken for background tasks that others can run now.
+    idle_workers.notify_all();
+}
+
+uint32_t ThreadPool::get_reserved_workers() const {
+    return reserved_workers.load(std::memory_order_relaxed);
+}
+
+bool ThreadPool::may_run_background(const uint32_t worker_index) const {
+    return worker_index != NO_WORKER &&
+           worker_index >= reserved_workers.load(std::memory_order_relaxed);
+}
+
+ThreadPool::QueuedTask* ThreadPool::find_task(const uint32_t worker_index,
+                                              uint32_t& rng_state) {
+    if (QueuedTask* task = lanes[static_cast<uint32_t>(Priority::HIGH)].pop()) {
+        return task;
+    }
+
+    if (worker_index != NO_WORKER) {
+        if (const std::optional<QueuedTask*> task = workers[worker_index]->deque.pop()) {
+            return *task;
+        }
+    }
+
+    if (QueuedTask* task = lanes[static_cast<uint32_t>(Priority::NORMAL)].pop()) {
+        return task;
+    }
+
+    // steal, starting at a random victim to spread contention
+    const uint32_t worker_count = workers.size();
+    const uint32_t start = xorshift32(rng_state) % worker_count;
+    for (uint32_t i = 0; i < worker_count; i++) {
+        const uint32_t victim = (start + i) % worker_count;
+        if (victim == worker_index) {
+            continue;
+        }
+        if (const std::optional<QueuedTask*> task = workers[victim]->deque.steal()) {
+            get_counters(worker_index).stolen.fetch_add(1, std::memory_order_relaxed);
+            return *task;
+        }
+    }
+
+    if (may_run_background(worker_index)) {
+        return lanes[static_cast<uint32_t>(Priority::BACKGROUND)].pop();
+    }
+
+    return nullptr;
+}
+
+bool ThreadPool::has_pending_tasks(const uint32_t worker_index) {
+    if (!lanes[static_cast<uint32_t>(Priority::HIGH)].empty() ||
+        !lanes[static_cast<uint32_t>(Priority::NORMAL)].empty()) {
+        return true;
+    }
+    if (may_run_background(worker_index) &&
+        !lanes[static_cast<uint32_t>(Priority::BACKGROUND)].empty()) {
+        return true;
+    }
+    for (const auto& worker : workers) {
+        if (!worker->deque.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_main(const uint32_t worker_index) {
+    current_worker = {this, worker_index};
+    steal_rng_state = worker_index * 0x9E3779B9u + 1;
+    uint32_t idle_rounds = 0;
+
+    while (true) {
+        if (QueuedTask* task = find_task(worker_index, steal_rng_state)) {
+            idle_rounds = 0;
+            execute(task, worker_index);
+            continue;
+        }
+
+        if (++idle_rounds < SPIN_COUNT) {
+            if (idle_rounds > YIELD_AFTER) {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+        idle_rounds = 0;
+
+        // park: register first, then check for work, so that a concurrent submit either sees the
+        // parked worker and notifies or its task is found by the check.
+        const EventCount::Key key = idle_workers.prepare_wait();
+        if (has_pending_tasks(worker_index)) {
+            idle_workers.cancel_wait();
+        } else if (stop.load(std::memory_order_relaxed)) {
+            idle_workers.cancel_wait();
+            break;
+        } else {
+            idle_workers.wait(key);
+        }
+    }
+
+    current_worker = {};
+}
+
+void ThreadPool::execute(QueuedTask* task, const uint32_t worker_index) {
+    Counters& counters = get_counters(worker_index);
+
+    if (task->stop_token.stop_requested() ||
+        (task->deadline != clock::time_point::max() && clock::now() > task->deadline)) {
+        // counted first, deleting breaks the promise of the task.
+        counters.skipped.fetch_add(1, std::memory_order_relaxed);
+        delete task;
+        return;
+    }
+
+    // tasks that were submitted while instrumentation was disabled are not timed.
+    if (task->enqueued == clock::time_point()) {
+        task->task();
+        delete task;
+        counters.executed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const clock::time_point start = clock::now();
+    task->task();
+    const clock::time_point end = clock::now();
+
+    const uint64_t latency_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(start - task->enqueued).count();
+    counters.executed.fetch_add(1, std::memory_order_relaxed);
+    counters.timed.fetch_add(1, std::memory_order_relaxed);
+    counters.busy_ns.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+        std::memory_order_relaxed);
+    counters.latency_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+    uint64_t max_latency_ns = counters.max_latency_ns.load(std::memory_order_relaxed);
+    while (latency_ns > max_latency_ns &&
+           !counters.max_latency_ns.compare_exchange_weak(max_latency_ns, latency_ns,
+                                                          std::memory_order_relaxed)) {}
+
+    if (task->traced && tracing_enabled.load(std::memory_order_relaxed)) {
+        TraceEvent event;
+        std::memcpy(event.name, task->name, sizeof(event.name));
+        event.enqueued = task->enqueued;
+        event.start = start;
+        event.end = end;
+        event.worker = worker_index;
+        push_trace_event(event, worker_index);
+    }
+
+    delete task;
+}
+
+void ThreadPool::push_trace_event(const TraceEvent& event, const uint32_t worker_index) {
+    const bool pushed = worker_index == NO_WORKER ? external_trace.try_push(event)
+                                                  : workers[worker_index]->trace.try_push(event);
+    if (!pushed) {
+        dropped_trace_events.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Instrumentation
+
+void ThreadPool::add_trace_event(const char* name,
+                                 const clock::time_point start,
+                                 const clock::time_point end) {
+    if (!tracing_enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    TraceEvent event;
+    copy_trace_name(event.name, name);
+    event.enqueued = start;
+    event.start = start;
+    event.end = end;
+    event.worker = is_worker_thread() ? current_worker.index : NO_WORKER;
+    push_trace_event(event, event.worker);
+}
+
+void ThreadPool::set_statistics_enabled(const bool enable) {
+    statistics_enabled.store(enable, std::memory_order_relaxed);
+    if (!enable) {
+        tracing_enabled.store(false, std::memory_order_relaxed);
+    }
+}
+
+bool ThreadPool::get_statistics_enabled() const {
+    return statistics_enabled.load(std::memory_order_relaxed);
+}
+
+void ThreadPool::set_tracing_enabled(const bool enable) {
+    tracing_enabled.store(enable, std::memory_order_relaxed);
+    if (enable) {
+        statistics_enabled.store(true, std::memory_order_relaxed);
+    }
+}
+
+bool ThreadPool::get_tracing_enabled() const {
+    return tracing_enabled.load(std::memory_order_relaxed);
+}
+
+uint32_t ThreadPool::get_queue_depth() {
+    std::size_t depth = 0;
+    for (const InjectionLane& lane : lanes) {
+        depth += lane.size();
+    }
+    for (const auto& worker : workers) {
+        depth += worker->deque.size();
+    }
+    return depth;
+}
+
+ThreadPool::Statistics ThreadPool::get_statistics() {
+    Statistics statistics;
+    statistics.submitted = submitted.load(std::memory_order_relaxed);
+    statistics.dropped_trace_events = dropped_trace_events.load(std::memory_order_relaxed);
+    statistics.queue_depth = get_queue_depth();
+    for (uint32_t priority = 0; priority < PRIORITY_COUNT; priority++) {
+        statistics.injected_depth[priority] = lanes[priority].size();
+    }
+
+    const auto accumulate = [&](const Counters& counters) {
+        statistics.executed += counters.executed.load(std::memory_order_relaxed);
+        statistics.stolen += counters.stolen.load(std::memory_order_relaxed);
+        statistics.skipped += counters.skipped.load(std::memory_order_relaxed);
+        statistics.timed += counters.timed.load(std::memory_order_relaxed);
+        statistics.latency +=
+            std::chrono::nanoseconds(counters.latency_ns.load(std::memory_order_relaxed));
+        statistics.max_latency = std::max(
+            statistics.max_latency,
+            std::chrono::nanoseconds(counters.max_latency_ns.load(std::memory_order_relaxed)));
+        statistics.busy.emplace_back(counters.busy_ns.load(std::memory_order_relaxed));
+    };
+    for (const auto& worker : workers) {
+        accumulate(worker->counters);
+    }
+    accumulate(external_counters);
+
+    return statistics;
+}
+
+std::vector<ThreadPool::TraceEvent> ThreadPool::collect_trace() {
+    std::vector<TraceEvent> events;
+
+    // the mutex makes this the only consumer of the per-worker buffers.
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    for (const auto& worker : workers) {
+        while (std::optional<TraceEvent> event = worker->trace.try_pop()) {
+            events.emplace_back(*event);
+        }
+    }
+    while (std::optional<TraceEvent> event = external_trace.try_pop()) {
+        events.emplace_back(*event);
+    }
+    std::sort(events.begin(), events.end(),
+              [](const TraceEvent& a, const TraceEvent& b) { return a.start < b.start; });
+
+    trace_history.insert(trace_history.end(), events.begin(), events.end());
+    while (trace_history.size() > max_trace_history) {
+        trace_history.pop_front();
+    }
+
+    return events;
+}
+
+std::vector<ThreadPool::TraceEvent> ThreadPool::get_trace_history() {
+    collect_trace();
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    return {trace_history.begin(), trace_history.end()};
+}
+
+void ThreadPool::clear_trace_history() {
+    collect_trace();
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_history.clear();
+}
+
+void ThreadPool::write_chrome_trace(const std::string& filename) {
+    const std::vector<TraceEvent> events = get_trace_history();
+    const auto to_us = [](const clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    };
+    // tasks that were run by non-worker threads are shown in an extra row.
+    const uint32_t external_tid = workers.size();
+
+    nlohmann::json trace_events = nlohmann::json::array();
+    for (uint32_t tid = 0; tid <= external_tid; tid++) {
+        trace_events.push_back({
+            {"name", "thread_name"},
+            {"ph", "M"},
+            {"pid", 0},
+            {"tid", tid},
+            {"args", {{"name", tid == external_tid ? "external" : fmt::format("worker {}", tid)}}},
+        });
+    }
+    for (const TraceEvent& event : events) {
+        trace_events.push_back({
+            {"name", event.name},
+            {"cat", "task"},
+            {"ph", "X"},
+            {"pid", 0},
+            {"tid", event.worker == NO_WORKER ? external_tid : event.worker},
+            {"ts", to_us(event.start - created)},
+            {"dur", to_us(event.end - event.start)},
+            {"args", {{"queued_us", to_us(event.start - event.enqueued)}}},
+        });
+    }
+
+    std::ofstream file(filename);
+    if (!file) {
+        SPDLOG_WARN("could not write thread pool trace to {}", filename);
+        return;
+    }
+    file << nlohmann::json{{"traceEvents", trace_events}, {"displayTimeUnit", "ms"}};
+    SPDLOG_INFO("wrote {} thread pool trace events to {}", events.size(), filename);
+}
+
+void ThreadPool::properties(Properties& props) {
+    // update the rates at most twice per second to get stable values.
+    const clock::time_point now = clock::now();
+    const double elapsed_ns =
+        std::chrono::duration<double, std::nano>(now - last_statistics_time).count();
+    if (elapsed_ns > 5e8 || !props.is_ui()) {
+        const Statistics statistics = get_statistics();
+        const uint64_t executed = statistics.executed - last_statistics.executed;
+        const uint64_t timed = statistics.timed - last_statistics.timed;
+
+        tasks_per_second = executed / (elapsed_ns / 1e9);
+        if (timed > 0) {
+            mean_latency_ms = (statistics.latency - last_statistics.latency).count() / 1e6 / timed;
+            std::chrono::nanoseconds busy{0};
+            for (uint32_t i = 0; i < statistics.busy.size(); i++) {
+                busy += statistics.busy[i] - last_statistics.busy[i];
+            }
+            mean_execution_ms = busy.count() / 1e6 / timed;
+        } else {
+            mean_latency_ms = mean_execution_ms = 0;
+        }
+
+        utilization.resize(workers.size());
+        for (uint32_t i = 0; i < workers.size(); i++) {
+            utilization[i] = (statistics.busy[i] - last_statistics.busy[i]).count() / elapsed_ns;
+        }
+
+        last_statistics = statistics;
+        last_statistics_time = now;
+    }
+
+    props.output_text("workers: {}, queue depth: {}", workers.size(), get_queue_depth());
+    props.output_text("submitted: {}, executed: {}, stolen: {}, skipped: {}",
+                      last_statistics.submitted, last_statistics.executed, last_statistics.stolen,
+                      last_statistics.skipped);
+    props.output_text("queued: {} high, {} normal, {} background",
+                      last_statistics.injected_depth[0], last_statistics.injected_depth[1],
+                      last_statistics.injected_depth[2]);
+
+    uint32_t reserved = get_reserved_workers();
+    if (props.config_uint("reserved workers", reserved, 0, workers.size() - 1,
+                          "Workers that do not run background tasks and stay available for "
+                          "latency-critical work.")) {
+        set_reserved_workers(reserved);
+    }
+
+    bool enable_statistics = get_statistics_enabled();
+    if (props.config_bool("statistics", enable_statistics,
+                          "Record submit to start latency, execution time and per worker "
+                          "utilization.")) {
+        set_statistics_enabled(enable_statistics);
+    }
+    if (get_statistics_enabled()) {
+        props.output_text("tasks/s: {:.1f}", tasks_per_second);
+        props.output_text("latency: {:.04f} ms (mean), {:.04f} ms (max)", mean_latency_ms,
+                          last_statistics.max_latency.count() / 1e6);
+        props.output_text("execution: {:.04f} ms (mean)", mean_execution_ms);
+        if (!utilization.empty()) {
+            props.output_plot_line("utilization", utilization.data(), utilization.size(), 0, 1);
+        }
+    }
+
+    bool enable_tracing = get_tracing_enabled();
+    if (props.config_bool("tracing", enable_tracing,
+                          "Record a trace event for every task, can be exported in the Chrome "
+                          "trace format.")) {
+        set_tracing_enabled(enable_tracing);
+    }
+    if (get_tracing_enabled()) {
+        uint32_t history = max_trace_history;
+        if (props.config_uint("trace history", history,
+                              "Maximum number of events that are kept for export.")) {
+            std::lock_guard<std::mutex> lock(trace_mutex);
+            max_trace_history = history;
+        }
+        props.output_text("dropped events: {}", last_statistics.dropped_trace_events);
+        [[maybe_unused]] const bool changed = props.config_text("trace file", trace_filename);
+        if (props.config_bool("write trace")) {
+            write_chrome_trace(trace_filename);
+        }
+        if (props.config_bool("clear trace")) {
+            clear_trace_history();
+        }
+    }
 }
 
 } // namespace merian
@@ -29,6 +29,7 @@ ContextHandle Context::create(const std::vector<std::shared_ptr<Extension>>& ext
     }
 
     context->shader_compiler = ShaderCompiler::get(context);
+    context->layout_cache = std::make_shared<LayoutCache>();
 
     return context;
 }
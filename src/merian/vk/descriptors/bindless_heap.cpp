@@ -0,0 +1,224 @@
+#include "merian/vk/descriptors/bindless_heap.hpp"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace merian {
+
+BindlessHeap::BindlessHeap(const ContextHandle& context,
+                           const uint32_t max_textures,
+                           const uint32_t max_buffers)
+    : context(context),
+      max_storage_buffer_range(
+          context->physical_device.get_physical_device_limits().maxStorageBufferRange) {
+    SPDLOG_DEBUG("create BindlessHeap ({})", fmt::ptr(this));
+
+    vk::PhysicalDeviceVulkan12Properties props12;
+    vk::PhysicalDeviceProperties2 props2;
+    props2.pNext = &props12;
+    context->physical_device.physical_device.getProperties2(&props2);
+
+    // combined image samplers count against sampler and sampled image limits.
+    textures.capacity = std::min({max_textures, props12.maxDescriptorSetUpdateAfterBindSamplers,
+                                  props12.maxDescriptorSetUpdateAfterBindSampledImages,
+                                  props12.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                  props12.maxPerStageDescriptorUpdateAfterBindSampledImages});
+    buffers.capacity =
+        std::min({max_buffers, props12.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                  props12.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+    SPDLOG_DEBUG("bindless heap capacity: {} textures, {} buffers", textures.capacity,
+                 buffers.capacity);
+
+    const std::vector<vk::DescriptorSetLayoutBinding> bindings = {
+        {BINDING_TEXTURES, vk::DescriptorType::eCombinedImageSampler, textures.capacity,
+         vk::ShaderStageFlagBits::eAll},
+        {BINDING_BUFFERS, vk::DescriptorType::eStorageBuffer, buffers.capacity,
+         vk::ShaderStageFlagBits::eAll},
+    };
+    const vk::DescriptorBindingFlags binding_flags =
+        vk::DescriptorBindingFlagBits::eUpdateAfterBind |
+        vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending |
+        vk::DescriptorBindingFlagBits::ePartiallyBound;
+
+    layout = std::make_shared<DescriptorSetLayout>(
+        context, bindings, vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+        std::vector<vk::DescriptorBindingFlags>(bindings.size(), binding_flags));
+    pool = std::make_shared<DescriptorPool>(layout, 1,
+                                            vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind);
+    set = std::make_shared<DescriptorSet>(pool);
+}
+
+BindlessHeap::~BindlessHeap() {
+    SPDLOG_DEBUG("destroy BindlessHeap ({})", fmt::ptr(this));
+}
+
+bool BindlessHeap::is_supported(const Context::FeaturesContainer& supported) {
+    const vk::PhysicalDeviceVulkan12Features& features = supported.physical_device_features_v12;
+    return features.descriptorIndexing && features.runtimeDescriptorArray &&
+           features.descriptorBindingPartiallyBound &&
+           features.descriptorBindingSampledImageUpdateAfterBind &&
+           features.descriptorBindingStorageBufferUpdateAfterBind &&
+           features.descriptorBindingUpdateUnusedWhilePending &&
+           features.shaderSampledImageArrayNonUniformIndexing &&
+           features.shaderStorageBufferArrayNonUniformIndexing;
+}
+
+void BindlessHeap::enable_features(Context::FeaturesContainer& enable) {
+    vk::PhysicalDeviceVulkan12Features& features = enable.physical_device_features_v12;
+    features.descriptorIndexing = true;
+    features.runtimeDescriptorArray = true;
+    features.descriptorBindingPartiallyBound = true;
+    features.descriptorBindingSampledImageUpdateAfterBind = true;
+    features.descriptorBindingStorageBufferUpdateAfterBind = true;
+    features.descriptorBindingUpdateUnusedWhilePending = true;
+    features.shaderSampledImageArrayNonUniformIndexing = true;
+    features.shaderStorageBufferArrayNonUniformIndexing = true;
+}
+
+uint32_t BindlessHeap::register_texture(const TextureHandle& texture) {
+    assert(texture->bindless_index == INVALID_INDEX && "texture already registered");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint32_t index = textures.allocate();
+    if (index == INVALID_INDEX) {
+        SPDLOG_WARN("bindless heap is full ({} textures), texture is not registered",
+                    textures.capacity);
+        return INVALID_INDEX;
+    }
+
+    texture->bindless_heap = shared_from_this();
+    texture->bindless_index = index;
+    write_texture(texture->get_view(), *texture->get_sampler(), index);
+
+    return index;
+}
+
+uint32_t BindlessHeap::register_buffer(const BufferHandle& buffer) {
+    assert(buffer->bindless_index == INVALID_INDEX && "buffer already registered");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint32_t index = buffers.allocate();
+    if (index == INVALID_INDEX) {
+        SPDLOG_WARN("bindless heap is full ({} buffers), buffer is not registered",
+                    buffers.capacity);
+        return INVALID_INDEX;
+    }
+
+    buffer->bindless_heap = shared_from_this();
+    buffer->bindless_index = index;
+
+    // VUID-VkWriteDescriptorSet-descriptorType-00333: the range must not exceed the limit.
+    if (buffer->get_size() > max_storage_buffer_range) {
+        SPDLOG_DEBUG("buffer exceeds maxStorageBufferRange, only the first {} bytes are accessible "
+                     "through the bindless heap",
+                     max_storage_buffer_range);
+    }
+    const vk::DescriptorBufferInfo info =
+        buffer->get_descriptor_info(0, std::min(buffer->get_size(), max_storage_buffer_range));
+    const vk::WriteDescriptorSet write{
+        *set, BINDING_BUFFERS, index, 1, vk::DescriptorType::eStorageBuffer, nullptr, &info};
+    context->device.updateDescriptorSets(write, {});
+
+    return index;
+}
+
+void BindlessHeap::update_texture(const Texture& texture, const SamplerHandle& previous_sampler) {
+    assert(texture.bindless_index != INVALID_INDEX);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // The descriptor might be used by pending command buffers, rewriting it is not allowed (even
+    // with eUpdateUnusedWhilePending). Keep the previous sampler alive until it is rewritten.
+    const auto [it, inserted] = pending_texture_updates.try_emplace(texture.bindless_index);
+    if (inserted) {
+        it->second.previous_sampler = previous_sampler;
+        pending_update_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    it->second.view = texture.get_view();
+    it->second.sampler = texture.get_sampler();
+}
+
+void BindlessHeap::apply_pending_updates() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [index, update] : pending_texture_updates) {
+        write_texture(update.view, *update.sampler, index);
+    }
+    pending_texture_updates.clear();
+    pending_update_count.store(0, std::memory_order_relaxed);
+}
+
+void BindlessHeap::write_texture(const vk::ImageView view,
+                                 const Sampler& sampler,
+                                 const uint32_t index) {
+    const vk::DescriptorImageInfo info{sampler, view, vk::ImageLayout::eShaderReadOnlyOptimal};
+    const vk::WriteDescriptorSet write{
+        *set, BINDING_TEXTURES, index, 1, vk::DescriptorType::eCombinedImageSampler, &info};
+    context->device.updateDescriptorSets(write, {});
+}
+
+void BindlessHeap::free_texture(const uint32_t index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = pending_texture_updates.find(index);
+    if (it != pending_texture_updates.end()) {
+        // the slot still holds the previous sampler
+        current_release_set.samplers.emplace_back(std::move(it->second.previous_sampler));
+        pending_texture_updates.erase(it);
+        pending_update_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+    current_release_set.textures.emplace_back(index);
+    textures.live--;
+    textures.pending++;
+}
+
+void BindlessHeap::free_buffer(const uint32_t index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    current_release_set.buffers.emplace_back(index);
+    buffers.live--;
+    buffers.pending++;
+}
+
+BindlessHeap::SetID BindlessHeap::finalize_release_set() {
+    SetID set_id;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (current_release_set.textures.empty() && current_release_set.buffers.empty() &&
+        current_release_set.samplers.empty()) {
+        return set_id;
+    }
+
+    set_id.id = next_set_id++;
+    release_sets[set_id.id] = std::move(current_release_set);
+    current_release_set = {};
+
+    return set_id;
+}
+
+void BindlessHeap::release_set(const SetID set_id) {
+    if (set_id.id == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = release_sets.find(set_id.id);
+    assert(it != release_sets.end() && "set was already released");
+
+    textures.free_indices.insert(textures.free_indices.end(), it->second.textures.begin(),
+                                 it->second.textures.end());
+    textures.pending -= it->second.textures.size();
+    buffers.free_indices.insert(buffers.free_indices.end(), it->second.buffers.begin(),
+                                it->second.buffers.end());
+    buffers.pending -= it->second.buffers.size();
+
+    release_sets.erase(it);
+}
+
+void BindlessHeap::properties(Properties& props) {
+    std::lock_guard<std::mutex> lock(mutex);
+    props.output_text("textures: {} / {} (pending release: {})", textures.live, textures.capacity,
+                      textures.pending);
+    props.output_text("buffers: {} / {} (pending release: {})", buffers.live, buffers.capacity,
+                      buffers.pending);
+    props.output_text("release sets in flight: {}", release_sets.size());
+    props.output_text("pending descriptor updates: {}", pending_texture_updates.size());
+}
+
+} // namespace merian
@@ -0,0 +1,198 @@
+#include "merian/vk/descriptors/descriptor_allocator.hpp"
+#include "merian/vk/utils/check_result.hpp"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace merian {
+
+DescriptorAllocator::DescriptorAllocator(const ContextHandle& context,
+                                         const uint32_t initial_sets_per_pool,
+                                         const uint32_t max_sets_per_pool)
+    : context(context), initial_sets_per_pool(initial_sets_per_pool),
+      max_sets_per_pool(max_sets_per_pool) {
+    assert(initial_sets_per_pool > 0 && initial_sets_per_pool <= max_sets_per_pool);
+    SPDLOG_DEBUG("create DescriptorAllocator ({})", fmt::ptr(this));
+}
+
+DescriptorAllocator::~DescriptorAllocator() {
+    SPDLOG_DEBUG("destroy DescriptorAllocator ({})", fmt::ptr(this));
+}
+
+DescriptorSetHandle DescriptorAllocator::allocate(const DescriptorSetLayoutHandle& layout) {
+    assert(!layout->is_push_descriptor_layout());
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Pool* pool = nullptr;
+    vk::DescriptorSet set;
+
+    // 1. Reuse a set that was allocated for this layout
+    const auto cache_it = cached_sets.find(layout.get());
+    if (cache_it != cached_sets.end() && !cache_it->second.sets.empty()) {
+        pool = cache_it->second.sets.back().pool;
+        set = cache_it->second.sets.back().set;
+        cache_it->second.sets.pop_back();
+        cached_set_count--;
+        reused_sets++;
+    }
+
+    // 2. Allocate from a pool of the same shape
+    if (!pool) {
+        std::vector<std::unique_ptr<Pool>>& pools = pools_for_shape[shape_for_layout(layout)];
+        const vk::DescriptorSetLayout vk_layout = *layout;
+
+        for (const auto& candidate : pools) {
+            if (candidate->full) {
+                continue;
+            }
+
+            const vk::DescriptorSetAllocateInfo info{*candidate->pool, 1, &vk_layout};
+            const vk::Result result = context->device.allocateDescriptorSets(&info, &set);
+            if (result == vk::Result::eSuccess) {
+                pool = candidate.get();
+                break;
+            }
+            if (result != vk::Result::eErrorOutOfPoolMemory &&
+                result != vk::Result::eErrorFragmentedPool) {
+                check_result(result, "could not allocate descriptor set");
+            }
+            candidate->full = true;
+        }
+
+        // 3. Grow the chain
+        if (!pool) {
+            const uint32_t capacity =
+                pools.empty() ? initial_sets_per_pool
+                              : std::min(pools.back()->capacity * 2, max_sets_per_pool);
+            const vk::DescriptorPoolCreateFlags flags =
+                (layout->get_create_flags() &
+                 vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+                    ? vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind
+                    : vk::DescriptorPoolCreateFlags{};
+            DescriptorSetLayoutHandle pool_layout = layout;
+
+            SPDLOG_DEBUG("DescriptorAllocator ({}): create pool for {} sets", fmt::ptr(this),
+                         capacity);
+            pools.emplace_back(std::make_unique<Pool>(
+                Pool{std::make_shared<DescriptorPool>(pool_layout, capacity, flags), capacity}));
+            pool = pools.back().get();
+            pool_count++;
+
+            const vk::DescriptorSetAllocateInfo info{*pool->pool, 1, &vk_layout};
+            check_result(context->device.allocateDescriptorSets(&info, &set),
+                         "could not allocate descriptor set");
+        }
+
+        pool->allocated++;
+        pool->full |= pool->allocated == pool->capacity;
+        allocated_sets++;
+    }
+
+    pool->in_use++;
+    set_count++;
+
+    return std::shared_ptr<DescriptorSet>(
+        new DescriptorSet(pool->pool, layout, set),
+        [allocator = shared_from_this(), pool](DescriptorSet* descriptor_set) {
+            allocator->recycle(descriptor_set->get_layout(), pool,
+                               descriptor_set->get_descriptor_set());
+            delete descriptor_set;
+        });
+}
+
+void DescriptorAllocator::recycle(const DescriptorSetLayoutHandle& layout,
+                                  Pool* pool,
+                                  const vk::DescriptorSet set) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    assert(pool->in_use > 0);
+    pool->in_use--;
+    set_count--;
+
+    if (pool->in_use == 0) {
+        // the set is dropped together with the cached sets of this pool.
+        reset_pool(*pool);
+        return;
+    }
+
+    LayoutCache& cache = cached_sets[layout.get()];
+    if (!cache.layout) {
+        cache.layout = layout;
+    }
+    cache.sets.push_back({pool, set});
+    cached_set_count++;
+}
+
+void DescriptorAllocator::reset_pool(Pool& pool) {
+    for (auto it = cached_sets.begin(); it != cached_sets.end();) {
+        std::vector<CachedSet>& sets = it->second.sets;
+        const auto removed = std::remove_if(sets.begin(), sets.end(), [&](const CachedSet& cached) {
+            return cached.pool == &pool;
+        });
+        cached_set_count -= std::distance(removed, sets.end());
+        sets.erase(removed, sets.end());
+
+        if (sets.empty()) {
+            it = cached_sets.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    context->device.resetDescriptorPool(*pool.pool);
+    pool.allocated = 0;
+    pool.full = false;
+    pool_resets++;
+}
+
+void DescriptorAllocator::trim() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& [shape, pools] : pools_for_shape) {
+        const auto removed =
+            std::remove_if(pools.begin(), pools.end(),
+                           [](const std::unique_ptr<Pool>& pool) { return pool->in_use == 0; });
+        pool_count -= std::distance(removed, pools.end());
+        pools.erase(removed, pools.end());
+    }
+}
+
+DescriptorAllocator::Shape
+DescriptorAllocator::shape_for_layout(const DescriptorSetLayoutHandle& layout) {
+    Shape shape;
+    shape.flags = static_cast<VkDescriptorSetLayoutCreateFlags>(layout->get_create_flags());
+
+    for (const vk::DescriptorPoolSize& size :
+         DescriptorPool::make_pool_sizes_from_bindings(layout->get_bindings())) {
+        shape.sizes.emplace_back(size.type, size.descriptorCount);
+    }
+    std::sort(shape.sizes.begin(), shape.sizes.end());
+
+    return shape;
+}
+
+uint32_t DescriptorAllocator::get_pool_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pool_count;
+}
+
+uint32_t DescriptorAllocator::get_set_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return set_count;
+}
+
+uint32_t DescriptorAllocator::get_cached_set_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return cached_set_count;
+}
+
+void DescriptorAllocator::properties(Properties& props) {
+    std::lock_guard<std::mutex> lock(mutex);
+    props.output_text("pools: {} (shapes: {})", pool_count, pools_for_shape.size());
+    props.output_text("sets in use: {}, cached: {}", set_count, cached_set_count);
+    props.output_text("sets allocated: {}, reused: {}, pool resets: {}", allocated_sets,
+                      reused_sets, pool_resets);
+}
+
+} // namespace merian
@@ -35,6 +35,11 @@ void ExtensionResources::enable_device_features(const Context::FeaturesContainer
         enable.physical_device_features_v12.bufferDeviceAddress = true;
         flags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
     }
+    if (BindlessHeap::is_supported(supported)) {
+        SPDLOG_DEBUG("bindless descriptors supported. Enabling features");
+        BindlessHeap::enable_features(enable);
+        bindless_supported = true;
+    }
 }
 
 void ExtensionResources::on_context_created(const ContextHandle& context) {
@@ -43,6 +48,13 @@ void ExtensionResources::on_context_created(const ContextHandle& context) {
 
 void ExtensionResources::on_destroy_context() {}
 
+std::map<std::string, std::string> ExtensionResources::shader_macro_definitions() {
+    if (bindless_supported) {
+        return {{"MERIAN_BINDLESS_HEAP_SUPPORTED", "1"}};
+    }
+    return {};
+}
+
 std::shared_ptr<MemoryAllocator> ExtensionResources::memory_allocator() {
     if (_memory_allocator.expired()) {
         assert(!weak_context.expired());
@@ -56,7 +68,8 @@ std::shared_ptr<ResourceAllocator> ExtensionResources::resource_allocator() {
     if (_resource_allocator.expired()) {
         assert(!weak_context.expired());
         auto ptr = std::make_shared<ResourceAllocator>(weak_context.lock(), memory_allocator(),
-                                                       staging(), sampler_pool());
+                                                       staging(), sampler_pool(), bindless_heap(),
+                                                       descriptor_allocator());
         _resource_allocator = ptr;
         return ptr;
     }
@@ -80,5 +93,26 @@ std::shared_ptr<StagingMemoryManager> ExtensionResources::staging() {
     }
     return _staging.lock();
 }
+std::shared_ptr<BindlessHeap> ExtensionResources::bindless_heap() {
+    if (!bindless_supported) {
+        return nullptr;
+    }
+    if (_bindless_heap.expired()) {
+        assert(!weak_context.expired());
+        auto ptr = std::make_shared<BindlessHeap>(weak_context.lock());
+        _bindless_heap = ptr;
+        return ptr;
+    }
+    return _bindless_heap.lock();
+}
+std::shared_ptr<DescriptorAllocator> ExtensionResources::descriptor_allocator() {
+    if (_descriptor_allocator.expired()) {
+        assert(!weak_context.expired());
+        auto ptr = std::make_shared<DescriptorAllocator>(weak_context.lock());
+        _descriptor_allocator = ptr;
+        return ptr;
+    }
+    return _descriptor_allocator.lock();
+}
 
 } // namespace merian
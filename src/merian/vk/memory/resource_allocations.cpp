@@ -1,9 +1,11 @@
 #include "merian/vk/memory/resource_allocations.hpp"
 #include "merian/utils/string.hpp"
+#include "merian/vk/descriptors/bindless_heap.hpp"
 #include "merian/vk/memory/memory_allocator.hpp"
 #include "merian/vk/utils/barriers.hpp"
 
 #include <spdlog/spdlog.h>
+#include <utility>
 #include <vulkan/vulkan.hpp>
 
 namespace merian {
@@ -14,6 +16,9 @@ Buffer::Buffer(const vk::Buffer& buffer,
     : buffer(buffer), memory(memory), create_info(create_info) {}
 
 Buffer::~Buffer() {
+    if (bindless_heap) {
+        bindless_heap->free_buffer(bindless_index);
+    }
     SPDLOG_TRACE("destroy buffer ({})", fmt::ptr(static_cast<VkBuffer>(buffer)));
     memory->get_context()->device.destroyBuffer(buffer);
 }
@@ -64,6 +69,9 @@ void Buffer::properties(Properties& props) {
     props.output_text(fmt::format("Handle: {}\nSize: {}\nUsage: {}",
                                   fmt::ptr(static_cast<VkBuffer>(buffer)),
                                   format_size(create_info.size), vk::to_string(create_info.usage)));
+    if (bindless_heap) {
+        props.output_text("Bindless index: {}", bindless_index);
+    }
     if (props.st_begin_child("memory_info", "Memory")) {
         get_memory()->properties(props);
         props.st_end_child();
@@ -190,16 +198,25 @@ Texture::Texture(const vk::ImageView& view, const ImageHandle& image, const Samp
 }
 
 Texture::~Texture() {
+    if (bindless_heap) {
+        bindless_heap->free_texture(bindless_index);
+    }
     SPDLOG_TRACE("destroy image view ({})", fmt::ptr(static_cast<VkImageView>(view)));
     image->get_memory()->get_context()->device.destroyImageView(view);
 }
 
 void Texture::set_sampler(const SamplerHandle& sampler) {
     assert(sampler);
-    this->sampler = sampler;
+    const SamplerHandle previous_sampler = std::exchange(this->sampler, sampler);
+    if (bindless_heap) {
+        bindless_heap->update_texture(*this, previous_sampler);
+    }
 }
 
 void Texture::properties(Properties& props) {
+    if (bindless_heap) {
+        props.output_text("Bindless index: {}", bindless_index);
+    }
     if (props.st_begin_child("image_info", "Image")) {
         image->properties(props);
         props.st_end_child();
@@ -9,8 +9,13 @@ namespace merian {
 ResourceAllocator::ResourceAllocator(const ContextHandle& context,
                                      const std::shared_ptr<MemoryAllocator>& memAllocator,
                                      const std::shared_ptr<StagingMemoryManager> staging,
-                                     const std::shared_ptr<SamplerPool>& samplerPool)
+                                     const std::shared_ptr<SamplerPool>& samplerPool,
+                                     const BindlessHeapHandle& bindless_heap,
+                                     const DescriptorAllocatorHandle& descriptor_allocator)
     : context(context), m_memAlloc(memAllocator), m_staging(staging), m_samplerPool(samplerPool),
+      bindless_heap(bindless_heap),
+      descriptor_allocator(descriptor_allocator ? descriptor_allocator
+                                                : std::make_shared<DescriptorAllocator>(context)),
       debug_utils(context->get_extension<ExtensionVkDebugUtils>()) {
     SPDLOG_DEBUG("create ResourceAllocator ({})", fmt::ptr(this));
 
@@ -37,6 +42,9 @@ BufferHandle ResourceAllocator::createBuffer(const vk::BufferCreateInfo& info,
                                              const std::optional<vk::DeviceSize> min_alignment) {
     const BufferHandle buffer =
         m_memAlloc->create_buffer(info, mapping_type, debug_name, min_alignment);
+    if (bindless_heap && (info.usage & vk::BufferUsageFlagBits::eStorageBuffer)) {
+        bindless_heap->register_buffer(buffer);
+    }
 
 #ifndef NDEBUG
     if (debug_utils) {
@@ -144,6 +152,9 @@ TextureHandle ResourceAllocator::createTexture(const ImageHandle& image,
     const vk::ImageView view =
         image->get_memory()->get_context()->device.createImageView(view_create_info);
     const TextureHandle tex = std::make_shared<Texture>(view, image, sampler);
+    if (bindless_heap && (image->get_usage_flags() & vk::ImageUsageFlagBits::eSampled)) {
+        bindless_heap->register_texture(tex);
+    }
 
 #ifndef NDEBUG
     if (debug_utils) {
@@ -274,12 +285,13 @@ const TextureHandle& ResourceAllocator::get_dummy_texture() const {
 AccelerationStructureHandle ResourceAllocator::createAccelerationStructure(
     const vk::AccelerationStructureTypeKHR type,
     const vk::AccelerationStructureBuildSizesInfoKHR& size_info,
-    const std::string& debug_name) {
+    const std::string& debug_name,
+    const MemoryMappingType mapping_type) {
     // Allocating the buffer to hold the acceleration structure
     BufferHandle buffer = createBuffer(size_info.accelerationStructureSize,
                                        vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR |
                                            vk::BufferUsageFlagBits::eShaderDeviceAddress,
-                                       MemoryMappingType::NONE, debug_name);
+                                       mapping_type, debug_name);
     vk::AccelerationStructureKHR as;
     // Setting the buffer
     vk::AccelerationStructureCreateInfoKHR createInfo{
@@ -0,0 +1,162 @@
+#include "merian/vk/pipeline/layout_cache.hpp"
+#include "merian/utils/hash.hpp"
+#include "merian/vk/descriptors/descriptor_set_layout.hpp"
+#include "merian/vk/pipeline/pipeline_layout.hpp"
+#include "merian/vk/sampler/sampler.hpp"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+namespace merian {
+
+// Remove expired entries after this many new layouts were created.
+static constexpr uint32_t CLEANUP_INTERVAL = 64;
+
+std::size_t LayoutCache::DescriptorSetLayoutKeyHash::operator()(
+    const DescriptorSetLayoutKey& key) const {
+    std::size_t seed = 0;
+    hash_combine(seed, key.flags);
+    for (const auto& [binding, type, count, stage_flags] : key.bindings) {
+        hash_combine(seed, binding, static_cast<uint32_t>(type), count, stage_flags);
+    }
+    for (const SamplerHandle& sampler : key.immutable_samplers) {
+        hash_combine(seed, sampler.get());
+    }
+    for (const VkDescriptorBindingFlags& flags : key.binding_flags) {
+        hash_combine(seed, flags);
+    }
+    return seed;
+}
+
+std::size_t
+LayoutCache::PipelineLayoutKeyHash::operator()(const PipelineLayoutKey& key) const {
+    std::size_t seed = 0;
+    hash_combine(seed, key.flags);
+    for (const DescriptorSetLayout* layout : key.set_layouts) {
+        hash_combine(seed, layout);
+    }
+    for (const auto& [stage_flags, offset, size] : key.ranges) {
+        hash_combine(seed, stage_flags, offset, size);
+    }
+    return seed;
+}
+
+LayoutCache::LayoutCache() {
+    SPDLOG_DEBUG("create LayoutCache ({})", fmt::ptr(this));
+}
+
+LayoutCache::~LayoutCache() {
+    SPDLOG_DEBUG("destroy LayoutCache ({})", fmt::ptr(this));
+}
+
+DescriptorSetLayoutHandle LayoutCache::acquire_descriptor_set_layout(
+    const ContextHandle& context,
+    const std::vector<vk::DescriptorSetLayoutBinding>& bindings,
+    const vk::DescriptorSetLayoutCreateFlags flags,
+    const std::vector<vk::DescriptorBindingFlags>& binding_flags,
+    const std::vector<SamplerHandle>& immutable_samplers) {
+    DescriptorSetLayoutKey key;
+    key.flags = static_cast<VkDescriptorSetLayoutCreateFlags>(flags);
+    for (const auto& binding : bindings) {
+        key.bindings.emplace_back(binding.binding, binding.descriptorType, binding.descriptorCount,
+                                  static_cast<VkShaderStageFlags>(binding.stageFlags));
+        if (!binding.pImmutableSamplers) {
+            continue;
+        }
+        for (uint32_t i = 0; i < binding.descriptorCount; i++) {
+            const vk::Sampler sampler = binding.pImmutableSamplers[i];
+            const auto it = std::ranges::find_if(immutable_samplers, [&](const auto& handle) {
+                return handle->get_sampler() == sampler;
+            });
+            if (it == immutable_samplers.end()) {
+                // The raw handle can be reused by another sampler once this one is destroyed.
+                SPDLOG_DEBUG("immutable sampler without SamplerHandle, layout is not cached");
+                return std::make_shared<DescriptorSetLayout>(context, bindings, flags,
+                                                             binding_flags, immutable_samplers);
+            }
+            key.immutable_samplers.emplace_back(*it);
+        }
+    }
+    for (const auto& binding_flag : binding_flags) {
+        key.binding_flags.emplace_back(static_cast<VkDescriptorBindingFlags>(binding_flag));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto it = descriptor_set_layouts.find(key);
+    if (it != descriptor_set_layouts.end()) {
+        if (DescriptorSetLayoutHandle layout = it->second.lock()) {
+            deduplicated_descriptor_set_layouts++;
+            return layout;
+        }
+    }
+
+    const DescriptorSetLayoutHandle layout =
+        std::make_shared<DescriptorSetLayout>(context, bindings, flags, binding_flags,
+                                              immutable_samplers);
+    descriptor_set_layouts[std::move(key)] = layout;
+    created_descriptor_set_layouts++;
+    cleanup();
+
+    return layout;
+}
+
+PipelineLayoutHandle LayoutCache::acquire_pipeline_layout(
+    const ContextHandle& context,
+    const std::vector<DescriptorSetLayoutHandle>& descriptor_set_layouts,
+    const std::vector<vk::PushConstantRange>& ranges,
+    const vk::PipelineLayoutCreateFlags flags) {
+    PipelineLayoutKey key;
+    key.flags = static_cast<VkPipelineLayoutCreateFlags>(flags);
+    for (const auto& layout : descriptor_set_layouts) {
+        key.set_layouts.emplace_back(layout.get());
+    }
+    for (const auto& range : ranges) {
+        key.ranges.emplace_back(static_cast<VkShaderStageFlags>(range.stageFlags), range.offset,
+                                range.size);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto it = pipeline_layouts.find(key);
+    if (it != pipeline_layouts.end()) {
+        if (PipelineLayoutHandle layout = it->second.lock()) {
+            deduplicated_pipeline_layouts++;
+            return layout;
+        }
+    }
+
+    const PipelineLayoutHandle layout =
+        std::make_shared<PipelineLayout>(context, descriptor_set_layouts, ranges, flags);
+    pipeline_layouts[std::move(key)] = layout;
+    created_pipeline_layouts++;
+    cleanup();
+
+    return layout;
+}
+
+void LayoutCache::cleanup() {
+    if (++inserts_since_cleanup < CLEANUP_INTERVAL) {
+        return;
+    }
+    inserts_since_cleanup = 0;
+
+    std::erase_if(descriptor_set_layouts, [](const auto& entry) { return entry.second.expired(); });
+    std::erase_if(pipeline_layouts, [](const auto& entry) { return entry.second.expired(); });
+}
+
+uint64_t LayoutCache::get_deduplicated_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return deduplicated_descriptor_set_layouts + deduplicated_pipeline_layouts;
+}
+
+void LayoutCache::properties(Properties& props) {
+    std::lock_guard<std::mutex> lock(mutex);
+    props.output_text("descriptor set layouts: created {}, deduplicated {}",
+                      created_descriptor_set_layouts, deduplicated_descriptor_set_layouts);
+    props.output_text("pipeline layouts: created {}, deduplicated {}", created_pipeline_layouts,
+                      deduplicated_pipeline_layouts);
+}
+
+} // namespace merian
@@ -1,5 +1,7 @@
 #include "merian/vk/raytrace/as_builder.hpp"
+#include "merian/utils/alignment.hpp"
 
+#include <unordered_set>
 #include <vector>
 
 namespace merian {
@@ -38,8 +40,6 @@ ASBuilder::queue_build(const vk::AccelerationStructureGeometryKHR* geometry,
         context->device.getAccelerationStructureBuildSizesKHR(
             vk::AccelerationStructureBuildTypeKHR::eDevice, build_info, primitive_counts);
 
-    pending_min_scratch_buffer = std::max(pending_min_scratch_buffer, size_info.buildScratchSize);
-
     // 2. Create the AS with the aquired info
     //--------------------------------------------
     const AccelerationStructureHandle as = allocator->createAccelerationStructure(
@@ -75,9 +75,8 @@ void ASBuilder::queue_build(const vk::AccelerationStructureGeometryKHR* geometry
         geometry_count,
         geometry};
 
-    pending_min_scratch_buffer =
-        std::max(pending_min_scratch_buffer, as->get_size_info().buildScratchSize);
-    pending_blas_builds.emplace_back(as, build_info, range_info);
+    pending_blas_builds.emplace_back(as, build_info, range_info,
+                                     as->get_size_info().buildScratchSize);
 }
 
 void ASBuilder::queue_update(
@@ -102,9 +101,8 @@ void ASBuilder::queue_update(const vk::AccelerationStructureGeometryKHR* geometr
         geometry_count,
         geometry};
 
-    pending_min_scratch_buffer =
-        std::max(pending_min_scratch_buffer, as->get_size_info().updateScratchSize);
-    pending_blas_builds.emplace_back(as, build_info, range_info);
+    pending_blas_builds.emplace_back(as, build_info, range_info,
+                                     as->get_size_info().updateScratchSize);
 }
 
 void ASBuilder::get_cmds_blas(const vk::CommandBuffer& cmd,
@@ -113,37 +111,90 @@ void ASBuilder::get_cmds_blas(const vk::CommandBuffer& cmd,
     if (pending_blas_builds.empty())
         return;
 
-    ensure_scratch_buffer(pending_min_scratch_buffer, scratch_buffer);
+    // 1. Split the builds into batches. Every build of a batch gets its own scratch region, the
+    // regions of a batch must fit into the budget. An AS must not be the destination of multiple
+    // builds in the same batch.
+    //--------------------------------------------
+    std::vector<uint32_t> batch_ends;
+    std::vector<vk::DeviceSize> scratch_offsets(pending_blas_builds.size());
+    vk::DeviceSize max_batch_scratch = 0;
+    {
+        uint32_t batch_builds = 0;
+        vk::DeviceSize batch_scratch = 0;
+        std::unordered_set<VkAccelerationStructureKHR> batch_destinations;
+        for (uint32_t idx = 0; idx < pending_blas_builds.size(); idx++) {
+            const PendingBLAS& pending = pending_blas_builds[idx];
+            const vk::DeviceSize scratch_size =
+                align_ceil(pending.scratch_size, scratch_buffer_min_alignment);
+            const VkAccelerationStructureKHR destination = static_cast<VkAccelerationStructureKHR>(
+                pending.build_info.dstAccelerationStructure);
+
+            if (batch_builds > 0 && (batch_scratch + scratch_size > scratch_budget ||
+                                      batch_destinations.contains(destination))) {
+                batch_ends.push_back(idx);
+                batch_builds = 0;
+                batch_scratch = 0;
+                batch_destinations.clear();
+            }
+
+            scratch_offsets[idx] = batch_scratch;
+            batch_builds++;
+            batch_scratch += scratch_size;
+            batch_destinations.insert(destination);
+            max_batch_scratch = std::max(max_batch_scratch, batch_scratch);
+        }
+        batch_ends.push_back(pending_blas_builds.size());
+    }
+
+    // TLAS builds share the scratch buffer, do not resize in between.
+    ensure_scratch_buffer(std::max(max_batch_scratch, pending_min_scratch_buffer), scratch_buffer);
     assert(scratch_buffer);
+    const vk::DeviceAddress scratch_address = scratch_buffer->get_device_address();
 
-    // Since the scratch buffer is reused across builds, we need a barrier to ensure one
-    // build is finished before starting the next one.
+    // 2. Record one build command and one barrier per batch
+    //--------------------------------------------
+
+    // Since the scratch buffer is reused across batches, we need a barrier to ensure one
+    // batch is finished before starting the next one.
     const vk::BufferMemoryBarrier scratch_barrier =
         scratch_buffer->buffer_barrier(vk::AccessFlagBits::eAccelerationStructureReadKHR |
                                            vk::AccessFlagBits::eAccelerationStructureWriteKHR,
                                        vk::AccessFlagBits::eAccelerationStructureReadKHR |
                                            vk::AccessFlagBits::eAccelerationStructureWriteKHR);
 
-    for (uint32_t idx = 0; idx < pending_blas_builds.size(); idx++) {
-        MERIAN_PROFILE_SCOPE_GPU(profiler, cmd, fmt::format("BLAS build {:02}", idx));
-
-        pending_blas_builds[idx].build_info.scratchData.deviceAddress =
-            scratch_buffer->get_device_address();
-        // Vulkan allows to create multiple as at once, however then the scratch buffer cannot be
-        // reused! (This is the reason why we need to supply a pointer to a pointer for range
-        // infos...)
-        cmd.buildAccelerationStructuresKHR(1, &pending_blas_builds[idx].build_info,
-                                           &pending_blas_builds[idx].range_info);
+    std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> build_infos;
+    std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> range_infos;
+    std::vector<vk::BufferMemoryBarrier> barriers;
+    uint32_t batch_begin = 0;
+    for (uint32_t batch = 0; batch < batch_ends.size(); batch++) {
+        const uint32_t batch_end = batch_ends[batch];
+        // keep the names stable across runs, see get_last_blas_batch_count() for the sizes.
+        MERIAN_PROFILE_SCOPE_GPU(profiler, cmd, fmt::format("BLAS batch {:02}", batch));
+
+        build_infos.clear();
+        range_infos.clear();
+        barriers.assign(1, scratch_barrier);
+        for (uint32_t idx = batch_begin; idx < batch_end; idx++) {
+            PendingBLAS& pending = pending_blas_builds[idx];
+            pending.build_info.scratchData.deviceAddress = scratch_address + scratch_offsets[idx];
+            build_infos.emplace_back(pending.build_info);
+            range_infos.emplace_back(pending.range_info);
+            barriers.emplace_back(pending.blas->blas_read_barrier());
+        }
+
+        cmd.buildAccelerationStructuresKHR(build_infos.size(), build_infos.data(),
+                                           range_infos.data());
         // Barrier for TLAS build / compaction reads (hope this is enough... the spec does not state
         // if a global barrier is necessary)
         cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
                             vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, {},
-                            {scratch_barrier, pending_blas_builds[idx].blas->blas_read_barrier()},
-                            {});
+                            barriers, {});
+        batch_begin = batch_end;
     }
 
+    last_blas_build_count = pending_blas_builds.size();
+    last_blas_batch_count = batch_ends.size();
     pending_blas_builds.clear();
-    pending_min_scratch_buffer = 0;
 }
 
 } // namespace merian
@@ -0,0 +1,302 @@
+#include "merian/vk/raytrace/host_as_builder.hpp"
+
+#include "merian/io/mapped_file.hpp"
+#include "merian/utils/hash.hpp"
+#include "merian/utils/string.hpp"
+#include "merian/vk/extension/extension_vk_acceleration_structure.hpp"
+#include "merian/vk/utils/check_result.hpp"
+
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <thread>
+
+namespace merian {
+
+// the cache header is written as it is in memory.
+static_assert(std::endian::native == std::endian::little);
+
+namespace {
+
+// Scratch and serialization memory, host addresses for acceleration structure commands should be
+// 16 byte aligned.
+struct alignas(16) HostBlock {
+    std::byte data[16];
+};
+
+std::vector<HostBlock> allocate_host_blocks(const std::size_t size) {
+    return std::vector<HostBlock>((size + sizeof(HostBlock) - 1) / sizeof(HostBlock));
+}
+
+// Offset of the size that is required for the deserialized acceleration structure in the
+// serialized data (after the driver and compatibility UUID and the serialized size).
+constexpr std::size_t DESERIALIZED_SIZE_OFFSET = 2 * VK_UUID_SIZE + sizeof(uint64_t);
+
+} // namespace
+
+bool HostASBuilder::is_supported(const ContextHandle& context) {
+    const auto ext = context->get_extension<ExtensionVkAccelerationStructure>();
+    return ext && ext->supports_host_commands();
+}
+
+HostASBuilder::HostASBuilder(const ContextHandle& context,
+                             const ResourceAllocatorHandle& allocator,
+                             const std::optional<std::filesystem::path>& cache_dir)
+    : context(context), allocator(allocator), cache_dir(cache_dir) {
+    const auto ext = context->get_extension<ExtensionVkAccelerationStructure>();
+    if (!ext || !ext->supports_host_commands()) {
+        throw std::runtime_error{"acceleration structure host commands are not supported"};
+    }
+    driver_uuid = ext->get_driver_uuid();
+
+    if (cache_dir) {
+        std::filesystem::create_directories(*cache_dir);
+    }
+}
+
+std::future<AccelerationStructureHandle>
+HostASBuilder::build(const std::vector<Geometry>& geometries,
+                     const vk::BuildAccelerationStructureFlagsKHR build_flags) {
+    return context->thread_pool.submit<AccelerationStructureHandle>(
+        [this, geometries, build_flags] { return build_or_load(geometries, build_flags); },
+        "HostASBuilder build");
+}
+
+std::future<AccelerationStructureHandle>
+HostASBuilder::build(const MeshHandle& mesh,
+                     const vk::BuildAccelerationStructureFlagsKHR build_flags) {
+    const Geometry geometry{
+        mesh->get_vertices().data(),
+        (uint32_t)mesh->get_vertices().size(),
+        sizeof(Mesh::Vertex),
+        mesh->get_indices().data(),
+        (uint32_t)mesh->get_indices().size(),
+    };
+    return context->thread_pool.submit<AccelerationStructureHandle>(
+        [this, mesh, geometry, build_flags] { return build_or_load({geometry}, build_flags); },
+        "HostASBuilder build");
+}
+
+uint64_t HostASBuilder::hash_geometry(const std::vector<Geometry>& geometries,
+                                      const vk::BuildAccelerationStructureFlagsKHR build_flags) {
+    const uint32_t flags = (uint32_t)build_flags;
+    uint64_t hash = hash_fnv1a(&flags, sizeof(flags));
+    for (const Geometry& geometry : geometries) {
+        const uint32_t geometry_flags = (uint32_t)geometry.flags;
+        hash = hash_fnv1a(&geometry_flags, sizeof(geometry_flags), hash);
+        hash = hash_fnv1a(&geometry.vertex_count, sizeof(geometry.vertex_count), hash);
+        hash = hash_fnv1a(&geometry.index_count, sizeof(geometry.index_count), hash);
+        // only the positions matter for the acceleration structure
+        const std::byte* vertex = static_cast<const std::byte*>(geometry.vertices);
+        for (uint32_t i = 0; i < geometry.vertex_count; i++, vertex += geometry.vertex_stride) {
+            hash = hash_fnv1a(vertex, 3 * sizeof(float), hash);
+        }
+        hash = hash_fnv1a(geometry.indices, geometry.index_count * sizeof(uint32_t), hash);
+    }
+    return hash;
+}
+
+AccelerationStructureHandle
+HostASBuilder::build_or_load(const std::vector<Geometry>& geometries,
+                             const vk::BuildAccelerationStructureFlagsKHR flags) {
+    // maxVertex would wrap around and a partial triangle would be dropped silently
+    for (std::size_t i = 0; i < geometries.size(); i++) {
+        if (geometries[i].vertex_count == 0 || geometries[i].index_count % 3 != 0) {
+            throw std::runtime_error{
+                fmt::format("geometry {} is not a valid triangle list ({} vertices, {} indices)",
+                            i, geometries[i].vertex_count, geometries[i].index_count)};
+        }
+    }
+
+    std::vector<vk::AccelerationStructureGeometryKHR> as_geometries;
+    std::vector<vk::AccelerationStructureBuildRangeInfoKHR> range_infos;
+    std::vector<uint32_t> primitive_counts;
+    for (const Geometry& geometry : geometries) {
+        const vk::AccelerationStructureGeometryTrianglesDataKHR triangles{
+            vk::Format::eR32G32B32Sfloat,
+            vk::DeviceOrHostAddressConstKHR{geometry.vertices},
+            geometry.vertex_stride,
+            geometry.vertex_count - 1,
+            vk::IndexType::eUint32,
+            vk::DeviceOrHostAddressConstKHR{geometry.indices},
+            {},
+        };
+        as_geometries.emplace_back(vk::GeometryTypeKHR::eTriangles,
+                                   vk::AccelerationStructureGeometryDataKHR{triangles},
+                                   geometry.flags);
+        range_infos.emplace_back(geometry.index_count / 3, 0, 0, 0);
+        primitive_counts.emplace_back(geometry.index_count / 3);
+    }
+
+    vk::AccelerationStructureBuildGeometryInfoKHR build_info{
+        vk::AccelerationStructureTypeKHR::eBottomLevel,
+        flags,
+        vk::BuildAccelerationStructureModeKHR::eBuild,
+        {},
+        {},
+        as_geometries,
+    };
+    const vk::AccelerationStructureBuildSizesInfoKHR size_info =
+        context->device.getAccelerationStructureBuildSizesKHR(
+            vk::AccelerationStructureBuildTypeKHR::eHost, build_info, primitive_counts);
+
+    std::optional<std::filesystem::path> cache_path;
+    uint64_t geometry_hash = 0;
+    if (cache_dir) {
+        geometry_hash = hash_geometry(geometries, flags);
+        cache_path = *cache_dir / fmt::format("{:016x}.blas", geometry_hash);
+        AccelerationStructureHandle blas = load_cache(*cache_path, geometry_hash, size_info);
+        if (blas) {
+            cache_hit_count++;
+            return blas;
+        }
+    }
+
+    AccelerationStructureHandle blas = allocator->createAccelerationStructure(
+        vk::AccelerationStructureTypeKHR::eBottomLevel, size_info, "HostASBuilder BLAS",
+        MemoryMappingType::HOST_ACCESS_RANDOM);
+    std::vector<HostBlock> scratch = allocate_host_blocks(size_info.buildScratchSize);
+
+    build_info.dstAccelerationStructure = *blas;
+    build_info.scratchData.hostAddress = scratch.data();
+    const vk::AccelerationStructureBuildRangeInfoKHR* range_info_ptr = range_infos.data();
+    check_result(
+        context->device.buildAccelerationStructuresKHR({}, 1, &build_info, &range_info_ptr),
+        "host acceleration structure build failed");
+    // no-op for host-coherent memory
+    blas->get_buffer()->get_memory()->flush();
+    build_count++;
+
+    if (cache_path) {
+        try {
+            write_cache(*cache_path, geometry_hash, blas);
+        } catch (const std::exception& e) {
+            SPDLOG_WARN("could not write acceleration structure cache {}: {}",
+                        cache_path->string(), e.what());
+        }
+    }
+
+    return blas;
+}
+
+AccelerationStructureHandle
+HostASBuilder::load_cache(const std::filesystem::path& path,
+                          const uint64_t geometry_hash,
+                          vk::AccelerationStructureBuildSizesInfoKHR size_info) const {
+    if (!std::filesystem::exists(path)) {
+        return nullptr;
+    }
+
+    std::unique_ptr<const MappedFile> file;
+    try {
+        file = std::make_unique<const MappedFile>(path, MappedFile::AccessPattern::SEQUENTIAL);
+    } catch (const std::runtime_error& e) {
+        SPDLOG_WARN("could not read acceleration structure cache: {}", e.what());
+        return nullptr;
+    }
+    const std::span<const std::byte> data = file->get_data();
+
+    CacheHeader header;
+    if (data.size() < sizeof(CacheHeader)) {
+        SPDLOG_DEBUG("acceleration structure cache {} is truncated", path.string());
+        return nullptr;
+    }
+    std::memcpy(&header, data.data(), sizeof(CacheHeader));
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION || header.geometry_hash != geometry_hash ||
+        header.data_size != data.size() - sizeof(CacheHeader) ||
+        header.data_size < DESERIALIZED_SIZE_OFFSET + sizeof(uint64_t)) {
+        SPDLOG_DEBUG("acceleration structure cache {} is invalid", path.string());
+        return nullptr;
+    }
+    if (std::memcmp(header.driver_uuid, driver_uuid.data(), VK_UUID_SIZE) != 0) {
+        SPDLOG_DEBUG("acceleration structure cache {} was written by a different driver",
+                     path.string());
+        return nullptr;
+    }
+
+    const std::byte* serialized = data.data() + sizeof(CacheHeader);
+    assert(reinterpret_cast<std::uintptr_t>(serialized) % alignof(HostBlock) == 0);
+
+    const vk::AccelerationStructureVersionInfoKHR version_info{
+        reinterpret_cast<const uint8_t*>(serialized)};
+    vk::AccelerationStructureCompatibilityKHR compatibility;
+    context->device.getAccelerationStructureCompatibilityKHR(&version_info, &compatibility);
+    if (compatibility != vk::AccelerationStructureCompatibilityKHR::eCompatible) {
+        SPDLOG_DEBUG("acceleration structure cache {} is not compatible", path.string());
+        return nullptr;
+    }
+
+    uint64_t deserialized_size;
+    std::memcpy(&deserialized_size, serialized + DESERIALIZED_SIZE_OFFSET, sizeof(uint64_t));
+    size_info.accelerationStructureSize = deserialized_size;
+
+    AccelerationStructureHandle blas = allocator->createAccelerationStructure(
+        vk::AccelerationStructureTypeKHR::eBottomLevel, size_info, "HostASBuilder BLAS (cached)",
+        MemoryMappingType::HOST_ACCESS_RANDOM);
+    const vk::CopyMemoryToAccelerationStructureInfoKHR copy_info{
+        vk::DeviceOrHostAddressConstKHR{serialized}, *blas,
+        vk::CopyAccelerationStructureModeKHR::eDeserialize};
+    const vk::Result result = context->device.copyMemoryToAccelerationStructureKHR({}, &copy_info);
+    if (result != vk::Result::eSuccess) {
+        SPDLOG_WARN("deserializing acceleration structure cache {} failed: {}", path.string(),
+                    vk::to_string(result));
+        return nullptr;
+    }
+    // no-op for host-coherent memory
+    blas->get_buffer()->get_memory()->flush();
+
+    SPDLOG_DEBUG("loaded acceleration structure from cache {} ({})", path.string(),
+                 format_size(deserialized_size));
+    return blas;
+}
+
+void HostASBuilder::write_cache(const std::filesystem::path& path,
+                                const uint64_t geometry_hash,
+                                const AccelerationStructureHandle& blas) const {
+    std::size_t serialized_size;
+    check_result(context->device.writeAccelerationStructuresPropertiesKHR(
+                     1, &*blas, vk::QueryType::eAccelerationStructureSerializationSizeKHR,
+                     sizeof(serialized_size), &serialized_size, sizeof(serialized_size)),
+                 "could not query the serialization size");
+
+    std::vector<HostBlock> serialized = allocate_host_blocks(serialized_size);
+    vk::CopyAccelerationStructureToMemoryInfoKHR copy_info{
+        *blas, {}, vk::CopyAccelerationStructureModeKHR::eSerialize};
+    copy_info.dst.hostAddress = serialized.data();
+    check_result(context->device.copyAccelerationStructureToMemoryKHR({}, &copy_info),
+                 "could not serialize acceleration structure");
+
+    CacheHeader header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    std::memcpy(header.driver_uuid, driver_uuid.data(), VK_UUID_SIZE);
+    header.geometry_hash = geometry_hash;
+    header.data_size = serialized_size;
+
+    // unique per thread, the same geometry might be built concurrently
+    const std::filesystem::path tmp_path = fmt::format(
+        "{}.{}.tmp", path.string(), std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream out(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+        out.write(reinterpret_cast<const char*>(serialized.data()),
+                  (std::streamsize)serialized_size);
+        out.close();
+        if (!out) {
+            std::filesystem::remove(tmp_path);
+            throw std::runtime_error{fmt::format("writing {} failed", tmp_path.string())};
+        }
+    }
+    std::filesystem::rename(tmp_path, path);
+
+    SPDLOG_DEBUG("wrote acceleration structure cache {} ({})", path.string(),
+                 format_size(serialized_size));
+}
+
+} // namespace merian
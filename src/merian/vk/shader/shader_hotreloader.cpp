@@ -17,15 +17,8 @@ HotReloader::get_shader(const std::filesystem::path& path,
     const std::filesystem::file_time_type last_write_time =
         std::filesystem::last_write_time(*canonical);
 
-    if (!shaders.contains(*canonical) ||
-        // workaround for this not working in older Ubuntu versions
-        // (std::chrono::system_clock::now().time_since_epoch() - 200ms >
-        // last_write_time.time_since_epoch()
-        ((std::chrono::system_clock::now().time_since_epoch() - 200ms) >
-             last_write_time.time_since_epoch() &&
-         last_write_time > shaders[*canonical].last_write_time)) {
-        // wait additional 200ms, else the write to the file might still be in process.
-
+    if (!shaders.contains(*canonical)) {
+        // first request: the caller needs a shader, compile synchronously.
         per_path& path_info = shaders[*canonical];
 
         // still remember time, so that we do not attempt to recompile the same broken file over
@@ -34,15 +27,44 @@ HotReloader::get_shader(const std::filesystem::path& path,
         try {
             path_info.shader =
                 compiler->compile_glsl_to_shadermodule(context, *canonical, shader_kind);
+        } catch (const ShaderCompiler::compilation_failed& e) {
+            path_info.error = e;
+        }
+    }
+
+    per_path& path_info = shaders[*canonical];
+
+    // workaround for this not working in older Ubuntu versions
+    // (std::chrono::system_clock::now().time_since_epoch() - 200ms >
+    // last_write_time.time_since_epoch()
+    if ((std::chrono::system_clock::now().time_since_epoch() - 200ms) >
+            last_write_time.time_since_epoch() &&
+        last_write_time > path_info.last_write_time) {
+        // wait additional 200ms, else the write to the file might still be in process.
+
+        path_info.last_write_time = last_write_time;
+
+        // a pending compilation of an older version is stale.
+        path_info.pending_stop.request_stop();
+        path_info.pending_stop = std::stop_source();
+        path_info.pending = context->thread_pool.submit<ShaderModuleHandle>(
+            [context = context, compiler = compiler, path = *canonical, shader_kind]() {
+                return compiler->compile_glsl_to_shadermodule(context, path, shader_kind);
+            },
+            {"shader hot reload", ThreadPool::Priority::BACKGROUND,
+             path_info.pending_stop.get_token()});
+    }
+
+    if (path_info.pending.valid() && path_info.pending.wait_for(0s) == std::future_status::ready) {
+        try {
+            path_info.shader = path_info.pending.get();
             path_info.error.reset();
         } catch (const ShaderCompiler::compilation_failed& e) {
             path_info.shader = nullptr;
             path_info.error = e;
-            throw e;
         }
     }
 
-    per_path& path_info = shaders[*canonical];
     if (path_info.error) {
         throw *path_info.error;
     }
@@ -50,6 +72,9 @@ HotReloader::get_shader(const std::filesystem::path& path,
 }
 
 void HotReloader::clear() {
+    for (auto& [path, path_info] : shaders) {
+        path_info.pending_stop.request_stop();
+    }
     shaders.clear();
 }
 
@@ -213,7 +213,7 @@ Profiler::set_collect_get_every(const QueryPoolHandle<vk::QueryType::eTimestamp>
 }
 
 std::string Profiler::get_report_str(const Profiler::Report& report) {
-    if (report.cpu_report.empty() && report.gpu_report.empty()) {
+    if (!report) {
         return "no timestamps captured";
     }
 
@@ -222,6 +222,10 @@ std::string Profiler::get_report_str(const Profiler::Report& report) {
     result += to_string(report.cpu_report, 1);
     result += "GPU:\n";
     result += to_string(report.gpu_report, 1);
+    if (!report.task_report.empty()) {
+        result += "Tasks:\n";
+        result += to_string(report.task_report, 1);
+    }
     return result;
 }
 
@@ -249,6 +253,10 @@ void Profiler::get_gpu_report_as_config(Properties& config, const Profiler::Repo
     to_config(config, report.gpu_report, 1u << 31);
 }
 
+void Profiler::get_task_report_as_config(Properties& config, const Profiler::Report& report) {
+    to_config(config, report.task_report, 1u << 30);
+}
+
 void Profiler::get_report_as_config(Properties& config, const Profiler::Report& report) {
     if (!report.cpu_report.empty()) {
         config.st_separate("CPU");
@@ -259,6 +267,59 @@ void Profiler::get_report_as_config(Properties& config, const Profiler::Report&
         config.st_separate("GPU");
         get_gpu_report_as_config(config, report);
     }
+
+    if (!report.task_report.empty()) {
+        config.st_separate("Tasks");
+        get_task_report_as_config(config, report);
+    }
+}
+
+std::vector<Profiler::ReportEntry>
+Profiler::make_task_report(const std::vector<ThreadPool::TraceEvent>& events) {
+    struct Accumulator {
+        uint32_t count{0};
+        double sum_duration_ns{0};
+        double sq_sum_duration_ns{0};
+        double sum_queued_ns{0};
+        double sq_sum_queued_ns{0};
+    };
+    std::unordered_map<std::string, Accumulator> tasks;
+    for (const auto& event : events) {
+        const double duration_ns =
+            std::chrono::duration<double, std::nano>(event.end - event.start).count();
+        const double queued_ns =
+            std::chrono::duration<double, std::nano>(event.start - event.enqueued).count();
+
+        Accumulator& task = tasks[event.name];
+        task.count++;
+        task.sum_duration_ns += duration_ns;
+        task.sq_sum_duration_ns += duration_ns * duration_ns;
+        task.sum_queued_ns += queued_ns;
+        task.sq_sum_queued_ns += queued_ns * queued_ns;
+    }
+
+    std::vector<std::pair<double, ReportEntry>> sorted;
+    for (const auto& [name, task] : tasks) {
+        const double avg = task.sum_duration_ns / task.count;
+        const double std =
+            std::sqrt(std::max(0.0, task.sq_sum_duration_ns / task.count - avg * avg));
+        const double avg_queued = task.sum_queued_ns / task.count;
+        const double std_queued =
+            std::sqrt(std::max(0.0, task.sq_sum_queued_ns / task.count - avg_queued * avg_queued));
+
+        ReportEntry entry{fmt::format("{} ({}x)", name, task.count), avg / 1e6, std / 1e6, {}};
+        entry.children.emplace_back("queued", avg_queued / 1e6, std_queued / 1e6,
+                                    std::vector<ReportEntry>());
+        sorted.emplace_back(task.sum_duration_ns, std::move(entry));
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    std::vector<ReportEntry> report;
+    for (auto& [total, entry] : sorted) {
+        report.emplace_back(std::move(entry));
+    }
+    return report;
 }
 
 Profiler::Report Profiler::get_report() {
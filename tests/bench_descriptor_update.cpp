@@ -0,0 +1,147 @@
+// Compares updating a descriptor set with 16 storage buffer bindings using one heap-allocated
+// vk::DescriptorBufferInfo and vk::WriteDescriptorSet per write (the previous DescriptorSetUpdate)
+// with the packed shadow copy and update template of DescriptorSetUpdate.
+//
+// If VK_KHR_push_descriptor is available, additionally compares the CPU time of updating and
+// binding a pooled set with updating and pushing a push descriptor set into a command buffer.
+
+#include "common.hpp"
+
+#include "merian/vk/descriptors/descriptor_set_update.hpp"
+#include "merian/vk/extension/extension_resources.hpp"
+#include "merian/vk/extension/extension_vk_push_descriptor.hpp"
+#include "merian/vk/pipeline/pipeline_layout.hpp"
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t BINDING_COUNT = 16;
+constexpr uint32_t ITERATIONS = 100000;
+// Command buffers are reset after this many recorded binds to bound their memory.
+constexpr uint32_t BINDS_PER_COMMAND_BUFFER = 1000;
+
+} // namespace
+
+int main() {
+    const auto resources = std::make_shared<ExtensionResources>();
+    const auto push_descriptor = std::make_shared<ExtensionVkPushDescriptor>();
+    const ContextHandle context = create_test_context({resources, push_descriptor});
+    if (!context) {
+        return MERIAN_TEST_SKIP;
+    }
+    const ResourceAllocatorHandle allocator = resources->resource_allocator();
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    std::vector<BufferHandle> buffers;
+    for (uint32_t i = 0; i < BINDING_COUNT; i++) {
+        bindings.emplace_back(i, vk::DescriptorType::eStorageBuffer, 1,
+                              vk::ShaderStageFlagBits::eCompute);
+        buffers.emplace_back(allocator->createBuffer(256, vk::BufferUsageFlagBits::eStorageBuffer,
+                                                     MemoryMappingType::NONE, "bench buffer"));
+    }
+    DescriptorSetLayoutHandle layout = std::make_shared<DescriptorSetLayout>(context, bindings);
+    const DescriptorPoolHandle pool = std::make_shared<DescriptorPool>(layout, 1);
+    const DescriptorSetHandle set = std::make_shared<DescriptorSet>(pool);
+
+    const double legacy = measure_seconds(ITERATIONS, [&] {
+        std::vector<std::unique_ptr<vk::DescriptorBufferInfo>> infos;
+        std::vector<vk::WriteDescriptorSet> writes;
+        for (uint32_t i = 0; i < BINDING_COUNT; i++) {
+            const auto& info = infos.emplace_back(
+                std::make_unique<vk::DescriptorBufferInfo>(*buffers[i], 0, VK_WHOLE_SIZE));
+            writes.emplace_back(*set, i, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr,
+                                info.get());
+        }
+        context->device.updateDescriptorSets(writes, {});
+    });
+
+    DescriptorSetUpdate update(set);
+    const double packed = measure_seconds(ITERATIONS, [&] {
+        for (uint32_t i = 0; i < BINDING_COUNT; i++) {
+            update.write_descriptor_buffer(i, buffers[i]);
+        }
+        update.update(context);
+        update.next();
+    });
+
+    fmt::print("{} storage buffer bindings, {} iterations\n", BINDING_COUNT, ITERATIONS);
+    fmt::print("  write per descriptor: {:8.3f} us / update\n", legacy * 1e6);
+    fmt::print("  update template:      {:8.3f} us / update ({:.2f}x)\n", packed * 1e6,
+               legacy / packed);
+
+    if (!context->get_extension<ExtensionVkPushDescriptor>()) {
+        fmt::print("VK_KHR_push_descriptor not supported, skipping push descriptors\n");
+        return 0;
+    }
+
+    // A set must not be updated while it is bound in a recording command buffer, use one set per
+    // bind like an application that allocates a set per draw would.
+    const DescriptorPoolHandle bind_pool =
+        std::make_shared<DescriptorPool>(layout, BINDS_PER_COMMAND_BUFFER);
+    std::vector<DescriptorSetHandle> bind_sets;
+    std::vector<DescriptorSetUpdate> bind_updates;
+    bind_updates.reserve(BINDS_PER_COMMAND_BUFFER);
+    for (uint32_t i = 0; i < BINDS_PER_COMMAND_BUFFER; i++) {
+        bind_sets.emplace_back(std::make_shared<DescriptorSet>(bind_pool));
+        bind_updates.emplace_back(bind_sets.back());
+    }
+
+    const DescriptorSetLayoutHandle push_layout = std::make_shared<DescriptorSetLayout>(
+        context, bindings, vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR);
+    const DescriptorSetHandle push_set = std::make_shared<DescriptorSet>(push_layout);
+    const PipelineLayoutHandle pipeline_layout =
+        std::make_shared<PipelineLayout>(context, std::vector{layout});
+    const PipelineLayoutHandle push_pipeline_layout =
+        std::make_shared<PipelineLayout>(context, std::vector{push_layout});
+
+    const CommandPoolHandle cmd_pool = std::make_shared<CommandPool>(context->get_queue_GCT());
+    vk::CommandBuffer cmd;
+    uint32_t recorded = 0;
+    // Returns a command buffer in recording state, recycles the pool from time to time.
+    const auto get_cmd = [&] {
+        if (recorded == BINDS_PER_COMMAND_BUFFER) {
+            cmd.end();
+            cmd_pool->reset();
+            recorded = 0;
+        }
+        if (recorded++ == 0) {
+            cmd = cmd_pool->create_and_begin();
+        }
+        return cmd;
+    };
+
+    const double pooled = measure_seconds(ITERATIONS, [&] {
+        const vk::CommandBuffer bind_cmd = get_cmd();
+        const uint32_t index = recorded - 1;
+        DescriptorSetUpdate& bind_update = bind_updates[index];
+        for (uint32_t i = 0; i < BINDING_COUNT; i++) {
+            bind_update.write_descriptor_buffer(i, buffers[i]);
+        }
+        bind_update.update(context);
+        bind_update.next();
+        bind_cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipeline_layout, 0, 1,
+                                    &**bind_sets[index], 0, nullptr);
+    });
+
+    DescriptorSetUpdate push_update(push_set);
+    const double pushed = measure_seconds(ITERATIONS, [&] {
+        for (uint32_t i = 0; i < BINDING_COUNT; i++) {
+            push_update.write_descriptor_buffer(i, buffers[i]);
+        }
+        push_update.update(context);
+        push_update.next();
+        get_cmd().pushDescriptorSetWithTemplateKHR(
+            push_pipeline_layout->get_push_descriptor_template(0, vk::PipelineBindPoint::eCompute),
+            *push_pipeline_layout, 0, static_cast<const void*>(push_set->get_push_data()));
+    });
+    cmd.end();
+    cmd_pool->reset();
+
+    fmt::print("update and record into a command buffer\n");
+    fmt::print("  pooled set, bind:     {:8.3f} us / update\n", pooled * 1e6);
+    fmt::print("  push descriptors:     {:8.3f} us / update ({:.2f}x)\n", pushed * 1e6,
+               pooled / pushed);
+
+    return 0;
+}
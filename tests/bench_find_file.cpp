@@ -0,0 +1,133 @@
+// Resolves the includes of the built-in node shaders like the shaderc includer does (relative to
+// the including file, then in the search paths), with and without the find_file cache. Reports the
+// time and the number of file system queries (stat calls) per pass over all shaders.
+//
+// Every file is expanded only once per shader, but find_file is called for every include
+// directive, as a compiler that honors include guards would do. Preprocessor conditions are not
+// evaluated, includes for C++ only (e.g. in types.glsl.h) are reported as unresolved.
+
+#include "common.hpp"
+
+#include "merian/io/file_loader.hpp"
+
+#include <filesystem>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t REPETITIONS = 20;
+
+const std::set<std::string> SHADER_EXTENSIONS = {".comp", ".vert", ".frag", ".rgen",
+                                                 ".rchit", ".rmiss", ".rahit"};
+
+struct Source {
+    std::filesystem::path path;
+    // (requested path, relative)
+    std::vector<std::pair<std::string, bool>> includes;
+};
+
+// Reads the include directives of every file once, such that the benchmark measures resolution
+// only.
+class IncludeTree {
+  public:
+    const Source& get(const std::filesystem::path& path) {
+        const auto it = sources.find(path);
+        if (it != sources.end()) {
+            return it->second;
+        }
+        static const std::regex directive(R"(\s*#\s*include\s*([<"])([^>"]+)[>"].*)");
+
+        Source source{path, {}};
+        std::istringstream content(FileLoader::load_file(path));
+        std::string line;
+        std::smatch match;
+        while (std::getline(content, line)) {
+            if (std::regex_match(line, match, directive)) {
+                source.includes.emplace_back(match[2].str(), match[1].str() == "\"");
+            }
+        }
+        return sources.emplace(path, std::move(source)).first->second;
+    }
+
+  private:
+    std::map<std::filesystem::path, Source> sources;
+};
+
+// Returns the number of include directives, unresolved ones are counted in unresolved.
+uint32_t resolve_includes(const FileLoader& loader,
+                          IncludeTree& tree,
+                          const std::filesystem::path& shader,
+                          uint32_t& unresolved) {
+    uint32_t directives = 0;
+    std::set<std::filesystem::path> expanded;
+    std::vector<std::filesystem::path> pending = {shader};
+    while (!pending.empty()) {
+        const std::filesystem::path path = pending.back();
+        pending.pop_back();
+        if (!expanded.insert(path).second) {
+            continue;
+        }
+
+        for (const auto& [requested, relative] : tree.get(path).includes) {
+            directives++;
+            std::optional<std::filesystem::path> full_path;
+            if (relative) {
+                full_path = loader.find_file(requested, path);
+            }
+            if (!full_path) {
+                full_path = loader.find_file(requested);
+            }
+            if (full_path) {
+                pending.emplace_back(*full_path);
+            } else {
+                unresolved++;
+            }
+        }
+    }
+    return directives;
+}
+
+} // namespace
+
+int main() {
+    const std::filesystem::path source_dir = MERIAN_SOURCE_DIR;
+    std::vector<std::filesystem::path> shaders;
+    for (const auto& entry :
+         std::filesystem::recursive_directory_iterator(source_dir / "src" / "merian-nodes")) {
+        if (entry.is_regular_file() && SHADER_EXTENSIONS.contains(entry.path().extension())) {
+            shaders.emplace_back(entry.path());
+        }
+    }
+    MERIAN_TEST_CHECK(!shaders.empty());
+
+    IncludeTree tree;
+    fmt::print("{} shaders, {} passes\n", shaders.size(), REPETITIONS);
+    fmt::print("{:>10} {:>12} {:>10} {:>14} {:>12}\n", "cache", "directives", "ms / pass",
+               "stat / pass", "unresolved");
+    for (const bool cache : {false, true}) {
+        FileLoader loader({source_dir / "include", source_dir / "src"});
+        loader.set_cache_enabled(cache);
+
+        uint32_t directives = 0;
+        uint32_t unresolved = 0;
+        const double seconds = measure_seconds(REPETITIONS, [&] {
+            directives = 0;
+            unresolved = 0;
+            for (const auto& shader : shaders) {
+                directives += resolve_includes(loader, tree, shader, unresolved);
+            }
+        });
+
+        const FileLoader::CacheStatistics statistics = loader.get_cache_statistics();
+        fmt::print("{:>10} {:>12} {:>10.3f} {:>14.1f} {:>12}\n", cache ? "enabled" : "disabled",
+                   directives, seconds * 1e3, (double)statistics.stat_calls / REPETITIONS,
+                   unresolved);
+    }
+
+    return 0;
+}
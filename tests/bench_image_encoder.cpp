@@ -0,0 +1,115 @@
+// Encoding throughput of ImageEncoder in megapixels per second per format and number of tasks.
+//
+// The image is a smooth gradient with some noise, roughly like a rendered frame. The output goes
+// to a memory stream.
+//
+// Usage: bench_image_encoder [width height]
+
+#include "common.hpp"
+
+#include "merian/io/image_encoder.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <string>
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t REPETITIONS = 3;
+constexpr uint32_t TASK_COUNTS[] = {1, 2, 4, 8, 16};
+
+uint32_t noise(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const uint32_t width = argc > 2 ? std::stoul(argv[1]) : 1920;
+    const uint32_t height = argc > 2 ? std::stoul(argv[2]) : 1080;
+    const double megapixels = width * height * 1e-6;
+
+    std::vector<uint8_t> ldr(4ul * width * height);
+    std::vector<float> hdr(4ul * width * height);
+    std::vector<uint16_t> half(4ul * width * height);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            for (uint32_t c = 0; c < 4; c++) {
+                const std::size_t i = 4ul * (y * width + x) + c;
+                const float gradient = (float)(x + y * c) / (width + height * 3);
+                const float value = gradient + (noise(i) % 16) / 255.f;
+                ldr[i] = c == 3 ? 255 : (uint8_t)std::min(255.f, value * 255.f);
+                hdr[i] = value * 4;
+                // positive halfs in [0, 2)
+                half[i] = (uint16_t)(value * 0x3C00) & 0x3FFF;
+            }
+        }
+    }
+
+    const std::pair<const char*, ImageEncoder::Compression> pngs[] = {
+        {"PNG fastest", ImageEncoder::Compression::FASTEST},
+        {"PNG default", ImageEncoder::Compression::DEFAULT},
+        {"PNG best", ImageEncoder::Compression::BEST},
+    };
+
+    // the calling thread participates
+    ThreadPool pool(TASK_COUNTS[std::size(TASK_COUNTS) - 1] - 1);
+    fmt::print("{}x{}, best of {}, MP/s (output size)\n", width, height, REPETITIONS);
+    fmt::print("{:>14}", "format");
+    for (const uint32_t tasks : TASK_COUNTS) {
+        fmt::print(" {:>9}", fmt::format("{} tasks", tasks));
+    }
+    fmt::print(" {:>10}\n", "size KiB");
+
+    const auto run = [&](const char* name, const ImageEncoder::Options& base_options,
+                         const auto& write) {
+        fmt::print("{:>14}", name);
+        std::size_t size = 0;
+        for (const uint32_t tasks : TASK_COUNTS) {
+            ImageEncoder::Options options = base_options;
+            options.tasks = tasks;
+            const ImageEncoder encoder(pool, options);
+            double best = std::numeric_limits<double>::max();
+            for (uint32_t i = 0; i < REPETITIONS; i++) {
+                std::ostringstream out;
+                best = std::min(best, measure_seconds(1, [&] { write(encoder, out); }));
+                size = out.tellp();
+                MERIAN_TEST_CHECK(size > 0);
+            }
+            fmt::print(" {:>9.1f}", megapixels / best);
+        }
+        fmt::print(" {:>10}\n", size >> 10);
+    };
+
+    for (const auto& [name, compression] : pngs) {
+        ImageEncoder::Options options;
+        options.compression = compression;
+        run(name, options, [&](const ImageEncoder& encoder, std::ostream& out) {
+            encoder.write_png(out, ldr.data(), width, height);
+        });
+    }
+    for (const int quality : {80, 95}) {
+        ImageEncoder::Options options;
+        options.quality = quality;
+        run(quality == 80 ? "JPG q80" : "JPG q95", options,
+            [&](const ImageEncoder& encoder, std::ostream& out) {
+                encoder.write_jpg(out, ldr.data(), width, height);
+            });
+    }
+    run("HDR", {}, [&](const ImageEncoder& encoder, std::ostream& out) {
+        encoder.write_hdr(out, hdr.data(), width, height);
+    });
+    run("EXR", {}, [&](const ImageEncoder& encoder, std::ostream& out) {
+        encoder.write_exr(out, half.data(), width, height);
+    });
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Load throughput and peak RSS of reading a file with std::ifstream into a zero-initialized string,
+// FileLoader::load_file (reads into the string without mapping) and MappedFile.
+//
+// Every load runs in a forked child such that the peak RSS (ru_maxrss) of the methods does not
+// mix. The file is in the page cache (warm), all methods read every byte. Note that touched pages
+// of a mapping count towards the RSS, but they are clean page cache pages that the kernel can drop
+// at any time, while the copies are anonymous memory.
+//
+// Usage: bench_mapped_file [size in MiB]
+
+#include "common.hpp"
+
+#include "merian/io/file_loader.hpp"
+#include "merian/io/mapped_file.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <string>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t REPETITIONS = 3;
+
+uint64_t checksum(const char* data, const std::size_t size) {
+    uint64_t sum = 0;
+    for (std::size_t i = 0; i < size; i += 64) {
+        sum += (unsigned char)data[i];
+    }
+    return sum;
+}
+
+uint64_t load_ifstream(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::string data(file.tellg(), '\0');
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    return checksum(data.data(), data.size());
+}
+
+uint64_t load_file_loader(const std::filesystem::path& path) {
+    const std::string data = FileLoader::load_file(path);
+    return checksum(data.data(), data.size());
+}
+
+uint64_t load_mapped(const std::filesystem::path& path) {
+    const MappedFile file(path);
+    return checksum(file.get_string_view().data(), file.get_size());
+}
+
+struct Result {
+    double seconds;
+    uint64_t checksum;
+    // KiB
+    long max_rss;
+};
+
+// Runs the load in a child process.
+Result run_isolated(uint64_t (*load)(const std::filesystem::path&),
+                    const std::filesystem::path& path) {
+    int fds[2];
+    MERIAN_TEST_CHECK(pipe(fds) == 0);
+
+    const pid_t pid = fork();
+    MERIAN_TEST_CHECK(pid >= 0);
+    if (pid == 0) {
+        close(fds[0]);
+        Result result{};
+        result.seconds = measure_seconds(1, [&] { result.checksum = load(path); });
+        const bool written = write(fds[1], &result, sizeof(result)) == sizeof(result);
+        _exit(written ? 0 : 1);
+    }
+
+    close(fds[1]);
+    Result result{};
+    const bool received = read(fds[0], &result, sizeof(result)) == sizeof(result);
+    close(fds[0]);
+    int status;
+    rusage usage{};
+    MERIAN_TEST_CHECK(wait4(pid, &status, 0, &usage) == pid);
+    MERIAN_TEST_CHECK(received && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    result.max_rss = usage.ru_maxrss;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t size = (argc > 1 ? std::stoull(argv[1]) : 256) << 20;
+    const std::filesystem::path path = "bench_mapped_file.bin";
+    {
+        std::vector<char> block(1 << 20);
+        std::iota(block.begin(), block.end(), 0);
+        std::ofstream file(path, std::ios::binary);
+        for (std::size_t written = 0; written < size; written += block.size()) {
+            file.write(block.data(), block.size());
+        }
+    }
+    // bring the file into the page cache
+    const uint64_t expected = load_mapped(path);
+
+    // the footprint of the process without loading anything
+    const Result baseline = run_isolated([](const std::filesystem::path&) { return 0ul; }, path);
+
+    fmt::print("{} MiB file, best of {}, peak RSS above an idle child ({} MiB)\n", size >> 20,
+               REPETITIONS, baseline.max_rss >> 10);
+    fmt::print("{:>24} {:>10} {:>14}\n", "method", "GiB/s", "peak RSS MiB");
+
+    const std::pair<const char*, uint64_t (*)(const std::filesystem::path&)> methods[] = {
+        {"ifstream into string", load_ifstream},
+        {"FileLoader::load_file", load_file_loader},
+        {"MappedFile", load_mapped},
+    };
+    for (const auto& [name, load] : methods) {
+        double best = std::numeric_limits<double>::max();
+        long max_rss = 0;
+        for (uint32_t i = 0; i < REPETITIONS; i++) {
+            const Result result = run_isolated(load, path);
+            MERIAN_TEST_CHECK(result.checksum == expected);
+            best = std::min(best, result.seconds);
+            max_rss = std::max(max_rss, result.max_rss);
+        }
+        fmt::print("{:>24} {:>10.2f} {:>14}\n", name, size / best / (1 << 30),
+                   (max_rss - baseline.max_rss) >> 10);
+    }
+
+    std::filesystem::remove(path);
+    return 0;
+}
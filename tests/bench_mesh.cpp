@@ -0,0 +1,93 @@
+// Parsing an OBJ file compared with loading the mesh cache (memory mapped, used in place) and
+// validating the cache by hash (after the modification time of the source changed).
+//
+// The OBJ is a grid with positions, normals and texture coordinates and quads as faces.
+//
+// Usage: bench_mesh [grid size]
+
+#include "common.hpp"
+
+#include "merian/io/mesh.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t REPETITIONS = 3;
+
+// Reads every vertex, such that the pages of a mapped cache are actually loaded.
+float touch(const MeshHandle& mesh) {
+    float sum = 0;
+    for (const Mesh::Vertex& vertex : mesh->get_vertices()) {
+        sum += vertex.position.x;
+    }
+    return sum;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const uint32_t size = argc > 1 ? std::stoul(argv[1]) : 1024;
+    const std::filesystem::path path = "bench_mesh.obj";
+    const std::filesystem::path cache = "bench_mesh.obj.meshcache";
+    {
+        std::ofstream obj(path);
+        for (uint32_t y = 0; y <= size; y++) {
+            for (uint32_t x = 0; x <= size; x++) {
+                obj << fmt::format("v {} {} {:.4f}\nvt {:.4f} {:.4f}\nvn 0 0 1\n", x, y,
+                                   (x * y % 97) / 97.f, (float)x / size, (float)y / size);
+            }
+        }
+        const auto index = [&](const uint32_t x, const uint32_t y) {
+            return y * (size + 1) + x + 1;
+        };
+        for (uint32_t y = 0; y < size; y++) {
+            for (uint32_t x = 0; x < size; x++) {
+                const uint32_t a = index(x, y), b = index(x + 1, y), c = index(x + 1, y + 1),
+                               d = index(x, y + 1);
+                obj << fmt::format("f {0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2} {3}/{3}/{3}\n", a, b, c,
+                                   d);
+            }
+        }
+    }
+    std::filesystem::remove(cache);
+    const double megabytes = std::filesystem::file_size(path) * 1e-6;
+
+    MeshHandle mesh;
+    const double parse = measure_seconds(REPETITIONS, [&] { mesh = Mesh::parse_obj(path); });
+    const float expected = touch(mesh);
+    const std::size_t triangles = mesh->get_indices().size() / 3;
+    mesh->write_cache(cache, Mesh::get_source_stamp(path, true));
+    mesh.reset();
+
+    const double cached = measure_seconds(REPETITIONS, [&] {
+        mesh = Mesh::load_obj(path);
+        MERIAN_TEST_CHECK(mesh->is_cached() && touch(mesh) == expected);
+        mesh.reset();
+    });
+
+    // every load finds a different modification time and hashes the source
+    const double hashed = measure_seconds(REPETITIONS, [&] {
+        std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) +
+                                                   std::chrono::seconds(1));
+        mesh = Mesh::load_obj(path);
+        MERIAN_TEST_CHECK(mesh->is_cached() && touch(mesh) == expected);
+        mesh.reset();
+    });
+
+    fmt::print("{:.1f} MB OBJ, {} triangles, {} cache MB\n", megabytes, triangles,
+               std::filesystem::file_size(cache) >> 20);
+    fmt::print("{:>22} {:>10} {:>10}\n", "", "ms", "OBJ MB/s");
+    fmt::print("{:>22} {:>10.2f} {:>10.1f}\n", "parse", parse * 1e3, megabytes / parse);
+    fmt::print("{:>22} {:>10.2f} {:>10.1f}\n", "cache", cached * 1e3, megabytes / cached);
+    fmt::print("{:>22} {:>10.2f} {:>10.1f}\n", "cache, validate hash", hashed * 1e3,
+               megabytes / hashed);
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(cache);
+    return 0;
+}
@@ -0,0 +1,111 @@
+// parallel_for and parallel_reduce on uneven workloads, compared with a static split into equal
+// chunks (one std::function task per chunk, like parallel_for before dynamic chunking).
+//
+// uniform:    every item costs the same
+// triangular: the cost of an item grows linearly with its index
+// spikes:     every 64th item is 256 times as expensive as the others
+
+#include "common.hpp"
+
+#include "merian/utils/concurrent/utils.hpp"
+
+#include <functional>
+#include <future>
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t ITEMS = 1 << 14;
+constexpr uint32_t REPETITIONS = 5;
+
+// Burns roughly `cost` units of CPU time and returns a value that depends on all of them.
+uint64_t work(const uint32_t item, const uint32_t cost) {
+    uint64_t x = item;
+    for (uint32_t i = 0; i < cost; i++) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    return x;
+}
+
+uint32_t uniform(const uint32_t /*item*/) {
+    return 256;
+}
+
+uint32_t triangular(const uint32_t item) {
+    return 1 + 512 * item / ITEMS;
+}
+
+uint32_t spikes(const uint32_t item) {
+    return item % 64 == 0 ? 256 * 64 : 64;
+}
+
+template <typename F>
+void static_parallel_for(const uint32_t count,
+                         const F& function,
+                         ThreadPool& thread_pool,
+                         const uint32_t tasks) {
+    const uint32_t chunk = (count + tasks - 1) / tasks;
+    std::vector<std::future<void>> futures;
+    for (uint32_t begin = 0; begin < count; begin += chunk) {
+        const uint32_t end = std::min(count, begin + chunk);
+        futures.emplace_back(thread_pool.submit<void>(std::function<void()>([&, begin, end] {
+            for (uint32_t i = begin; i < end; i++) {
+                function(i);
+            }
+        })));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+}
+
+} // namespace
+
+int main() {
+    ThreadPool pool;
+    const uint32_t tasks = pool.size();
+    std::vector<uint64_t> results(ITEMS);
+
+    fmt::print("{} items, {} threads, ms per call\n", ITEMS, tasks);
+    fmt::print("{:>12} {:>10} {:>10} {:>10} {:>12}\n", "workload", "serial", "static", "dynamic",
+               "reduce");
+
+    const std::pair<const char*, uint32_t (*)(uint32_t)> workloads[] = {
+        {"uniform", uniform},
+        {"triangular", triangular},
+        {"spikes", spikes},
+    };
+    for (const auto& [name, cost] : workloads) {
+        const auto item = [&](const uint32_t i) { results[i] = work(i, cost(i)); };
+
+        const double serial = measure_seconds(REPETITIONS, [&] {
+            for (uint32_t i = 0; i < ITEMS; i++) {
+                item(i);
+            }
+        });
+        const double static_split =
+            measure_seconds(REPETITIONS, [&] { static_parallel_for(ITEMS, item, pool, tasks); });
+        const double dynamic = measure_seconds(REPETITIONS, [&] {
+            parallel_for(ITEMS, [&](const uint32_t i, const uint32_t) { item(i); }, pool, tasks);
+        });
+
+        uint64_t checksum = 0;
+        const double reduce = measure_seconds(REPETITIONS, [&] {
+            checksum = parallel_reduce(
+                ITEMS, uint64_t(0), [&](const uint32_t i) { return work(i, cost(i)); },
+                [](const uint64_t a, const uint64_t b) { return a ^ b; }, pool, tasks);
+        });
+
+        uint64_t expected = 0;
+        for (const uint64_t result : results) {
+            expected ^= result;
+        }
+        MERIAN_TEST_CHECK(checksum == expected);
+
+        fmt::print("{:>12} {:>10.3f} {:>10.3f} {:>10.3f} {:>12.3f}\n", name, serial * 1e3,
+                   static_split * 1e3, dynamic * 1e3, reduce * 1e3);
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+// push / pop throughput of MPMCQueue and SPSCQueue compared with the mutex and condition variable
+// based ConcurrentQueue, bounded to the same capacity.
+
+#include "common.hpp"
+
+#include "merian/utils/concurrent/concurrent_queue.hpp"
+#include "merian/utils/concurrent/mpmc_queue.hpp"
+#include "merian/utils/concurrent/spsc_queue.hpp"
+
+#include <string>
+#include <thread>
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t CAPACITY = 1024;
+constexpr uint32_t ITEMS = 1 << 21;
+constexpr uint32_t REPETITIONS = 3;
+
+// Adapts ConcurrentQueue to the interface of the lock-free queues.
+class BoundedConcurrentQueue {
+  public:
+    BoundedConcurrentQueue(const uint32_t capacity) : capacity(capacity) {}
+
+    void push(const uint64_t value) {
+        queue.push(value, capacity);
+    }
+
+    uint64_t pop() {
+        return queue.pop();
+    }
+
+  private:
+    const uint32_t capacity;
+    ConcurrentQueue<uint64_t> queue;
+};
+
+// Returns million push / pop pairs per second.
+template <typename Queue> double throughput(const uint32_t producers, const uint32_t consumers) {
+    const double seconds = measure_seconds(REPETITIONS, [&] {
+        Queue queue(CAPACITY);
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < producers; i++) {
+            threads.emplace_back([&, i] {
+                for (uint64_t item = i; item < ITEMS; item += producers) {
+                    queue.push(item);
+                }
+            });
+        }
+        for (uint32_t i = 0; i < consumers; i++) {
+            threads.emplace_back([&, i] {
+                // ITEMS is a multiple of the consumer count
+                for (uint32_t item = i; item < ITEMS; item += consumers) {
+                    queue.pop();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    });
+    return ITEMS / seconds * 1e-6;
+}
+
+} // namespace
+
+int main() {
+    fmt::print("{} items, capacity {}, M ops/s (push + pop)\n", ITEMS, CAPACITY);
+    fmt::print("{:>12} {:>16} {:>10} {:>10}\n", "threads", "ConcurrentQueue", "MPMCQueue",
+               "SPSCQueue");
+
+    const double concurrent_1 = throughput<BoundedConcurrentQueue>(1, 1);
+    const double mpmc_1 = throughput<MPMCQueue<uint64_t>>(1, 1);
+    const double spsc_1 = throughput<SPSCQueue<uint64_t>>(1, 1);
+    fmt::print("{:>12} {:>16.3f} {:>10.3f} {:>10.3f}\n", "1P / 1C", concurrent_1, mpmc_1, spsc_1);
+
+    for (const uint32_t threads : {2u, 4u, 8u}) {
+        const double concurrent = throughput<BoundedConcurrentQueue>(threads, threads);
+        const double mpmc = throughput<MPMCQueue<uint64_t>>(threads, threads);
+        const std::string label = fmt::format("{}P / {}C", threads, threads);
+        fmt::print("{:>12} {:>16.3f} {:>10.3f} {:>10}\n", label, concurrent, mpmc, "-");
+    }
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+// Task throughput of the work-stealing ThreadPool compared with the previous implementation, a
+// fixed number of threads that pop std::function tasks from one ConcurrentQueue.
+//
+// flat:   the main thread submits many small tasks.
+// nested: every task submits two child tasks from a worker thread (binary tree).
+
+#include "common.hpp"
+
+#include "merian/utils/concurrent/concurrent_queue.hpp"
+#include "merian/utils/concurrent/thread_pool.hpp"
+
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <thread>
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t FLAT_TASKS = 200000;
+constexpr uint32_t NESTED_DEPTH = 17;
+constexpr uint32_t REPETITIONS = 3;
+constexpr uint32_t THREAD_COUNTS[] = {1, 2, 4, 8, 16, 32, 64};
+
+// The thread pool before the work-stealing rework.
+class MutexQueuePool {
+  public:
+    MutexQueuePool(const uint32_t concurrency) {
+        for (uint32_t i = 0; i < concurrency; i++) {
+            threads.emplace_back([&] {
+                while (true) {
+                    const std::optional<std::function<void()>> task = tasks.pop();
+                    if (!task) {
+                        return;
+                    }
+                    task.value()();
+                }
+            });
+        }
+    }
+
+    ~MutexQueuePool() {
+        for (uint32_t i = 0; i < threads.size(); i++) {
+            tasks.push(std::nullopt);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    template <typename F> void post(F&& function) {
+        tasks.push(std::function<void()>(std::forward<F>(function)));
+    }
+
+  private:
+    std::vector<std::thread> threads;
+    ConcurrentQueue<std::optional<std::function<void()>>> tasks;
+};
+
+class WorkStealingPool {
+  public:
+    WorkStealingPool(const uint32_t concurrency) : pool(concurrency) {}
+
+    template <typename F> void post(F&& function) {
+        pool.submit_detached(std::forward<F>(function));
+    }
+
+  private:
+    ThreadPool pool;
+};
+
+void wait_for(const std::atomic<uint32_t>& counter, const uint32_t value) {
+    while (counter.load(std::memory_order_acquire) < value) {
+        std::this_thread::yield();
+    }
+}
+
+template <typename Pool> void run_flat(Pool& pool) {
+    std::atomic<uint32_t> done{0};
+    for (uint32_t i = 0; i < FLAT_TASKS; i++) {
+        pool.post([&done] { done.fetch_add(1, std::memory_order_release); });
+    }
+    wait_for(done, FLAT_TASKS);
+}
+
+template <typename Pool>
+void spawn(Pool& pool, std::atomic<uint32_t>& done, const uint32_t depth) {
+    if (depth > 0) {
+        pool.post([&pool, &done, depth] { spawn(pool, done, depth - 1); });
+        pool.post([&pool, &done, depth] { spawn(pool, done, depth - 1); });
+    }
+    done.fetch_add(1, std::memory_order_release);
+}
+
+constexpr uint32_t NESTED_TASKS = (2u << NESTED_DEPTH) - 1;
+
+template <typename Pool> void run_nested(Pool& pool) {
+    std::atomic<uint32_t> done{0};
+    pool.post([&pool, &done] { spawn(pool, done, NESTED_DEPTH); });
+    wait_for(done, NESTED_TASKS);
+}
+
+// Returns million tasks per second.
+template <typename Pool> double flat_throughput(const uint32_t threads) {
+    Pool pool(threads);
+    return FLAT_TASKS / measure_seconds(REPETITIONS, [&] { run_flat(pool); }) * 1e-6;
+}
+
+template <typename Pool> double nested_throughput(const uint32_t threads) {
+    Pool pool(threads);
+    return NESTED_TASKS / measure_seconds(REPETITIONS, [&] { run_nested(pool); }) * 1e-6;
+}
+
+} // namespace
+
+int main() {
+    fmt::print("{} flat tasks, {} nested tasks, Mtasks/s (speedup)\n", FLAT_TASKS, NESTED_TASKS);
+    fmt::print("{:>8} {:>10} {:>10} {:>8} {:>10} {:>10} {:>8}\n", "threads", "flat mutex",
+               "flat ws", "", "nest mutex", "nest ws", "");
+    for (const uint32_t threads : THREAD_COUNTS) {
+        const double flat_mutex = flat_throughput<MutexQueuePool>(threads);
+        const double flat_ws = flat_throughput<WorkStealingPool>(threads);
+        const double nested_mutex = nested_throughput<MutexQueuePool>(threads);
+        const double nested_ws = nested_throughput<WorkStealingPool>(threads);
+        fmt::print("{:>8} {:>10.3f} {:>10.3f} {:>7.2f}x {:>10.3f} {:>10.3f} {:>7.2f}x\n", threads,
+                   flat_mutex, flat_ws, flat_ws / flat_mutex, nested_mutex, nested_ws,
+                   nested_ws / nested_mutex);
+    }
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "merian/utils/vector.hpp"
+#include "merian/vk/context.hpp"
+#include "merian/vk/memory/resource_allocator.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <memory>
+#include <vector>
+
+// Shared helpers for the tests and benchmarks in this directory.
+
+// meson reports a test that exits with this code as skipped.
+constexpr int MERIAN_TEST_SKIP = 77;
+
+// Like assert(), but also checked in release builds.
+#define MERIAN_TEST_CHECK(condition)                                                               \
+    do {                                                                                           \
+        if (!(condition)) {                                                                        \
+            fmt::print(stderr, "{}:{}: check failed: {}\n", __FILE__, __LINE__, #condition);       \
+            std::exit(EXIT_FAILURE);                                                               \
+        }                                                                                          \
+    } while (0)
+
+// Returns nullptr if no Vulkan device is available (the test should then be skipped).
+inline merian::ContextHandle
+create_test_context(const std::vector<std::shared_ptr<merian::Extension>>& extensions = {}) {
+    try {
+        return merian::Context::create(extensions, "merian-test");
+    } catch (const std::exception& e) {
+        fmt::print(stderr, "could not create a Vulkan context: {}\n", e.what());
+        return nullptr;
+    }
+}
+
+// Runs the function the given number of times and returns the average duration in seconds.
+template <typename F> double measure_seconds(const uint32_t iterations, const F& function) {
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        function();
+    }
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    return duration.count() / iterations;
+}
+
+// A host-visible buffer with the data, e.g. geometry for acceleration structure builds.
+template <typename T>
+merian::BufferHandle create_mapped_buffer(const merian::ResourceAllocatorHandle& allocator,
+                                          const std::vector<T>& data,
+                                          const vk::BufferUsageFlags usage) {
+    const merian::BufferHandle buffer = allocator->createBuffer(
+        merian::size_of(data), usage, merian::MemoryMappingType::HOST_ACCESS_SEQUENTIAL_WRITE,
+        "test buffer");
+    std::memcpy(buffer->get_memory()->map(), data.data(), merian::size_of(data));
+    buffer->get_memory()->unmap();
+    return buffer;
+}
@@ -0,0 +1,188 @@
+// The deferred BLAS compaction of DeviceASBuilder over several iterations: the compacted size is
+// queried in the iteration of the build and read when its in-flight data is reused, then the BLAS
+// is replaced by the compacted copy and the instance is re-uploaded. Queries of BLASes that were
+// updated or rebuilt in the meantime are dropped, a compacted BLAS is rebuilt into a new one.
+
+#include "common.hpp"
+
+#include "merian-nodes/nodes/as_builder/device_as_builder.hpp"
+#include "merian/vk/extension/extension_resources.hpp"
+#include "merian/vk/extension/extension_vk_acceleration_structure.hpp"
+
+#include <algorithm>
+#include <array>
+
+using namespace merian;
+using namespace merian_nodes;
+
+namespace {
+
+// quads in each direction
+constexpr uint32_t GRID_SIZE = 64;
+
+constexpr vk::BufferUsageFlags GEOMETRY_USAGE =
+    vk::BufferUsageFlagBits::eShaderDeviceAddress |
+    vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+
+constexpr vk::BuildAccelerationStructureFlagsKHR COMPACTABLE =
+    vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
+    vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction |
+    vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
+
+vk::DeviceAddress address(const AccelerationStructureHandle& as) {
+    return as->get_acceleration_structure_device_address();
+}
+
+vk::DeviceSize as_size(const AccelerationStructureHandle& as) {
+    return as->get_size_info().accelerationStructureSize;
+}
+
+} // namespace
+
+int main() {
+    const auto resources = std::make_shared<ExtensionResources>();
+    const auto acceleration_structure = std::make_shared<ExtensionVkAccelerationStructure>();
+    const ContextHandle context = create_test_context({resources, acceleration_structure});
+    if (!context || !context->get_extension<ExtensionVkAccelerationStructure>()) {
+        return MERIAN_TEST_SKIP;
+    }
+    const ResourceAllocatorHandle allocator = resources->resource_allocator();
+    const QueueHandle queue = context->get_queue_GCT();
+    const CommandPoolHandle cmd_pool = std::make_shared<CommandPool>(queue);
+
+    std::vector<float> positions;
+    for (uint32_t y = 0; y <= GRID_SIZE; y++) {
+        for (uint32_t x = 0; x <= GRID_SIZE; x++) {
+            positions.insert(positions.end(), {(float)x, (float)y, (float)((x * y) % 7)});
+        }
+    }
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y < GRID_SIZE; y++) {
+        for (uint32_t x = 0; x < GRID_SIZE; x++) {
+            const uint32_t a = y * (GRID_SIZE + 1) + x;
+            const uint32_t b = a + 1, c = a + GRID_SIZE + 2, d = a + GRID_SIZE + 1;
+            indices.insert(indices.end(), {a, b, c, a, c, d});
+        }
+    }
+    const uint32_t vertex_count = positions.size() / 3;
+    const uint32_t triangle_count = indices.size() / 3;
+    const BufferHandle vertex_buffer = create_mapped_buffer(allocator, positions, GEOMETRY_USAGE);
+    const BufferHandle index_buffer = create_mapped_buffer(allocator, indices, GEOMETRY_USAGE);
+
+    const auto create_blas_info = [&](const vk::BuildAccelerationStructureFlagsKHR flags) {
+        const auto blas_info = std::make_shared<DeviceASBuilder::BlasBuildInfo>(flags);
+        blas_info->add_geometry_f32_u32(vertex_count, triangle_count, vertex_buffer,
+                                        index_buffer);
+        return blas_info;
+    };
+
+    DeviceASBuilder builder(context, allocator);
+    DeviceASBuilder::TlasBuildInfo tlas_info;
+    // the graph reuses in-flight data after waiting for the iteration that used it before
+    std::array<DeviceASBuilder::InFlightData, 2> in_flight_data;
+    uint32_t iteration = 0;
+    // Records and submits one iteration, waits until it finished.
+    const auto run_iteration = [&]() -> DeviceASBuilder::InFlightData& {
+        DeviceASBuilder::InFlightData& data = in_flight_data[iteration++ % in_flight_data.size()];
+        const vk::CommandBuffer cmd = cmd_pool->create_and_begin();
+        builder.record_builds(cmd, tlas_info, data, vk::PipelineStageFlagBits2::eComputeShader);
+        cmd.end();
+        queue->submit_wait(cmd);
+        cmd_pool->reset();
+        return data;
+    };
+
+    const auto plain =
+        create_blas_info(vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+    const auto a = create_blas_info(COMPACTABLE);
+    tlas_info.add_instance(plain).add_instance(a);
+
+    // 1. Build, only the compactable BLAS is queried.
+    const DeviceASBuilder::InFlightData& first = run_iteration();
+    MERIAN_TEST_CHECK(first.compaction_queries.size() == 1);
+    MERIAN_TEST_CHECK(a->get_build_count() == 1 && !a->is_compacted());
+    const AccelerationStructureHandle original = a->get_blas();
+    MERIAN_TEST_CHECK(tlas_info.get_instance(1).accelerationStructureReference ==
+                      address(original));
+
+    const uint64_t compacted_size =
+        first.compaction_query_pool->get_query_pool_results_64(0, 1)[0];
+    fmt::print("BLAS with {} triangles: {} bytes, compacted {} bytes\n", triangle_count,
+               as_size(original), compacted_size);
+    if (compacted_size == 0 || compacted_size >= as_size(original)) {
+        fmt::print("compaction does not reduce the size on this device\n");
+        return MERIAN_TEST_SKIP;
+    }
+
+    // 2. The other in-flight data, nothing to do.
+    const AccelerationStructureHandle tlas = tlas_info.get_tlas();
+    run_iteration();
+    MERIAN_TEST_CHECK(a->get_blas() == original);
+    MERIAN_TEST_CHECK(tlas_info.get_tlas() == tlas);
+    MERIAN_TEST_CHECK(builder.get_last_instance_upload_ranges() == 0);
+
+    // 3. The first in-flight data is reused: the BLAS is swapped for the compacted copy, only its
+    // instance is uploaded and the TLAS is rebuilt. The original lives until the iteration ends.
+    const vk::DeviceAddress plain_address =
+        tlas_info.get_instance(0).accelerationStructureReference;
+    const DeviceASBuilder::InFlightData& third = run_iteration();
+    MERIAN_TEST_CHECK(a->is_compacted() && a->get_blas() != original);
+    MERIAN_TEST_CHECK(as_size(a->get_blas()) == compacted_size);
+    MERIAN_TEST_CHECK(a->get_build_count() == 1);
+    MERIAN_TEST_CHECK(builder.get_compacted_blas_count() == 1);
+    MERIAN_TEST_CHECK(tlas_info.get_instance(1).accelerationStructureReference ==
+                      address(a->get_blas()));
+    MERIAN_TEST_CHECK(tlas_info.get_instance(0).accelerationStructureReference == plain_address);
+    MERIAN_TEST_CHECK(builder.get_last_instance_upload_ranges() == 1);
+    MERIAN_TEST_CHECK(builder.get_last_instance_upload_bytes() ==
+                      sizeof(vk::AccelerationStructureInstanceKHR));
+    MERIAN_TEST_CHECK(tlas_info.get_tlas() != tlas);
+    MERIAN_TEST_CHECK(std::ranges::find(third.blases, original) != third.blases.end());
+    MERIAN_TEST_CHECK(third.compaction_queries.empty());
+
+    // 4. An update (b) or a rebuild (c) between the query and the readback drops the query. The
+    // rebuild is queried again.
+    const auto b = create_blas_info(COMPACTABLE);
+    const auto c = create_blas_info(COMPACTABLE);
+    tlas_info.add_instance(b).add_instance(c);
+    run_iteration();
+    const AccelerationStructureHandle b_blas = b->get_blas();
+    const AccelerationStructureHandle c_blas = c->get_blas();
+    b->request_update();
+    c->request_rebuild();
+    const DeviceASBuilder::InFlightData& fifth = run_iteration();
+    MERIAN_TEST_CHECK(b->get_build_count() == 2 && c->get_build_count() == 2);
+    MERIAN_TEST_CHECK(fifth.compaction_queries.size() == 1);
+    MERIAN_TEST_CHECK(fifth.compaction_queries[0].blas_info == c);
+
+    run_iteration();
+    MERIAN_TEST_CHECK(!b->is_compacted() && b->get_blas() == b_blas);
+    MERIAN_TEST_CHECK(!c->is_compacted() && c->get_blas() == c_blas);
+    MERIAN_TEST_CHECK(builder.get_compacted_blas_count() == 1);
+
+    run_iteration();
+    MERIAN_TEST_CHECK(!b->is_compacted() && b->get_blas() == b_blas);
+    MERIAN_TEST_CHECK(c->is_compacted() && c->get_blas() != c_blas);
+    MERIAN_TEST_CHECK(builder.get_compacted_blas_count() == 2);
+
+    // 5. A compacted BLAS is too small to be rebuilt in place, a new one is built and compacted
+    // again.
+    const AccelerationStructureHandle compacted = a->get_blas();
+    a->request_rebuild();
+    run_iteration();
+    MERIAN_TEST_CHECK(!a->is_compacted() && a->get_blas() != compacted);
+    MERIAN_TEST_CHECK(as_size(a->get_blas()) == as_size(original));
+    MERIAN_TEST_CHECK(a->get_build_count() == 2);
+    MERIAN_TEST_CHECK(tlas_info.get_instance(1).accelerationStructureReference ==
+                      address(a->get_blas()));
+
+    run_iteration();
+    MERIAN_TEST_CHECK(!a->is_compacted());
+    run_iteration();
+    MERIAN_TEST_CHECK(a->is_compacted());
+    MERIAN_TEST_CHECK(tlas_info.get_instance(1).accelerationStructureReference ==
+                      address(a->get_blas()));
+    MERIAN_TEST_CHECK(builder.get_compacted_blas_count() == 3);
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Index allocation and recycling of the BindlessHeap and the deferred descriptor rewrite of
+// Texture::set_sampler().
+
+#include "common.hpp"
+
+#include "merian/vk/descriptors/bindless_heap.hpp"
+#include "merian/vk/extension/extension_resources.hpp"
+
+#include <set>
+
+using namespace merian;
+
+namespace {
+
+TextureHandle create_texture(const ResourceAllocatorHandle& allocator) {
+    const vk::ImageCreateInfo info{
+        {},
+        vk::ImageType::e2D,
+        vk::Format::eR8G8B8A8Unorm,
+        {4, 4, 1},
+        1,
+        1,
+        vk::SampleCountFlagBits::e1,
+        vk::ImageTiling::eOptimal,
+        vk::ImageUsageFlagBits::eSampled,
+    };
+    const ImageHandle image = allocator->createImage(info, MemoryMappingType::NONE, "test image");
+    return allocator->createTexture(image, "test texture");
+}
+
+BufferHandle create_buffer(const ResourceAllocatorHandle& allocator) {
+    return allocator->createBuffer(256, vk::BufferUsageFlagBits::eStorageBuffer,
+                                   MemoryMappingType::NONE, "test buffer");
+}
+
+} // namespace
+
+int main() {
+    const auto resources = std::make_shared<ExtensionResources>();
+    const ContextHandle context = create_test_context({resources});
+    if (!context || !resources->bindless_heap()) {
+        return MERIAN_TEST_SKIP;
+    }
+    const ResourceAllocatorHandle allocator = resources->resource_allocator();
+    const BindlessHeapHandle heap = allocator->get_bindless_heap();
+    MERIAN_TEST_CHECK(heap);
+
+    // registered on creation with distinct indices
+    std::vector<TextureHandle> textures;
+    std::vector<BufferHandle> buffers;
+    std::set<uint32_t> texture_indices;
+    std::set<uint32_t> buffer_indices;
+    for (uint32_t i = 0; i < 8; i++) {
+        textures.emplace_back(create_texture(allocator));
+        buffers.emplace_back(create_buffer(allocator));
+        MERIAN_TEST_CHECK(textures.back()->get_bindless_index() != BindlessHeap::INVALID_INDEX);
+        MERIAN_TEST_CHECK(buffers.back()->get_bindless_index() != BindlessHeap::INVALID_INDEX);
+        texture_indices.insert(textures.back()->get_bindless_index());
+        buffer_indices.insert(buffers.back()->get_bindless_index());
+    }
+    MERIAN_TEST_CHECK(texture_indices.size() == 8 && buffer_indices.size() == 8);
+
+    // freed indices are not reused before their set is released
+    const uint32_t freed_texture = textures.back()->get_bindless_index();
+    const uint32_t freed_buffer = buffers.back()->get_bindless_index();
+    textures.pop_back();
+    buffers.pop_back();
+    const TextureHandle texture_in_flight = create_texture(allocator);
+    const BufferHandle buffer_in_flight = create_buffer(allocator);
+    MERIAN_TEST_CHECK(texture_in_flight->get_bindless_index() != freed_texture);
+    MERIAN_TEST_CHECK(buffer_in_flight->get_bindless_index() != freed_buffer);
+
+    const BindlessHeap::SetID set_id = heap->finalize_release_set();
+    MERIAN_TEST_CHECK(create_texture(allocator)->get_bindless_index() != freed_texture);
+    heap->release_set(set_id);
+    MERIAN_TEST_CHECK(create_texture(allocator)->get_bindless_index() == freed_texture);
+    MERIAN_TEST_CHECK(create_buffer(allocator)->get_bindless_index() == freed_buffer);
+
+    // changing the sampler keeps the index, the rewrite waits for apply_pending_updates()
+    const TextureHandle& texture = textures.front();
+    const uint32_t index = texture->get_bindless_index();
+    MERIAN_TEST_CHECK(!heap->has_pending_updates());
+    texture->set_sampler(allocator->get_sampler_pool()->nearest_repeat());
+    texture->set_sampler(allocator->get_sampler_pool()->linear_repeat());
+    MERIAN_TEST_CHECK(texture->get_bindless_index() == index);
+    MERIAN_TEST_CHECK(heap->has_pending_updates());
+    context->device.waitIdle();
+    heap->apply_pending_updates();
+    MERIAN_TEST_CHECK(!heap->has_pending_updates());
+    MERIAN_TEST_CHECK(texture->get_bindless_index() == index);
+
+    // destroying a texture with a pending rewrite drops the rewrite
+    textures[1]->set_sampler(allocator->get_sampler_pool()->nearest_repeat());
+    MERIAN_TEST_CHECK(heap->has_pending_updates());
+    textures.erase(textures.begin() + 1);
+    MERIAN_TEST_CHECK(!heap->has_pending_updates());
+
+    return 0;
+}
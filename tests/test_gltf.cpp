@@ -0,0 +1,130 @@
+// Loads a glTF file with a single triangle on two threads at the same time (each load uses a
+// staging memory manager of its own) and reads the geometry back.
+
+#include "common.hpp"
+
+#include "merian/io/gltf.hpp"
+#include "merian/vk/extension/extension_resources.hpp"
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+
+using namespace merian;
+
+namespace {
+
+const std::filesystem::path GLTF_PATH = "test_gltf.gltf";
+
+// Positions (0,0,0), (1,0,0), (0,1,0) and the 16 bit indices 0, 1, 2 (padded to 44 bytes).
+constexpr char GLTF[] = R"({
+  "asset": {"version": "2.0"},
+  "scene": 0,
+  "scenes": [{"nodes": [0]}],
+  "nodes": [{"mesh": 0, "translation": [0, 0, 2]}],
+  "meshes": [{"name": "triangle",
+              "primitives": [{"attributes": {"POSITION": 0}, "indices": 1}]}],
+  "buffers": [{"byteLength": 44, "uri":
+"data:application/octet-stream;base64,AAAAAAAAAAAAAAAAAACAPwAAAAAAAAAAAAAAAAAAgD8AAAAAAAABAAIAAAA="
+  }],
+  "bufferViews": [{"buffer": 0, "byteOffset": 0, "byteLength": 36},
+                  {"buffer": 0, "byteOffset": 36, "byteLength": 6}],
+  "accessors": [{"bufferView": 0, "componentType": 5126, "count": 3, "type": "VEC3",
+                 "min": [0, 0, 0], "max": [1, 1, 0]},
+                {"bufferView": 1, "componentType": 5123, "count": 3, "type": "SCALAR"}]
+})";
+
+// Copies the range of the buffer into host memory.
+std::vector<uint8_t> read_back(const ResourceAllocatorHandle& allocator,
+                               const QueueHandle& queue,
+                               const BufferHandle& buffer,
+                               const vk::DeviceSize offset,
+                               const vk::DeviceSize size) {
+    const BufferHandle host = allocator->createBuffer(
+        size, vk::BufferUsageFlagBits::eTransferDst, MemoryMappingType::HOST_ACCESS_RANDOM,
+        "test read back");
+    queue->submit_wait([&](const vk::CommandBuffer& cmd) {
+        cmd.copyBuffer(*buffer, *host, vk::BufferCopy{offset, 0, size});
+    });
+
+    std::vector<uint8_t> result(size);
+    host->get_memory()->invalidate();
+    std::memcpy(result.data(), host->get_memory()->map(), size);
+    host->get_memory()->unmap();
+    return result;
+}
+
+void check_scene(const GLTFSceneHandle& scene,
+                 const ResourceAllocatorHandle& allocator,
+                 const QueueHandle& queue) {
+    MERIAN_TEST_CHECK(scene->get_meshes().size() == 1);
+    MERIAN_TEST_CHECK(scene->get_meshes()[0].name == "triangle");
+    MERIAN_TEST_CHECK(scene->get_instances().size() == 1);
+    MERIAN_TEST_CHECK(scene->get_instances()[0].transform[3].z == 2);
+    MERIAN_TEST_CHECK(scene->get_primitives().size() == 1);
+
+    const GLTFScene::Primitive& primitive = scene->get_primitives()[0];
+    MERIAN_TEST_CHECK(primitive.vertex_count == 3 && primitive.index_count == 3);
+    MERIAN_TEST_CHECK(primitive.material == -1);
+
+    const std::vector<uint8_t> indices =
+        read_back(allocator, queue, primitive.index_buffer, primitive.index_offset,
+                  primitive.index_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < 3; i++) {
+        uint32_t index;
+        std::memcpy(&index, indices.data() + i * sizeof(uint32_t), sizeof(uint32_t));
+        MERIAN_TEST_CHECK(index == i);
+    }
+
+    const std::vector<uint8_t> vertices =
+        read_back(allocator, queue, primitive.vertex_buffer, primitive.vertex_offset,
+                  primitive.vertex_count * sizeof(GLTFScene::Vertex));
+    GLTFScene::Vertex vertex;
+    std::memcpy(&vertex, vertices.data() + sizeof(GLTFScene::Vertex), sizeof(GLTFScene::Vertex));
+    MERIAN_TEST_CHECK(vertex.position.x == 1 && vertex.position.y == 0 && vertex.position.z == 0);
+}
+
+} // namespace
+
+int main() {
+    const auto resources = std::make_shared<ExtensionResources>();
+    const ContextHandle context = create_test_context({resources});
+    if (!context) {
+        return MERIAN_TEST_SKIP;
+    }
+    const ResourceAllocatorHandle allocator = resources->resource_allocator();
+    const QueueHandle queue = context->get_queue_GCT();
+
+    std::ofstream(GLTF_PATH, std::ios::binary) << GLTF;
+
+    std::array<std::future<GLTFSceneHandle>, 2> loads;
+    for (auto& load : loads) {
+        load = std::async(std::launch::async,
+                          [&] { return GLTFScene::load(GLTF_PATH, allocator, queue); });
+    }
+    std::vector<GLTFSceneHandle> scenes;
+    for (auto& load : loads) {
+        try {
+            scenes.emplace_back(load.get());
+        } catch (const std::runtime_error& e) {
+            fmt::print(stderr, "{}\n", e.what());
+            if (std::string(e.what()).starts_with("tinygltf is not available")) {
+                std::filesystem::remove(GLTF_PATH);
+                return MERIAN_TEST_SKIP;
+            }
+            return EXIT_FAILURE;
+        }
+    }
+    std::filesystem::remove(GLTF_PATH);
+
+    for (const GLTFSceneHandle& scene : scenes) {
+        check_scene(scene, allocator, queue);
+    }
+    // every load has its own buffers
+    MERIAN_TEST_CHECK(scenes[0]->get_buffers()[0] != scenes[1]->get_buffers()[0]);
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Builds a BLAS on the host, loads it from the cache directory and checks that invalid geometry
+// is rejected. Skipped if the device does not support acceleration structure host commands.
+
+#include "common.hpp"
+
+#include "merian/vk/extension/extension_resources.hpp"
+#include "merian/vk/extension/extension_vk_acceleration_structure.hpp"
+#include "merian/vk/raytrace/host_as_builder.hpp"
+
+#include <filesystem>
+
+using namespace merian;
+
+namespace {
+
+const std::filesystem::path CACHE_DIR = "test_host_as_builder_cache";
+
+// Checks that the build fails with std::runtime_error.
+void check_rejected(HostASBuilder& builder, const HostASBuilder::Geometry& geometry) {
+    try {
+        builder.build({geometry}).get();
+    } catch (const std::runtime_error& e) {
+        fmt::print("rejected: {}\n", e.what());
+        return;
+    }
+    MERIAN_TEST_CHECK(false);
+}
+
+} // namespace
+
+int main() {
+    const auto resources = std::make_shared<ExtensionResources>();
+    const auto acceleration_structure = std::make_shared<ExtensionVkAccelerationStructure>();
+    const ContextHandle context = create_test_context({resources, acceleration_structure});
+    if (!context || !HostASBuilder::is_supported(context)) {
+        return MERIAN_TEST_SKIP;
+    }
+    const ResourceAllocatorHandle allocator = resources->resource_allocator();
+    std::filesystem::remove_all(CACHE_DIR);
+
+    const float positions[] = {0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 0};
+    const uint32_t indices[] = {0, 1, 2, 1, 3, 2, 0};
+    const HostASBuilder::Geometry quad{positions, 4, 3 * sizeof(float), indices, 6};
+
+    {
+        HostASBuilder builder(context, allocator, CACHE_DIR);
+        const AccelerationStructureHandle blas = builder.build({quad}).get();
+        MERIAN_TEST_CHECK(blas->get_acceleration_structure_device_address() != 0);
+        MERIAN_TEST_CHECK(builder.get_build_count() == 1 && builder.get_cache_hit_count() == 0);
+        const uint64_t hash = HostASBuilder::hash_geometry(
+            {quad}, vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+        MERIAN_TEST_CHECK(std::filesystem::exists(CACHE_DIR / fmt::format("{:016x}.blas", hash)));
+
+        // a trailing partial triangle and geometry without vertices
+        HostASBuilder::Geometry partial = quad;
+        partial.index_count = 7;
+        check_rejected(builder, partial);
+        const HostASBuilder::Geometry empty{positions, 0, 3 * sizeof(float), indices, 0};
+        check_rejected(builder, empty);
+        MERIAN_TEST_CHECK(builder.get_build_count() == 1);
+    }
+
+    {
+        // the driver decides if the entry is compatible, either way the BLAS is built only once
+        HostASBuilder builder(context, allocator, CACHE_DIR);
+        const AccelerationStructureHandle blas = builder.build({quad}).get();
+        MERIAN_TEST_CHECK(blas);
+        MERIAN_TEST_CHECK(builder.get_build_count() + builder.get_cache_hit_count() == 1);
+        fmt::print("cache hits: {}\n", builder.get_cache_hit_count());
+    }
+
+    std::filesystem::remove_all(CACHE_DIR);
+    return 0;
+}
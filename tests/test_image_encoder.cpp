@@ -0,0 +1,198 @@
+// Round trip of ImageEncoder through stb_image: PNG (every compression) and HDR must decode
+// exactly, JPEG within a tolerance. Odd sizes and small stripes test partial MCUs, many restart
+// intervals and many IDAT chunks. PNG BEST must be smaller than DEFAULT on a noisy image.
+
+#include "common.hpp"
+
+#include "merian/io/image_encoder.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace merian;
+
+namespace {
+
+constexpr std::pair<uint32_t, uint32_t> SIZES[] = {{1, 1}, {7, 3}, {37, 23}, {257, 131}};
+constexpr uint32_t STRIPE_HEIGHTS[] = {0, 1, 8, 13};
+
+uint32_t noise(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// A gradient with noise and flat regions.
+std::vector<uint8_t> create_ldr(const uint32_t width, const uint32_t height) {
+    std::vector<uint8_t> pixels(4ul * width * height);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            for (uint32_t c = 0; c < 4; c++) {
+                const std::size_t i = 4ul * (y * width + x) + c;
+                pixels[i] = x < width / 4 ? 64 * c : (x * 3 + y * (c + 1) + noise(i) % 24) & 0xff;
+            }
+        }
+    }
+    return pixels;
+}
+
+// Values that are exactly representable in RGBE (all components use the exponent of the
+// largest), such that the round trip is exact.
+std::vector<float> create_hdr(const uint32_t width, const uint32_t height) {
+    std::vector<float> pixels(4ul * width * height);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            const std::size_t i = 4ul * (y * width + x);
+            const uint32_t n = noise(i);
+            if (x % 16 < 5) {
+                // runs
+                pixels[i] = pixels[i + 1] = pixels[i + 2] = 0;
+                pixels[i + 3] = 1;
+                continue;
+            }
+            const int exponent = (int)(n % 9) - 4;
+            const uint32_t max_mantissa = 128 + n / 9 % 128;
+            for (uint32_t c = 0; c < 3; c++) {
+                const uint32_t mantissa =
+                    c == y % 3 ? max_mantissa : noise(i + c) % (max_mantissa + 1);
+                pixels[i + c] = std::ldexp((float)mantissa, exponent - 8);
+            }
+            pixels[i + 3] = 1;
+        }
+    }
+    return pixels;
+}
+
+struct StbiDeleter {
+    void operator()(void* data) const {
+        stbi_image_free(data);
+    }
+};
+
+template <typename T> using StbiImage = std::unique_ptr<T, StbiDeleter>;
+
+template <typename T>
+StbiImage<T> decode(const std::string& encoded, const uint32_t width, const uint32_t height) {
+    int w, h, channels;
+    const auto* data = reinterpret_cast<const stbi_uc*>(encoded.data());
+    T* pixels;
+    if constexpr (std::is_same_v<T, float>) {
+        pixels = stbi_loadf_from_memory(data, encoded.size(), &w, &h, &channels, 4);
+    } else {
+        pixels = stbi_load_from_memory(data, encoded.size(), &w, &h, &channels, 4);
+    }
+    if (!pixels) {
+        fmt::print(stderr, "decoding failed: {}\n", stbi_failure_reason());
+    }
+    MERIAN_TEST_CHECK(pixels);
+    MERIAN_TEST_CHECK(w == (int)width && h == (int)height);
+    return StbiImage<T>(pixels);
+}
+
+void test_png(ThreadPool& pool) {
+    for (const auto& [width, height] : SIZES) {
+        const std::vector<uint8_t> pixels = create_ldr(width, height);
+        for (const auto compression :
+             {ImageEncoder::Compression::NONE, ImageEncoder::Compression::FASTEST,
+              ImageEncoder::Compression::FAST, ImageEncoder::Compression::DEFAULT,
+              ImageEncoder::Compression::BEST}) {
+            for (const uint32_t stripe_height : STRIPE_HEIGHTS) {
+                ImageEncoder::Options options;
+                options.compression = compression;
+                options.stripe_height = stripe_height;
+                std::ostringstream out;
+                ImageEncoder(pool, options).write_png(out, pixels.data(), width, height);
+
+                const StbiImage<uint8_t> decoded = decode<uint8_t>(out.str(), width, height);
+                MERIAN_TEST_CHECK(std::equal(pixels.begin(), pixels.end(), decoded.get()));
+            }
+        }
+    }
+}
+
+void test_png_best(ThreadPool& pool) {
+    const uint32_t width = 512, height = 256;
+    const std::vector<uint8_t> pixels = create_ldr(width, height);
+    std::size_t sizes[2];
+    for (const auto compression :
+         {ImageEncoder::Compression::DEFAULT, ImageEncoder::Compression::BEST}) {
+        ImageEncoder::Options options;
+        options.compression = compression;
+        std::ostringstream out;
+        ImageEncoder(pool, options).write_png(out, pixels.data(), width, height);
+        sizes[compression == ImageEncoder::Compression::BEST] = out.str().size();
+    }
+    fmt::print("PNG {}x{}: default {} bytes, best {} bytes\n", width, height, sizes[0], sizes[1]);
+    MERIAN_TEST_CHECK(sizes[1] < sizes[0]);
+}
+
+void test_jpg(ThreadPool& pool) {
+    for (const auto& [width, height] : SIZES) {
+        const std::vector<uint8_t> pixels = create_ldr(width, height);
+        // 4:4:4 and 4:2:0 (below quality 90)
+        for (const int quality : {95, 80}) {
+            std::string first;
+            for (const uint32_t stripe_height : STRIPE_HEIGHTS) {
+                ImageEncoder::Options options;
+                options.quality = quality;
+                options.stripe_height = stripe_height;
+                std::ostringstream out;
+                ImageEncoder(pool, options).write_jpg(out, pixels.data(), width, height);
+
+                // every MCU row is a restart interval, the stripes must not change the result
+                if (first.empty()) {
+                    first = out.str();
+                }
+                MERIAN_TEST_CHECK(out.str() == first);
+
+                const StbiImage<uint8_t> decoded = decode<uint8_t>(out.str(), width, height);
+                double error = 0;
+                for (std::size_t i = 0; i < pixels.size(); i++) {
+                    if (i % 4 != 3) {
+                        error += std::abs((int)pixels[i] - (int)decoded.get()[i]);
+                    }
+                }
+                // mean absolute error, the noise makes 4:2:0 lossy (libjpeg: 2.4 and 10.5 for the
+                // largest image)
+                error /= 3.0 * width * height;
+                MERIAN_TEST_CHECK(error < (quality == 95 ? 4 : 16));
+            }
+        }
+    }
+}
+
+void test_hdr(ThreadPool& pool) {
+    for (const auto& [width, height] : SIZES) {
+        const std::vector<float> pixels = create_hdr(width, height);
+        for (const uint32_t stripe_height : STRIPE_HEIGHTS) {
+            ImageEncoder::Options options;
+            options.stripe_height = stripe_height;
+            std::ostringstream out;
+            ImageEncoder(pool, options).write_hdr(out, pixels.data(), width, height);
+
+            const StbiImage<float> decoded = decode<float>(out.str(), width, height);
+            MERIAN_TEST_CHECK(std::equal(pixels.begin(), pixels.end(), decoded.get()));
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    ThreadPool pool(3);
+    test_png(pool);
+    test_png_best(pool);
+    test_jpg(pool);
+    test_hdr(pool);
+    return 0;
+}
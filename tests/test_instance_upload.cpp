@@ -0,0 +1,123 @@
+// The dirty instance tracking of DeviceASBuilder::TlasBuildInfo and the coalescing of the ranges
+// into uploads. The uploads after a build need a device, without one only the host part runs and
+// the test is skipped.
+
+#include "common.hpp"
+
+#include "merian-nodes/nodes/as_builder/device_as_builder.hpp"
+#include "merian/vk/extension/extension_resources.hpp"
+#include "merian/vk/extension/extension_vk_acceleration_structure.hpp"
+
+using namespace merian;
+using namespace merian_nodes;
+
+namespace {
+
+using Ranges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+constexpr uint32_t DISTANCE = DeviceASBuilder::UPLOAD_MERGE_DISTANCE;
+
+Ranges coalesce(const Ranges& ranges) {
+    return DeviceASBuilder::coalesce_dirty_ranges(ranges);
+}
+
+void test_coalesce() {
+    MERIAN_TEST_CHECK(coalesce({}).empty());
+    MERIAN_TEST_CHECK(coalesce({{3, 4}}) == Ranges({{3, 4}}));
+
+    // sorted, overlapping and contained ranges are merged
+    MERIAN_TEST_CHECK(coalesce({{10, 20}, {0, 5}, {12, 15}, {3, 8}}) == Ranges({{0, 20}}));
+
+    // gaps of at most the merge distance are uploaded together, larger gaps are not
+    MERIAN_TEST_CHECK(coalesce({{0, 1}, {1 + DISTANCE, 2 + DISTANCE}}) ==
+                      Ranges({{0, 2 + DISTANCE}}));
+    MERIAN_TEST_CHECK(coalesce({{2 + DISTANCE, 3 + DISTANCE}, {0, 1}}) ==
+                      Ranges({{0, 1}, {2 + DISTANCE, 3 + DISTANCE}}));
+}
+
+void test_dirty_tracking() {
+    const auto blas_info = std::make_shared<DeviceASBuilder::BlasBuildInfo>(
+        vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+    DeviceASBuilder::TlasBuildInfo tlas_info;
+
+    // consecutive instances form one range
+    for (uint32_t i = 0; i < 100; i++) {
+        tlas_info.add_instance(blas_info);
+    }
+    MERIAN_TEST_CHECK(tlas_info.get_instance_count() == 100);
+    MERIAN_TEST_CHECK(tlas_info.get_dirty_ranges() == Ranges({{0, 100}}));
+
+    // transforms inside the last range do not add a range
+    vk::TransformMatrixKHR transform = merian::transform_identity();
+    transform.matrix[0][3] = 5;
+    tlas_info.set_transform(42, transform);
+    MERIAN_TEST_CHECK(tlas_info.get_dirty_ranges() == Ranges({{0, 100}}));
+    MERIAN_TEST_CHECK(tlas_info.get_transform(42).matrix[0][3] == 5);
+}
+
+// After a build only the changed instances are uploaded.
+void test_upload(const ContextHandle& context, const ResourceAllocatorHandle& allocator) {
+    const QueueHandle queue = context->get_queue_GCT();
+    const CommandPoolHandle cmd_pool = std::make_shared<CommandPool>(queue);
+    const vk::BufferUsageFlags geometry_usage =
+        vk::BufferUsageFlagBits::eShaderDeviceAddress |
+        vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+    const BufferHandle vertex_buffer =
+        create_mapped_buffer(allocator, std::vector<float>{0, 0, 0, 1, 0, 0, 0, 1, 0},
+                             geometry_usage);
+    const BufferHandle index_buffer =
+        create_mapped_buffer(allocator, std::vector<uint32_t>{0, 1, 2}, geometry_usage);
+    const auto blas_info = std::make_shared<DeviceASBuilder::BlasBuildInfo>(
+        vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+    blas_info->add_geometry_f32_u32(3, 1, vertex_buffer, index_buffer);
+
+    DeviceASBuilder builder(context, allocator);
+    DeviceASBuilder::TlasBuildInfo tlas_info;
+    DeviceASBuilder::InFlightData in_flight_data;
+    const auto run_iteration = [&]() {
+        const vk::CommandBuffer cmd = cmd_pool->create_and_begin();
+        builder.record_builds(cmd, tlas_info, in_flight_data,
+                              vk::PipelineStageFlagBits2::eComputeShader);
+        cmd.end();
+        queue->submit_wait(cmd);
+        cmd_pool->reset();
+    };
+
+    for (uint32_t i = 0; i < 100; i++) {
+        tlas_info.add_instance(blas_info);
+    }
+    run_iteration();
+    MERIAN_TEST_CHECK(tlas_info.get_dirty_ranges().empty());
+    MERIAN_TEST_CHECK(builder.get_last_instance_upload_ranges() == 1);
+
+    // a transform outside the last range starts a new range, close ranges are uploaded together
+    vk::TransformMatrixKHR transform = merian::transform_identity();
+    transform.matrix[0][3] = 1;
+    tlas_info.set_transform(10, transform);
+    tlas_info.set_transform(80, transform);
+    MERIAN_TEST_CHECK(tlas_info.get_dirty_ranges() == Ranges({{10, 11}, {80, 81}}));
+    tlas_info.set_transform(12, transform);
+    MERIAN_TEST_CHECK(tlas_info.get_dirty_ranges() == Ranges({{10, 11}, {80, 81}, {12, 13}}));
+    run_iteration();
+    MERIAN_TEST_CHECK(tlas_info.get_dirty_ranges().empty());
+    MERIAN_TEST_CHECK(builder.get_last_instance_upload_ranges() == 2);
+    MERIAN_TEST_CHECK(builder.get_last_instance_upload_bytes() ==
+                      4 * sizeof(vk::AccelerationStructureInstanceKHR));
+}
+
+} // namespace
+
+int main() {
+    test_coalesce();
+    test_dirty_tracking();
+
+    const auto resources = std::make_shared<ExtensionResources>();
+    const auto acceleration_structure = std::make_shared<ExtensionVkAccelerationStructure>();
+    const ContextHandle context = create_test_context({resources, acceleration_structure});
+    if (!context || !context->get_extension<ExtensionVkAccelerationStructure>()) {
+        return MERIAN_TEST_SKIP;
+    }
+    test_upload(context, resources->resource_allocator());
+
+    return 0;
+}
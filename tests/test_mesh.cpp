@@ -0,0 +1,100 @@
+// Parsing OBJ files and the mesh cache of Mesh::load_obj.
+
+#include "common.hpp"
+
+#include "merian/io/mesh.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+using namespace merian;
+
+namespace {
+
+const std::filesystem::path OBJ_PATH = "test_mesh.obj";
+const std::filesystem::path CACHE_PATH = "test_mesh.obj.meshcache";
+
+// A quad (two triangles after triangulation) and a triangle with a material.
+constexpr char OBJ[] = R"(# test
+v 0 0 0
+v 1 0 0
+v 1 1 0
+v 0 1 0
+vn 0 0 1
+vt 0 0
+o quad
+f 1//1 2//1 3//1 4//1
+o triangle
+usemtl red
+f 1/1 2/1 3/1
+)";
+
+void write_obj(const std::string& content) {
+    std::ofstream(OBJ_PATH, std::ios::binary) << content;
+}
+
+void check_mesh(const MeshHandle& mesh) {
+    MERIAN_TEST_CHECK(mesh->get_indices().size() == 9);
+    MERIAN_TEST_CHECK(mesh->get_parts().size() == 2);
+    MERIAN_TEST_CHECK(mesh->get_part_name(mesh->get_parts()[0]) == "quad");
+    MERIAN_TEST_CHECK(mesh->get_parts()[0].index_count == 6);
+    MERIAN_TEST_CHECK(mesh->get_parts()[0].material == -1);
+    MERIAN_TEST_CHECK(mesh->get_part_name(mesh->get_parts()[1]) == "triangle");
+    MERIAN_TEST_CHECK(mesh->get_material_count() == 1);
+    MERIAN_TEST_CHECK(mesh->get_material_name(0) == "red");
+    for (const uint32_t index : mesh->get_indices()) {
+        MERIAN_TEST_CHECK(index < mesh->get_vertices().size());
+    }
+    const Mesh::Vertex& vertex = mesh->get_vertices()[mesh->get_indices()[2]];
+    MERIAN_TEST_CHECK(vertex.position.x == 1 && vertex.position.y == 1 && vertex.position.z == 0);
+    MERIAN_TEST_CHECK(vertex.normal.z == 1);
+}
+
+} // namespace
+
+int main() {
+    std::filesystem::remove(CACHE_PATH);
+    write_obj(OBJ);
+
+    // parses and writes the cache
+    const MeshHandle parsed = Mesh::load_obj(OBJ_PATH);
+    MERIAN_TEST_CHECK(!parsed->is_cached());
+    check_mesh(parsed);
+    MERIAN_TEST_CHECK(std::filesystem::exists(CACHE_PATH));
+
+    // maps the cache
+    const MeshHandle cached = Mesh::load_obj(OBJ_PATH);
+    MERIAN_TEST_CHECK(cached->is_cached());
+    check_mesh(cached);
+    const Mesh::SourceStamp stamp = cached->get_source();
+    MERIAN_TEST_CHECK(stamp.size == std::filesystem::file_size(OBJ_PATH));
+
+    // only the modification time changed: the cache is used and its stamp updated
+    std::filesystem::last_write_time(OBJ_PATH, std::filesystem::last_write_time(OBJ_PATH) +
+                                                   std::chrono::hours(1));
+    const MeshHandle touched = Mesh::load_obj(OBJ_PATH);
+    MERIAN_TEST_CHECK(touched->is_cached());
+    MERIAN_TEST_CHECK(touched->get_source().mtime != stamp.mtime);
+    MERIAN_TEST_CHECK(touched->get_source().hash == stamp.hash);
+    const Mesh::SourceStamp updated = Mesh::read_cache(CACHE_PATH)->get_source();
+    MERIAN_TEST_CHECK(updated.mtime == touched->get_source().mtime);
+    MERIAN_TEST_CHECK(updated.mtime == Mesh::get_source_stamp(OBJ_PATH, false).mtime);
+
+    // same size, different content: parsed again and the cache rewritten
+    std::string changed = OBJ;
+    changed.replace(changed.find("v 1 1 0"), 7, "v 1 2 0");
+    write_obj(changed);
+    const MeshHandle reparsed = Mesh::load_obj(OBJ_PATH);
+    MERIAN_TEST_CHECK(!reparsed->is_cached());
+    MERIAN_TEST_CHECK(reparsed->get_vertices()[reparsed->get_indices()[2]].position.y == 2);
+    MERIAN_TEST_CHECK(Mesh::read_cache(CACHE_PATH)->get_source().hash != stamp.hash);
+
+    // an invalid cache is ignored and replaced
+    std::ofstream(CACHE_PATH, std::ios::binary) << "not a cache";
+    MERIAN_TEST_CHECK(!Mesh::load_obj(OBJ_PATH)->is_cached());
+    MERIAN_TEST_CHECK(Mesh::load_obj(OBJ_PATH)->is_cached());
+
+    std::filesystem::remove(OBJ_PATH);
+    std::filesystem::remove(CACHE_PATH);
+    return 0;
+}
@@ -0,0 +1,169 @@
+// Stress tests for MPMCQueue and SPSCQueue. Small capacities make producers and consumers run into
+// full and empty queues often. Run with -Db_sanitize=thread to check for data races.
+
+#include "common.hpp"
+
+#include "merian/utils/concurrent/mpmc_queue.hpp"
+#include "merian/utils/concurrent/spsc_queue.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t PRODUCERS = 4;
+constexpr uint32_t CONSUMERS = 4;
+constexpr uint32_t ITEMS_PER_PRODUCER = 100000;
+constexpr uint32_t SPSC_ITEMS = 200000;
+
+void test_single_thread() {
+    MPMCQueue<std::unique_ptr<uint32_t>> mpmc(3);
+    MERIAN_TEST_CHECK(mpmc.get_capacity() == 4);
+    for (uint32_t i = 0; i < 4; i++) {
+        MERIAN_TEST_CHECK(mpmc.try_push(std::make_unique<uint32_t>(i)));
+    }
+    // a failed push must not move from the value
+    auto rejected = std::make_unique<uint32_t>(4);
+    MERIAN_TEST_CHECK(!mpmc.try_push(std::move(rejected)));
+    MERIAN_TEST_CHECK(rejected && *rejected == 4);
+    for (uint32_t i = 0; i < 4; i++) {
+        const auto value = mpmc.try_pop();
+        MERIAN_TEST_CHECK(value && **value == i);
+    }
+    MERIAN_TEST_CHECK(!mpmc.try_pop());
+
+    // remaining values are destroyed with the queue
+    const auto shared = std::make_shared<uint32_t>(0);
+    {
+        SPSCQueue<std::shared_ptr<uint32_t>> spsc(5);
+        MERIAN_TEST_CHECK(spsc.get_capacity() == 8);
+        spsc.push(shared);
+        spsc.push(shared);
+        MERIAN_TEST_CHECK(spsc.size() == 2);
+        MERIAN_TEST_CHECK(shared.use_count() == 3);
+    }
+    MERIAN_TEST_CHECK(shared.use_count() == 1);
+}
+
+// Every producer pushes increasing values, the consumers check that the values of each producer
+// arrive in order and that no value is lost or duplicated.
+template <bool BLOCKING> void test_mpmc() {
+    MPMCQueue<uint64_t> queue(64);
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint32_t> popped{0};
+    std::atomic<bool> order_ok{true};
+    constexpr uint32_t TOTAL = PRODUCERS * ITEMS_PER_PRODUCER;
+
+    std::vector<std::thread> threads;
+    for (uint32_t producer = 0; producer < PRODUCERS; producer++) {
+        threads.emplace_back([&, producer] {
+            for (uint32_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+                const uint64_t value = ((uint64_t)producer << 32) | i;
+                if constexpr (BLOCKING) {
+                    queue.push(value);
+                } else {
+                    while (!queue.try_push(value)) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        });
+    }
+    for (uint32_t consumer = 0; consumer < CONSUMERS; consumer++) {
+        threads.emplace_back([&] {
+            std::vector<int64_t> last(PRODUCERS, -1);
+            while (popped.load(std::memory_order_relaxed) < TOTAL) {
+                uint64_t value;
+                if constexpr (BLOCKING) {
+                    // do not block if the other consumers took the remaining values
+                    if (popped.fetch_add(1, std::memory_order_relaxed) >= TOTAL) {
+                        break;
+                    }
+                    value = queue.pop();
+                } else {
+                    const std::optional<uint64_t> next = queue.try_pop();
+                    if (!next) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    popped.fetch_add(1, std::memory_order_relaxed);
+                    value = *next;
+                }
+                const uint32_t producer = value >> 32;
+                const int64_t index = value & 0xFFFFFFFF;
+                if (producer >= PRODUCERS || index <= last[producer]) {
+                    order_ok = false;
+                } else {
+                    last[producer] = index;
+                }
+                sum.fetch_add(value, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    uint64_t expected = 0;
+    for (uint64_t producer = 0; producer < PRODUCERS; producer++) {
+        for (uint64_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+            expected += (producer << 32) | i;
+        }
+    }
+    MERIAN_TEST_CHECK(order_ok);
+    MERIAN_TEST_CHECK(sum == expected);
+    MERIAN_TEST_CHECK(queue.empty());
+}
+
+// Non-trivial values must arrive unchanged and in order.
+template <bool BLOCKING> void test_spsc() {
+    SPSCQueue<std::string> queue(16);
+
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < SPSC_ITEMS; i++) {
+            std::string value = fmt::format("value {} with some padding to defeat SSO", i);
+            if constexpr (BLOCKING) {
+                queue.push(std::move(value));
+            } else {
+                while (!queue.try_push(std::move(value))) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    });
+
+    bool order_ok = true;
+    for (uint32_t i = 0; i < SPSC_ITEMS; i++) {
+        std::string value;
+        if constexpr (BLOCKING) {
+            value = queue.pop();
+        } else {
+            std::optional<std::string> next;
+            while (!(next = queue.try_pop())) {
+                std::this_thread::yield();
+            }
+            value = std::move(*next);
+        }
+        order_ok &= value == fmt::format("value {} with some padding to defeat SSO", i);
+    }
+    producer.join();
+
+    MERIAN_TEST_CHECK(order_ok);
+    MERIAN_TEST_CHECK(queue.empty());
+}
+
+} // namespace
+
+int main() {
+    test_single_thread();
+    test_mpmc<true>();
+    test_mpmc<false>();
+    test_spsc<true>();
+    test_spsc<false>();
+
+    return 0;
+}
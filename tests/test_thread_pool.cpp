@@ -0,0 +1,195 @@
+// Statistics, trace events and Chrome trace export of the ThreadPool, trace events of a TaskGraph.
+
+#include "common.hpp"
+
+#include "merian/utils/concurrent/task_graph.hpp"
+#include "merian/utils/concurrent/thread_pool.hpp"
+#include "merian/utils/concurrent/utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+using namespace merian;
+
+namespace {
+
+constexpr uint32_t WORKERS = 2;
+constexpr uint32_t TASKS = 100;
+
+// Counters and trace events are recorded after the task (and its future) completed.
+template <typename F> bool wait_until(const F& condition) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+std::vector<ThreadPool::TraceEvent> collect_events(ThreadPool& pool, const std::size_t count) {
+    std::vector<ThreadPool::TraceEvent> events;
+    MERIAN_TEST_CHECK(wait_until([&] {
+        const std::vector<ThreadPool::TraceEvent> collected = pool.collect_trace();
+        events.insert(events.end(), collected.begin(), collected.end());
+        return events.size() >= count;
+    }));
+    MERIAN_TEST_CHECK(events.size() == count);
+    return events;
+}
+
+// The name is copied at submission and may be freed while the task is queued.
+void test_name_copied(ThreadPool& pool) {
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::future<void> future;
+    {
+        std::string name = "temporary name";
+        future = pool.submit<void>([released] { released.wait(); }, name.c_str());
+        name.assign(64, 'x');
+    }
+    release.set_value();
+    future.get();
+
+    const std::vector<ThreadPool::TraceEvent> events = collect_events(pool, 1);
+    MERIAN_TEST_CHECK(std::strcmp(events[0].name, "temporary name") == 0);
+}
+
+// Every task of a graph gets its own event, also if it runs as continuation of another task.
+void test_task_graph(ThreadPool& pool) {
+    TaskGraph graph;
+    const TaskGraph::TaskID a = graph.add_task("a", [] {});
+    const TaskGraph::TaskID b = graph.add_task("b", [] {});
+    const TaskGraph::TaskID c = graph.add_task("c", [] {});
+    graph.add_dependency(a, b);
+    graph.add_dependency(b, c);
+    graph.run(pool);
+    // the names are freed with the tasks
+    graph.clear();
+
+    std::vector<ThreadPool::TraceEvent> events = collect_events(pool, 3);
+    MERIAN_TEST_CHECK(std::strcmp(events[0].name, "a") == 0);
+    MERIAN_TEST_CHECK(std::strcmp(events[1].name, "b") == 0);
+    MERIAN_TEST_CHECK(std::strcmp(events[2].name, "c") == 0);
+    for (uint32_t i = 1; i < events.size(); i++) {
+        MERIAN_TEST_CHECK(events[i - 1].end <= events[i].start);
+    }
+}
+
+// The caller of parallel_for only processes its own chunks: it neither runs unrelated queued tasks
+// nor waits for helpers that did not start (here all workers are blocked).
+void test_parallel_for(ThreadPool& pool) {
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::vector<std::future<void>> blockers;
+    for (uint32_t i = 0; i < WORKERS; i++) {
+        blockers.emplace_back(pool.submit<void>([released] { released.wait(); }));
+    }
+
+    std::vector<std::future<std::thread::id>> unrelated;
+    for (uint32_t i = 0; i < TASKS; i++) {
+        unrelated.emplace_back(
+            pool.submit<std::thread::id>([] { return std::this_thread::get_id(); }));
+    }
+
+    std::vector<uint32_t> visited(TASKS, 0);
+    parallel_for(TASKS, [&](const uint32_t i, const uint32_t) { visited[i]++; }, pool, WORKERS + 1);
+    MERIAN_TEST_CHECK(std::count(visited.begin(), visited.end(), 1u) == TASKS);
+
+    release.set_value();
+    for (auto& future : unrelated) {
+        MERIAN_TEST_CHECK(future.get() != std::this_thread::get_id());
+    }
+    for (auto& future : blockers) {
+        future.get();
+    }
+}
+
+} // namespace
+
+int main() {
+    ThreadPool pool(WORKERS);
+
+    // disabled by default
+    MERIAN_TEST_CHECK(!pool.get_statistics_enabled() && !pool.get_tracing_enabled());
+    pool.submit<void>([] {}).get();
+    MERIAN_TEST_CHECK(wait_until([&] { return pool.get_statistics().executed == 1; }));
+    MERIAN_TEST_CHECK(pool.get_statistics().timed == 0);
+    MERIAN_TEST_CHECK(pool.collect_trace().empty());
+
+    // tracing implies statistics
+    pool.set_tracing_enabled(true);
+    MERIAN_TEST_CHECK(pool.get_statistics_enabled());
+
+    std::vector<std::future<uint32_t>> futures;
+    for (uint32_t i = 0; i < TASKS; i++) {
+        futures.emplace_back(pool.submit<uint32_t>([i] { return i * i; }, "test task"));
+    }
+    for (uint32_t i = 0; i < TASKS; i++) {
+        MERIAN_TEST_CHECK(futures[i].get() == i * i);
+    }
+
+    // tasks whose token was stopped before they started are skipped
+    std::stop_source stop;
+    stop.request_stop();
+    std::future<void> cancelled =
+        pool.submit<void>([] {}, ThreadPool::TaskOptions{"cancelled", ThreadPool::Priority::NORMAL,
+                                                         stop.get_token()});
+    bool broken_promise = false;
+    try {
+        cancelled.get();
+    } catch (const std::future_error& e) {
+        broken_promise = e.code() == std::future_errc::broken_promise;
+    }
+    MERIAN_TEST_CHECK(broken_promise);
+
+    MERIAN_TEST_CHECK(wait_until([&] { return pool.get_statistics().executed == TASKS + 1; }));
+    const ThreadPool::Statistics statistics = pool.get_statistics();
+    MERIAN_TEST_CHECK(statistics.submitted == TASKS + 2);
+    MERIAN_TEST_CHECK(statistics.skipped == 1);
+    MERIAN_TEST_CHECK(statistics.timed == TASKS);
+    MERIAN_TEST_CHECK(statistics.max_latency <= statistics.latency);
+    // one entry per worker and one for other threads
+    MERIAN_TEST_CHECK(statistics.busy.size() == WORKERS + 1);
+    MERIAN_TEST_CHECK(statistics.dropped_trace_events == 0);
+
+    const std::vector<ThreadPool::TraceEvent> events = collect_events(pool, TASKS);
+    for (const ThreadPool::TraceEvent& event : events) {
+        MERIAN_TEST_CHECK(std::strcmp(event.name, "test task") == 0);
+        MERIAN_TEST_CHECK(event.enqueued <= event.start && event.start <= event.end);
+        MERIAN_TEST_CHECK(event.worker < WORKERS || event.worker == ThreadPool::NO_WORKER);
+    }
+    MERIAN_TEST_CHECK(pool.get_trace_history().size() == TASKS);
+
+    const std::string filename = "test_thread_pool_trace.json";
+    pool.write_chrome_trace(filename);
+    nlohmann::json trace;
+    std::ifstream(filename) >> trace;
+    std::filesystem::remove(filename);
+    uint32_t thread_names = 0;
+    uint32_t complete_events = 0;
+    for (const auto& event : trace.at("traceEvents")) {
+        if (event.at("ph") == "M") {
+            thread_names++;
+        } else if (event.at("ph") == "X") {
+            MERIAN_TEST_CHECK(event.at("name") == "test task");
+            MERIAN_TEST_CHECK(event.at("dur").get<double>() >= 0);
+            complete_events++;
+        }
+    }
+    MERIAN_TEST_CHECK(thread_names == WORKERS + 1);
+    MERIAN_TEST_CHECK(complete_events == TASKS);
+
+    pool.clear_trace_history();
+    MERIAN_TEST_CHECK(pool.get_trace_history().empty());
+
+    test_name_copied(pool);
+    test_task_graph(pool);
+    test_parallel_for(pool);
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+// How DeviceASBuilder brings a TLAS up to date (DeviceASBuilder::get_tlas_build_mode()): transform
+// changes update a TLAS with eAllowUpdate until max_tlas_updates updates in a row and rebuild it
+// otherwise, added instances build a new TLAS and changed BLAS addresses rebuild it.
+
+#include "common.hpp"
+
+#include "merian-nodes/nodes/as_builder/device_as_builder.hpp"
+#include "merian/vk/extension/extension_resources.hpp"
+#include "merian/vk/extension/extension_vk_acceleration_structure.hpp"
+
+#include <array>
+
+using namespace merian;
+using namespace merian_nodes;
+
+namespace {
+
+using Mode = DeviceASBuilder::TlasBuildMode;
+
+constexpr vk::BufferUsageFlags GEOMETRY_USAGE =
+    vk::BufferUsageFlagBits::eShaderDeviceAddress |
+    vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+
+constexpr uint32_t MAX_UPDATES = 16;
+
+// The BLAS addresses as they were uploaded with the last build.
+std::vector<vk::DeviceAddress> uploaded_addresses(const DeviceASBuilder::TlasBuildInfo& tlas_info) {
+    std::vector<vk::DeviceAddress> addresses;
+    for (uint32_t i = 0; i < tlas_info.get_instance_count(); i++) {
+        addresses.push_back(tlas_info.get_instance(i).accelerationStructureReference);
+    }
+    return addresses;
+}
+
+Mode mode(const DeviceASBuilder::TlasBuildInfo& tlas_info,
+          const uint32_t max_updates = MAX_UPDATES) {
+    return DeviceASBuilder::get_tlas_build_mode(tlas_info, uploaded_addresses(tlas_info),
+                                                max_updates);
+}
+
+vk::TransformMatrixKHR translation(const float x) {
+    vk::TransformMatrixKHR transform = transform_identity();
+    transform.matrix[0][3] = x;
+    return transform;
+}
+
+} // namespace
+
+int main() {
+    const auto resources = std::make_shared<ExtensionResources>();
+    const auto acceleration_structure = std::make_shared<ExtensionVkAccelerationStructure>();
+    const ContextHandle context = create_test_context({resources, acceleration_structure});
+    if (!context || !context->get_extension<ExtensionVkAccelerationStructure>()) {
+        return MERIAN_TEST_SKIP;
+    }
+    const ResourceAllocatorHandle allocator = resources->resource_allocator();
+    const QueueHandle queue = context->get_queue_GCT();
+    const CommandPoolHandle cmd_pool = std::make_shared<CommandPool>(queue);
+
+    const std::vector<float> positions = {0, 0, 0, 1, 0, 0, 0, 1, 0};
+    const std::vector<uint32_t> indices = {0, 1, 2};
+    const BufferHandle vertex_buffer = create_mapped_buffer(allocator, positions, GEOMETRY_USAGE);
+    const BufferHandle index_buffer = create_mapped_buffer(allocator, indices, GEOMETRY_USAGE);
+    const auto create_blas_info = [&]() {
+        const auto blas_info = std::make_shared<DeviceASBuilder::BlasBuildInfo>(
+            vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+        blas_info->add_geometry_f32_u32(3, 1, vertex_buffer, index_buffer);
+        return blas_info;
+    };
+
+    DeviceASBuilder builder(context, allocator);
+    builder.set_max_tlas_updates(MAX_UPDATES);
+    std::array<DeviceASBuilder::InFlightData, 2> in_flight_data;
+    uint32_t iteration = 0;
+    // Records and submits one iteration, waits until it finished.
+    const auto run_iteration = [&](DeviceASBuilder::TlasBuildInfo& tlas_info) {
+        DeviceASBuilder::InFlightData& data = in_flight_data[iteration++ % in_flight_data.size()];
+        const vk::CommandBuffer cmd = cmd_pool->create_and_begin();
+        builder.record_builds(cmd, tlas_info, data, vk::PipelineStageFlagBits2::eComputeShader);
+        cmd.end();
+        queue->submit_wait(cmd);
+        cmd_pool->reset();
+        return builder.get_last_tlas_build_mode();
+    };
+
+    const auto a = create_blas_info();
+    const auto b = create_blas_info();
+    DeviceASBuilder::TlasBuildInfo updatable(
+        vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
+        vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate);
+    DeviceASBuilder::TlasBuildInfo static_tlas(
+        vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+    updatable.add_instance(a).add_instance(b);
+    static_tlas.add_instance(a);
+
+    // 1. The first run builds, then nothing changes.
+    MERIAN_TEST_CHECK(mode(updatable) == Mode::BUILD);
+    MERIAN_TEST_CHECK(run_iteration(updatable) == Mode::BUILD);
+    MERIAN_TEST_CHECK(run_iteration(static_tlas) == Mode::BUILD);
+    MERIAN_TEST_CHECK(mode(updatable) == Mode::NONE);
+    MERIAN_TEST_CHECK(run_iteration(updatable) == Mode::NONE);
+
+    // 2. Transforms update only TLASes with eAllowUpdate.
+    updatable.set_transform(1, translation(1));
+    static_tlas.set_transform(0, translation(1));
+    MERIAN_TEST_CHECK(mode(updatable) == Mode::UPDATE);
+    MERIAN_TEST_CHECK(mode(static_tlas) == Mode::REBUILD);
+    const AccelerationStructureHandle updated = updatable.get_tlas();
+    MERIAN_TEST_CHECK(run_iteration(updatable) == Mode::UPDATE);
+    MERIAN_TEST_CHECK(updatable.get_tlas() == updated);
+    MERIAN_TEST_CHECK(run_iteration(static_tlas) == Mode::REBUILD);
+
+    // 3. After max_tlas_updates updates in a row the TLAS is rebuilt, which resets the count.
+    // 0 always rebuilds.
+    updatable.set_transform(1, translation(2));
+    MERIAN_TEST_CHECK(mode(updatable, 0) == Mode::REBUILD);
+    MERIAN_TEST_CHECK(mode(updatable, 1) == Mode::REBUILD);
+    MERIAN_TEST_CHECK(mode(updatable, 2) == Mode::UPDATE);
+    builder.set_max_tlas_updates(2);
+    MERIAN_TEST_CHECK(run_iteration(updatable) == Mode::UPDATE);
+    updatable.set_transform(1, translation(3));
+    MERIAN_TEST_CHECK(mode(updatable, 2) == Mode::REBUILD);
+    MERIAN_TEST_CHECK(mode(updatable, 3) == Mode::UPDATE);
+    MERIAN_TEST_CHECK(run_iteration(updatable) == Mode::REBUILD);
+    MERIAN_TEST_CHECK(updatable.get_tlas() != updated);
+    updatable.set_transform(1, translation(4));
+    MERIAN_TEST_CHECK(mode(updatable, 2) == Mode::UPDATE);
+    MERIAN_TEST_CHECK(run_iteration(updatable) == Mode::UPDATE);
+    builder.set_max_tlas_updates(MAX_UPDATES);
+
+    // 4. A changed BLAS address rebuilds, also if only an update was requested.
+    updatable.set_transform(0, translation(5));
+    std::vector<vk::DeviceAddress> addresses = uploaded_addresses(updatable);
+    MERIAN_TEST_CHECK(addresses[0] != addresses[1]);
+    std::swap(addresses[0], addresses[1]);
+    MERIAN_TEST_CHECK(DeviceASBuilder::get_tlas_build_mode(updatable, addresses, MAX_UPDATES) ==
+                      Mode::REBUILD);
+    MERIAN_TEST_CHECK(mode(updatable) == Mode::UPDATE);
+    MERIAN_TEST_CHECK(run_iteration(updatable) == Mode::UPDATE);
+
+    // 5. Adding an instance builds a new TLAS, also if an update was requested.
+    updatable.set_transform(0, translation(6));
+    updatable.add_instance(a);
+    MERIAN_TEST_CHECK(!updatable.get_tlas());
+    MERIAN_TEST_CHECK(mode(updatable) == Mode::BUILD);
+    MERIAN_TEST_CHECK(run_iteration(updatable) == Mode::BUILD);
+    MERIAN_TEST_CHECK(updatable.get_instance(2).accelerationStructureReference ==
+                      a->get_blas()->get_acceleration_structure_device_address());
+
+    // 6. Rebuilding a BLAS rebuilds the TLAS.
+    b->request_rebuild();
+    updatable.set_transform(0, translation(7));
+    MERIAN_TEST_CHECK(run_iteration(updatable) == Mode::REBUILD);
+
+    return 0;
+}
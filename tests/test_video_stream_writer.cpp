@@ -0,0 +1,115 @@
+// Writes frames with a known pattern with VideoStreamWriter and parses the Y4M and raw streams.
+
+#include "common.hpp"
+
+#include "merian/io/video_stream_writer.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace merian;
+
+namespace {
+
+// odd to check that the chroma planes are rounded up
+constexpr uint32_t WIDTH = 33;
+constexpr uint32_t HEIGHT = 17;
+constexpr uint32_t CHROMA_SIZE = ((WIDTH + 1) / 2) * ((HEIGHT + 1) / 2);
+constexpr uint32_t FRAMES = 5;
+
+std::vector<uint8_t> make_frame(const uint32_t frame) {
+    std::vector<uint8_t> yuv(VideoStreamWriter::get_frame_size(WIDTH, HEIGHT));
+    for (std::size_t i = 0; i < yuv.size(); i++) {
+        yuv[i] = (uint8_t)(frame * 31 + i * 7);
+    }
+    return yuv;
+}
+
+uint64_t checksum(const uint8_t* data, const std::size_t size) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+// Checks the Y, Cb and Cr planes separately.
+void check_planes(const uint8_t* data, const uint32_t frame) {
+    const std::vector<uint8_t> expected = make_frame(frame);
+    const std::size_t offsets[] = {0, WIDTH * HEIGHT, WIDTH * HEIGHT + CHROMA_SIZE};
+    const std::size_t sizes[] = {WIDTH * HEIGHT, CHROMA_SIZE, CHROMA_SIZE};
+    for (uint32_t plane = 0; plane < 3; plane++) {
+        MERIAN_TEST_CHECK(checksum(data + offsets[plane], sizes[plane]) ==
+                          checksum(expected.data() + offsets[plane], sizes[plane]));
+    }
+}
+
+std::string write_stream(const std::string& path,
+                         const VideoStreamWriter::Container container,
+                         const double framerate) {
+    {
+        VideoStreamWriter writer(path, VideoStreamWriter::Target::PATH, container, WIDTH, HEIGHT,
+                                 framerate);
+        // opened on the first frame
+        MERIAN_TEST_CHECK(!std::filesystem::exists(path));
+        for (uint32_t frame = 0; frame < FRAMES; frame++) {
+            writer.write_frame(make_frame(frame).data());
+        }
+        MERIAN_TEST_CHECK(writer.get_frame_count() == FRAMES);
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::string content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    file.close();
+    std::filesystem::remove(path);
+    return content;
+}
+
+void test_y4m(const double framerate, const std::string& rate) {
+    const std::string content =
+        write_stream("test_video_stream_writer.y4m", VideoStreamWriter::Container::Y4M, framerate);
+
+    const std::string header = fmt::format(
+        "YUV4MPEG2 W{} H{} F{} Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", WIDTH, HEIGHT, rate);
+    MERIAN_TEST_CHECK(content.starts_with(header));
+
+    const std::string frame_header = "FRAME\n";
+    const std::size_t frame_size = VideoStreamWriter::get_frame_size(WIDTH, HEIGHT);
+    std::size_t offset = header.size();
+    uint32_t frames = 0;
+    while (offset < content.size()) {
+        MERIAN_TEST_CHECK(content.compare(offset, frame_header.size(), frame_header) == 0);
+        offset += frame_header.size();
+        MERIAN_TEST_CHECK(offset + frame_size <= content.size());
+        check_planes(reinterpret_cast<const uint8_t*>(content.data() + offset), frames);
+        offset += frame_size;
+        frames++;
+    }
+    MERIAN_TEST_CHECK(frames == FRAMES);
+}
+
+void test_raw() {
+    const std::string content =
+        write_stream("test_video_stream_writer.yuv", VideoStreamWriter::Container::RAW, 30);
+
+    const std::size_t frame_size = VideoStreamWriter::get_frame_size(WIDTH, HEIGHT);
+    MERIAN_TEST_CHECK(content.size() == FRAMES * frame_size);
+    for (uint32_t frame = 0; frame < FRAMES; frame++) {
+        check_planes(reinterpret_cast<const uint8_t*>(content.data() + frame * frame_size), frame);
+    }
+}
+
+} // namespace
+
+int main() {
+    MERIAN_TEST_CHECK(VideoStreamWriter::get_frame_size(WIDTH, HEIGHT) ==
+                      WIDTH * HEIGHT + 2 * CHROMA_SIZE);
+
+    test_y4m(30, "30:1");
+    test_y4m(29.97, "2997:100");
+    test_raw();
+
+    return 0;
+}